@@ -38,7 +38,10 @@
 #include <math.h>
 #include <esp_log.h>
 #include <string.h>
-#include <ets_sys.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <modbus_crc.h>
 
 #define I2C_FREQ_HZ (100000) // 100kHz
 
@@ -54,100 +57,116 @@ static const char *TAG = "am2320";
 
 #define DELAY_T1_US (800 + 100) // minimum delay + extra
 #define DELAY_T2_US (1500 + 100)
+#define MIN_READ_INTERVAL_US (2000000) // The sensor heats up when it is read more often
 
 #define CHECK(x) do { esp_err_t __; if ((__ = x) != ESP_OK) return __; } while (0)
 #define CHECK_ARG(VAL) do { if (!(VAL)) return ESP_ERR_INVALID_ARG; } while (0)
 
-static uint16_t crc16(uint8_t *data, size_t len)
+// Sleeps for at least us microseconds, yields the CPU instead of spinning.
+// The first tick of a delay may be almost over, so the delay is checked against esp_timer and extended tick by tick.
+static inline void sleep_at_least_us(uint32_t us)
 {
-    uint16_t crc = 0xffff;
-    while (len--)
-    {
-        crc ^= *data++;
-        for (int i = 0; i < 8; i++)
-        {
-            if (crc & 0x01)
-            {
-                crc >>= 1;
-                crc ^= 0xa001;
-            } else crc >>= 1;
-        }
-    }
-    return crc;
+    int64_t deadline = esp_timer_get_time() + us;
+    vTaskDelay(pdMS_TO_TICKS(us / 1000) + 1);
+    while (esp_timer_get_time() < deadline)
+        vTaskDelay(1);
 }
 
-/*
- * Request: [3 bytes] CMD, START_REG, BYTES
- * Response: [BYTES + 4] CMD, BYTES, DATA0, ... DATAn, CRC16_LOW, CRC16_HIGH
- */
-static esp_err_t read_reg_modbus(i2c_dev_t *dev, uint8_t reg, uint8_t len, uint8_t *buf)
+/* Wake up the sensor. See 8.2.4 I2C Communication Timing */
+static void wake(i2c_dev_t *dev)
 {
-    uint8_t req[] = { MODBUS_READ, reg, len };
-    uint8_t resp[len + 4];
-    esp_err_t err = ESP_FAIL;
-
-    I2C_DEV_TAKE_MUTEX(dev);
-
-    /* Wake up the sensor. See 8.2.4 I2C Communication Timing */
-    err = i2c_dev_probe(dev, I2C_DEV_READ);
+    esp_err_t err = i2c_dev_probe(dev, I2C_DEV_READ);
     if (err == ESP_FAIL)
     {
         /* the sensor does not send ACK for wakeup command, ignore the error
          */
         ESP_LOGD(TAG, "i2c_dev_probe(): %s", esp_err_to_name(err));
     }
-    ets_delay_us(DELAY_T1_US);
+}
 
-    err =  i2c_dev_write(dev, NULL, 0, req, sizeof(req));
+/*
+ * Request: [3 bytes] CMD, START_REG, BYTES
+ */
+static esp_err_t send_request(i2c_dev_t *dev, uint8_t reg, uint8_t len)
+{
+    uint8_t req[] = { MODBUS_READ, reg, len };
+
+    esp_err_t err = i2c_dev_write(dev, NULL, 0, req, sizeof(req));
     if (err != ESP_OK)
-    {
         ESP_LOGE(TAG, "i2c_dev_write(): %s", esp_err_to_name(err));
-        goto fail;
-    }
-    ets_delay_us(DELAY_T2_US);
 
-    err = i2c_dev_read(dev, NULL, 0, resp, sizeof(resp));
+    return err;
+}
+
+/*
+ * Response: [BYTES + 4] CMD, BYTES, DATA0, ... DATAn, CRC16_LOW, CRC16_HIGH
+ */
+static esp_err_t read_reply(i2c_dev_t *dev, uint8_t len, uint8_t *buf)
+{
+    uint8_t resp[len + 4];
+
+    esp_err_t err = i2c_dev_read(dev, NULL, 0, resp, sizeof(resp));
     if (err != ESP_OK)
     {
         ESP_LOGE(TAG, "i2c_dev_read(): %s", esp_err_to_name(err));
-        goto fail;
+        return err;
     }
 
     if (resp[0] != MODBUS_READ)
     {
         ESP_LOGE(TAG, "Invalid MODBUS reply (%d != 0x03)", resp[0]);
-        err = ESP_ERR_INVALID_RESPONSE;
-        goto fail;
+        return ESP_ERR_INVALID_RESPONSE;
     }
     if (resp[1] != len)
     {
         ESP_LOGE(TAG, "Invalid MODBUS reply length (%d != %d)", resp[1], len);
-        err = ESP_ERR_INVALID_RESPONSE;
-        goto fail;
+        return ESP_ERR_INVALID_RESPONSE;
     }
 
     /* CRC16 in little endian */
-    if (crc16(resp, len + 2) != ((uint16_t)resp[len + 3] << 8) + resp[len + 2])
+    if (modbus_crc16(resp, len + 2) != ((uint16_t)resp[len + 3] << 8) + resp[len + 2])
     {
         ESP_LOGE(TAG, "Invalid CRC in MODBUS reply");
-        err = ESP_ERR_INVALID_CRC;
-        goto fail;
+        return ESP_ERR_INVALID_CRC;
     }
     memcpy(buf, resp + 2, len);
 
-fail:
+    return ESP_OK;
+}
+
+static esp_err_t read_reg_modbus(i2c_dev_t *dev, uint8_t reg, uint8_t len, uint8_t *buf)
+{
+    esp_err_t err;
+
+    I2C_DEV_TAKE_MUTEX(dev);
+
+    wake(dev);
+    sleep_at_least_us(DELAY_T1_US);
+
+    err = send_request(dev, reg, len);
+    if (err == ESP_OK)
+    {
+        sleep_at_least_us(DELAY_T2_US);
+        err = read_reply(dev, len, buf);
+    }
+
     I2C_DEV_GIVE_MUTEX(dev);
     return err;
 }
 
+// The sensor sends the temperature as sign and magnitude
+static inline int16_t decode_temperature(uint16_t raw)
+{
+    return raw & 0x8000
+        ? -(int16_t)(raw & 0x7fff)
+        : (int16_t)raw;
+}
+
 static float convert_temperature(uint16_t raw)
 {
     if (raw == 0xffff)
         return NAN;
-    float res = raw & 0x8000
-        ? (float)-(int16_t)(raw & 0x7fff)
-        : (float)(raw);
-    return res / 10.0f;
+    return (float)decode_temperature(raw) / 10.0f;
 }
 
 static inline float convert_humidity(uint16_t raw)
@@ -241,3 +260,116 @@ esp_err_t am2320_get_device_id(i2c_dev_t *dev, uint32_t *id)
 
     return ESP_OK;
 }
+
+esp_err_t am2320_reader_init(am2320_reader_t *reader, i2c_dev_t *dev)
+{
+    CHECK_ARG(reader && dev);
+
+    memset(reader, 0, sizeof(am2320_reader_t));
+    reader->dev = dev;
+    reader->state = AM2320_STATE_IDLE;
+
+    return ESP_OK;
+}
+
+esp_err_t am2320_reader_step(am2320_reader_t *reader, uint32_t *wait_us)
+{
+    CHECK_ARG(reader && wait_us);
+
+    int64_t now = esp_timer_get_time();
+    *wait_us = 0;
+
+    if (now < reader->next_step_time)
+    {
+        *wait_us = reader->next_step_time - now;
+        return ESP_ERR_NOT_FINISHED;
+    }
+
+    // The device mutex is only held for one phase, other tasks can use the bus in between
+    esp_err_t err = ESP_ERR_NOT_FINISHED;
+    uint8_t buf[4];
+
+    I2C_DEV_TAKE_MUTEX(reader->dev);
+    switch (reader->state)
+    {
+        case AM2320_STATE_IDLE:
+            wake(reader->dev);
+            reader->state = AM2320_STATE_REQUEST;
+            reader->next_step_time = now + DELAY_T1_US;
+            break;
+        case AM2320_STATE_REQUEST:
+            err = send_request(reader->dev, REG_RH_H, 4);
+            if (err != ESP_OK)
+                break;
+            err = ESP_ERR_NOT_FINISHED;
+            reader->state = AM2320_STATE_READ;
+            reader->next_step_time = now + DELAY_T2_US;
+            break;
+        case AM2320_STATE_READ:
+            err = read_reply(reader->dev, 4, buf);
+            if (err != ESP_OK)
+                break;
+            reader->raw_humidity = ((uint16_t)buf[0] << 8) + buf[1];
+            reader->raw_temperature = ((uint16_t)buf[2] << 8) + buf[3];
+            reader->has_values = true;
+            break;
+    }
+    I2C_DEV_GIVE_MUTEX(reader->dev);
+
+    if (err != ESP_ERR_NOT_FINISHED)
+    {
+        // Finished or failed, either way the sensor needs its rest before the next read
+        reader->state = AM2320_STATE_IDLE;
+        reader->next_step_time = now + MIN_READ_INTERVAL_US;
+    }
+    *wait_us = reader->next_step_time > now ? reader->next_step_time - now : 0;
+
+    return err;
+}
+
+// Runs the reader to completion unless the sensor is resting
+static esp_err_t update_cached(am2320_reader_t *reader)
+{
+    uint32_t wait_us;
+    esp_err_t err = ESP_ERR_NOT_FINISHED;
+
+    // Within the minimum read interval the first step returns right away with ESP_ERR_NOT_FINISHED
+    if (reader->state != AM2320_STATE_IDLE || esp_timer_get_time() >= reader->next_step_time)
+    {
+        while ((err = am2320_reader_step(reader, &wait_us)) == ESP_ERR_NOT_FINISHED)
+            sleep_at_least_us(wait_us);
+    }
+
+    if (err != ESP_OK && err != ESP_ERR_NOT_FINISHED)
+        return err;
+    if (!reader->has_values)
+        return ESP_ERR_NOT_FINISHED;
+
+    return ESP_OK;
+}
+
+esp_err_t am2320_get_rht_cached(am2320_reader_t *reader, float *temperature, float *humidity)
+{
+    CHECK_ARG(reader && temperature && humidity);
+
+    CHECK(update_cached(reader));
+
+    *temperature = convert_temperature(reader->raw_temperature);
+    *humidity = convert_humidity(reader->raw_humidity);
+
+    return ESP_OK;
+}
+
+esp_err_t am2320_get_rht_raw_cached(am2320_reader_t *reader, int16_t *temperature, uint16_t *humidity)
+{
+    CHECK_ARG(reader && temperature && humidity);
+
+    CHECK(update_cached(reader));
+    if (reader->raw_temperature == 0xffff || reader->raw_humidity == 0xffff)
+        return ESP_ERR_INVALID_RESPONSE;
+
+    *temperature = decode_temperature(reader->raw_temperature);
+    *humidity = reader->raw_humidity;
+
+    return ESP_OK;
+}
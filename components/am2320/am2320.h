@@ -48,6 +48,28 @@ extern "C" {
 
 #define AM2320_I2C_ADDR (0x5c)
 
+/**
+ * Phase of a non-blocking read
+ */
+typedef enum {
+    AM2320_STATE_IDLE = 0, //!< Next step wakes the sensor
+    AM2320_STATE_REQUEST,  //!< Next step sends the read request
+    AM2320_STATE_READ      //!< Next step reads and validates the reply
+} am2320_state_t;
+
+/**
+ * Non-blocking temperature and humidity reader
+ */
+typedef struct
+{
+    i2c_dev_t *dev;          //!< Device descriptor
+    am2320_state_t state;    //!< Current phase
+    int64_t next_step_time;  //!< esp_timer time before which the next step has to wait
+    uint16_t raw_temperature; //!< Last temperature as sent by the sensor
+    uint16_t raw_humidity;    //!< Last relative humidity as sent by the sensor
+    bool has_values;          //!< `raw_temperature` and `raw_humidity` are valid
+} am2320_reader_t;
+
 /**
  * @brief Initialize device descriptor
  *
@@ -104,6 +126,52 @@ esp_err_t am2320_get_version(i2c_dev_t *dev, uint8_t *version);
  */
 esp_err_t am2320_get_device_id(i2c_dev_t *dev, uint32_t *id);
 
+/**
+ * @brief Initialize a non-blocking reader
+ * @param reader Reader
+ * @param dev    Device descriptor, initialized with ::am2320_init_desc
+ * @return `ESP_OK` on success
+ */
+esp_err_t am2320_reader_init(am2320_reader_t *reader, i2c_dev_t *dev);
+
+/**
+ * @brief Run the next phase of a temperature and humidity read
+ *
+ * A read goes through wake, request and read + CRC check. Each step does one phase and
+ * holds the device mutex only for its I2C transfer, the sensor timing is left to the caller.
+ * After a finished or failed read the sensor rests for its 2 s minimum read interval.
+ *
+ * @param reader Reader
+ * @param[out] wait_us Time until the next step can run
+ * @return `ESP_OK` when a new reading is in the reader,
+ *         `ESP_ERR_NOT_FINISHED` while the read is in progress or the sensor is resting
+ */
+esp_err_t am2320_reader_step(am2320_reader_t *reader, uint32_t *wait_us);
+
+/**
+ * @brief Get temperature and relative humidity, at most one sensor read every 2 s
+ *
+ * Runs the reader to completion and sleeps between the phases.
+ * Within 2 s of the last read the cached values are returned without touching the bus.
+ *
+ * @param reader Reader
+ * @param[out] temperature Temperature, degrees Celsius
+ * @param[out] humidity    Relative humidity, percents
+ * @return `ESP_OK` on success, `ESP_ERR_NOT_FINISHED` if there is no reading yet
+ */
+esp_err_t am2320_get_rht_cached(am2320_reader_t *reader, float *temperature, float *humidity);
+
+/**
+ * @brief Same as ::am2320_get_rht_cached, but returns the integer values of the sensor
+ *
+ * @param reader Reader
+ * @param[out] temperature Temperature, 0.1 degrees Celsius
+ * @param[out] humidity    Relative humidity, 0.1 percents
+ * @return `ESP_OK` on success, `ESP_ERR_NOT_FINISHED` if there is no reading yet,
+ *         `ESP_ERR_INVALID_RESPONSE` if the sensor reported an invalid value
+ */
+esp_err_t am2320_get_rht_raw_cached(am2320_reader_t *reader, int16_t *temperature, uint16_t *humidity);
+
 #ifdef __cplusplus
 }
 #endif
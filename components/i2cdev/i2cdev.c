@@ -43,6 +43,7 @@ typedef struct {
     SemaphoreHandle_t lock;
     i2c_config_t config;
     bool installed;
+    const i2c_dev_t *last_dev;
 } i2c_port_state_t;
 
 static i2c_port_state_t states[I2C_NUM_MAX];
@@ -101,6 +102,7 @@ esp_err_t i2cdev_done()
             SEMAPHORE_TAKE(i);
             i2c_driver_delete(i);
             states[i].installed = false;
+            states[i].last_dev = NULL;
             SEMAPHORE_GIVE(i);
         }
 #if !CONFIG_I2CDEV_NOLOCK
@@ -192,6 +194,10 @@ static esp_err_t i2c_setup_port(const i2c_dev_t *dev)
 {
     if (dev->port >= I2C_NUM_MAX) return ESP_ERR_INVALID_ARG;
 
+    // The port is still set up for the device of the last transfer, descriptors don't change after init
+    if (states[dev->port].installed && states[dev->port].last_dev == dev)
+        return ESP_OK;
+
     esp_err_t res;
     if (!cfg_equal(&dev->cfg, &states[dev->port].config) || !states[dev->port].installed)
     {
@@ -243,6 +249,7 @@ static esp_err_t i2c_setup_port(const i2c_dev_t *dev)
         return res;
     ESP_LOGD(TAG, "Timeout: ticks = %" PRIu32 " (%" PRIu32 " usec) on port %d", dev->timeout_ticks, dev->timeout_ticks / 80, dev->port);
 #endif
+    states[dev->port].last_dev = dev;
 
     return ESP_OK;
 }
@@ -338,3 +345,96 @@ esp_err_t i2c_dev_write_reg(const i2c_dev_t *dev, uint8_t reg, const void *out_d
 {
     return i2c_dev_write(dev, &reg, 1, out_data, out_size);
 }
+
+esp_err_t i2c_dev_transaction_init(i2c_dev_transaction_t *transaction, const i2c_dev_t *dev, uint8_t *buffer, size_t size)
+{
+    if (!transaction || !dev || !buffer) return ESP_ERR_INVALID_ARG;
+
+    transaction->dev = dev;
+    transaction->cmd = i2c_cmd_link_create_static(buffer, size);
+    if (!transaction->cmd)
+    {
+        ESP_LOGE(TAG, "[0x%02x at %d] Transaction buffer too small", dev->addr, dev->port);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_dev_transaction_free(i2c_dev_transaction_t *transaction)
+{
+    if (!transaction || !transaction->cmd) return ESP_ERR_INVALID_ARG;
+
+    i2c_cmd_link_delete_static(transaction->cmd);
+    transaction->cmd = NULL;
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_dev_transaction_add_read(i2c_dev_transaction_t *transaction, const void *out_data, size_t out_size, void *in_data, size_t in_size)
+{
+    if (!transaction || !transaction->cmd || !in_data || !in_size) return ESP_ERR_INVALID_ARG;
+
+    i2c_cmd_handle_t cmd = transaction->cmd;
+    uint8_t addr = transaction->dev->addr;
+    esp_err_t res;
+
+    if (out_data && out_size)
+    {
+        if ((res = i2c_master_start(cmd)) != ESP_OK
+            || (res = i2c_master_write_byte(cmd, addr << 1, true)) != ESP_OK
+            || (res = i2c_master_write(cmd, (void *)out_data, out_size, true)) != ESP_OK)
+            return res;
+    }
+    if ((res = i2c_master_start(cmd)) != ESP_OK
+        || (res = i2c_master_write_byte(cmd, (addr << 1) | 1, true)) != ESP_OK
+        || (res = i2c_master_read(cmd, in_data, in_size, I2C_MASTER_LAST_NACK)) != ESP_OK)
+        return res;
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_dev_transaction_add_write(i2c_dev_transaction_t *transaction, const void *out_reg, size_t out_reg_size, const void *out_data, size_t out_size)
+{
+    if (!transaction || !transaction->cmd || !out_data || !out_size) return ESP_ERR_INVALID_ARG;
+
+    i2c_cmd_handle_t cmd = transaction->cmd;
+    esp_err_t res;
+
+    if ((res = i2c_master_start(cmd)) != ESP_OK
+        || (res = i2c_master_write_byte(cmd, transaction->dev->addr << 1, true)) != ESP_OK)
+        return res;
+    if (out_reg && out_reg_size && (res = i2c_master_write(cmd, (void *)out_reg, out_reg_size, true)) != ESP_OK)
+        return res;
+    if ((res = i2c_master_write(cmd, (void *)out_data, out_size, true)) != ESP_OK)
+        return res;
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_dev_transaction_end(i2c_dev_transaction_t *transaction)
+{
+    if (!transaction || !transaction->cmd) return ESP_ERR_INVALID_ARG;
+
+    return i2c_master_stop(transaction->cmd);
+}
+
+esp_err_t i2c_dev_transaction_execute(const i2c_dev_transaction_t *transaction)
+{
+    if (!transaction || !transaction->cmd) return ESP_ERR_INVALID_ARG;
+
+    const i2c_dev_t *dev = transaction->dev;
+
+    SEMAPHORE_TAKE(dev->port);
+
+    esp_err_t res = i2c_setup_port(dev);
+    if (res == ESP_OK)
+    {
+        res = i2c_master_cmd_begin(dev->port, transaction->cmd, pdMS_TO_TICKS(CONFIG_I2CDEV_TIMEOUT));
+        if (res != ESP_OK)
+            ESP_LOGE(TAG, "Could not execute transaction on device [0x%02x at %d]: %d (%s)", dev->addr, dev->port, res, esp_err_to_name(res));
+    }
+
+    SEMAPHORE_GIVE(dev->port);
+    return res;
+}
@@ -76,6 +76,23 @@ typedef struct
                                   When this value is 0, I2CDEV_MAX_STRETCH_TIME will be used */
 } i2c_dev_t;
 
+/**
+ * Pre-built I2C transaction
+ *
+ * A sequence of reads and writes that is built once into a caller owned buffer
+ * and can be executed any number of times without heap allocations.
+ */
+typedef struct
+{
+    const i2c_dev_t *dev;  //!< Device descriptor
+    i2c_cmd_handle_t cmd;  //!< Static command link
+} i2c_dev_transaction_t;
+
+/**
+ * Buffer size for a transaction with \p segments reads or writes
+ */
+#define I2C_DEV_TRANSACTION_SIZE(segments) I2C_LINK_RECOMMENDED_SIZE(3 * (segments))
+
 /**
  * I2C transaction type
  */
@@ -215,6 +232,77 @@ esp_err_t i2c_dev_read_reg(const i2c_dev_t *dev, uint8_t reg,
 esp_err_t i2c_dev_write_reg(const i2c_dev_t *dev, uint8_t reg,
         const void *out_data, size_t out_size);
 
+/**
+ * @brief Initialize an empty transaction
+ *
+ * @param transaction Transaction
+ * @param dev Device descriptor, must stay valid while the transaction is used
+ * @param buffer Buffer for the commands, see ::I2C_DEV_TRANSACTION_SIZE
+ * @param size Size of the buffer
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the buffer is too small
+ */
+esp_err_t i2c_dev_transaction_init(i2c_dev_transaction_t *transaction, const i2c_dev_t *dev,
+        uint8_t *buffer, size_t size);
+
+/**
+ * @brief Release a transaction, the buffer can be reused afterwards
+ *
+ * @param transaction Transaction
+ * @return ESP_OK on success
+ */
+esp_err_t i2c_dev_transaction_free(i2c_dev_transaction_t *transaction);
+
+/**
+ * @brief Append a read to a transaction
+ *
+ * Same as ::i2c_dev_read(), but the data is only transferred by ::i2c_dev_transaction_execute().
+ * The buffers are referenced, not copied, they have to stay valid while the transaction is used.
+ *
+ * @param transaction Transaction
+ * @param out_data Pointer to data to send if non-null
+ * @param out_size Size of data to send
+ * @param[out] in_data Pointer to input data buffer
+ * @param in_size Number of byte to read
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the transaction buffer is full
+ */
+esp_err_t i2c_dev_transaction_add_read(i2c_dev_transaction_t *transaction, const void *out_data,
+        size_t out_size, void *in_data, size_t in_size);
+
+/**
+ * @brief Append a write to a transaction
+ *
+ * Same as ::i2c_dev_write(), but the data is only transferred by ::i2c_dev_transaction_execute().
+ * The buffers are referenced, not copied, they have to stay valid while the transaction is used.
+ *
+ * @param transaction Transaction
+ * @param out_reg Pointer to register address to send if non-null
+ * @param out_reg_size Size of register address
+ * @param out_data Pointer to data to send
+ * @param out_size Size of data to send
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the transaction buffer is full
+ */
+esp_err_t i2c_dev_transaction_add_write(i2c_dev_transaction_t *transaction, const void *out_reg,
+        size_t out_reg_size, const void *out_data, size_t out_size);
+
+/**
+ * @brief Finish building a transaction with a stop condition
+ *
+ * @param transaction Transaction
+ * @return ESP_OK on success
+ */
+esp_err_t i2c_dev_transaction_end(i2c_dev_transaction_t *transaction);
+
+/**
+ * @brief Execute all reads and writes of a finished transaction
+ *
+ * The port is locked once for the whole transaction.
+ * Function is thread-safe.
+ *
+ * @param transaction Transaction
+ * @return ESP_OK on success
+ */
+esp_err_t i2c_dev_transaction_execute(const i2c_dev_transaction_t *transaction);
+
 #define I2C_DEV_TAKE_MUTEX(dev) do { \
         esp_err_t __ = i2c_dev_take_mutex(dev); \
         if (__ != ESP_OK) return __;\
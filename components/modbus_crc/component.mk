@@ -0,0 +1 @@
+COMPONENT_ADD_INCLUDEDIRS = .
@@ -0,0 +1,51 @@
+/**
+ * @file modbus_crc.h
+ * @defgroup modbus_crc modbus_crc
+ * @{
+ *
+ * Table driven CRC16 of MODBUS frames (polynomial 0xa001 reflected, initial value 0xffff),
+ * shared by the drivers of MODBUS style I2C sensors like the AM2320
+ */
+#ifndef __MODBUS_CRC_H__
+#define __MODBUS_CRC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MODBUS_CRC16_INIT (0xffff)
+
+/**
+ * @brief Continue a CRC16 over more data, for frames that are not in one buffer
+ *
+ * @param crc  CRC of the previous data, ::MODBUS_CRC16_INIT for the first chunk
+ * @param data Data
+ * @param len  Length of the data in bytes
+ * @return CRC16 over the previous and this data
+ */
+uint16_t modbus_crc16_update(uint16_t crc, const uint8_t *data, size_t len);
+
+/**
+ * @brief Calculate the CRC16 of a MODBUS frame
+ *
+ * The CRC is sent in little endian after the frame.
+ *
+ * @param data Frame without the CRC
+ * @param len  Length of the frame in bytes
+ * @return CRC16
+ */
+static inline uint16_t modbus_crc16(const uint8_t *data, size_t len)
+{
+    return modbus_crc16_update(MODBUS_CRC16_INIT, data, len);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif /* __MODBUS_CRC_H__ */
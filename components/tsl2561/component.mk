@@ -1,2 +1,2 @@
 COMPONENT_ADD_INCLUDEDIRS = .
-COMPONENT_DEPENDS = i2cdev log esp_idf_lib_helpers
+COMPONENT_DEPENDS = i2cdev log esp_idf_lib_helpers esp_timer
@@ -42,6 +42,7 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <esp_idf_lib_helpers.h>
 #include "tsl2561.h"
 
@@ -133,7 +134,6 @@ static const char *TAG = "tsl2561";
 
 #define CHECK(x) do { esp_err_t __; if ((__ = x) != ESP_OK) return __; } while (0)
 #define CHECK_ARG(VAL) do { if (!(VAL)) return ESP_ERR_INVALID_ARG; } while (0)
-#define SLEEP_MS(x) do { vTaskDelay(pdMS_TO_TICKS(x)); } while (0)
 
 static inline esp_err_t write_register(tsl2561_t *dev, uint8_t reg, uint8_t value)
 {
@@ -145,16 +145,6 @@ static inline esp_err_t read_register(tsl2561_t *dev, uint8_t reg, uint8_t *valu
     return i2c_dev_read_reg(&dev->i2c_dev, TSL2561_REG_COMMAND | reg, value, 1);
 }
 
-static inline esp_err_t read_register_16(tsl2561_t *dev, uint8_t low_register_addr, uint16_t *value)
-{
-    uint8_t buf[2];
-
-    CHECK(i2c_dev_read_reg(&dev->i2c_dev, TSL2561_REG_COMMAND | TSL2561_READ_WORD | low_register_addr, buf, 2));
-    *value = ((uint16_t)buf[1] << 8) | buf[0];
-
-    return ESP_OK;
-}
-
 static inline esp_err_t enable(tsl2561_t *dev)
 {
     return write_register(dev, TSL2561_REG_CONTROL, TSL2561_ON);
@@ -165,35 +155,116 @@ static inline esp_err_t disable(tsl2561_t *dev)
     return write_register(dev, TSL2561_REG_CONTROL, TSL2561_OFF);
 }
 
-static inline esp_err_t get_channel_data(tsl2561_t *dev, uint16_t *channel0, uint16_t *channel1)
+static int integration_time_ms(tsl2561_t *dev)
 {
-    int sleep_ms;
-
-    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
-    I2C_DEV_CHECK(&dev->i2c_dev, enable(dev));
-
-    // Since we just enabled the chip, we need to sleep
-    // for the chip's integration time so it can gather a reading
     switch (dev->integration_time)
     {
         case TSL2561_INTEGRATION_13MS:
-            sleep_ms = TSL2561_INTEGRATION_TIME_13MS;
-            break;
+            return TSL2561_INTEGRATION_TIME_13MS;
         case TSL2561_INTEGRATION_101MS:
-            sleep_ms = TSL2561_INTEGRATION_TIME_101MS;
-            break;
+            return TSL2561_INTEGRATION_TIME_101MS;
         default:
-            sleep_ms = TSL2561_INTEGRATION_TIME_402MS;
+            return TSL2561_INTEGRATION_TIME_402MS;
+    }
+}
+
+// Power cycling the chip restarts the integration
+static inline esp_err_t restart_integration(tsl2561_t *dev)
+{
+    CHECK(disable(dev));
+    CHECK(enable(dev));
+    dev->measurement_start = esp_timer_get_time();
+
+    return ESP_OK;
+}
+
+// Must be called with the device mutex taken, keeps the chip powered while a measurement is running
+static esp_err_t write_timing(tsl2561_t *dev, uint8_t timing)
+{
+    CHECK(enable(dev));
+    CHECK(write_register(dev, TSL2561_REG_TIMING, timing));
+
+    if (dev->measuring)
+        return restart_integration(dev);
+
+    return disable(dev);
+}
+
+// Auto ranging steps through these ranges, gain is raised before the integration time
+// so the shortest integration that reaches the requested counts is used
+typedef struct
+{
+    tsl2561_integration_time_t integration_time;
+    tsl2561_gain_t gain;
+    uint16_t sensitivity; // Counts relative to 13ms / 1x, from CHSCALE_TINT0 and CHSCALE_TINT1
+    uint16_t max_counts;  // The ADC saturates below 65535 for the short integration times
+} range_t;
+
+static const range_t ranges[] = {
+    { TSL2561_INTEGRATION_13MS,  TSL2561_GAIN_1X,  1,   5047 },
+    { TSL2561_INTEGRATION_13MS,  TSL2561_GAIN_16X, 16,  5047 },
+    { TSL2561_INTEGRATION_101MS, TSL2561_GAIN_16X, 118, 37177 },
+    { TSL2561_INTEGRATION_402MS, TSL2561_GAIN_16X, 468, 65535 },
+};
+
+#define RANGE_COUNT (sizeof(ranges) / sizeof(ranges[0]))
+#define SATURATED(counts, range) ((counts) >= (range)->max_counts - (range)->max_counts / 10)
+#define HIGH_COUNTS(range) ((range)->max_counts - (range)->max_counts / 5)
+
+// The fastest more sensitive range that reaches min_counts, or the most sensitive one that won't be close to saturating
+static uint8_t more_sensitive_range(tsl2561_t *dev, uint16_t ch0)
+{
+    const range_t *range = &ranges[dev->range];
+    uint8_t best = dev->range;
+
+    for (uint8_t next = dev->range + 1; next < RANGE_COUNT; next++)
+    {
+        uint32_t counts = (uint32_t)ch0 * ranges[next].sensitivity / range->sensitivity;
+        if (counts >= HIGH_COUNTS(&ranges[next]))
+            break;
+        best = next;
+        if (counts >= dev->min_counts)
             break;
     }
-    SLEEP_MS(sleep_ms);
 
-    I2C_DEV_CHECK(&dev->i2c_dev, read_register_16(dev, TSL2561_REG_CHANNEL_0_LOW, channel0));
-    I2C_DEV_CHECK(&dev->i2c_dev, read_register_16(dev, TSL2561_REG_CHANNEL_1_LOW, channel1));
+    return best;
+}
 
-    I2C_DEV_CHECK(&dev->i2c_dev, disable(dev));
+static esp_err_t set_range(tsl2561_t *dev, uint8_t range)
+{
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    dev->range = range;
+    dev->integration_time = ranges[range].integration_time;
+    dev->gain = ranges[range].gain;
+    I2C_DEV_CHECK(&dev->i2c_dev, write_timing(dev, dev->integration_time | dev->gain));
+    I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+    ESP_LOGD(TAG, "Range changed to %d ms, gain %s", integration_time_ms(dev), dev->gain == TSL2561_GAIN_16X ? "16x" : "1x");
+
+    return ESP_OK;
+}
+
+// Both channels are read with one transaction that was built in tsl2561_init_desc
+static esp_err_t build_channel_read(tsl2561_t *dev)
+{
+    dev->channel_regs[0] = TSL2561_REG_COMMAND | TSL2561_READ_WORD | TSL2561_REG_CHANNEL_0_LOW;
+    dev->channel_regs[1] = TSL2561_REG_COMMAND | TSL2561_READ_WORD | TSL2561_REG_CHANNEL_1_LOW;
+
+    CHECK(i2c_dev_transaction_init(&dev->channel_read, &dev->i2c_dev, dev->channel_read_buffer, sizeof(dev->channel_read_buffer)));
+    CHECK(i2c_dev_transaction_add_read(&dev->channel_read, &dev->channel_regs[0], 1, &dev->channel_data[0], 2));
+    CHECK(i2c_dev_transaction_add_read(&dev->channel_read, &dev->channel_regs[1], 1, &dev->channel_data[2], 2));
+    CHECK(i2c_dev_transaction_end(&dev->channel_read));
+
+    return ESP_OK;
+}
+
+static inline esp_err_t get_channel_data(tsl2561_t *dev, uint16_t *channel0, uint16_t *channel1)
+{
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    I2C_DEV_CHECK(&dev->i2c_dev, i2c_dev_transaction_execute(&dev->channel_read));
+    *channel0 = ((uint16_t)dev->channel_data[1] << 8) | dev->channel_data[0];
+    *channel1 = ((uint16_t)dev->channel_data[3] << 8) | dev->channel_data[2];
     I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
-    ESP_LOGD(TAG, "integration time: %d ms channel0: 0x%x channel1: 0x%x", sleep_ms, *channel0, *channel1);
+    ESP_LOGD(TAG, "integration time: %d ms channel0: 0x%x channel1: 0x%x", integration_time_ms(dev), *channel0, *channel1);
 
     return ESP_OK;
 }
@@ -215,17 +286,25 @@ esp_err_t tsl2561_init_desc(tsl2561_t *dev, uint8_t addr, i2c_port_t port, gpio_
     dev->i2c_dev.addr = addr;
     dev->i2c_dev.cfg.sda_io_num = sda_gpio;
     dev->i2c_dev.cfg.scl_io_num = scl_gpio;
+    dev->measuring = false;
+    dev->saturated = false;
+    dev->has_lux = false;
+    dev->auto_range = false;
+    dev->range = 0;
 #if HELPER_TARGET_IS_ESP32
     dev->i2c_dev.cfg.master.clk_speed = I2C_FREQ_HZ;
 #endif
 
-    return i2c_dev_create_mutex(&dev->i2c_dev);
+    CHECK(i2c_dev_create_mutex(&dev->i2c_dev));
+
+    return build_channel_read(dev);
 }
 
 esp_err_t tsl2561_free_desc(tsl2561_t *dev)
 {
     CHECK_ARG(dev);
 
+    CHECK(i2c_dev_transaction_free(&dev->channel_read));
     return i2c_dev_delete_mutex(&dev->i2c_dev);
 }
 
@@ -266,12 +345,8 @@ esp_err_t tsl2561_set_integration_time(tsl2561_t *dev, tsl2561_integration_time_
     CHECK_ARG(dev);
 
     I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
-    I2C_DEV_CHECK(&dev->i2c_dev, enable(dev));
-
-    I2C_DEV_CHECK(&dev->i2c_dev, write_register(dev, TSL2561_REG_TIMING, integration_time | dev->gain));
     dev->integration_time = integration_time;
-
-    I2C_DEV_CHECK(&dev->i2c_dev, disable(dev));
+    I2C_DEV_CHECK(&dev->i2c_dev, write_timing(dev, integration_time | dev->gain));
     I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
 
     return ESP_OK;
@@ -282,21 +357,15 @@ esp_err_t tsl2561_set_gain(tsl2561_t *dev, tsl2561_gain_t gain)
     CHECK_ARG(dev);
 
     I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
-    I2C_DEV_CHECK(&dev->i2c_dev, enable(dev));
-
-    I2C_DEV_CHECK(&dev->i2c_dev, write_register(dev, TSL2561_REG_TIMING, gain | dev->integration_time));
     dev->gain = gain;
-
-    I2C_DEV_CHECK(&dev->i2c_dev, disable(dev));
+    I2C_DEV_CHECK(&dev->i2c_dev, write_timing(dev, gain | dev->integration_time));
     I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
 
     return ESP_OK;
 }
 
-esp_err_t tsl2561_read_lux(tsl2561_t *dev, uint32_t *lux)
+static esp_err_t calculate_lux(tsl2561_t *dev, uint16_t ch0, uint16_t ch1, uint32_t *lux)
 {
-    CHECK_ARG(dev && lux);
-
     uint32_t ch_scale, channel1, channel0;
 
     switch (dev->integration_time)
@@ -318,11 +387,6 @@ esp_err_t tsl2561_read_lux(tsl2561_t *dev, uint32_t *lux)
         // we need to scale by 16
         ch_scale = ch_scale << 4;
 
-    uint16_t ch0 = 0;
-    uint16_t ch1 = 0;
-
-    CHECK(get_channel_data(dev, &ch0, &ch1));
-
     // Scale the channel values
     channel0 = (ch0 * ch_scale) >> CH_SCALE;
     channel1 = (ch1 * ch_scale) >> CH_SCALE;
@@ -442,3 +506,103 @@ esp_err_t tsl2561_read_lux(tsl2561_t *dev, uint32_t *lux)
 
     return ESP_OK;
 }
+
+esp_err_t tsl2561_set_auto_range(tsl2561_t *dev, bool enable, uint16_t min_counts)
+{
+    CHECK_ARG(dev);
+
+    dev->auto_range = enable;
+    dev->min_counts = min_counts;
+    if (!enable)
+        return ESP_OK;
+
+    // Start in the fastest range that is sensitive enough for indoor light
+    return set_range(dev, 1);
+}
+
+esp_err_t tsl2561_start_measurement(tsl2561_t *dev)
+{
+    CHECK_ARG(dev);
+
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    I2C_DEV_CHECK(&dev->i2c_dev, enable(dev));
+    dev->measurement_start = esp_timer_get_time();
+    dev->measuring = true;
+    dev->has_lux = false;
+    I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+
+    return ESP_OK;
+}
+
+esp_err_t tsl2561_stop_measurement(tsl2561_t *dev)
+{
+    CHECK_ARG(dev);
+
+    I2C_DEV_TAKE_MUTEX(&dev->i2c_dev);
+    I2C_DEV_CHECK(&dev->i2c_dev, disable(dev));
+    dev->measuring = false;
+    I2C_DEV_GIVE_MUTEX(&dev->i2c_dev);
+
+    return ESP_OK;
+}
+
+esp_err_t tsl2561_fetch_lux(tsl2561_t *dev, uint32_t *lux)
+{
+    CHECK_ARG(dev && lux);
+
+    if (!dev->measuring)
+        return ESP_ERR_INVALID_STATE;
+
+    // The channel registers only hold a valid value after the first integration since the start
+    if (esp_timer_get_time() - dev->measurement_start < integration_time_ms(dev) * 1000LL)
+        return ESP_ERR_NOT_FINISHED;
+
+    uint16_t ch0 = 0;
+    uint16_t ch1 = 0;
+
+    CHECK(get_channel_data(dev, &ch0, &ch1));
+
+    const range_t *range = &ranges[dev->range];
+    bool saturated = SATURATED(ch0, range) || SATURATED(ch1, range);
+    if (dev->auto_range && dev->range > 0 && saturated)
+    {
+        // A saturated reading has no usable lux value and doesn't tell how much less sensitive the range has to be,
+        // the least sensitive one has a conversion every 13 ms and its counts pick the range after it
+        CHECK(set_range(dev, 0));
+        return ESP_ERR_NOT_FINISHED;
+    }
+
+    // Nothing less sensitive left, the clipped counts only give a lower bound
+    dev->saturated = saturated;
+    CHECK(calculate_lux(dev, ch0, ch1, lux));
+    dev->lux = *lux;
+    dev->has_lux = true;
+
+    if (dev->auto_range && ch0 < dev->min_counts && dev->range < RANGE_COUNT - 1)
+    {
+        uint8_t next = more_sensitive_range(dev, ch0);
+        if (next != dev->range)
+            CHECK(set_range(dev, next));
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t tsl2561_read_lux(tsl2561_t *dev, uint32_t *lux)
+{
+    CHECK_ARG(dev && lux);
+
+    if (!dev->measuring)
+        CHECK(tsl2561_start_measurement(dev));
+
+    // The chip integrates in the background, waiting for it would hold the caller for up to 420 ms.
+    // The first integration in a new range is covered by the last conversion of the previous one.
+    esp_err_t res = tsl2561_fetch_lux(dev, lux);
+    if (res == ESP_ERR_NOT_FINISHED && dev->has_lux)
+    {
+        *lux = dev->lux;
+        return ESP_OK;
+    }
+
+    return res;
+}
@@ -44,6 +44,8 @@
 #ifndef __TSL2561_H__
 #define __TSL2561_H__
 
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
 #include <i2cdev.h>
 #include <esp_err.h>
 
@@ -80,6 +82,8 @@ typedef enum
     TSL2561_PACKAGE_T_FN_CL
 } tsl2561_package_t;
 
+#define TSL2561_CHANNEL_READ_SIZE I2C_DEV_TRANSACTION_SIZE(2)
+
 /**
  * Device descriptor
  */
@@ -89,6 +93,18 @@ typedef struct
     tsl2561_integration_time_t integration_time;
     tsl2561_gain_t gain;
     tsl2561_package_t package_type;
+    bool measuring;               //!< Chip is powered and integrating continuously
+    int64_t measurement_start;    //!< esp_timer time of the first integration after power on or a timing change, us
+    bool saturated;               //!< The last fetched conversion saturated a channel in the least sensitive range, the lux are a lower bound
+    bool has_lux;                 //!< A conversion was fetched since the start
+    uint32_t lux;                 //!< Light intensity of the last fetched conversion, lux
+    bool auto_range;              //!< Gain and integration time follow the light level
+    uint16_t min_counts;          //!< Auto ranging raises the sensitivity below these channel 0 counts
+    uint8_t range;                //!< Current auto ranging step
+    i2c_dev_transaction_t channel_read; //!< Pre-built read of both channels
+    uint8_t channel_regs[2];
+    uint8_t channel_data[4];
+    uint8_t channel_read_buffer[TSL2561_CHANNEL_READ_SIZE];
 } tsl2561_t;
 
 /**
@@ -137,12 +153,64 @@ esp_err_t tsl2561_set_integration_time(tsl2561_t *dev, tsl2561_integration_time_
  */
 esp_err_t tsl2561_set_gain(tsl2561_t *dev, tsl2561_gain_t gain);
 
+/**
+ * @brief Enable or disable automatic gain and integration time ranging
+ *
+ * While enabled, every fetched conversion is checked against the current range:
+ * a saturated channel switches to the least sensitive range and is discarded,
+ * channel 0 counts below `min_counts` switch straight to the fastest range that reaches them without saturating.
+ * Gain is raised before the integration time, so bright light is measured every 13 ms
+ * and only dark readings wait for the 402 ms integration. Either way the next conversion is in the right range.
+ * Disabling keeps the current gain and integration time.
+ *
+ * @param dev Device descriptor
+ * @param enable true to enable auto ranging
+ * @param min_counts Lowest channel 0 counts that give the required resolution
+ * @return `ESP_OK` on success
+ */
+esp_err_t tsl2561_set_auto_range(tsl2561_t *dev, bool enable, uint16_t min_counts);
+
+/**
+ * @brief Power on the device and let it integrate continuously
+ *
+ * Returns right away, the first result can be fetched after one integration time.
+ * The chip stays powered until ::tsl2561_stop_measurement.
+ *
+ * @param dev Device descriptor
+ * @return `ESP_OK` on success
+ */
+esp_err_t tsl2561_start_measurement(tsl2561_t *dev);
+
+/**
+ * @brief Power off the device
+ *
+ * @param dev Device descriptor
+ * @return `ESP_OK` on success
+ */
+esp_err_t tsl2561_stop_measurement(tsl2561_t *dev);
+
+/**
+ * @brief Read the last completed conversion of a running measurement
+ *
+ * Does not wait for the integration, the device mutex is only held for reading the channels.
+ * Sets `saturated` if a channel is saturated and auto ranging can't switch to a less sensitive range.
+ *
+ * @param dev Device descriptor
+ * @param[out] lux Light intensity, lux
+ * @return `ESP_OK` on success, `ESP_ERR_NOT_FINISHED` if no integration completed since the start or
+ *         auto ranging discarded a saturated conversion, `ESP_ERR_INVALID_STATE` if no measurement is running
+ */
+esp_err_t tsl2561_fetch_lux(tsl2561_t *dev, uint32_t *lux);
+
 /**
  * @brief Read light intensity from device
  *
+ * Starts a measurement on the first call and never waits for an integration.
+ * While the first integration after a range change is running, the lux of the last fetched conversion are returned.
+ *
  * @param dev Device descriptor
  * @param[out] lux Light intensity, lux
- * @return `ESP_OK` on success
+ * @return `ESP_OK` on success, `ESP_ERR_NOT_FINISHED` if no conversion completed since the start
  */
 esp_err_t tsl2561_read_lux(tsl2561_t *dev, uint32_t *lux);
 
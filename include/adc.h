@@ -1,22 +1,85 @@
 #ifndef __ADC_H__
 #define __ADC_H__
 
-#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali.h"
 
-typedef struct adc_oneshot_unit {
+// The calibration lookup table has an entry every 2^ADC_CALI_LUT_STEP_BITS codes, the values in between are interpolated
+#define ADC_CALI_LUT_STEP_BITS 4
+#define ADC_CALI_LUT_SIZE ((1 << (SOC_ADC_DIGI_MAX_BITWIDTH - ADC_CALI_LUT_STEP_BITS)) + 1)
+
+// eFuse Vref of boards without burnt calibration values
+#define ADC_CALI_DEFAULT_VREF_MV 1100
+
+typedef struct adc_cali_lut {
+    u_int16_t mv[ADC_CALI_LUT_SIZE];
+} adc_cali_lut_t;
+
+typedef struct adc_continuous_unit {
     adc_unit_t adc_unit;
-    adc_oneshot_unit_handle_t adc_handle;
-    adc_oneshot_chan_cfg_t adc_chan_config;
-} adc_oneshot_unit_t;
+    adc_channel_t adc_channel;
+    adc_continuous_handle_t adc_handle;
+    u_int32_t sample_freq_hz;
+    u_int32_t frame_size;
+    u_int8_t *frame;
+    adc_cali_lut_t cali_lut;
+} adc_continuous_unit_t;
 
 /**
- * Initializes an ADC oneshot unit with the specified ADC unit and attenuation
- * 
+ * Initializes an ADC continuous unit that converts a single channel into DMA frames
+ *
  * @param unit The ADC unit to use
+ * @param channel The ADC channel to convert
  * @param atten The attenuation to use
- * @param out_unit Pointer for returning the adc_oneshot_unit
+ * @param sample_freq_hz The conversion rate in Hz
+ * @param frame_size The size of one DMA frame in bytes (multiple of SOC_ADC_DIGI_DATA_BYTES_PER_CONV)
+ * @param out_unit Pointer for returning the adc_continuous_unit
+ */
+void adc_continuous_unit_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, u_int32_t sample_freq_hz, u_int32_t frame_size, adc_continuous_unit_t *out_unit);
+
+/**
+ * Blocks until the next DMA frame is available and converts it into averaged millivolts
+ *
+ * Every oversampling consecutive samples are averaged into one point, the average keeps ADC_CALI_LUT_STEP_BITS
+ * fractional bits and is converted with one lookup in the calibration table of the unit.
+ *
+ * @param unit Pointer to the started ADC continuous unit
+ * @param oversampling The number of samples averaged into one point
+ * @param out_mv Buffer for the points, must hold at least frame_size / SOC_ADC_DIGI_RESULT_BYTES / oversampling points
+ * @param out_count Pointer for returning the number of points written to out_mv
+ * @param timeout_ms The maximum time to wait for a frame
+ *
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if no frame was converted in time
+ */
+esp_err_t adc_continuous_unit_read_mv(adc_continuous_unit_t *unit, u_int32_t oversampling, u_int16_t *out_mv, u_int32_t *out_count, u_int32_t timeout_ms);
+
+/**
+ * Converts the sum of raw samples into millivolts with one table lookup
+ *
+ * @param lut Pointer to the calibration lookup table
+ * @param raw_sum The sum of the raw samples
+ * @param count The number of samples in the sum
+ *
+ * @return The average voltage in millivolts
+ */
+u_int16_t adc_cali_lut_to_mv(const adc_cali_lut_t *lut, u_int32_t raw_sum, u_int32_t count);
+
+/**
+ * Fills a calibration lookup table, falls back to the nominal input range of the attenuation if there is no calibration scheme
+ *
+ * @param unit The ADC unit
+ * @param channel The ADC channel
+ * @param atten The attenuation
+ * @param out_lut Pointer for returning the table
+ */
+void adc_cali_lut_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, adc_cali_lut_t *out_lut);
+
+/**
+ * Deinitializes an ADC continuous unit and frees its frame buffer
+ *
+ * @param unit Pointer to the adc_continuous_unit to deinitialize
  */
-void adc_oneshot_unit_init(adc_unit_t unit, adc_atten_t atten, adc_oneshot_unit_t *out_unit);
+void adc_continuous_unit_deinit(adc_continuous_unit_t *unit);
 
 /**
  * Initializes ADC calibration for a given unit, channel, and attenuation
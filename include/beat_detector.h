@@ -0,0 +1,93 @@
+#ifndef __BEAT_DETECTOR_H__
+#define __BEAT_DETECTOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Moving window integration, spikes much shorter than a pulse of the receiver are averaged away
+#define BEAT_DETECTOR_INTEGRATION_MS 10
+#define BEAT_DETECTOR_MAX_INTEGRATION_SAMPLES 32
+
+// Time after a (re)start in which the signal and noise levels are learned instead of detecting beats
+#define BEAT_DETECTOR_LEARNING_MS 1000
+
+/*
+ * Incremental peak detector in the style of Pan-Tompkins.
+ * The signal is high-passed with a slow baseline and integrated over a short moving window, every local maximum is classified as a beat or as noise
+ * against a threshold between the running signal and noise peak levels.
+ * When no beat came for 1.66 average intervals, the largest peak above half the threshold is taken as the missed beat.
+ * Integer only and without ESP-IDF dependencies.
+ */
+typedef struct beat_detector {
+    uint32_t sample_rate_hz;
+    uint16_t min_peak;
+    uint32_t refractory_samples;
+    uint32_t learning_samples;
+    uint64_t sample_index;
+
+    // Baseline with 8 fractional bits, follows the signal with a time constant of about one second
+    int32_t baseline;
+    uint8_t baseline_shift;
+
+    // Moving window integration
+    int32_t window[BEAT_DETECTOR_MAX_INTEGRATION_SAMPLES];
+    uint8_t window_size;
+    uint8_t window_head;
+    int32_t window_sum;
+
+    // Peak currently being tracked, confirmed when the signal fell to half of it
+    bool tracking;
+    int32_t candidate;
+    uint64_t candidate_sample;
+    bool pulse; // The tracked peak is above the threshold
+
+    // Peak levels and the detection threshold, in the unit of the samples above the baseline
+    int32_t signal_level;
+    int32_t noise_level;
+    int32_t threshold;
+
+    // Learning phase
+    int32_t learning_max;
+    int64_t learning_sum;
+
+    // Missed beat search back
+    int32_t searchback_peak;
+    uint64_t searchback_sample;
+
+    bool has_last_beat;
+    uint64_t last_beat_sample;
+    uint32_t average_interval_samples; // 0 until the first interval
+} beat_detector_t;
+
+/**
+ * Initializes a beat detector
+ *
+ * @param detector Pointer to the detector
+ * @param sample_rate_hz The rate of the samples passed to beat_detector_add_sample
+ * @param min_peak The minimum height of a beat above the baseline, the adaptive threshold never goes below it
+ * @param refractory_ms Time after a beat in which no other beat is accepted
+ */
+void beat_detector_init(beat_detector_t *detector, uint32_t sample_rate_hz, uint16_t min_peak, uint32_t refractory_ms);
+
+/**
+ * Starts learning the signal and noise levels again, e.g. after the signal was lost
+ *
+ * @param detector Pointer to the detector
+ */
+void beat_detector_reset(beat_detector_t *detector);
+
+/**
+ * Feeds a single sample into the detector, O(1)
+ *
+ * Beats are reported when their peak is confirmed, so out_beat_sample lies a few samples
+ * (or up to 1.66 intervals for a missed beat) in the past.
+ *
+ * @param detector Pointer to the detector
+ * @param value The sample value
+ * @param out_beat_sample Pointer for returning the sample index of the beat
+ *
+ * @return true if a beat was detected
+ */
+bool beat_detector_add_sample(beat_detector_t *detector, uint16_t value, uint64_t *out_beat_sample);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __CALIBRATION_H__
+#define __CALIBRATION_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "calibration_polynomial.h"
+
+/*
+ * Converts the integer sensor readings into physical values with a per-sensor polynomial of calibration_polynomial.h,
+ * the coefficients are stored in NVS.
+ */
+
+typedef enum calibration_sensor {
+    CALIBRATION_TEMPERATURE = 0, // 0.1 degrees Celsius from the AM2320, -400 to 800
+    CALIBRATION_HUMIDITY,        // 0.1 percent from the AM2320, 0 to 1000
+    CALIBRATION_ILLUMINANCE,     // Lux from the TSL2561, up to 2^17 in direct sunlight
+    CALIBRATION_PRESSURE,        // Filtered raw conversions from the HX710B, 24-bit signed
+    CALIBRATION_SENSOR_COUNT
+} calibration_sensor_t;
+
+/**
+ * Loads the calibrations from NVS, sensors without a stored calibration use the defaults
+ *
+ * nvs_flash_init must have been called before.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t calibration_init(void);
+
+/**
+ * Replaces the calibration of a sensor and stores it in NVS
+ *
+ * @param sensor The sensor
+ * @param calibration Pointer to the new calibration
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the order or the input shift is out of range
+ */
+esp_err_t calibration_set(calibration_sensor_t sensor, const calibration_t *calibration);
+
+/**
+ * Returns the input shift of the readings of a sensor, for calibration_parse
+ *
+ * @param sensor The sensor
+ *
+ * @return The input shift
+ */
+uint8_t calibration_input_shift(calibration_sensor_t sensor);
+
+/**
+ * Looks up a sensor by the name its calibration is stored under in NVS ("temp", "hum", "illuminance", "pressure")
+ *
+ * @param name The name of the sensor
+ * @param out_sensor Pointer to the sensor, unchanged if the name is unknown
+ *
+ * @return true if the name is known
+ */
+bool calibration_sensor_from_name(const char *name, calibration_sensor_t *out_sensor);
+
+/**
+ * Tells if the values of a sensor can be converted, i.e. it has a default or a stored calibration
+ *
+ * @param sensor The sensor
+ *
+ * @return true if calibration_apply gives physical values
+ */
+bool calibration_is_valid(calibration_sensor_t sensor);
+
+/**
+ * Converts a reading with the current calibration of the sensor
+ *
+ * @param sensor The sensor
+ * @param input The integer reading of the sensor
+ *
+ * @return The value in milli-units
+ */
+int32_t calibration_apply(calibration_sensor_t sensor, int32_t input);
+
+#endif
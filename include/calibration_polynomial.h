@@ -0,0 +1,61 @@
+#ifndef __CALIBRATION_POLYNOMIAL_H__
+#define __CALIBRATION_POLYNOMIAL_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define CALIBRATION_MAX_ORDER 3
+
+// Fractional bits of the coefficients
+#define CALIBRATION_FRACTION_BITS 24
+
+// Largest input shift, the reading is an int32_t
+#define CALIBRATION_MAX_INPUT_SHIFT 31
+
+// Converts the floating point coefficient of input^power into fixed point, only for compile time constants with power * input_shift < 63
+#define CALIBRATION_COEFFICIENT(x, power, input_shift) \
+    ((int64_t) ((double) (x) * (double) (1LL << CALIBRATION_FRACTION_BITS) * (double) (1LL << ((power) * (input_shift))) + ((x) < 0 ? -0.5 : 0.5)))
+
+/*
+ * output = c0 + c1 * x + ... + c[order] * x^order with x = input / 2^input_shift
+ *
+ * The coefficients are in Q(CALIBRATION_FRACTION_BITS) and map the reading to milli-units of the output.
+ * The input shift scales the reading to around 1, so every power of it keeps the resolution of its coefficient:
+ * without it, the 2nd order coefficient of a 24-bit HX710B reading would be ~1e-8 milli-hPa per count^2,
+ * below the 6e-8 of the last fractional bit.
+ * The polynomial is evaluated with integers only, so it is cheap in ISR and task context and the results are
+ * bit-exact between the device and a host build.
+ */
+typedef struct calibration {
+    uint8_t order;
+    uint8_t input_shift; // Bit width of the reading, 0 for stored calibrations from before the shift
+    int64_t coefficients[CALIBRATION_MAX_ORDER + 1];
+} calibration_t;
+
+/**
+ * Evaluates a calibration polynomial
+ *
+ * Overflowing intermediate values saturate, the result is rounded to the nearest milli-unit.
+ *
+ * @param calibration Pointer to the calibration
+ * @param input The integer reading of the sensor
+ *
+ * @return The value in milli-units
+ */
+int32_t calibration_eval(const calibration_t *calibration, int32_t input);
+
+/**
+ * Parses the coefficients c0,c1,... of a polynomial, separated by commas
+ *
+ * The coefficients are decimal numbers in milli-units per input unit (per input unit^2 for c2 and so on),
+ * the order is the number of coefficients minus one.
+ *
+ * @param text The null-terminated coefficients
+ * @param input_shift The input shift of the sensor, at most CALIBRATION_MAX_INPUT_SHIFT
+ * @param out_calibration Pointer to the calibration, unchanged on error
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the text isn't 1 to CALIBRATION_MAX_ORDER + 1 coefficients in range
+ */
+esp_err_t calibration_parse(const char *text, uint8_t input_shift, calibration_t *out_calibration);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef __CBOR_H__
+#define __CBOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Minimal CBOR (RFC 8949) encoder into a caller provided buffer, definite lengths only.
+ * Writes past the end of the buffer are dropped and mark the writer as overflowed.
+ */
+
+typedef struct cbor_writer {
+    uint8_t *buffer;
+    size_t size;
+    size_t len;
+    bool overflow;
+} cbor_writer_t;
+
+/**
+ * Initializes a writer that appends to a buffer
+ *
+ * @param writer Pointer to the writer
+ * @param buffer The buffer for the encoded items
+ * @param size Size of the buffer in bytes
+ */
+void cbor_writer_init(cbor_writer_t *writer, uint8_t *buffer, size_t size);
+
+/**
+ * Writes an unsigned integer in the shortest encoding
+ *
+ * @param writer Pointer to the writer
+ * @param value The value
+ */
+void cbor_write_uint(cbor_writer_t *writer, uint64_t value);
+
+/**
+ * Writes a signed integer in the shortest encoding
+ *
+ * @param writer Pointer to the writer
+ * @param value The value
+ */
+void cbor_write_int(cbor_writer_t *writer, int64_t value);
+
+/**
+ * Writes a single precision float, NaN stays NaN
+ *
+ * @param writer Pointer to the writer
+ * @param value The value
+ */
+void cbor_write_float(cbor_writer_t *writer, float value);
+
+/**
+ * Writes true or false
+ *
+ * @param writer Pointer to the writer
+ * @param value The value
+ */
+void cbor_write_bool(cbor_writer_t *writer, bool value);
+
+/**
+ * Writes null
+ *
+ * @param writer Pointer to the writer
+ */
+void cbor_write_null(cbor_writer_t *writer);
+
+/**
+ * Writes a UTF-8 text string
+ *
+ * @param writer Pointer to the writer
+ * @param text The null terminated text
+ */
+void cbor_write_text(cbor_writer_t *writer, const char *text);
+
+/**
+ * Writes the header of a map, the next count key value pairs are its entries
+ *
+ * @param writer Pointer to the writer
+ * @param count Number of key value pairs
+ */
+void cbor_write_map(cbor_writer_t *writer, size_t count);
+
+/**
+ * Writes the header of an array, the next count items are its elements
+ *
+ * @param writer Pointer to the writer
+ * @param count Number of items
+ */
+void cbor_write_array(cbor_writer_t *writer, size_t count);
+
+#endif
@@ -1,15 +1,59 @@
-#include "esp_adc/adc_oneshot.h"
-
 #define WIFI_DISCONNECT_LED_GPIO 14
 #define HEARTBEAT_LED_GPIO 13
 #define RESET_BUTTON_GPIO 25
 #define HEARTRATE_SENSOR_ADC_CHANNEL 6
 #define PRESSURE_SENSOR_SCK_PIN 17
 #define PRESSURE_SENSOR_OUT_PIN 16
+#define PRESSURE_SENSOR_SPI_HOST SPI2_HOST
 #define I2C_SCL_PIN 22
 #define I2C_SDA_PIN 21
 
 #define ADC_ATTEN ADC_ATTEN_DB_11
-#define HEARTBEAT_THRESHOLD 3000
-#define REQUIRED_HEARTBEATS 7
-#define HEARTBEAT_TIMEOUT_MS 2000
\ No newline at end of file
+#define HEARTBEAT_MIN_PEAK_MV 300 // floor of the adaptive beat threshold, above the baseline
+#define HEARTBEAT_TIMEOUT_MS 2000
+#define HEARTRATE_ADC_SAMPLE_FREQ_HZ 20000
+#define HEARTRATE_ADC_FRAME_SIZE 1024
+#define HEARTBEAT_INTERVAL_WINDOW 8
+
+#define SNTP_SERVER "pool.ntp.org"
+
+#define WEBSERVER_PORT 80
+#define WEBSERVER_MAX_OPEN_SOCKETS 11 // CONFIG_LWIP_MAX_SOCKETS (16) - 3 used by the server - 2 for SNTP and remote write
+#define WEBSERVER_BACKLOG 8 // absorbs the connection burst of several scrapers starting at the same second
+#define WEBSERVER_LRU_PURGE 1 // close the idlest keep-alive connection instead of refusing a new one
+#define WEBSERVER_KEEP_ALIVE_IDLE_S 30 // TCP keep-alive, frees the sockets of clients that vanished
+#define WEBSERVER_STACK_SIZE 6144
+#define WEBSERVER_TASK_PRIORITY 4 // below the sensor tasks, a burst of requests must not delay a sample
+#define WEBSERVER_CORE_ID tskNO_AFFINITY
+#define STREAM_TASK_STACK_SIZE 4096
+#define STREAM_TASK_PRIORITY 4
+
+#define SENSOR_TASK_STACK_SIZE 4096
+#define METRICS_STALE_PERIODS 3 // a /metrics value is rendered as NaN after this many periods of its sensor without an update
+#define SENSOR_TASK_PRIORITY 5
+#define ILLUMINANCE_PERIOD_MS 5000
+#define ILLUMINANCE_DEADLINE_MS 100
+#define ILLUMINANCE_MIN_COUNTS 1000 // auto ranging picks the fastest range with at least this many counts
+#define TEMPERATURE_PERIOD_MS 5000
+#define TEMPERATURE_DEADLINE_MS 500
+#define HEARTRATE_PERIOD_MS 0 // free-running, paced by the ADC frames
+#define HEARTRATE_DEADLINE_MS 100
+#define HEARTRATE_PUBLISH_INTERVAL_MS 5000 // an unchanged rate is republished at this interval, so it doesn't go stale
+#define PRESSURE_SENSOR_ENABLED 0 // gated until the pressure conversion has real coefficients
+#define PRESSURE_ACQUIRE_PERIOD_MS 0 // free-running, paced by the 10 Hz conversions
+#define PRESSURE_ACQUIRE_DEADLINE_MS 150
+#define PRESSURE_MEDIAN_WINDOW 5 // rejects spikes of up to 2 conversions
+#define PRESSURE_EMA_SHIFT 3 // weight of a new conversion is 1/8
+#define PRESSURE_PERIOD_MS 1000
+#define PRESSURE_DEADLINE_MS 100
+
+#define HISTORY_PERIOD_MS 5000
+#define HISTORY_DEADLINE_MS 100
+
+#define REMOTE_WRITE_ENABLED 0 // the URL is set in secrets.h
+#define REMOTE_WRITE_JOB "sensor_api"
+#define REMOTE_WRITE_SAMPLE_PERIOD_MS 15000
+#define REMOTE_WRITE_SAMPLE_DEADLINE_MS 100
+#define REMOTE_WRITE_PUSH_PERIOD_MS 300000
+#define REMOTE_WRITE_TASK_STACK_SIZE 6144
+#define REMOTE_WRITE_TASK_PRIORITY 3
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef __FORMAT_H__
+#define __FORMAT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Number formatting for the hot paths of the webserver, without the locale and varargs overhead of printf.
+ * The output is not terminated, the functions return its length.
+ */
+
+// Room for the longest output of any of the functions ("-4294967296.000000")
+#define FORMAT_MAX_LENGTH 24
+
+// Maximum number of decimals of format_fixed
+#define FORMAT_MAX_DECIMALS 6
+
+/**
+ * Formats an unsigned integer in decimal
+ *
+ * @param buffer Buffer with room for at least FORMAT_MAX_LENGTH characters
+ * @param value The value
+ *
+ * @return The length of the output
+ */
+size_t format_u32(char *buffer, uint32_t value);
+
+/**
+ * Formats a 64-bit unsigned integer in decimal
+ *
+ * @param buffer Buffer with room for at least FORMAT_MAX_LENGTH characters
+ * @param value The value
+ *
+ * @return The length of the output
+ */
+size_t format_u64(char *buffer, uint64_t value);
+
+/**
+ * Formats a signed integer in decimal
+ *
+ * @param buffer Buffer with room for at least FORMAT_MAX_LENGTH characters
+ * @param value The value
+ *
+ * @return The length of the output
+ */
+size_t format_i32(char *buffer, int32_t value);
+
+/**
+ * Formats a float with a fixed number of decimals, rounded half away from zero
+ *
+ * NaN, infinite values and values with a magnitude above 2^32 are written as NaN.
+ *
+ * @param buffer Buffer with room for at least FORMAT_MAX_LENGTH characters
+ * @param value The value
+ * @param decimals Number of decimals (at most FORMAT_MAX_DECIMALS)
+ *
+ * @return The length of the output
+ */
+size_t format_fixed(char *buffer, float value, uint8_t decimals);
+
+#endif
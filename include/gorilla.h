@@ -0,0 +1,140 @@
+#ifndef __GORILLA_H__
+#define __GORILLA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Worst case size of one appended timestamp and value in bits
+#define GORILLA_MAX_TIME_BITS (4 + 40)
+#define GORILLA_MAX_VALUE_BITS (2 + 5 + 5 + 32)
+
+/*
+ * Gorilla compression (Pelkonen et al., "Gorilla: A Fast, Scalable, In-Memory Time Series Database")
+ * for 32 bit timestamps and floats. Timestamps are stored as delta-of-delta, values as XOR with the previous value.
+ * Timestamps and values are separate streams, so series that share their timestamps only store them once.
+ */
+
+typedef struct gorilla_bit_writer {
+    uint8_t *buffer;
+    size_t capacity_bits;
+    size_t bit_len;
+} gorilla_bit_writer_t;
+
+typedef struct gorilla_bit_reader {
+    const uint8_t *buffer;
+    size_t bit_len;
+    size_t position;
+} gorilla_bit_reader_t;
+
+typedef struct gorilla_time_encoder {
+    gorilla_bit_writer_t writer;
+    uint32_t count;
+    uint32_t prev_timestamp;
+    int64_t prev_delta;
+} gorilla_time_encoder_t;
+
+typedef struct gorilla_value_encoder {
+    gorilla_bit_writer_t writer;
+    uint32_t count;
+    uint32_t prev_value;
+    uint8_t prev_leading;
+    uint8_t prev_trailing;
+} gorilla_value_encoder_t;
+
+typedef struct gorilla_time_decoder {
+    gorilla_bit_reader_t reader;
+    uint32_t count;
+    uint32_t remaining;
+    uint32_t prev_timestamp;
+    int64_t prev_delta;
+} gorilla_time_decoder_t;
+
+typedef struct gorilla_value_decoder {
+    gorilla_bit_reader_t reader;
+    uint32_t count;
+    uint32_t remaining;
+    uint32_t prev_value;
+    uint8_t prev_leading;
+    uint8_t prev_trailing;
+} gorilla_value_decoder_t;
+
+/**
+ * Initializes a timestamp encoder that appends to a buffer
+ *
+ * @param encoder Pointer to the encoder
+ * @param buffer The buffer for the encoded stream
+ * @param size Size of the buffer in bytes
+ */
+void gorilla_time_encoder_init(gorilla_time_encoder_t *encoder, uint8_t *buffer, size_t size);
+
+/**
+ * Appends a timestamp, nothing is written if it doesn't fit into the buffer
+ *
+ * @param encoder Pointer to the encoder
+ * @param timestamp The timestamp, must not be older than the previous one
+ *
+ * @return true if the timestamp was appended, false if the buffer is full
+ */
+bool gorilla_time_encoder_append(gorilla_time_encoder_t *encoder, uint32_t timestamp);
+
+/**
+ * Initializes a value encoder that appends to a buffer
+ *
+ * @param encoder Pointer to the encoder
+ * @param buffer The buffer for the encoded stream
+ * @param size Size of the buffer in bytes
+ */
+void gorilla_value_encoder_init(gorilla_value_encoder_t *encoder, uint8_t *buffer, size_t size);
+
+/**
+ * Appends a value, nothing is written if it doesn't fit into the buffer
+ *
+ * @param encoder Pointer to the encoder
+ * @param value The value
+ *
+ * @return true if the value was appended, false if the buffer is full
+ */
+bool gorilla_value_encoder_append(gorilla_value_encoder_t *encoder, float value);
+
+/**
+ * Initializes a streaming decoder for the timestamps written by a gorilla_time_encoder_t
+ *
+ * @param decoder Pointer to the decoder
+ * @param buffer The encoded stream
+ * @param bit_len Length of the encoded stream in bits
+ * @param count Number of encoded timestamps
+ */
+void gorilla_time_decoder_init(gorilla_time_decoder_t *decoder, const uint8_t *buffer, size_t bit_len, uint32_t count);
+
+/**
+ * Decodes the next timestamp
+ *
+ * @param decoder Pointer to the decoder
+ * @param out_timestamp Pointer for returning the timestamp
+ *
+ * @return false when all timestamps were decoded
+ */
+bool gorilla_time_decoder_next(gorilla_time_decoder_t *decoder, uint32_t *out_timestamp);
+
+/**
+ * Initializes a streaming decoder for the values written by a gorilla_value_encoder_t
+ *
+ * @param decoder Pointer to the decoder
+ * @param buffer The encoded stream
+ * @param bit_len Length of the encoded stream in bits
+ * @param count Number of encoded values
+ */
+void gorilla_value_decoder_init(gorilla_value_decoder_t *decoder, const uint8_t *buffer, size_t bit_len, uint32_t count);
+
+/**
+ * Decodes the next value
+ *
+ * @param decoder Pointer to the decoder
+ * @param out_value Pointer for returning the value
+ *
+ * @return false when all values were decoded
+ */
+bool gorilla_value_decoder_next(gorilla_value_decoder_t *decoder, float *out_value);
+
+#endif
@@ -1,16 +1,23 @@
-#include "esp_adc/adc_oneshot.h"
 #include "driver/gpio.h"
+#include "adc.h"
+#include "hr_estimator.h"
+
+// Number of consecutive ADC samples that are averaged into one estimator sample, rejects ADC noise around the edges
+#define HEARTRATE_SAMPLES_PER_POINT 16
 
 /**
- * Calculates the heart rate in beats per minute (BPM) using an ADC to measure the heart rate pulse
+ * Waits for the next DMA frame of an ADC continuous unit and feeds it into a heart rate estimator
+ *
+ * The task sleeps until a whole frame is converted and the frame is processed at once.
+ * The estimator gets the calibrated averages in millivolts, so its threshold is in millivolts too.
+ * It has to be initialized with a sample rate of sample_freq_hz / HEARTRATE_SAMPLES_PER_POINT.
  *
- * @param unit_handle Pointer to the ADC oneshot unit handle
- * @param channel ADC channel to read from
- * @param heartbeat_threshold The threshold value for detecting a heart rate pulse
- * @param required_beats The number of heart rate pulses required to calculate the BPM
- * @param timeout_ms The timeout in milliseconds for detecting a single heart rate pulse
+ * @param unit Pointer to the started ADC continuous unit
+ * @param estimator Pointer to the heart rate estimator
+ * @param timeout_ms The maximum time to wait for a frame
  * @param led_gpio The GPIO pin to use for the heartbeat LED (use GPIO_NUM_NC for no LED)
+ * @param out_beats Pointer for returning the number of heart beats detected in the frame
  *
- * @return The heart rate in BPM
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if no frame was converted in time
  */
-u_int8_t get_heart_rate(adc_oneshot_unit_handle_t *unit_handle, adc_channel_t channel, u_int16_t heartbeat_threshold, u_int8_t required_beats, u_int32_t timeout_ms, gpio_num_t led_gpio);
\ No newline at end of file
+esp_err_t heart_rate_process_frame(adc_continuous_unit_t *unit, hr_estimator_t *estimator, u_int32_t timeout_ms, gpio_num_t led_gpio, u_int32_t *out_beats);
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "config.h"
+
+// Rows are Gorilla compressed in blocks, a block is closed when it has HISTORY_BLOCK_ROWS rows or one of its streams is full.
+// The oldest block is dropped when all blocks are in use.
+#define HISTORY_BLOCK_COUNT 40
+#define HISTORY_BLOCK_ROWS 360
+#define HISTORY_TIME_BYTES 64
+#define HISTORY_VALUE_BYTES 256
+
+typedef enum history_metric {
+    HISTORY_TEMPERATURE = 0,
+    HISTORY_HUMIDITY,
+    HISTORY_ILLUMINANCE,
+    HISTORY_HEARTRATE,
+#if PRESSURE_SENSOR_ENABLED
+    HISTORY_PRESSURE,
+#endif
+    HISTORY_METRIC_COUNT
+} history_metric_t;
+
+typedef struct history_point {
+    uint32_t timestamp;
+    float value;
+} history_point_t;
+
+/**
+ * Initializes the history, must be called before any other history function
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t history_init(void);
+
+/**
+ * Appends one row with a value for every metric
+ *
+ * When all blocks are in use the oldest block of rows is dropped.
+ *
+ * @param timestamp Time of the row in seconds, must not be older than the last appended row
+ * @param values One value per history_metric_t, NAN for a missing value
+ */
+void history_append(uint32_t timestamp, const float values[HISTORY_METRIC_COUNT]);
+
+/**
+ * Looks up a metric by the name of its endpoint (temp, hum, illuminance, heartrate)
+ *
+ * @param name The metric name
+ * @param out_metric Pointer for returning the metric
+ *
+ * @return true if the metric exists
+ */
+bool history_metric_from_name(const char *name, history_metric_t *out_metric);
+
+/**
+ * Downsamples a time range of a metric into buckets of step seconds
+ *
+ * Each returned point is the mean of the bucket that starts at its timestamp, empty buckets are skipped.
+ * The first block of the range is located with a binary search on the block time ranges,
+ * then the blocks are decoded as a stream.
+ * Call again with *next_from until it is greater than to, to page through long ranges.
+ *
+ * @param metric The metric to query
+ * @param from Start of the range in seconds (inclusive)
+ * @param to End of the range in seconds (inclusive)
+ * @param step The bucket size in seconds, at least 1
+ * @param out_points Buffer for the returned points
+ * @param max_points Size of out_points
+ * @param next_from Pointer for returning the start of the first bucket that was not returned
+ *
+ * @return The number of points written to out_points
+ */
+size_t history_query(history_metric_t metric, uint32_t from, uint32_t to, uint32_t step, history_point_t *out_points, size_t max_points, uint32_t *next_from);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef __HR_ESTIMATOR_H__
+#define __HR_ESTIMATOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "beat_detector.h"
+
+// Maximum number of inter-beat intervals kept in the rolling window
+#define HR_ESTIMATOR_MAX_INTERVALS 32
+
+// Intervals outside of this range are not physiological and are treated as noise or a gap
+#define HR_ESTIMATOR_MIN_BPM 30
+#define HR_ESTIMATOR_MAX_BPM 220
+
+typedef struct hr_estimator {
+    uint32_t sample_rate_hz;
+    uint8_t window;
+    uint64_t timeout_samples;
+
+    // Beat detection
+    beat_detector_t detector;
+    uint64_t last_beat_sample;
+    bool has_last_beat;
+
+    // Ring buffer of inter-beat intervals in ms
+    uint32_t intervals[HR_ESTIMATOR_MAX_INTERVALS];
+    uint8_t head;
+    uint8_t count;
+
+    // Running sums over the window, so every statistic is O(1)
+    uint64_t interval_sum;
+    uint64_t interval_sq_sum;
+    uint64_t diff_sq_sum;
+} hr_estimator_t;
+
+typedef struct hr_estimator_stats {
+    uint8_t bpm;
+    float rmssd_ms;
+    float sdnn_ms;
+    uint8_t intervals;
+} hr_estimator_stats_t;
+
+/**
+ * Initializes a streaming heart rate estimator
+ *
+ * @param estimator Pointer to the estimator
+ * @param sample_rate_hz The rate of the samples passed to hr_estimator_add_sample
+ * @param min_peak The minimum height of a heart beat pulse above the baseline
+ * @param window The number of inter-beat intervals in the rolling window (at most HR_ESTIMATOR_MAX_INTERVALS)
+ * @param timeout_ms The time without a pulse after which the window is cleared
+ */
+void hr_estimator_init(hr_estimator_t *estimator, uint32_t sample_rate_hz, uint16_t min_peak, uint8_t window, uint32_t timeout_ms);
+
+/**
+ * Clears the interval window and lets the beat detector learn the signal again
+ *
+ * @param estimator Pointer to the estimator
+ */
+void hr_estimator_reset(hr_estimator_t *estimator);
+
+/**
+ * Feeds a single sample into the estimator, O(1)
+ *
+ * @param estimator Pointer to the estimator
+ * @param value The sample value
+ *
+ * @return true if a heart beat was detected, it may have started a few samples earlier
+ */
+bool hr_estimator_add_sample(hr_estimator_t *estimator, uint16_t value);
+
+/**
+ * Returns the statistics of the current interval window, O(1)
+ *
+ * BPM is 0 and the HRV figures are NAN until enough intervals are collected.
+ *
+ * @param estimator Pointer to the estimator
+ * @param out_stats Pointer for returning the statistics
+ */
+void hr_estimator_get_stats(const hr_estimator_t *estimator, hr_estimator_stats_t *out_stats);
+
+#endif
@@ -3,40 +3,69 @@
 #define __HX710B_H__
 
 #include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "esp_err.h"
 
-#define HX710B_RES 2.98023e-7
-
-typedef enum bit_order {
-    LSBFIRST = 0,
-    MSBFIRST = 1
-} bit_order_t;
+// The HX710B converts at 10 Hz, a conversion is late if DOUT didn't go low after twice the period
+#define HX710B_CONVERSION_TIMEOUT_MS 200
 
+// The value is the number of SCK pulses after the 24 data bits, they select the input and rate of the next conversion
 typedef enum hx710b_gain {
-    HX710B_GAIN_128 = 1, // Channel A
-    HX710B_GAIN_32 = 2, // Channel A
-    HX710B_GAIN_64 = 3 // Channel B
+    HX710B_GAIN_128 = 1, // 25 pulses, differential input at 10 Hz
+    HX710B_GAIN_32 = 2, // 26 pulses, DVDD-AVDD supply at 40 Hz
+    HX710B_GAIN_64 = 3 // 27 pulses, differential input at 40 Hz
 } hx710b_gain_t;
 
 typedef struct hx710b {
-    unsigned long sck;
-    unsigned long dout;
+    gpio_num_t sck;
+    gpio_num_t dout;
     hx710b_gain_t gain;
+    spi_host_device_t host;
+    spi_device_handle_t spi;
+    TaskHandle_t waiting_task; // Notified by the DOUT interrupt
 } hx710b_t;
 
-void hx710b_init(hx710b_t *sensor, unsigned int sck, unsigned int dout, hx710b_gain_t gain);
-
-int hx710b_is_ready(hx710b_t *sensor);
-
-void hx710b_wait_ready(hx710b_t *sensor, unsigned int delay_ms);
+/**
+ * Initializes the sensor
+ *
+ * SCK and DOUT are driven by the SPI peripheral, the bits of a conversion are clocked out without the CPU.
+ * DOUT going low (data ready) wakes the reading task through a GPIO interrupt, gpio_install_isr_service must have been called before.
+ *
+ * @param sensor Pointer to the sensor struct
+ * @param sck The GPIO of the SCK pin
+ * @param dout The GPIO of the DOUT pin
+ * @param gain The gain and channel of the conversions
+ * @param host The SPI host, the bus is initialized and owned by the sensor
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t hx710b_init(hx710b_t *sensor, gpio_num_t sck, gpio_num_t dout, hx710b_gain_t gain, spi_host_device_t host);
 
-long hx710b_read(hx710b_t *sensor);
+/**
+ * Frees the SPI device, the SPI bus and the DOUT interrupt
+ *
+ * @param sensor Pointer to the sensor struct
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t hx710b_free(hx710b_t *sensor);
 
-long hx710b_read_average(hx710b_t *sensor, uint8_t times);
-
-float hx710b_read_hpa(hx710b_t *sensor);
-
-void hx710b_power_down(hx710b_t *sensor);
+int hx710b_is_ready(hx710b_t *sensor);
 
-void hx710b_power_up(hx710b_t *sensor);
+/**
+ * Blocks until the next conversion is ready and reads it
+ *
+ * Must only be called from one task at a time.
+ *
+ * @param sensor Pointer to the sensor struct
+ * @param value The signed 24-bit conversion result
+ * @param timeout_ms Maximum time to wait for the conversion
+ *
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if DOUT didn't go low in time
+ */
+esp_err_t hx710b_read(hx710b_t *sensor, int32_t *value, u_int32_t timeout_ms);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,127 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define METRICS_MAX_COUNT 16
+
+typedef enum metrics_type {
+    METRICS_GAUGE = 0,
+    METRICS_COUNTER,
+    METRICS_HISTOGRAM
+} metrics_type_t;
+
+typedef enum metrics_format {
+    METRICS_FORMAT_PROMETHEUS = 0, // text/plain; version=0.0.4
+    METRICS_FORMAT_OPENMETRICS,    // application/openmetrics-text; version=1.0.0
+    METRICS_FORMAT_COUNT
+} metrics_format_t;
+
+typedef struct metric {
+    const char *name;
+    const char *help;
+    metrics_type_t type;
+    const char *labels; // Label pairs without braces, e.g. sensor="am2320", or NULL
+    uint32_t stale_after_ms; // Time without metrics_set after which the value is rendered as NaN, 0 if it never goes stale
+    float value;
+    int64_t timestamp_ms; // Unix time of the value in milliseconds, 0 if the clock wasn't synced
+    int64_t uptime_ms; // Time since boot of the value in milliseconds, for the staleness
+} metric_t;
+
+/**
+ * Adds a metric to the registry, must be called before the first metrics_render
+ *
+ * @param metric Pointer to the metric, must stay valid forever
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the registry is full
+ */
+esp_err_t metrics_register(metric_t *metric);
+
+/**
+ * Sets the value of a metric and stamps it with the current time
+ *
+ * Not synchronized, the caller has to serialize metrics_set and metrics_render
+ * (the sensor tasks call it between webserver_sensor_data_begin_update and webserver_sensor_data_end_update).
+ *
+ * @param metric Pointer to the registered metric
+ * @param value The new value
+ */
+void metrics_set(metric_t *metric, float value);
+
+/**
+ * Returns the current unix time in milliseconds, the timestamp metrics_set gives a value
+ *
+ * @return The unix time in milliseconds, 0 if SNTP hasn't synced the clock yet
+ */
+int64_t metrics_timestamp_ms(void);
+
+/**
+ * Renders all registered metrics
+ *
+ * Values that are older than the stale_after_ms of their metric are rendered as NaN without timestamp, like metrics
+ * that were never set. An explicit timestamp that stops advancing would keep the last value alive in Prometheus
+ * for the whole lookback window, a NaN stamped with the scrape time ends the series right away.
+ * The OpenMetrics terminator isn't part of the output, so more families can follow before metrics_render_eof.
+ *
+ * @param format The exposition format
+ * @param buffer Buffer for the rendered text
+ * @param size Size of the buffer
+ *
+ * @return Length of the rendered text, or -1 if it doesn't fit into the buffer
+ */
+int metrics_render(metrics_format_t format, char *buffer, size_t size);
+
+/**
+ * Renders the HELP and TYPE lines of a metric family that isn't in the registry
+ *
+ * @param format The exposition format
+ * @param name Name of the family
+ * @param help Description of the family
+ * @param type Type of the family
+ * @param buffer Buffer for the rendered text
+ * @param size Size of the buffer
+ *
+ * @return Length of the rendered text, or -1 if it doesn't fit into the buffer
+ */
+int metrics_render_family(metrics_format_t format, const char *name, const char *help, metrics_type_t type, char *buffer, size_t size);
+
+/**
+ * Renders a single sample without timestamp of a family rendered with metrics_render_family
+ *
+ * @param format The exposition format
+ * @param name Name of the family
+ * @param suffix Suffix of the sample name, e.g. _bucket for histograms, or NULL (counters get _total in OpenMetrics)
+ * @param type Type of the family
+ * @param labels Label pairs without braces, or NULL
+ * @param value The formatted value
+ * @param buffer Buffer for the rendered text
+ * @param size Size of the buffer
+ *
+ * @return Length of the rendered text, or -1 if it doesn't fit into the buffer
+ */
+int metrics_render_sample(metrics_format_t format, const char *name, const char *suffix, metrics_type_t type, const char *labels, const char *value, char *buffer, size_t size);
+
+/**
+ * Renders the end of the exposition, the # EOF line of OpenMetrics and nothing for the Prometheus text format
+ *
+ * @param format The exposition format
+ * @param buffer Buffer for the rendered text
+ * @param size Size of the buffer
+ *
+ * @return Length of the rendered text, or -1 if it doesn't fit into the buffer
+ */
+int metrics_render_eof(metrics_format_t format, char *buffer, size_t size);
+
+/**
+ * Returns the HTTP content type of a format
+ *
+ * @param format The exposition format
+ *
+ * @return The content type
+ */
+const char *metrics_content_type(metrics_format_t format);
+
+#endif
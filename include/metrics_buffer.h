@@ -0,0 +1,64 @@
+#ifndef __METRICS_BUFFER_H__
+#define __METRICS_BUFFER_H__
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "metrics.h"
+
+/*
+ * Double buffer for the rendered metrics registry, so responses can be sent without a lock or an allocation.
+ *
+ * The writer renders into the buffer that is not published and swaps it in, writers have to be serialized by the
+ * caller. Readers pin the published buffer with a reference count while they send it, the writer skips the render
+ * while the other buffer is still pinned by a slow reader.
+ */
+
+#define METRICS_BUFFER_SIZE 2048
+
+typedef struct metrics_buffer {
+    char data[METRICS_BUFFER_SIZE];
+    size_t len;
+    atomic_uint readers;
+} metrics_buffer_t;
+
+typedef struct metrics_double_buffer {
+    metrics_buffer_t buffers[2];
+    _Atomic(metrics_buffer_t *) current;
+} metrics_double_buffer_t;
+
+/**
+ * Publishes the first, empty buffer
+ *
+ * @param double_buffer The double buffer
+ */
+void metrics_buffer_init(metrics_double_buffer_t *double_buffer);
+
+/**
+ * Renders the registry into the unpublished buffer and publishes it
+ *
+ * @param double_buffer The double buffer
+ * @param format The exposition format
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if a reader still has the unpublished buffer pinned,
+ *         ESP_ERR_INVALID_SIZE if the metrics don't fit into METRICS_BUFFER_SIZE. The published buffer is kept on errors.
+ */
+esp_err_t metrics_buffer_render(metrics_double_buffer_t *double_buffer, metrics_format_t format);
+
+/**
+ * Pins the published buffer, it stays valid until metrics_buffer_release
+ *
+ * @param double_buffer The double buffer
+ *
+ * @return The published buffer
+ */
+metrics_buffer_t *metrics_buffer_acquire(metrics_double_buffer_t *double_buffer);
+
+/**
+ * Unpins a buffer returned by metrics_buffer_acquire
+ *
+ * @param buffer The buffer
+ */
+void metrics_buffer_release(metrics_buffer_t *buffer);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef __PRESSURE_FILTER_H__
+#define __PRESSURE_FILTER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Raw conversions kept in the ring buffer, also the maximum median window
+#define PRESSURE_FILTER_RING_SIZE 16
+
+// Fractional bits of the EMA state, so small steps aren't lost to the shift
+#define PRESSURE_FILTER_EMA_FRACTION_BITS 8
+
+/*
+ * Streaming filter for the raw HX710B conversions: a median of the last median_window conversions
+ * rejects single spikes, an exponential moving average with weight 1/2^ema_shift smooths the result.
+ * One task adds the conversions, any task may read the filtered value.
+ */
+typedef struct pressure_filter {
+    uint8_t median_window; // 1 disables the median
+    uint8_t ema_shift;     // 0 disables the EMA
+
+    // Ring buffer of raw conversions, only touched by the adding task
+    int32_t conversions[PRESSURE_FILTER_RING_SIZE];
+    uint8_t head;
+    uint8_t count;
+    int64_t ema; // Scaled by 2^PRESSURE_FILTER_EMA_FRACTION_BITS
+
+    _Atomic int32_t filtered;
+    _Atomic bool has_value;
+} pressure_filter_t;
+
+/**
+ * Initializes a pressure filter
+ *
+ * @param filter Pointer to the filter
+ * @param median_window The number of conversions of the median (1 to PRESSURE_FILTER_RING_SIZE, odd windows are symmetric)
+ * @param ema_shift The EMA weight of a new value is 1/2^ema_shift
+ */
+void pressure_filter_init(pressure_filter_t *filter, uint8_t median_window, uint8_t ema_shift);
+
+/**
+ * Adds a raw conversion and updates the filtered value
+ *
+ * @param filter Pointer to the filter
+ * @param conversion The raw conversion
+ */
+void pressure_filter_add(pressure_filter_t *filter, int32_t conversion);
+
+/**
+ * Returns the latest filtered conversion in O(1)
+ *
+ * @param filter Pointer to the filter
+ * @param out_filtered Pointer for returning the filtered conversion
+ *
+ * @return false if no conversion was added yet
+ */
+bool pressure_filter_get(pressure_filter_t *filter, int32_t *out_filtered);
+
+#endif
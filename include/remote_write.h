@@ -0,0 +1,49 @@
+#ifndef __REMOTE_WRITE_H__
+#define __REMOTE_WRITE_H__
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "webserver.h"
+
+/*
+ * Pushes the sensor values to a Prometheus remote_write endpoint (https://prometheus.io/docs/concepts/remote_write_spec/).
+ * Rows are batched in RAM and sent as one snappy compressed WriteRequest per push,
+ * so the WiFi radio stays idle between pushes.
+ */
+
+// Rows that are kept until they were pushed, the oldest row is dropped when the batch is full
+#define REMOTE_WRITE_BATCH_ROWS 64
+
+/**
+ * Initializes the remote write batch
+ *
+ * Nothing is pushed before SNTP synced the clock, the samples need the wall clock time.
+ *
+ * @param url The remote write URL, e.g. http://prometheus:9090/api/v1/write
+ * @param job Value of the job label of all series
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t remote_write_init(const char *url, const char *job);
+
+/**
+ * Appends the current sensor values to the batch, wakes the push task early when the batch is almost full
+ *
+ * @param values The sensor values
+ */
+void remote_write_append(const webserver_sensor_values_t *values);
+
+/**
+ * Starts the FreeRTOS task that pushes the batch every push_period_ms
+ *
+ * Failed pushes are retried with exponential backoff, the rows stay in the batch until the receiver accepted them.
+ *
+ * @param push_period_ms Time between two pushes in milliseconds
+ * @param stack_size The stack size of the task in bytes
+ * @param priority The priority of the task
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the task could not be created
+ */
+esp_err_t remote_write_start(u_int32_t push_period_ms, u_int32_t stack_size, UBaseType_t priority);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "webserver.h"
+
+#define SCHEDULER_MAX_TASKS 8
+
+typedef struct sensor_task sensor_task_t;
+
+/**
+ * Reads a sensor and publishes the result into the shared sensor data
+ *
+ * @param task The sensor task that is sampled
+ *
+ * @return ESP_OK if the sensor was read successfully
+ */
+typedef esp_err_t (*sensor_sample_fn_t)(sensor_task_t *task);
+
+struct sensor_task {
+    const char *name;
+    u_int32_t period_ms;
+    u_int32_t deadline_ms;
+    sensor_sample_fn_t sample;
+    void *sensor;
+    webserver_sensor_data_t *data;
+    webserver_sensor_t status; // Where failed samples are reported, WEBSERVER_SENSOR_NONE for tasks without a sensor
+    u_int32_t errors;
+    atomic_uint missed_deadlines; // Samples that took longer than deadline_ms, read by the webserver
+    TaskHandle_t handle;
+};
+
+/**
+ * Starts a FreeRTOS task that samples the sensor every period_ms
+ *
+ * A sample that takes longer than deadline_ms is counted as a missed deadline.
+ * If a sample overruns the whole period the next one starts right away instead of catching up.
+ * A period of 0 runs the sample function back to back, for sensors that block on their own data.
+ * After a failed sample it waits deadline_ms (at least one tick), so a missing sensor doesn't keep the CPU busy.
+ * Failed samples are counted in the sensor status of the shared data.
+ *
+ * @param task Pointer to the sensor task, must stay valid while the task runs
+ * @param stack_size The stack size of the task in bytes
+ * @param priority The priority of the task
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the task could not be created or SCHEDULER_MAX_TASKS are running
+ */
+esp_err_t sensor_task_start(sensor_task_t *task, u_int32_t stack_size, UBaseType_t priority);
+
+/**
+ * Returns the number of started sensor tasks
+ *
+ * @return The number of tasks, the valid indexes of sensor_task_get
+ */
+size_t sensor_task_count(void);
+
+/**
+ * Returns a started sensor task, e.g. for rendering its missed deadlines
+ *
+ * @param index The index in the order the tasks were started
+ *
+ * @return Pointer to the task
+ */
+const sensor_task_t *sensor_task_get(size_t index);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef __SEQLOCK_H__
+#define __SEQLOCK_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/*
+ * Sequence counter that lets readers copy data without blocking the writer.
+ *
+ * The writer makes the counter odd before it changes the data and even again afterwards, writers have to be serialized
+ * by the caller. A reader copies the data between seqlock_read_begin and seqlock_read_retry and starts over when the
+ * counter was odd or changed in between, so the copy is only used if no write overlapped it.
+ */
+
+/**
+ * Marks the data as inconsistent, call before the first write
+ *
+ * @param sequence The sequence counter of the data
+ */
+static inline void seqlock_write_begin(atomic_uint *sequence) {
+    unsigned int value = atomic_load_explicit(sequence, memory_order_relaxed);
+    atomic_store_explicit(sequence, value + 1, memory_order_relaxed);
+    // Keeps the writes of the data behind the odd counter
+    atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * Marks the data as consistent again, call after the last write
+ *
+ * @param sequence The sequence counter of the data
+ */
+static inline void seqlock_write_end(atomic_uint *sequence) {
+    unsigned int value = atomic_load_explicit(sequence, memory_order_relaxed);
+    atomic_store_explicit(sequence, value + 1, memory_order_release);
+}
+
+/**
+ * Starts reading, the data may only be copied if the returned value is even
+ *
+ * @param sequence The sequence counter of the data
+ *
+ * @return The sequence to pass to seqlock_read_retry, odd while a write is in progress
+ */
+static inline unsigned int seqlock_read_begin(atomic_uint *sequence) {
+    return atomic_load_explicit(sequence, memory_order_acquire);
+}
+
+/**
+ * Finishes reading
+ *
+ * @param sequence The sequence counter of the data
+ * @param start The value returned by seqlock_read_begin
+ *
+ * @return true if a write overlapped the read and the copy has to be discarded
+ */
+static inline bool seqlock_read_retry(atomic_uint *sequence, unsigned int start) {
+    // Keeps the reads of the data before the second load of the counter
+    atomic_thread_fence(memory_order_acquire);
+    return (start & 1) || atomic_load_explicit(sequence, memory_order_relaxed) != start;
+}
+
+#endif
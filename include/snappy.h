@@ -0,0 +1,32 @@
+#ifndef __SNAPPY_H__
+#define __SNAPPY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Snappy compressor for the raw block format (https://github.com/google/snappy/blob/main/format_description.txt),
+ * as used by the Prometheus remote_write protocol. Only compression is implemented.
+ */
+
+/**
+ * Returns the size of the output buffer that snappy_compress needs in the worst case
+ *
+ * @param input_len Length of the uncompressed input in bytes
+ *
+ * @return The maximum compressed length in bytes
+ */
+size_t snappy_max_compressed_length(size_t input_len);
+
+/**
+ * Compresses a buffer into the snappy block format
+ *
+ * @param input The uncompressed input
+ * @param input_len Length of the input in bytes
+ * @param output Buffer for the compressed output, at least snappy_max_compressed_length(input_len) bytes
+ *
+ * @return The compressed length in bytes
+ */
+size_t snappy_compress(const uint8_t *input, size_t input_len, uint8_t *output);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "webserver.h"
+
+/*
+ * Pushes new samples and heart beats to subscribed clients as Server-Sent Events (https://html.spec.whatwg.org/multipage/server-sent-events.html).
+ *
+ * Publishing only sets a flag and wakes the stream task, the task renders the events from a snapshot of the sensor data
+ * and writes them with non-blocking sends. Every client has room for a single event, while it is still being sent
+ * newer events of the same kind are coalesced into one, so a slow client gets the latest values instead of a backlog.
+ * A client that doesn't accept any data for STREAM_CLIENT_TIMEOUT_MS is dropped.
+ *
+ * The server can close a stream session on its own, e.g. when it purges the least recently used connection, so
+ * stream_close_session has to be the close_fn of the server.
+ */
+
+// Clients that can be subscribed at the same time, every one of them keeps a socket of the webserver open
+#define STREAM_MAX_CLIENTS 4
+
+// Largest event including the SSE framing
+#define STREAM_EVENT_SIZE 256
+
+// A comment is sent to idle clients after this time, so closed connections are noticed
+#define STREAM_KEEPALIVE_MS 15000
+
+// Clients that didn't accept any data for this time are dropped
+#define STREAM_CLIENT_TIMEOUT_MS 10000
+
+/**
+ * Starts the FreeRTOS task that sends the events to the clients
+ *
+ * @param webserver_sensor_data A pointer to the webserver sensor data struct the events are rendered from
+ * @param stack_size The stack size of the task in bytes
+ * @param priority The priority of the task
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the task could not be created
+ */
+esp_err_t stream_start(webserver_sensor_data_t *webserver_sensor_data, u_int32_t stack_size, UBaseType_t priority);
+
+/**
+ * URI handler that subscribes the client to the events
+ *
+ * Sends the response headers and hands the connection to the stream task as asynchronous request.
+ * Answers with 503 if STREAM_MAX_CLIENTS clients are already subscribed.
+ *
+ * @param req The request
+ *
+ * @return ESP_OK if the client was subscribed
+ */
+esp_err_t stream_subscribe(httpd_req_t *req);
+
+/**
+ * Session close callback of the server (httpd_config_t.close_fn), unsubscribes a client whose session is closed
+ *
+ * Closes the socket, like the server does without a close_fn.
+ *
+ * @param server The server
+ * @param sockfd The socket of the session
+ */
+void stream_close_session(httpd_handle_t server, int sockfd);
+
+/**
+ * Notifies the clients that sensors published new values, never blocks
+ *
+ * @param sensors Bit mask of the sensors, bit n is webserver_sensor_t n
+ */
+void stream_publish_samples(u_int32_t sensors);
+
+/**
+ * Notifies the clients of detected heart beats, never blocks
+ *
+ * @param beats Number of heart beats detected since the last call
+ */
+void stream_publish_heartbeats(u_int32_t beats);
+
+#endif
@@ -1,26 +1,127 @@
+#ifndef __WEBSERVER_H__
+#define __WEBSERVER_H__
+
+#include <stdatomic.h>
 #include "esp_http_server.h"
 
-struct webserver_sensor_data {
-    SemaphoreHandle_t semaphore;
+typedef enum webserver_sensor {
+    WEBSERVER_SENSOR_NONE = 0, // Tasks that don't read a sensor
+    WEBSERVER_SENSOR_AM2320,
+    WEBSERVER_SENSOR_TSL2561,
+    WEBSERVER_SENSOR_HEARTRATE,
+    WEBSERVER_SENSOR_HX710B,
+    WEBSERVER_SENSOR_COUNT
+} webserver_sensor_t;
+
+typedef struct webserver_sensor_status {
+    bool sampled;         // A value was published
+    int64_t timestamp_ms; // Unix time of the last published value, 0 if the clock wasn't synced
+    u_int32_t errors;     // Failed samples since the last successful one
+    esp_err_t last_error;
+    u_int32_t generation; // Number of published values, the ETag of the values of this sensor
+    int64_t uptime_ms;    // Time since boot of the last published value
+    u_int32_t interval_ms; // Time between the last two published values, the expected time until the next one
+} webserver_sensor_status_t;
+
+typedef struct webserver_sensor_values {
     float temperature;
     float humidity;
     u_int32_t illuminance;
     u_int8_t heartrate;
+    float heartrate_rmssd;
+    float heartrate_sdnn;
+    float pressure;
+    webserver_sensor_status_t status[WEBSERVER_SENSOR_COUNT];
+    u_int32_t generation; // Number of updates, the ETag of the whole snapshot
+} webserver_sensor_values_t;
+
+typedef struct webserver_config {
+    u_int16_t port;
+    u_int16_t max_open_sockets; // At most CONFIG_LWIP_MAX_SOCKETS - 3, the server uses 3 sockets itself
+    u_int16_t backlog;          // Connections the TCP stack accepts before the server task picked them up
+    bool lru_purge;             // Close the least recently used connection instead of refusing a new one
+    u_int16_t keep_alive_idle_s; // Idle time before TCP keep-alive probes are sent to detect dead clients, 0 disables them
+    size_t stack_size;
+    UBaseType_t priority;
+    BaseType_t core_id; // tskNO_AFFINITY to run on any core
+} webserver_config_t;
+
+struct webserver_sensor_data {
+    SemaphoreHandle_t semaphore; // Serializes the writers, readers never take it
+    atomic_uint sequence; // Odd while an update is in progress
+    u_int32_t sampled;    // Sensors marked as sampled during the current update, published to the stream clients when it ends
+    webserver_sensor_values_t values;
 } typedef webserver_sensor_data_t;
 
 /**
- * Starts the webserver on the specified port
- * 
- * @param port The port number to start the webserver on
+ * Starts an update of one or more values
+ *
+ * Takes the writer semaphore and marks the data as inconsistent for readers until webserver_sensor_data_end_update.
+ *
+ * @param webserver_sensor_data A pointer to the webserver sensor data struct
+ *
+ * @return true if the values may be written, false if the semaphore could not be taken
+ */
+bool webserver_sensor_data_begin_update(webserver_sensor_data_t *webserver_sensor_data);
+
+/**
+ * Finishes an update started with webserver_sensor_data_begin_update and releases the writer semaphore
+ *
+ * @param webserver_sensor_data A pointer to the webserver sensor data struct
+ */
+void webserver_sensor_data_end_update(webserver_sensor_data_t *webserver_sensor_data);
+
+/**
+ * Marks that a sensor published a new value, stamps it with the current time and advances its generation
+ *
+ * Must be called between webserver_sensor_data_begin_update and webserver_sensor_data_end_update.
+ *
  * @param webserver_sensor_data A pointer to the webserver sensor data struct
- * 
- * @return The handle to the started webserver
+ * @param sensor The sensor that was sampled
  */
-httpd_handle_t start_webserver(u_int16_t port, webserver_sensor_data_t *webserver_sensor_data);
+void webserver_sensor_data_mark_sampled(webserver_sensor_data_t *webserver_sensor_data, webserver_sensor_t sensor);
+
+/**
+ * Copies a consistent snapshot of the values without taking the semaphore
+ *
+ * Retries while a writer is updating the values, so it never returns a torn record.
+ *
+ * @param webserver_sensor_data A pointer to the webserver sensor data struct
+ * @param out_values Pointer for returning the snapshot
+ */
+void webserver_sensor_data_read(webserver_sensor_data_t *webserver_sensor_data, webserver_sensor_values_t *out_values);
+
+/**
+ * Encodes the values of one sensor as JSON object, e.g. {"sensor":"am2320","timestamp_ms":1700000000123,"values":{"temperature":21.5,"humidity":45.0}}
+ *
+ * The output is not terminated.
+ *
+ * @param sensor The sensor
+ * @param values The snapshot the values are taken from
+ * @param buffer Buffer for the JSON
+ * @param size Size of the buffer
+ *
+ * @return The length of the JSON, 0 if it doesn't fit into the buffer
+ */
+size_t webserver_encode_sensor_json(webserver_sensor_t sensor, const webserver_sensor_values_t *values, char *buffer, size_t size);
+
+/**
+ * Starts the webserver
+ *
+ * Every request is counted and timed per URI, the counters are exported on /metrics.
+ *
+ * @param config The server configuration
+ * @param webserver_sensor_data A pointer to the webserver sensor data struct
+ *
+ * @return The handle to the started webserver, NULL if it couldn't be started
+ */
+httpd_handle_t start_webserver(const webserver_config_t *config, webserver_sensor_data_t *webserver_sensor_data);
 
 /**
  * Stops the HTTP server
  *
  * @param server The handle of the HTTP server to stop
  */
-void stop_webserver(httpd_handle_t server);
\ No newline at end of file
+void stop_webserver(httpd_handle_t server);
+
+#endif
\ No newline at end of file
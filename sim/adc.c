@@ -0,0 +1,235 @@
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_timer.h"
+#include "sim.h"
+#include "internal.h"
+
+/*
+ * The ADC converts the millivolts of the simulated input, with the nominal 11 dB range of an uncalibrated ESP32.
+ * The continuous driver computes its frames when they are read: frame n holds the conversions of the sample times
+ * after the start that a DMA running at the sample rate would have written into it.
+ */
+
+#define MAX_CODE ((1 << SOC_ADC_DIGI_MAX_BITWIDTH) - 1)
+
+static const uint16_t full_scale_mv[] = {
+    [ADC_ATTEN_DB_0] = 950,
+    [ADC_ATTEN_DB_2_5] = 1250,
+    [ADC_ATTEN_DB_6] = 1750,
+    [ADC_ATTEN_DB_11] = 2450,
+};
+
+struct adc_continuous_ctx_t {
+    uint32_t frame_size;
+    uint32_t pool_frames;
+    uint32_t sample_freq_hz;
+    uint8_t channel;
+    uint8_t atten;
+    bool started;
+    int64_t start_time;
+    uint64_t next_frame; // Index of the next frame that is read
+    uint64_t dropped_frames;
+};
+
+struct adc_oneshot_unit_ctx_t {
+    adc_unit_t unit;
+    adc_atten_t atten[ADC_CHANNEL_9 + 1];
+};
+
+static pthread_mutex_t adc_lock = PTHREAD_MUTEX_INITIALIZER;
+static double (*input)(void *ctx, double time_s) = NULL;
+static void *input_ctx = NULL;
+static bool unpaced = false;
+
+void sim_adc_set_input(double (*new_input)(void *ctx, double time_s), void *ctx) {
+    pthread_mutex_lock(&adc_lock);
+    input = new_input;
+    input_ctx = ctx;
+    pthread_mutex_unlock(&adc_lock);
+}
+
+void sim_adc_set_unpaced(bool new_unpaced) {
+    pthread_mutex_lock(&adc_lock);
+    unpaced = new_unpaced;
+    pthread_mutex_unlock(&adc_lock);
+}
+
+// Must be called with adc_lock taken
+static uint16_t convert(uint8_t atten, double time_s) {
+    double mv = input != NULL ? input(input_ctx, time_s) : 0;
+    long code = lround(mv * MAX_CODE / full_scale_mv[atten]);
+    return code < 0 ? 0 : code > MAX_CODE ? MAX_CODE : code;
+}
+
+//---------Continuous---------//
+
+esp_err_t adc_continuous_new_handle(const adc_continuous_handle_cfg_t *hdl_config, adc_continuous_handle_t *ret_handle) {
+    if (hdl_config->conv_frame_size == 0 || hdl_config->conv_frame_size % SOC_ADC_DIGI_DATA_BYTES_PER_CONV != 0
+            || hdl_config->max_store_buf_size < hdl_config->conv_frame_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    adc_continuous_handle_t handle = calloc(1, sizeof(struct adc_continuous_ctx_t));
+    if (handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    handle->frame_size = hdl_config->conv_frame_size;
+    handle->pool_frames = hdl_config->max_store_buf_size / hdl_config->conv_frame_size;
+    *ret_handle = handle;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_config(adc_continuous_handle_t handle, const adc_continuous_config_t *config) {
+    if (handle->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config->pattern_num != 1 || config->format != ADC_DIGI_OUTPUT_FORMAT_TYPE1
+            || config->sample_freq_hz < SOC_ADC_SAMPLE_FREQ_THRES_LOW || config->sample_freq_hz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handle->sample_freq_hz = config->sample_freq_hz;
+    handle->channel = config->adc_pattern[0].channel;
+    handle->atten = config->adc_pattern[0].atten;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_start(adc_continuous_handle_t handle) {
+    pthread_mutex_lock(&adc_lock);
+    if (handle->started) {
+        pthread_mutex_unlock(&adc_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->started = true;
+    handle->start_time = esp_timer_get_time();
+    handle->next_frame = 0;
+    handle->dropped_frames = 0;
+    pthread_mutex_unlock(&adc_lock);
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_stop(adc_continuous_handle_t handle) {
+    pthread_mutex_lock(&adc_lock);
+    bool started = handle->started;
+    handle->started = false;
+    pthread_mutex_unlock(&adc_lock);
+    return started ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+static int64_t frame_end_time(adc_continuous_handle_t handle, uint64_t frame) {
+    uint64_t samples = (frame + 1) * (handle->frame_size / SOC_ADC_DIGI_RESULT_BYTES);
+    return handle->start_time + (int64_t) (samples * 1000000 / handle->sample_freq_hz);
+}
+
+esp_err_t adc_continuous_read(adc_continuous_handle_t handle, uint8_t *buf, uint32_t length_max, uint32_t *out_length, uint32_t timeout_ms) {
+    *out_length = 0;
+
+    pthread_mutex_lock(&adc_lock);
+    if (!handle->started) {
+        pthread_mutex_unlock(&adc_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (!unpaced) {
+        int64_t now = esp_timer_get_time();
+        int64_t ready = frame_end_time(handle, handle->next_frame);
+        if (ready > now) {
+            if (timeout_ms != ADC_MAX_DELAY && ready > now + (int64_t) timeout_ms * 1000) {
+                pthread_mutex_unlock(&adc_lock);
+                sim_sleep_until(now + (int64_t) timeout_ms * 1000);
+                return ESP_ERR_TIMEOUT;
+            }
+            pthread_mutex_unlock(&adc_lock);
+            sim_sleep_until(ready);
+            pthread_mutex_lock(&adc_lock);
+            now = esp_timer_get_time();
+        }
+
+        // Frames that didn't fit into the pool were dropped by the driver
+        uint64_t samples = (uint64_t) (now - handle->start_time) * handle->sample_freq_hz / 1000000;
+        uint64_t completed = samples / (handle->frame_size / SOC_ADC_DIGI_RESULT_BYTES);
+        if (completed > handle->next_frame + handle->pool_frames) {
+            handle->dropped_frames += completed - handle->next_frame - handle->pool_frames;
+            handle->next_frame = completed - handle->pool_frames;
+        }
+    }
+
+    uint32_t samples = handle->frame_size / SOC_ADC_DIGI_RESULT_BYTES;
+    uint32_t length = length_max < handle->frame_size ? length_max : handle->frame_size;
+    uint64_t first_sample = handle->next_frame * samples;
+    for (uint32_t i = 0; i * SOC_ADC_DIGI_RESULT_BYTES + 1 < length; i++) {
+        double time_s = handle->start_time / 1e6 + (double) (first_sample + i) / handle->sample_freq_hz;
+        adc_digi_output_data_t result = {
+            .type1.data = convert(handle->atten, time_s),
+            .type1.channel = handle->channel,
+        };
+        memcpy(&buf[i * SOC_ADC_DIGI_RESULT_BYTES], &result, SOC_ADC_DIGI_RESULT_BYTES);
+    }
+    handle->next_frame++;
+    pthread_mutex_unlock(&adc_lock);
+
+    *out_length = length;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_deinit(adc_continuous_handle_t handle) {
+    if (handle->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(handle);
+    return ESP_OK;
+}
+
+//---------Oneshot---------//
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t *init_config, adc_oneshot_unit_handle_t *ret_unit) {
+    adc_oneshot_unit_handle_t unit = calloc(1, sizeof(struct adc_oneshot_unit_ctx_t));
+    if (unit == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    unit->unit = init_config->unit_id;
+    *ret_unit = unit;
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t handle, adc_channel_t channel, const adc_oneshot_chan_cfg_t *config) {
+    if (channel < ADC_CHANNEL_0 || channel > ADC_CHANNEL_9) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handle->atten[channel] = config->atten;
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t handle, adc_channel_t chan, int *out_raw) {
+    if (chan < ADC_CHANNEL_0 || chan > ADC_CHANNEL_9) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&adc_lock);
+    *out_raw = convert(handle->atten[chan], esp_timer_get_time() / 1e6);
+    pthread_mutex_unlock(&adc_lock);
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_del_unit(adc_oneshot_unit_handle_t handle) {
+    free(handle);
+    return ESP_OK;
+}
+
+//---------Calibration---------//
+
+// The eFuses of the simulated chip have no calibration values
+esp_err_t adc_cali_create_scheme_line_fitting(const adc_cali_line_fitting_config_t *config, adc_cali_handle_t *ret_handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t adc_cali_delete_scheme_line_fitting(adc_cali_handle_t handle) {
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int *voltage) {
+    return ESP_ERR_INVALID_ARG;
+}
@@ -0,0 +1,167 @@
+#include <math.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "modbus_crc.h"
+#include "sim.h"
+
+/*
+ * The AM2320 sleeps between reads. The address byte that wakes it isn't acknowledged, it accepts a request
+ * 800 us after the wake-up and has the reply ready 1.5 ms after the request, earlier transfers are NACKed.
+ * It goes back to sleep after the reply was read or after 3 s without a request.
+ */
+
+#define AM2320_ADDR 0x5c
+#define MODBUS_READ 0x03
+#define WAKE_US 800
+#define MEASURE_US 1500
+#define IDLE_SLEEP_US 3000000
+#define REGISTER_COUNT 32
+#define MAX_READ_LEN 10
+
+#define MODEL 0x0320
+#define VERSION 0x01
+#define DEVICE_ID 0x53494d01
+
+static const char *TAG = "sim_am2320";
+
+typedef enum {
+    STATE_SLEEP,
+    STATE_AWAKE,     // Waiting for the request
+    STATE_MEASURING, // Request received, the reply is being prepared
+} state_t;
+
+typedef struct {
+    const sim_trace_t *trace;
+    state_t state;
+    int64_t ready_time;  // End of the wake-up or the measurement
+    int64_t active_time; // Last request, for the idle timeout
+    bool reading;
+    uint8_t request[3];
+    size_t request_len;
+    uint8_t reply[MAX_READ_LEN + 4];
+    size_t reply_len;
+    size_t reply_pos;
+} am2320_model_t;
+
+static am2320_model_t am2320;
+
+static void put_u16(uint8_t *registers, size_t reg, uint16_t value) {
+    registers[reg] = value >> 8;
+    registers[reg + 1] = value & 0xff;
+}
+
+static void build_reply(am2320_model_t *model, uint8_t reg, uint8_t len) {
+    double time_s = esp_timer_get_time() / 1e6;
+    double temperature = sim_trace_value(model->trace, 1, time_s);
+    double humidity = sim_trace_value(model->trace, 2, time_s);
+
+    uint8_t registers[REGISTER_COUNT] = {0};
+    put_u16(registers, 0x00, (uint16_t) lround(humidity * 10));
+    // Sign and magnitude in tenths of a degree
+    uint16_t magnitude = (uint16_t) lround(fabs(temperature) * 10) & 0x7fff;
+    put_u16(registers, 0x02, temperature < 0 ? 0x8000 | magnitude : magnitude);
+    put_u16(registers, 0x08, MODEL);
+    registers[0x0a] = VERSION;
+    put_u16(registers, 0x0b, DEVICE_ID >> 16);
+    put_u16(registers, 0x0d, DEVICE_ID & 0xffff);
+
+    model->reply[0] = MODBUS_READ;
+    model->reply[1] = len;
+    memcpy(&model->reply[2], &registers[reg], len);
+    uint16_t crc = modbus_crc16(model->reply, len + 2);
+    model->reply[len + 2] = crc & 0xff;
+    model->reply[len + 3] = crc >> 8;
+    model->reply_len = len + 4;
+    model->reply_pos = 0;
+}
+
+static bool am2320_start(void *ctx, bool read) {
+    am2320_model_t *model = ctx;
+    int64_t now = esp_timer_get_time();
+
+    if (model->state != STATE_SLEEP && now - model->active_time > IDLE_SLEEP_US) {
+        model->state = STATE_SLEEP;
+    }
+
+    switch (model->state) {
+        case STATE_SLEEP:
+            // The address wakes the sensor but isn't acknowledged
+            model->state = STATE_AWAKE;
+            model->ready_time = now + WAKE_US;
+            model->active_time = now;
+            return false;
+        case STATE_AWAKE:
+            if (read || now < model->ready_time) {
+                ESP_LOGD(TAG, "NACK, %s %lld us after the wake-up", read ? "read" : "request", (long long) (now - model->ready_time + WAKE_US));
+                return false;
+            }
+            model->reading = false;
+            model->request_len = 0;
+            return true;
+        case STATE_MEASURING:
+            if (!read || now < model->ready_time) {
+                ESP_LOGD(TAG, "NACK, %s %lld us after the request", read ? "read" : "request", (long long) (now - model->ready_time + MEASURE_US));
+                return false;
+            }
+            model->reading = true;
+            return true;
+    }
+    return false;
+}
+
+static bool am2320_write(void *ctx, uint8_t byte) {
+    am2320_model_t *model = ctx;
+    if (model->request_len == sizeof(model->request)) {
+        return false;
+    }
+    model->request[model->request_len++] = byte;
+    return true;
+}
+
+static uint8_t am2320_read(void *ctx) {
+    am2320_model_t *model = ctx;
+    return model->reply_pos < model->reply_len ? model->reply[model->reply_pos++] : 0xff;
+}
+
+static void am2320_stop(void *ctx) {
+    am2320_model_t *model = ctx;
+    int64_t now = esp_timer_get_time();
+
+    if (model->reading) {
+        // The reply was read, the sensor goes back to sleep
+        model->reading = false;
+        model->state = STATE_SLEEP;
+        return;
+    }
+    if (model->state != STATE_AWAKE || model->request_len == 0) {
+        return;
+    }
+
+    uint8_t reg = model->request[1];
+    uint8_t len = model->request[2];
+    if (model->request_len != sizeof(model->request) || model->request[0] != MODBUS_READ
+            || len == 0 || len > MAX_READ_LEN || reg + len > REGISTER_COUNT) {
+        ESP_LOGW(TAG, "Ignoring an invalid request");
+        model->request_len = 0;
+        return;
+    }
+    build_reply(model, reg, len);
+    model->state = STATE_MEASURING;
+    model->ready_time = now + MEASURE_US;
+    model->active_time = now;
+}
+
+static const sim_i2c_device_t am2320_device = {
+    .start = am2320_start,
+    .write = am2320_write,
+    .read = am2320_read,
+    .stop = am2320_stop,
+    .ctx = &am2320,
+};
+
+esp_err_t sim_am2320_attach(i2c_port_t port, const sim_trace_t *trace) {
+    am2320.trace = trace;
+    am2320.state = STATE_SLEEP;
+    return sim_i2c_attach(port, AM2320_ADDR, &am2320_device);
+}
@@ -0,0 +1,41 @@
+#include "esp_log.h"
+#include "sim.h"
+#include "config.h"
+#include "tsl2561.h"
+
+static const char *TAG = "sim";
+
+static sim_trace_t am2320_trace;
+static sim_trace_t tsl2561_trace;
+static sim_trace_t hx710b_trace;
+static sim_trace_t heartrate_trace;
+
+static double heartrate_input(void *ctx, double time_s) {
+    return sim_trace_value(ctx, 1, time_s);
+}
+
+esp_err_t sim_devices_init(void) {
+    const struct {
+        const char *name;
+        size_t columns;
+        sim_trace_t *trace;
+    } traces[] = {
+        { "am2320.csv", 3, &am2320_trace },
+        { "tsl2561.csv", 3, &tsl2561_trace },
+        { "hx710b.csv", 2, &hx710b_trace },
+        { "heartrate.csv", 2, &heartrate_trace },
+    };
+    for (size_t i = 0; i < sizeof(traces) / sizeof(traces[0]); i++) {
+        esp_err_t res = sim_trace_load(traces[i].name, traces[i].columns, traces[i].trace);
+        if (res != ESP_OK) {
+            ESP_LOGE(TAG, "Loading the trace %s failed: %s", traces[i].name, esp_err_to_name(res));
+            return res;
+        }
+    }
+
+    ESP_ERROR_CHECK(sim_am2320_attach(I2C_NUM_0, &am2320_trace));
+    ESP_ERROR_CHECK(sim_tsl2561_attach(I2C_NUM_0, TSL2561_I2C_ADDR_FLOAT, &tsl2561_trace));
+    ESP_ERROR_CHECK(sim_hx710b_attach(PRESSURE_SENSOR_SPI_HOST, PRESSURE_SENSOR_OUT_PIN, &hx710b_trace));
+    sim_adc_set_input(heartrate_input, &heartrate_trace);
+    return ESP_OK;
+}
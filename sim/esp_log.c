@@ -0,0 +1,40 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static int log_level = -1;
+
+static esp_log_level_t default_level(void) {
+    const char *env = getenv("SIM_LOG_LEVEL");
+    if (env != NULL && *env >= '0' && *env <= '5') {
+        return *env - '0';
+    }
+    return CONFIG_LOG_DEFAULT_LEVEL;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    __atomic_store_n(&log_level, level, __ATOMIC_RELAXED);
+}
+
+esp_log_level_t esp_log_level_get(const char *tag) {
+    int level = __atomic_load_n(&log_level, __ATOMIC_RELAXED);
+    if (level < 0) {
+        level = default_level();
+        __atomic_store_n(&log_level, level, __ATOMIC_RELAXED);
+    }
+    return level;
+}
+
+uint32_t esp_log_timestamp(void) {
+    return esp_timer_get_time() / 1000;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    // One call per line, stdio locks the stream so lines of different tasks don't interleave
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
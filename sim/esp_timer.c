@@ -0,0 +1,223 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "internal.h"
+
+static const char *TAG = "esp_timer";
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    bool skip_unhandled_events;
+    int64_t alarm_us;
+    uint64_t period_us; // 0 for one-shot timers
+    bool active;
+    struct esp_timer *next; // Armed timers, sorted by alarm
+};
+
+static struct timespec start_time;
+static pthread_mutex_t timers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timers_changed;
+static pthread_once_t dispatcher_once = PTHREAD_ONCE_INIT;
+static struct esp_timer *armed = NULL;
+
+// The boot of the simulated chip
+__attribute__((constructor)) static void capture_start_time(void) {
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+static void to_timespec(int64_t us, struct timespec *ts) {
+    int64_t ns = start_time.tv_nsec + (us % 1000000) * 1000;
+    ts->tv_sec = start_time.tv_sec + us / 1000000 + ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+int64_t esp_timer_get_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) (now.tv_sec - start_time.tv_sec) * 1000000 + (now.tv_nsec - start_time.tv_nsec) / 1000;
+}
+
+//---------Waiting---------//
+
+void sim_cond_init(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+int sim_cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t deadline_us) {
+    if (deadline_us == SIM_FOREVER) {
+        return pthread_cond_wait(cond, mutex);
+    }
+    struct timespec deadline;
+    to_timespec(deadline_us, &deadline);
+    return pthread_cond_timedwait(cond, mutex, &deadline);
+}
+
+void sim_sleep_until(int64_t deadline_us) {
+    struct timespec deadline;
+    to_timespec(deadline_us, &deadline);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+int64_t sim_ticks_deadline(TickType_t ticks) {
+    if (ticks == portMAX_DELAY) {
+        return SIM_FOREVER;
+    }
+    return (esp_timer_get_time() / SIM_TICK_US + ticks) * SIM_TICK_US;
+}
+
+//---------Dispatcher---------//
+
+// Must be called with timers_lock taken
+static void insert_armed(struct esp_timer *timer) {
+    struct esp_timer **link = &armed;
+    while (*link != NULL && (*link)->alarm_us <= timer->alarm_us) {
+        link = &(*link)->next;
+    }
+    timer->next = *link;
+    *link = timer;
+    timer->active = true;
+    pthread_cond_signal(&timers_changed);
+}
+
+// Must be called with timers_lock taken
+static void remove_armed(struct esp_timer *timer) {
+    for (struct esp_timer **link = &armed; *link != NULL; link = &(*link)->next) {
+        if (*link == timer) {
+            *link = timer->next;
+            break;
+        }
+    }
+    timer->next = NULL;
+    timer->active = false;
+}
+
+// Runs the callbacks one after the other, like the esp_timer task
+static void dispatcher_task(void *arg) {
+    pthread_mutex_lock(&timers_lock);
+    for (;;) {
+        if (armed == NULL) {
+            pthread_cond_wait(&timers_changed, &timers_lock);
+            continue;
+        }
+        struct esp_timer *timer = armed;
+        int64_t now = esp_timer_get_time();
+        if (timer->alarm_us > now) {
+            sim_cond_wait_until(&timers_changed, &timers_lock, timer->alarm_us);
+            continue;
+        }
+
+        remove_armed(timer);
+        if (timer->period_us > 0) {
+            timer->alarm_us += timer->period_us;
+            if (timer->skip_unhandled_events && timer->alarm_us <= now) {
+                timer->alarm_us = now + timer->period_us;
+            }
+            insert_armed(timer);
+        }
+        esp_timer_cb_t callback = timer->callback;
+        void *callback_arg = timer->arg;
+
+        pthread_mutex_unlock(&timers_lock);
+        callback(callback_arg);
+        pthread_mutex_lock(&timers_lock);
+    }
+}
+
+static void start_dispatcher(void) {
+    sim_cond_init(&timers_changed);
+    if (xTaskCreate(dispatcher_task, "esp_timer", 4096, NULL, configMAX_PRIORITIES - 1, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Starting the dispatcher failed");
+        abort();
+    }
+}
+
+//---------Timers---------//
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_once(&dispatcher_once, start_dispatcher);
+
+    struct esp_timer *timer = calloc(1, sizeof(struct esp_timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+    timer->skip_unhandled_events = create_args->skip_unhandled_events;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timers_lock);
+    if (timer->active) {
+        pthread_mutex_unlock(&timers_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->alarm_us = esp_timer_get_time() + timeout_us;
+    timer->period_us = period_us;
+    insert_armed(timer);
+    pthread_mutex_unlock(&timers_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timers_lock);
+    if (!timer->active) {
+        pthread_mutex_unlock(&timers_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    remove_armed(timer);
+    pthread_mutex_unlock(&timers_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timers_lock);
+    bool active = timer->active;
+    pthread_mutex_unlock(&timers_lock);
+    if (active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&timers_lock);
+    bool active = timer->active;
+    pthread_mutex_unlock(&timers_lock);
+    return active;
+}
@@ -0,0 +1,362 @@
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "internal.h"
+
+// The host needs more stack than the ESP32 for the same code, 64-bit pointers and the C library
+#define MIN_TASK_STACK_SIZE (512 * 1024)
+#define TASK_NAME_LEN 16
+
+static const char *TAG = "freertos";
+
+struct tskTaskControlBlock {
+    char name[TASK_NAME_LEN];
+    TaskFunction_t function;
+    void *parameters;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify_value;
+};
+
+struct sim_semaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t given;
+    UBaseType_t count;
+    UBaseType_t max_count;
+};
+
+struct QueueDefinition {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *items;
+};
+
+static __thread TaskHandle_t current_task = NULL;
+
+//---------Tasks---------//
+
+static TaskHandle_t new_task(const char *name, TaskFunction_t function, void *parameters) {
+    TaskHandle_t task = calloc(1, sizeof(struct tskTaskControlBlock));
+    if (task == NULL) {
+        return NULL;
+    }
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    task->function = function;
+    task->parameters = parameters;
+    pthread_mutex_init(&task->lock, NULL);
+    sim_cond_init(&task->notified);
+    return task;
+}
+
+static void *task_main(void *arg) {
+    current_task = (TaskHandle_t) arg;
+    pthread_setname_np(pthread_self(), current_task->name);
+    current_task->function(current_task->parameters);
+
+    // Returning from a task function is a bug in FreeRTOS
+    ESP_LOGE(TAG, "Task %s returned", current_task->name);
+    abort();
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameters, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id) {
+    TaskHandle_t task = new_task(name, function, parameters);
+    if (task == NULL) {
+        return pdFAIL;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, stack_depth > MIN_TASK_STACK_SIZE ? stack_depth : MIN_TASK_STACK_SIZE);
+    pthread_t thread;
+    int err = pthread_create(&thread, &attr, task_main, task);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        free(task);
+        return pdFAIL;
+    }
+
+    if (created_task != NULL) {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameters, UBaseType_t priority, TaskHandle_t *created_task) {
+    return xTaskCreatePinnedToCore(function, name, stack_depth, parameters, priority, created_task, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task != NULL && task != current_task) {
+        ESP_LOGE(TAG, "Only the calling task can be deleted");
+        abort();
+    }
+    // The handle stays valid, other tasks may still notify it
+    pthread_exit(NULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (current_task == NULL) {
+        char name[TASK_NAME_LEN] = "main";
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        current_task = new_task(name, NULL, NULL);
+    }
+    return current_task;
+}
+
+char *pcTaskGetName(TaskHandle_t task) {
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+//---------Ticks---------//
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t) (esp_timer_get_time() / SIM_TICK_US);
+}
+
+TickType_t xTaskGetTickCountFromISR(void) {
+    return xTaskGetTickCount();
+}
+
+void taskYIELD(void) {
+    sched_yield();
+}
+
+void vTaskDelay(const TickType_t ticks) {
+    if (ticks == 0) {
+        sched_yield();
+        return;
+    }
+    sim_sleep_until(sim_ticks_deadline(ticks));
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *previous_wake_time, const TickType_t time_increment) {
+    TickType_t now = xTaskGetTickCount();
+    TickType_t time_to_wake = *previous_wake_time + time_increment;
+    BaseType_t should_delay;
+
+    // Same overflow handling as FreeRTOS
+    if (now < *previous_wake_time) {
+        should_delay = time_to_wake < *previous_wake_time && time_to_wake > now;
+    } else {
+        should_delay = time_to_wake < *previous_wake_time || time_to_wake > now;
+    }
+    *previous_wake_time = time_to_wake;
+
+    if (should_delay) {
+        vTaskDelay(time_to_wake - now);
+    } else {
+        sched_yield();
+    }
+    return should_delay;
+}
+
+//---------Notifications---------//
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    int64_t deadline = sim_ticks_deadline(ticks_to_wait);
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify_value == 0 && ticks_to_wait > 0) {
+        if (sim_cond_wait_until(&task->notified, &task->lock, deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    uint32_t value = task->notify_value;
+    if (value > 0) {
+        task->notify_value = clear_count_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notify_value++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken) {
+    xTaskNotifyGive(task);
+    if (higher_priority_task_woken != NULL) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+}
+
+//---------Semaphores---------//
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    SemaphoreHandle_t semaphore = calloc(1, sizeof(struct sim_semaphore));
+    if (semaphore == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&semaphore->lock, NULL);
+    sim_cond_init(&semaphore->given);
+    semaphore->count = initial_count;
+    semaphore->max_count = max_count;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    pthread_mutex_destroy(&semaphore->lock);
+    pthread_cond_destroy(&semaphore->given);
+    free(semaphore);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+    int64_t deadline = sim_ticks_deadline(ticks_to_wait);
+
+    pthread_mutex_lock(&semaphore->lock);
+    while (semaphore->count == 0) {
+        if (ticks_to_wait == 0 || sim_cond_wait_until(&semaphore->given, &semaphore->lock, deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    BaseType_t taken = semaphore->count > 0;
+    if (taken) {
+        semaphore->count--;
+    }
+    pthread_mutex_unlock(&semaphore->lock);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    pthread_mutex_lock(&semaphore->lock);
+    BaseType_t given = semaphore->count < semaphore->max_count;
+    if (given) {
+        semaphore->count++;
+        pthread_cond_signal(&semaphore->given);
+    }
+    pthread_mutex_unlock(&semaphore->lock);
+    return given;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken) {
+    if (higher_priority_task_woken != NULL) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+    return xSemaphoreGive(semaphore);
+}
+
+//---------Queues---------//
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    QueueHandle_t queue = calloc(1, sizeof(struct QueueDefinition));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->items = malloc((size_t) length * item_size);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    sim_cond_init(&queue->not_empty);
+    sim_cond_init(&queue->not_full);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->items);
+    free(queue);
+}
+
+// Must be called with the queue locked and room for the item
+static void push_item(QueueHandle_t queue, const void *item) {
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->items[(size_t) tail * queue->item_size], item, queue->item_size);
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+    int64_t deadline = sim_ticks_deadline(ticks_to_wait);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (ticks_to_wait == 0 || sim_cond_wait_until(&queue->not_full, &queue->lock, deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    BaseType_t sent = queue->count < queue->length;
+    if (sent) {
+        push_item(queue, item);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return sent ? pdPASS : errQUEUE_FULL;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken) {
+    if (higher_priority_task_woken != NULL) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->length) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+    }
+    push_item(queue, item);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait) {
+    int64_t deadline = sim_ticks_deadline(ticks_to_wait);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (ticks_to_wait == 0 || sim_cond_wait_until(&queue->not_empty, &queue->lock, deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    BaseType_t received = queue->count > 0;
+    if (received) {
+        memcpy(buffer, &queue->items[(size_t) queue->head * queue->item_size], queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return received ? pdPASS : errQUEUE_EMPTY;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
@@ -0,0 +1,165 @@
+#include <pthread.h>
+#include "driver/gpio.h"
+#include "sim.h"
+
+typedef struct {
+    gpio_mode_t mode;
+    gpio_pull_mode_t pull;
+    gpio_int_type_t intr_type;
+    bool intr_enabled;
+    uint32_t level;
+    gpio_isr_t isr_handler;
+    void *isr_args;
+} pin_t;
+
+// Recursive, a handler may disable its own interrupt like hx710b.c does
+static pthread_mutex_t gpio_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static pin_t pins[GPIO_NUM_MAX];
+static bool isr_service_installed = false;
+
+#define CHECK_PIN(gpio_num) do { if ((gpio_num) < 0 || (gpio_num) >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG; } while (0)
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num) {
+    CHECK_PIN(gpio_num);
+    pthread_mutex_lock(&gpio_lock);
+    pins[gpio_num] = (pin_t) {
+        .mode = GPIO_MODE_INPUT,
+        .pull = GPIO_PULLUP_ONLY,
+        .level = 1,
+    };
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode) {
+    CHECK_PIN(gpio_num);
+    pthread_mutex_lock(&gpio_lock);
+    pins[gpio_num].mode = mode;
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull) {
+    CHECK_PIN(gpio_num);
+    pthread_mutex_lock(&gpio_lock);
+    pins[gpio_num].pull = pull;
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    CHECK_PIN(gpio_num);
+    pthread_mutex_lock(&gpio_lock);
+    if (pins[gpio_num].mode & GPIO_MODE_OUTPUT) {
+        pins[gpio_num].level = level ? 1 : 0;
+    }
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return 0;
+    }
+    pthread_mutex_lock(&gpio_lock);
+    int level = pins[gpio_num].level;
+    pthread_mutex_unlock(&gpio_lock);
+    return level;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    CHECK_PIN(gpio_num);
+    pthread_mutex_lock(&gpio_lock);
+    pins[gpio_num].intr_type = intr_type;
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num) {
+    CHECK_PIN(gpio_num);
+    pthread_mutex_lock(&gpio_lock);
+    pins[gpio_num].intr_enabled = true;
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num) {
+    CHECK_PIN(gpio_num);
+    pthread_mutex_lock(&gpio_lock);
+    pins[gpio_num].intr_enabled = false;
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    pthread_mutex_lock(&gpio_lock);
+    bool installed = isr_service_installed;
+    isr_service_installed = true;
+    pthread_mutex_unlock(&gpio_lock);
+    return installed ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+void gpio_uninstall_isr_service(void) {
+    pthread_mutex_lock(&gpio_lock);
+    isr_service_installed = false;
+    pthread_mutex_unlock(&gpio_lock);
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
+    CHECK_PIN(gpio_num);
+    pthread_mutex_lock(&gpio_lock);
+    if (!isr_service_installed) {
+        pthread_mutex_unlock(&gpio_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    pins[gpio_num].isr_handler = isr_handler;
+    pins[gpio_num].isr_args = args;
+    // Like ESP-IDF, adding the handler enables the interrupt
+    pins[gpio_num].intr_enabled = true;
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num) {
+    CHECK_PIN(gpio_num);
+    pthread_mutex_lock(&gpio_lock);
+    pins[gpio_num].isr_handler = NULL;
+    pins[gpio_num].isr_args = NULL;
+    pins[gpio_num].intr_enabled = false;
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+static bool triggers(gpio_int_type_t intr_type, uint32_t previous, uint32_t level) {
+    switch (intr_type) {
+        case GPIO_INTR_POSEDGE:
+            return previous == 0 && level == 1;
+        case GPIO_INTR_NEGEDGE:
+            return previous == 1 && level == 0;
+        case GPIO_INTR_ANYEDGE:
+            return previous != level;
+        case GPIO_INTR_LOW_LEVEL:
+            return level == 0;
+        case GPIO_INTR_HIGH_LEVEL:
+            return level == 1;
+        default:
+            return false;
+    }
+}
+
+void sim_gpio_drive(gpio_num_t gpio_num, uint32_t level) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return;
+    }
+    level = level ? 1 : 0;
+
+    // The handler runs with the GPIO lock held, like an ISR it can't be preempted by another one
+    pthread_mutex_lock(&gpio_lock);
+    pin_t *pin = &pins[gpio_num];
+    uint32_t previous = pin->level;
+    pin->level = level;
+    if (isr_service_installed && pin->intr_enabled && pin->isr_handler != NULL && triggers(pin->intr_type, previous, level)) {
+        pin->isr_handler(pin->isr_args);
+    }
+    pthread_mutex_unlock(&gpio_lock);
+}
@@ -0,0 +1,269 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "esp_http_client.h"
+#include "esp_log.h"
+
+#define DEFAULT_TIMEOUT_MS 5000
+#define MAX_HEADERS 8
+#define HOST_SIZE 64
+#define PATH_SIZE 256
+#define REQUEST_HEADER_SIZE 1024
+#define RESPONSE_BUFFER_SIZE 1024
+
+static const char *TAG = "http_client";
+
+typedef struct {
+    char *key;
+    char *value;
+} client_header_t;
+
+struct esp_http_client {
+    char host[HOST_SIZE];
+    char port[8];
+    char path[PATH_SIZE];
+    esp_http_client_method_t method;
+    int timeout_ms;
+    client_header_t headers[MAX_HEADERS];
+    size_t header_count;
+    const char *post_data;
+    int post_len;
+    int status_code;
+    int64_t content_length;
+};
+
+static const char *method_names[HTTP_METHOD_MAX] = {
+    [HTTP_METHOD_GET] = "GET",
+    [HTTP_METHOD_POST] = "POST",
+    [HTTP_METHOD_PUT] = "PUT",
+    [HTTP_METHOD_PATCH] = "PATCH",
+    [HTTP_METHOD_DELETE] = "DELETE",
+    [HTTP_METHOD_HEAD] = "HEAD",
+};
+
+// Splits http://host[:port][/path]
+static bool parse_url(struct esp_http_client *client, const char *url) {
+    if (strncmp(url, "http://", 7) != 0) {
+        ESP_LOGE(TAG, "Only http:// URLs are supported: %s", url);
+        return false;
+    }
+    const char *host = url + 7;
+    const char *path = strchr(host, '/');
+    if (path == NULL) {
+        path = "/";
+    }
+    size_t authority_len = strcspn(host, "/");
+    const char *colon = memchr(host, ':', authority_len);
+    size_t host_len = colon != NULL ? (size_t) (colon - host) : authority_len;
+    if (host_len == 0 || host_len >= sizeof(client->host) || strlen(path) >= sizeof(client->path)) {
+        return false;
+    }
+    memcpy(client->host, host, host_len);
+    client->host[host_len] = '\0';
+    if (colon != NULL) {
+        size_t port_len = authority_len - host_len - 1;
+        if (port_len == 0 || port_len >= sizeof(client->port)) {
+            return false;
+        }
+        memcpy(client->port, colon + 1, port_len);
+        client->port[port_len] = '\0';
+    } else {
+        strcpy(client->port, "80");
+    }
+    strcpy(client->path, path);
+    return true;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+    struct esp_http_client *client = calloc(1, sizeof(struct esp_http_client));
+    if (client == NULL) {
+        return NULL;
+    }
+    if (config->url != NULL) {
+        if (!parse_url(client, config->url)) {
+            free(client);
+            return NULL;
+        }
+    } else {
+        snprintf(client->host, sizeof(client->host), "%s", config->host != NULL ? config->host : "localhost");
+        snprintf(client->port, sizeof(client->port), "%d", config->port != 0 ? config->port : 80);
+        snprintf(client->path, sizeof(client->path), "%s%s%s", config->path != NULL ? config->path : "/",
+                 config->query != NULL ? "?" : "", config->query != NULL ? config->query : "");
+    }
+    client->method = config->method;
+    client->timeout_ms = config->timeout_ms > 0 ? config->timeout_ms : DEFAULT_TIMEOUT_MS;
+    client->status_code = -1;
+    client->content_length = -1;
+    return client;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
+    if (client == NULL || key == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < client->header_count; i++) {
+        if (strcasecmp(client->headers[i].key, key) == 0) {
+            char *copy = strdup(value);
+            if (copy == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            free(client->headers[i].value);
+            client->headers[i].value = copy;
+            return ESP_OK;
+        }
+    }
+    if (client->header_count == MAX_HEADERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    client_header_t *header = &client->headers[client->header_count];
+    header->key = strdup(key);
+    header->value = strdup(value);
+    if (header->key == NULL || header->value == NULL) {
+        free(header->key);
+        free(header->value);
+        return ESP_ERR_NO_MEM;
+    }
+    client->header_count++;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method) {
+    if (client == NULL || method >= HTTP_METHOD_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    client->method = method;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len) {
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    client->post_data = data;
+    client->post_len = data != NULL ? len : 0;
+    return ESP_OK;
+}
+
+static int connect_to(esp_http_client_handle_t client) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *addrs;
+    if (getaddrinfo(client->host, client->port, &hints, &addrs) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *addr = addrs; addr != NULL && fd < 0; addr = addr->ai_next) {
+        fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        struct timeval timeout = { .tv_sec = client->timeout_ms / 1000, .tv_usec = (client->timeout_ms % 1000) * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (connect(fd, addr->ai_addr, addr->ai_addrlen) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+    return fd;
+}
+
+static bool send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = send(fd, data, len, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client) {
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int fd = connect_to(client);
+    if (fd < 0) {
+        return ESP_ERR_HTTP_CONNECT;
+    }
+
+    char header[REQUEST_HEADER_SIZE];
+    int len = snprintf(header, sizeof(header), "%s %s HTTP/1.1\r\nHost: %s:%s\r\nConnection: close\r\n",
+                       method_names[client->method], client->path, client->host, client->port);
+    for (size_t i = 0; i < client->header_count && len < (int) sizeof(header); i++) {
+        len += snprintf(header + len, sizeof(header) - len, "%s: %s\r\n", client->headers[i].key, client->headers[i].value);
+    }
+    if (len < (int) sizeof(header) && (client->post_len > 0 || client->method == HTTP_METHOD_POST)) {
+        len += snprintf(header + len, sizeof(header) - len, "Content-Length: %d\r\n", client->post_len);
+    }
+    if (len < (int) sizeof(header)) {
+        len += snprintf(header + len, sizeof(header) - len, "\r\n");
+    }
+    if (len >= (int) sizeof(header)) {
+        close(fd);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (!send_all(fd, header, len) || (client->post_len > 0 && !send_all(fd, client->post_data, client->post_len))) {
+        close(fd);
+        return ESP_ERR_HTTP_WRITE_DATA;
+    }
+
+    // Status line and headers, the body is discarded
+    char response[RESPONSE_BUFFER_SIZE];
+    size_t received = 0;
+    char *header_end = NULL;
+    while (header_end == NULL && received < sizeof(response) - 1) {
+        ssize_t n = recv(fd, response + received, sizeof(response) - 1 - received, 0);
+        if (n <= 0) {
+            close(fd);
+            return n == 0 ? ESP_ERR_HTTP_CONNECTION_CLOSED : ESP_ERR_HTTP_FETCH_HEADER;
+        }
+        received += n;
+        response[received] = '\0';
+        header_end = strstr(response, "\r\n\r\n");
+    }
+    int status;
+    if (header_end == NULL || sscanf(response, "HTTP/1.%*d %d", &status) != 1) {
+        close(fd);
+        return ESP_ERR_HTTP_FETCH_HEADER;
+    }
+    client->status_code = status;
+    *header_end = '\0';
+    const char *length = strcasestr(response, "\r\nContent-Length:");
+    client->content_length = length != NULL ? strtoll(length + 17, NULL, 10) : -1;
+
+    while (recv(fd, response, sizeof(response), 0) > 0) {
+    }
+    close(fd);
+    return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+    return client->status_code;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client) {
+    return client->content_length;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < client->header_count; i++) {
+        free(client->headers[i].key);
+        free(client->headers[i].value);
+    }
+    free(client);
+    return ESP_OK;
+}
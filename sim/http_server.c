@@ -0,0 +1,865 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "freertos/semphr.h"
+
+/*
+ * All sessions are served by the server task, like in ESP-IDF. Other tasks only talk to it through the control pipe
+ * (async requests that completed, sessions to close, stop), so handlers and close_fn never run concurrently.
+ */
+
+#define REQUEST_LINE_EXTRA 32 // Method, version and separators around the URI
+#define SESSION_BUFFER_SIZE (HTTPD_MAX_URI_LEN + REQUEST_LINE_EXTRA + HTTPD_MAX_REQ_HDR_LEN + 4)
+#define UNPRIVILEGED_PORT_OFFSET 8000
+#define HEADER_BUFFER_SIZE 128
+#define DISCARD_BUFFER_SIZE 256
+
+static const char *TAG = "httpd";
+
+typedef enum {
+    CONTROL_COMPLETE,
+    CONTROL_CLOSE,
+    CONTROL_STOP,
+} control_type_t;
+
+typedef struct {
+    control_type_t type;
+    int fd;
+    int session;
+    uint32_t generation;
+} control_t;
+
+typedef struct {
+    int fd; // -1 if the slot is free
+    uint32_t generation;
+    uint64_t lru;
+    bool busy; // Handed over to an async request
+    bool closing;
+    char buffer[SESSION_BUFFER_SIZE];
+    size_t len;
+} session_t;
+
+typedef struct {
+    const char *field;
+    const char *value;
+} resp_header_t;
+
+struct httpd_data;
+
+// req->aux, the state of one request and its response
+typedef struct {
+    struct httpd_data *server;
+    int session;
+    uint32_t generation;
+    int fd;
+    char *headers; // The header lines of the request, owned if the request is async
+    size_t headers_len;
+    const char *body; // Bytes of the body that were received with the headers
+    size_t body_len;
+    size_t content_remaining;
+    bool close_after;
+    const char *status;
+    const char *content_type;
+    resp_header_t *resp_headers;
+    size_t resp_header_count;
+    bool headers_sent;
+    bool finished;
+    bool send_failed;
+} req_aux_t;
+
+typedef struct httpd_data {
+    httpd_config_t config;
+    int listen_fd;
+    int control[2];
+    uint16_t port;
+    session_t *sessions;
+    httpd_uri_t *handlers;
+    size_t handler_count;
+    uint64_t lru_counter;
+    SemaphoreHandle_t stopped;
+} httpd_data_t;
+
+//---------Sockets---------//
+
+static esp_err_t send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = send(fd, data, len, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        data += written;
+        len -= written;
+    }
+    return ESP_OK;
+}
+
+static void set_timeout(int fd, int option, uint16_t seconds) {
+    struct timeval timeout = { .tv_sec = seconds };
+    setsockopt(fd, SOL_SOCKET, option, &timeout, sizeof(timeout));
+}
+
+static void send_control(httpd_data_t *server, const control_t *control) {
+    while (write(server->control[1], control, sizeof(*control)) < 0 && errno == EINTR) {
+    }
+}
+
+//---------Sessions---------//
+
+static void close_session(httpd_data_t *server, session_t *session) {
+    if (server->config.close_fn != NULL) {
+        server->config.close_fn(server, session->fd);
+    } else {
+        close(session->fd);
+    }
+    session->fd = -1;
+    session->busy = false;
+    session->closing = false;
+    session->len = 0;
+    session->generation++;
+}
+
+static session_t *find_session(httpd_data_t *server, int fd) {
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd == fd) {
+            return &server->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static session_t *lru_session(httpd_data_t *server) {
+    session_t *lru = NULL;
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        session_t *session = &server->sessions[i];
+        if (session->fd >= 0 && (lru == NULL || session->lru < lru->lru)) {
+            lru = session;
+        }
+    }
+    return lru;
+}
+
+static void accept_session(httpd_data_t *server) {
+    session_t *free_session = find_session(server, -1);
+    if (free_session == NULL) {
+        session_t *lru = lru_session(server);
+        ESP_LOGW(TAG, "Closing the least recently used session %d", lru->fd);
+        close_session(server, lru);
+        free_session = lru;
+    }
+
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        ESP_LOGW(TAG, "accept failed: %s", strerror(errno));
+        return;
+    }
+    set_timeout(fd, SO_RCVTIMEO, server->config.recv_wait_timeout);
+    set_timeout(fd, SO_SNDTIMEO, server->config.send_wait_timeout);
+    if (server->config.keep_alive_enable) {
+        int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &server->config.keep_alive_idle, sizeof(int));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &server->config.keep_alive_interval, sizeof(int));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &server->config.keep_alive_count, sizeof(int));
+    }
+
+    free_session->fd = fd;
+    free_session->len = 0;
+    free_session->busy = false;
+    free_session->lru = ++server->lru_counter;
+    if (server->config.open_fn != NULL && server->config.open_fn(server, fd) != ESP_OK) {
+        close_session(server, free_session);
+    }
+}
+
+//---------Requests---------//
+
+static int parse_method(const char *method, size_t len) {
+    static const struct {
+        const char *name;
+        int method;
+    } methods[] = {
+        { "DELETE", HTTP_DELETE }, { "GET", HTTP_GET }, { "HEAD", HTTP_HEAD }, { "POST", HTTP_POST },
+        { "PUT", HTTP_PUT }, { "OPTIONS", HTTP_OPTIONS }, { "PATCH", HTTP_PATCH },
+    };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (strlen(methods[i].name) == len && strncmp(methods[i].name, method, len) == 0) {
+            return methods[i].method;
+        }
+    }
+    return -1;
+}
+
+static const char *find_header(const char *headers, size_t headers_len, const char *field, size_t *value_len) {
+    size_t field_len = strlen(field);
+    const char *line = headers;
+    const char *end = headers + headers_len;
+
+    while (line < end) {
+        const char *line_end = memchr(line, '\n', end - line);
+        if (line_end == NULL) {
+            line_end = end;
+        }
+        const char *colon = memchr(line, ':', line_end - line);
+        if (colon != NULL && (size_t) (colon - line) == field_len && strncasecmp(line, field, field_len) == 0) {
+            const char *value = colon + 1;
+            while (value < line_end && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            const char *value_end = line_end;
+            while (value_end > value && isspace((unsigned char) value_end[-1])) {
+                value_end--;
+            }
+            *value_len = value_end - value;
+            return value;
+        }
+        line = line_end + 1;
+    }
+    return NULL;
+}
+
+static const httpd_uri_t *find_handler(httpd_data_t *server, const char *path, size_t path_len, int method, bool *path_found) {
+    *path_found = false;
+    for (size_t i = 0; i < server->handler_count; i++) {
+        const httpd_uri_t *handler = &server->handlers[i];
+        if (strlen(handler->uri) != path_len || strncmp(handler->uri, path, path_len) != 0) {
+            continue;
+        }
+        *path_found = true;
+        if ((int) handler->method == method || (int) handler->method == HTTP_ANY) {
+            return handler;
+        }
+    }
+    return NULL;
+}
+
+// Sends an error for a request that couldn't be parsed, the session is closed afterwards
+static void send_parse_error(httpd_data_t *server, session_t *session, httpd_err_code_t error) {
+    httpd_req_t req = { .handle = server };
+    req_aux_t aux = { .server = server, .fd = session->fd, .status = HTTPD_200, .content_type = HTTPD_TYPE_TEXT };
+    req.aux = &aux;
+    httpd_resp_send_err(&req, error, NULL);
+}
+
+/**
+ * Serves the request at the start of the session buffer
+ *
+ * @return The bytes of the buffer the request used, 0 if it is incomplete, -1 if the session has to be closed
+ */
+static ssize_t serve_request(httpd_data_t *server, session_t *session) {
+    char *buffer = session->buffer;
+    char *header_end = memmem(buffer, session->len, "\r\n\r\n", 4);
+    char *line_end = memmem(buffer, session->len, "\r\n", 2);
+
+    if (line_end == NULL && session->len > HTTPD_MAX_URI_LEN + REQUEST_LINE_EXTRA) {
+        send_parse_error(server, session, HTTPD_414_URI_TOO_LONG);
+        return -1;
+    }
+    if (header_end == NULL) {
+        if (session->len == sizeof(session->buffer)) {
+            send_parse_error(server, session, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE);
+            return -1;
+        }
+        return 0;
+    }
+
+    // Request line: METHOD SP URI SP VERSION
+    char *method_end = memchr(buffer, ' ', line_end - buffer);
+    char *uri = method_end != NULL ? method_end + 1 : NULL;
+    char *uri_end = uri != NULL ? memchr(uri, ' ', line_end - uri) : NULL;
+    if (uri_end == NULL || strncmp(uri_end + 1, "HTTP/1.", 7) != 0) {
+        send_parse_error(server, session, HTTPD_400_BAD_REQUEST);
+        return -1;
+    }
+    if (uri_end - uri > HTTPD_MAX_URI_LEN) {
+        send_parse_error(server, session, HTTPD_414_URI_TOO_LONG);
+        return -1;
+    }
+    char *headers = line_end + 2;
+    size_t headers_len = header_end + 2 - headers;
+    if (headers_len > HTTPD_MAX_REQ_HDR_LEN) {
+        send_parse_error(server, session, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE);
+        return -1;
+    }
+    int method = parse_method(buffer, method_end - buffer);
+
+    size_t content_len = 0;
+    size_t value_len;
+    const char *value = find_header(headers, headers_len, "Content-Length", &value_len);
+    if (value != NULL) {
+        content_len = strtoul(value, NULL, 10);
+    }
+    const char *connection = find_header(headers, headers_len, "Connection", &value_len);
+    bool close_after = connection != NULL && value_len == 5 && strncasecmp(connection, "close", 5) == 0;
+    if (strncmp(uri_end + 1, "HTTP/1.0", 8) == 0 && (connection == NULL || strncasecmp(connection, "keep-alive", value_len) != 0)) {
+        close_after = true;
+    }
+
+    size_t used = header_end + 4 - buffer;
+    size_t body_len = session->len - used < content_len ? session->len - used : content_len;
+
+    httpd_req_t req = {
+        .handle = server,
+        .method = method,
+        .content_len = content_len,
+    };
+    memcpy((char *) req.uri, uri, uri_end - uri);
+    ((char *) req.uri)[uri_end - uri] = '\0';
+
+    resp_header_t resp_headers[server->config.max_resp_headers > 0 ? server->config.max_resp_headers : 1];
+    req_aux_t aux = {
+        .server = server,
+        .session = session - server->sessions,
+        .generation = session->generation,
+        .fd = session->fd,
+        .headers = headers,
+        .headers_len = headers_len,
+        .body = buffer + used,
+        .body_len = body_len,
+        .content_remaining = content_len,
+        .close_after = close_after,
+        .status = HTTPD_200,
+        .content_type = HTTPD_TYPE_TEXT,
+        .resp_headers = resp_headers,
+    };
+    req.aux = &aux;
+
+    const char *query = memchr(req.uri, '?', uri_end - uri);
+    size_t path_len = query != NULL ? (size_t) (query - req.uri) : strlen(req.uri);
+    bool path_found;
+    const httpd_uri_t *handler = find_handler(server, req.uri, path_len, method, &path_found);
+    session->lru = ++server->lru_counter;
+
+    esp_err_t ret;
+    if (handler == NULL) {
+        httpd_resp_send_err(&req, path_found ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, NULL);
+        ret = ESP_FAIL;
+    } else {
+        req.user_ctx = handler->user_ctx;
+        ret = handler->handler(&req);
+    }
+
+    if (ret != ESP_OK || aux.send_failed || aux.close_after) {
+        return -1;
+    }
+    if (session->busy) {
+        // The async request owns the session until it completes, the body it didn't read stays in the buffer
+        return used + (body_len - (aux.body_len < body_len ? aux.body_len : body_len));
+    }
+
+    // The body that the handler didn't read is discarded
+    size_t consumed = used + body_len;
+    size_t remaining = aux.content_remaining - aux.body_len;
+    char discard[DISCARD_BUFFER_SIZE];
+    while (remaining > 0) {
+        ssize_t n = recv(session->fd, discard, remaining < sizeof(discard) ? remaining : sizeof(discard), 0);
+        if (n <= 0) {
+            return -1;
+        }
+        remaining -= n;
+    }
+    return consumed;
+}
+
+static void serve_session(httpd_data_t *server, session_t *session) {
+    ssize_t n = recv(session->fd, session->buffer + session->len, sizeof(session->buffer) - session->len, 0);
+    if (n <= 0) {
+        close_session(server, session);
+        return;
+    }
+    session->len += n;
+
+    // Pipelined requests are served one after the other
+    while (session->fd >= 0 && !session->busy && session->len > 0) {
+        ssize_t used = serve_request(server, session);
+        if (used < 0) {
+            close_session(server, session);
+            return;
+        }
+        if (used == 0) {
+            return;
+        }
+        memmove(session->buffer, session->buffer + used, session->len - used);
+        session->len -= used;
+    }
+}
+
+static void handle_control(httpd_data_t *server, const control_t *control, bool *stop) {
+    session_t *session;
+    switch (control->type) {
+        case CONTROL_COMPLETE:
+            session = &server->sessions[control->session];
+            if (session->fd >= 0 && session->generation == control->generation) {
+                session->busy = false;
+                session->lru = ++server->lru_counter;
+            }
+            break;
+        case CONTROL_CLOSE:
+            session = find_session(server, control->fd);
+            if (session != NULL) {
+                close_session(server, session);
+            }
+            break;
+        case CONTROL_STOP:
+            *stop = true;
+            break;
+    }
+}
+
+static void server_task(void *arg) {
+    httpd_data_t *server = arg;
+    bool stop = false;
+
+    while (!stop) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(server->listen_fd, &readable);
+        FD_SET(server->control[0], &readable);
+        int max_fd = server->listen_fd > server->control[0] ? server->listen_fd : server->control[0];
+        bool full = true;
+        for (int i = 0; i < server->config.max_open_sockets; i++) {
+            session_t *session = &server->sessions[i];
+            if (session->fd < 0) {
+                full = false;
+            } else if (!session->busy) {
+                FD_SET(session->fd, &readable);
+                max_fd = session->fd > max_fd ? session->fd : max_fd;
+            }
+        }
+        // Without the purge, new connections wait in the backlog until a session is closed
+        if (full && !server->config.lru_purge_enable) {
+            FD_CLR(server->listen_fd, &readable);
+        }
+
+        if (select(max_fd + 1, &readable, NULL, NULL, NULL) < 0) {
+            if (errno != EINTR) {
+                ESP_LOGE(TAG, "select failed: %s", strerror(errno));
+            }
+            continue;
+        }
+
+        if (FD_ISSET(server->control[0], &readable)) {
+            control_t control;
+            while (read(server->control[0], &control, sizeof(control)) == sizeof(control)) {
+                handle_control(server, &control, &stop);
+            }
+        }
+        for (int i = 0; i < server->config.max_open_sockets && !stop; i++) {
+            session_t *session = &server->sessions[i];
+            if (session->fd >= 0 && !session->busy && FD_ISSET(session->fd, &readable)) {
+                serve_session(server, session);
+            }
+        }
+        if (!stop && FD_ISSET(server->listen_fd, &readable)) {
+            accept_session(server);
+        }
+    }
+
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd >= 0) {
+            close_session(server, &server->sessions[i]);
+        }
+    }
+    xSemaphoreGive(server->stopped);
+    vTaskDelete(NULL);
+}
+
+//---------Server---------//
+
+static uint16_t host_port(uint16_t port) {
+    const char *env = getenv("SIM_HTTP_PORT");
+    if (env != NULL) {
+        return atoi(env);
+    }
+    // Ports below 1024 need privileges on the host
+    return port < 1024 ? port + UNPRIVILEGED_PORT_OFFSET : port;
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    if (handle == NULL || config == NULL || config->max_open_sockets == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_data_t *server = calloc(1, sizeof(httpd_data_t));
+    if (server == NULL) {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    server->config = *config;
+    server->port = host_port(config->server_port);
+    server->sessions = calloc(config->max_open_sockets, sizeof(session_t));
+    server->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    server->stopped = xSemaphoreCreateBinary();
+    if (server->sessions == NULL || server->handlers == NULL || server->stopped == NULL) {
+        free(server->sessions);
+        free(server->handlers);
+        free(server);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    for (int i = 0; i < config->max_open_sockets; i++) {
+        server->sessions[i].fd = -1;
+    }
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(server->port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(server->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(server->listen_fd, config->backlog_conn) < 0) {
+        ESP_LOGE(TAG, "Listening on port %d failed: %s", server->port, strerror(errno));
+        close(server->listen_fd);
+        free(server->sessions);
+        free(server->handlers);
+        free(server);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    if (pipe(server->control) < 0) {
+        close(server->listen_fd);
+        free(server->sessions);
+        free(server->handlers);
+        free(server);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    fcntl(server->control[0], F_SETFL, O_NONBLOCK);
+
+    if (xTaskCreatePinnedToCore(server_task, "httpd", config->stack_size, server, config->task_priority, NULL, config->core_id) != pdPASS) {
+        return ESP_ERR_HTTPD_TASK;
+    }
+    ESP_LOGI(TAG, "Listening on http://localhost:%d", server->port);
+    *handle = server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    httpd_data_t *server = handle;
+    if (server == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    control_t control = { .type = CONTROL_STOP };
+    send_control(server, &control);
+    xSemaphoreTake(server->stopped, portMAX_DELAY);
+
+    close(server->listen_fd);
+    close(server->control[0]);
+    close(server->control[1]);
+    vSemaphoreDelete(server->stopped);
+    free(server->sessions);
+    free(server->handlers);
+    free(server);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    httpd_data_t *server = handle;
+    if (server == NULL || uri_handler == NULL || uri_handler->uri == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < server->handler_count; i++) {
+        if (strcmp(server->handlers[i].uri, uri_handler->uri) == 0 && server->handlers[i].method == uri_handler->method) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (server->handler_count == server->config.max_uri_handlers) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    server->handlers[server->handler_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+//---------Responses---------//
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+    ((req_aux_t *) r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    ((req_aux_t *) r->aux)->content_type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+    req_aux_t *aux = r->aux;
+    if (aux->resp_header_count == aux->server->config.max_resp_headers) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    aux->resp_headers[aux->resp_header_count++] = (resp_header_t) { field, value };
+    return ESP_OK;
+}
+
+static esp_err_t send_headers(req_aux_t *aux, const char *length_header) {
+    char header[HEADER_BUFFER_SIZE];
+    int len = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s", aux->status, aux->content_type, length_header);
+    esp_err_t err = send_all(aux->fd, header, len);
+    for (size_t i = 0; i < aux->resp_header_count && err == ESP_OK; i++) {
+        const resp_header_t *h = &aux->resp_headers[i];
+        err = send_all(aux->fd, h->field, strlen(h->field));
+        if (err == ESP_OK) {
+            err = send_all(aux->fd, ": ", 2);
+        }
+        if (err == ESP_OK) {
+            err = send_all(aux->fd, h->value, strlen(h->value));
+        }
+        if (err == ESP_OK) {
+            err = send_all(aux->fd, "\r\n", 2);
+        }
+    }
+    if (err == ESP_OK && aux->close_after) {
+        err = send_all(aux->fd, "Connection: close\r\n", 19);
+    }
+    if (err == ESP_OK) {
+        err = send_all(aux->fd, "\r\n", 2);
+    }
+    aux->headers_sent = true;
+    return err;
+}
+
+static esp_err_t check_send(req_aux_t *aux, esp_err_t err) {
+    if (err != ESP_OK) {
+        aux->send_failed = true;
+    }
+    return err;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    req_aux_t *aux = r->aux;
+    if (aux->headers_sent) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf != NULL ? strlen(buf) : 0;
+    }
+    char length_header[48];
+    snprintf(length_header, sizeof(length_header), "Content-Length: %zd\r\n", buf_len);
+    esp_err_t err = send_headers(aux, length_header);
+    if (err == ESP_OK && buf_len > 0) {
+        err = send_all(aux->fd, buf, buf_len);
+    }
+    aux->finished = true;
+    return check_send(aux, err);
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    req_aux_t *aux = r->aux;
+    esp_err_t err = ESP_OK;
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf != NULL ? strlen(buf) : 0;
+    }
+    if (!aux->headers_sent) {
+        err = send_headers(aux, "Transfer-Encoding: chunked\r\n");
+    }
+    if (err == ESP_OK && (buf == NULL || buf_len == 0)) {
+        err = send_all(aux->fd, "0\r\n\r\n", 5);
+        aux->finished = true;
+    } else if (err == ESP_OK) {
+        char size[16];
+        int len = snprintf(size, sizeof(size), "%zx\r\n", buf_len);
+        err = send_all(aux->fd, size, len);
+        if (err == ESP_OK) {
+            err = send_all(aux->fd, buf, buf_len);
+        }
+        if (err == ESP_OK) {
+            err = send_all(aux->fd, "\r\n", 2);
+        }
+    }
+    return check_send(aux, err);
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+    static const struct {
+        const char *status;
+        const char *msg;
+    } errors[HTTPD_ERR_CODE_MAX] = {
+        [HTTPD_500_INTERNAL_SERVER_ERROR] = { "500 Internal Server Error", "Server has encountered an unexpected error" },
+        [HTTPD_501_METHOD_NOT_IMPLEMENTED] = { "501 Method Not Implemented", "Server does not support this method" },
+        [HTTPD_505_VERSION_NOT_SUPPORTED] = { "505 Version Not Supported", "HTTP version not supported by server" },
+        [HTTPD_400_BAD_REQUEST] = { "400 Bad Request", "Bad request syntax" },
+        [HTTPD_401_UNAUTHORIZED] = { "401 Unauthorized", "No permission -- see authorization schemes" },
+        [HTTPD_403_FORBIDDEN] = { "403 Forbidden", "Request forbidden -- authorization will not help" },
+        [HTTPD_404_NOT_FOUND] = { "404 Not Found", "Nothing matches the given URI" },
+        [HTTPD_405_METHOD_NOT_ALLOWED] = { "405 Method Not Allowed", "Specified method is invalid for this resource" },
+        [HTTPD_408_REQ_TIMEOUT] = { "408 Request Timeout", "Server closed this connection" },
+        [HTTPD_411_LENGTH_REQUIRED] = { "411 Length Required", "Client must specify Content-Length" },
+        [HTTPD_414_URI_TOO_LONG] = { "414 URI Too Long", "URI is too long" },
+        [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE] = { "431 Request Header Fields Too Large", "Header fields are too long" },
+    };
+    if (error < 0 || error >= HTTPD_ERR_CODE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    req_aux_t *aux = req->aux;
+    aux->status = errors[error].status;
+    aux->content_type = HTTPD_TYPE_TEXT;
+    aux->resp_header_count = 0;
+    return httpd_resp_send(req, msg != NULL ? msg : errors[error].msg, HTTPD_RESP_USE_STRLEN);
+}
+
+//---------Request data---------//
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+    req_aux_t *aux = r->aux;
+    if (aux->content_remaining == 0) {
+        return 0;
+    }
+    if (buf_len > aux->content_remaining) {
+        buf_len = aux->content_remaining;
+    }
+
+    // The bytes that came with the headers first
+    if (aux->body_len > 0) {
+        size_t len = buf_len < aux->body_len ? buf_len : aux->body_len;
+        memcpy(buf, aux->body, len);
+        aux->body += len;
+        aux->body_len -= len;
+        aux->content_remaining -= len;
+        return len;
+    }
+
+    ssize_t n = recv(aux->fd, buf, buf_len, 0);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    if (n == 0) {
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    aux->content_remaining -= n;
+    return n;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+    req_aux_t *aux = r->aux;
+    size_t len = 0;
+    return find_header(aux->headers, aux->headers_len, field, &len) != NULL ? len : 0;
+}
+
+static esp_err_t copy_value(const char *value, size_t len, char *buf, size_t buf_size) {
+    if (buf_size == 0) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    size_t copied = len < buf_size - 1 ? len : buf_size - 1;
+    memcpy(buf, value, copied);
+    buf[copied] = '\0';
+    return copied < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size) {
+    req_aux_t *aux = r->aux;
+    size_t len;
+    const char *value = find_header(aux->headers, aux->headers_len, field, &len);
+    if (value == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return copy_value(value, len, val, val_size);
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) {
+    const char *query = strchr(r->uri, '?');
+    return query != NULL ? strlen(query + 1) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+    const char *query = strchr(r->uri, '?');
+    if (query == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return copy_value(query + 1, strlen(query + 1), buf, buf_len);
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+    if (qry == NULL || key == NULL || val == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t key_len = strlen(key);
+    const char *pair = qry;
+    while (*pair != '\0') {
+        const char *pair_end = strchr(pair, '&');
+        if (pair_end == NULL) {
+            pair_end = pair + strlen(pair);
+        }
+        const char *equals = memchr(pair, '=', pair_end - pair);
+        if (equals != NULL && (size_t) (equals - pair) == key_len && strncmp(pair, key, key_len) == 0) {
+            return copy_value(equals + 1, pair_end - equals - 1, val, val_size);
+        }
+        pair = *pair_end == '&' ? pair_end + 1 : pair_end;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+    return r != NULL ? ((req_aux_t *) r->aux)->fd : -1;
+}
+
+//---------Async requests---------//
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out) {
+    req_aux_t *aux = r->aux;
+    httpd_req_t *copy = malloc(sizeof(httpd_req_t));
+    req_aux_t *aux_copy = malloc(sizeof(req_aux_t));
+    char *headers = malloc(aux->headers_len + 1);
+    resp_header_t *resp_headers = calloc(aux->server->config.max_resp_headers + 1, sizeof(resp_header_t));
+    if (copy == NULL || aux_copy == NULL || headers == NULL || resp_headers == NULL) {
+        free(copy);
+        free(aux_copy);
+        free(headers);
+        free(resp_headers);
+        return ESP_ERR_NO_MEM;
+    }
+
+    memcpy(headers, aux->headers, aux->headers_len);
+    memcpy(resp_headers, aux->resp_headers, aux->resp_header_count * sizeof(resp_header_t));
+    *aux_copy = *aux;
+    aux_copy->headers = headers;
+    aux_copy->resp_headers = resp_headers;
+    // The body is read from the socket from now on
+    aux_copy->content_remaining -= aux->body_len;
+    aux_copy->body_len = 0;
+    memcpy(copy, r, sizeof(httpd_req_t));
+    copy->aux = aux_copy;
+
+    aux->server->sessions[aux->session].busy = true;
+    *out = copy;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r) {
+    if (r == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    req_aux_t *aux = r->aux;
+    control_t control = {
+        .type = CONTROL_COMPLETE,
+        .fd = aux->fd,
+        .session = aux->session,
+        .generation = aux->generation,
+    };
+    send_control(aux->server, &control);
+
+    free(aux->headers);
+    free(aux->resp_headers);
+    free(aux);
+    free(r);
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    control_t control = { .type = CONTROL_CLOSE, .fd = sockfd };
+    send_control(handle, &control);
+    return ESP_OK;
+}
@@ -0,0 +1,108 @@
+#include <math.h>
+#include <pthread.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sim.h"
+
+/*
+ * An HX710B converting at 10 Hz or 40 Hz. DOUT goes low when a conversion is ready and back high after the 24 data bits
+ * were clocked out, the number of pulses after them selects the rate of the next conversions.
+ * The code of a conversion is the trace at the time it completed.
+ */
+
+#define DATA_BITS 24
+#define PERIOD_10HZ_US 100000
+#define PERIOD_40HZ_US 25000
+
+static const char *TAG = "sim_hx710b";
+
+typedef struct {
+    const sim_trace_t *trace;
+    gpio_num_t dout;
+    pthread_mutex_t lock;
+    esp_timer_handle_t timer;
+    uint64_t period_us;
+    bool ready;
+    int32_t code;
+} hx710b_model_t;
+
+static hx710b_model_t hx710b = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void conversion_done(void *arg) {
+    hx710b_model_t *model = arg;
+    double value = sim_trace_value(model->trace, 1, esp_timer_get_time() / 1e6);
+
+    pthread_mutex_lock(&model->lock);
+    // 24-bit two's complement, saturated like the ADC
+    model->code = value > 0x7fffff ? 0x7fffff : value < -0x800000 ? -0x800000 : (int32_t) lround(value);
+    model->ready = true;
+    pthread_mutex_unlock(&model->lock);
+    sim_gpio_drive(model->dout, 0);
+}
+
+static void set_period(hx710b_model_t *model, uint64_t period_us) {
+    if (model->period_us == period_us) {
+        return;
+    }
+    model->period_us = period_us;
+    esp_timer_stop(model->timer);
+    esp_timer_start_periodic(model->timer, period_us);
+}
+
+static void hx710b_transfer(void *ctx, uint8_t *rx, size_t rx_bits) {
+    hx710b_model_t *model = ctx;
+
+    pthread_mutex_lock(&model->lock);
+    if (!model->ready) {
+        // DOUT is high, the bits read as ones
+        pthread_mutex_unlock(&model->lock);
+        ESP_LOGD(TAG, "Read without a conversion ready");
+        return;
+    }
+    uint32_t code = (uint32_t) model->code & 0xffffff;
+    model->ready = false;
+    pthread_mutex_unlock(&model->lock);
+
+    // MSB first, DOUT is pulled high by the 25th pulse
+    for (size_t bit = 0; bit < rx_bits; bit++) {
+        bool one = bit < DATA_BITS ? code >> (DATA_BITS - 1 - bit) & 1 : true;
+        if (!one) {
+            rx[bit / 8] &= ~(0x80 >> (bit % 8));
+        }
+    }
+    sim_gpio_drive(model->dout, 1);
+
+    if (rx_bits > DATA_BITS) {
+        set_period(model, rx_bits - DATA_BITS == 1 ? PERIOD_10HZ_US : PERIOD_40HZ_US);
+    }
+}
+
+static const sim_spi_device_t hx710b_device = {
+    .transfer = hx710b_transfer,
+    .ctx = &hx710b,
+};
+
+esp_err_t sim_hx710b_attach(spi_host_device_t host, gpio_num_t dout, const sim_trace_t *trace) {
+    hx710b.trace = trace;
+    hx710b.dout = dout;
+    sim_gpio_drive(dout, 1);
+
+    esp_timer_create_args_t timer_args = {
+        .callback = conversion_done,
+        .arg = &hx710b,
+        .name = "sim_hx710b",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &hx710b.timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    hx710b.period_us = PERIOD_10HZ_US;
+    err = esp_timer_start_periodic(hx710b.timer, hx710b.period_us);
+    if (err != ESP_OK) {
+        return err;
+    }
+    sim_spi_attach(host, &hx710b_device);
+    return ESP_OK;
+}
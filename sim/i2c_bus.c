@@ -0,0 +1,307 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "driver/i2c.h"
+#include "esp_timer.h"
+#include "sim.h"
+#include "internal.h"
+
+// Devices per port
+#define MAX_DEVICES 8
+// Bits on the bus per byte, 8 data bits and the acknowledge
+#define BITS_PER_BYTE 9
+
+typedef enum {
+    OP_START,
+    OP_WRITE_BYTE,
+    OP_WRITE,
+    OP_READ,
+    OP_STOP,
+} op_type_t;
+
+// The size of a command of the ESP-IDF driver, static links must fit the same number of them
+typedef struct op {
+    struct op *next;
+    union {
+        const uint8_t *out;
+        uint8_t *in;
+    };
+    uint16_t len;
+    uint8_t byte;
+    uint8_t type;
+} op_t;
+
+typedef struct {
+    op_t *first;
+    op_t *last;
+    uint8_t *free;  // Next free command in the buffer of a static link
+    uint8_t *end;
+    bool is_static;
+} cmd_link_t;
+
+_Static_assert(sizeof(op_t) <= I2C_INTERNAL_STRUCT_SIZE, "Command larger than in ESP-IDF");
+_Static_assert(sizeof(cmd_link_t) <= 2 * I2C_INTERNAL_STRUCT_SIZE, "Link larger than in ESP-IDF");
+
+typedef struct {
+    uint8_t addr;
+    const sim_i2c_device_t *device;
+} attached_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    bool installed;
+    uint32_t clk_speed;
+    int timeout;
+    size_t device_count;
+    attached_t devices[MAX_DEVICES];
+} port_t;
+
+static port_t ports[I2C_NUM_MAX] = {
+    { .lock = PTHREAD_MUTEX_INITIALIZER, .clk_speed = 100000 },
+    { .lock = PTHREAD_MUTEX_INITIALIZER, .clk_speed = 100000 },
+};
+
+#define CHECK_PORT(port) do { if ((port) < 0 || (port) >= I2C_NUM_MAX) return ESP_ERR_INVALID_ARG; } while (0)
+
+esp_err_t sim_i2c_attach(i2c_port_t port, uint8_t addr, const sim_i2c_device_t *device) {
+    CHECK_PORT(port);
+    port_t *p = &ports[port];
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&p->lock);
+    for (size_t i = 0; i < p->device_count; i++) {
+        if (p->devices[i].addr == addr) {
+            err = ESP_ERR_INVALID_STATE;
+        }
+    }
+    if (err == ESP_OK && p->device_count == MAX_DEVICES) {
+        err = ESP_ERR_NO_MEM;
+    }
+    if (err == ESP_OK) {
+        p->devices[p->device_count++] = (attached_t) { .addr = addr, .device = device };
+    }
+    pthread_mutex_unlock(&p->lock);
+    return err;
+}
+
+//---------Driver---------//
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len, int intr_alloc_flags) {
+    CHECK_PORT(port);
+    if (mode != I2C_MODE_MASTER) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    pthread_mutex_lock(&ports[port].lock);
+    bool installed = ports[port].installed;
+    ports[port].installed = true;
+    pthread_mutex_unlock(&ports[port].lock);
+    return installed ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t port) {
+    CHECK_PORT(port);
+    pthread_mutex_lock(&ports[port].lock);
+    bool installed = ports[port].installed;
+    ports[port].installed = false;
+    pthread_mutex_unlock(&ports[port].lock);
+    return installed ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *config) {
+    CHECK_PORT(port);
+    if (config->mode != I2C_MODE_MASTER || config->master.clk_speed == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&ports[port].lock);
+    ports[port].clk_speed = config->master.clk_speed;
+    pthread_mutex_unlock(&ports[port].lock);
+    return ESP_OK;
+}
+
+esp_err_t i2c_set_timeout(i2c_port_t port, int timeout) {
+    CHECK_PORT(port);
+    ports[port].timeout = timeout;
+    return ESP_OK;
+}
+
+esp_err_t i2c_get_timeout(i2c_port_t port, int *timeout) {
+    CHECK_PORT(port);
+    *timeout = ports[port].timeout;
+    return ESP_OK;
+}
+
+//---------Command links---------//
+
+i2c_cmd_handle_t i2c_cmd_link_create(void) {
+    return calloc(1, sizeof(cmd_link_t));
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size) {
+    if (size < 2 * I2C_INTERNAL_STRUCT_SIZE) {
+        return NULL;
+    }
+    cmd_link_t *link = (cmd_link_t *) buffer;
+    memset(link, 0, sizeof(cmd_link_t));
+    link->is_static = true;
+    link->free = buffer + 2 * I2C_INTERNAL_STRUCT_SIZE;
+    link->end = buffer + size;
+    return link;
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd) {
+    cmd_link_t *link = cmd;
+    if (link == NULL) {
+        return;
+    }
+    for (op_t *op = link->first; op != NULL;) {
+        op_t *next = op->next;
+        free(op);
+        op = next;
+    }
+    free(link);
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd) {
+}
+
+static esp_err_t add_op(i2c_cmd_handle_t cmd, op_type_t type, uint8_t byte, const uint8_t *data, size_t len) {
+    cmd_link_t *link = cmd;
+    op_t *op;
+
+    if (link == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (link->is_static) {
+        if (link->free + I2C_INTERNAL_STRUCT_SIZE > link->end) {
+            return ESP_ERR_NO_MEM;
+        }
+        op = (op_t *) link->free;
+        link->free += I2C_INTERNAL_STRUCT_SIZE;
+    } else {
+        op = malloc(sizeof(op_t));
+        if (op == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    op->next = NULL;
+    op->type = type;
+    op->byte = byte;
+    op->out = data;
+    op->len = len;
+
+    if (link->last != NULL) {
+        link->last->next = op;
+    } else {
+        link->first = op;
+    }
+    link->last = op;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd) {
+    return add_op(cmd, OP_START, 0, NULL, 0);
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en) {
+    return add_op(cmd, OP_WRITE_BYTE, data, NULL, 1);
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *data, size_t data_len, bool ack_en) {
+    return add_op(cmd, OP_WRITE, 0, data, data_len);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t *data, size_t data_len, i2c_ack_type_t ack) {
+    return add_op(cmd, OP_READ, 0, data, data_len);
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd) {
+    return add_op(cmd, OP_STOP, 0, NULL, 0);
+}
+
+//---------Transfers---------//
+
+// Must be called with the port locked
+static const sim_i2c_device_t *find_device(port_t *p, uint8_t addr) {
+    for (size_t i = 0; i < p->device_count; i++) {
+        if (p->devices[i].addr == addr) {
+            return p->devices[i].device;
+        }
+    }
+    return NULL;
+}
+
+// Must be called with the port locked, a NACK ends the transaction with a stop like the ESP-IDF driver
+static esp_err_t transfer(port_t *p, const cmd_link_t *link, size_t *bytes) {
+    const sim_i2c_device_t *device = NULL;
+    bool expect_address = false;
+    bool reading = false;
+
+    for (const op_t *op = link->first; op != NULL; op = op->next) {
+        switch (op->type) {
+            case OP_START:
+                expect_address = true;
+                break;
+            case OP_WRITE_BYTE:
+            case OP_WRITE:
+                for (size_t i = 0; i < op->len; i++) {
+                    uint8_t byte = op->type == OP_WRITE_BYTE ? op->byte : op->out[i];
+                    (*bytes)++;
+                    if (expect_address) {
+                        expect_address = false;
+                        reading = byte & 1;
+                        if (device != NULL && device->stop != NULL && find_device(p, byte >> 1) != device) {
+                            device->stop(device->ctx);
+                        }
+                        device = find_device(p, byte >> 1);
+                        if (device == NULL || (device->start != NULL && !device->start(device->ctx, reading))) {
+                            return ESP_FAIL;
+                        }
+                    } else if (device == NULL || reading || device->write == NULL || !device->write(device->ctx, byte)) {
+                        if (device != NULL && device->stop != NULL) {
+                            device->stop(device->ctx);
+                        }
+                        return ESP_FAIL;
+                    }
+                }
+                break;
+            case OP_READ:
+                if (device == NULL || !reading) {
+                    return ESP_FAIL;
+                }
+                for (size_t i = 0; i < op->len; i++) {
+                    op->in[i] = device->read != NULL ? device->read(device->ctx) : 0xff;
+                    (*bytes)++;
+                }
+                break;
+            case OP_STOP:
+                if (device != NULL && device->stop != NULL) {
+                    device->stop(device->ctx);
+                }
+                device = NULL;
+                break;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait) {
+    CHECK_PORT(port);
+    port_t *p = &ports[port];
+    if (cmd == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    if (!p->installed) {
+        pthread_mutex_unlock(&p->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    int64_t start = esp_timer_get_time();
+    size_t bytes = 0;
+    esp_err_t err = transfer(p, cmd, &bytes);
+
+    // The bus is busy while the bits are clocked
+    sim_sleep_until(start + (int64_t) bytes * BITS_PER_BYTE * 1000000 / p->clk_speed);
+    pthread_mutex_unlock(&p->lock);
+    return err;
+}
@@ -0,0 +1,12 @@
+#ifndef __SHIM_ESP32_ROM_ETS_SYS_H__
+#define __SHIM_ESP32_ROM_ETS_SYS_H__
+
+#include <stdint.h>
+
+/*
+ * Host shim of the ROM functions, the busy wait sleeps instead
+ */
+
+void ets_delay_us(uint32_t us);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __SHIM_ESP_ADC_ADC_CALI_H__
+#define __SHIM_ESP_ADC_ADC_CALI_H__
+
+#include "esp_err.h"
+#include "hal/adc_types.h"
+
+/*
+ * Host shim of the ESP-IDF ADC calibration
+ */
+
+typedef struct adc_cali_scheme_t *adc_cali_handle_t;
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int *voltage);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __SHIM_ESP_ADC_ADC_CALI_SCHEME_H__
+#define __SHIM_ESP_ADC_ADC_CALI_SCHEME_H__
+
+#include <stdint.h>
+#include "esp_adc/adc_cali.h"
+
+/*
+ * Host shim of the ESP32 ADC calibration scheme. The simulated chip has no calibration values in its eFuses,
+ * creating the scheme fails with ESP_ERR_NOT_SUPPORTED like on such a board.
+ */
+
+#define ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED 1
+
+typedef struct {
+    adc_unit_t unit_id;
+    adc_atten_t atten;
+    adc_bitwidth_t bitwidth;
+    uint32_t default_vref;
+} adc_cali_line_fitting_config_t;
+
+esp_err_t adc_cali_create_scheme_line_fitting(const adc_cali_line_fitting_config_t *config, adc_cali_handle_t *ret_handle);
+esp_err_t adc_cali_delete_scheme_line_fitting(adc_cali_handle_t handle);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __SHIM_ESP_ADC_ADC_ONESHOT_H__
+#define __SHIM_ESP_ADC_ADC_ONESHOT_H__
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "hal/adc_types.h"
+
+/*
+ * Host shim of the ESP-IDF ADC oneshot driver, a read converts the current value of the simulated input
+ */
+
+typedef struct adc_oneshot_unit_ctx_t *adc_oneshot_unit_handle_t;
+
+typedef enum {
+    ADC_ULP_MODE_DISABLE = 0,
+} adc_ulp_mode_t;
+
+typedef struct {
+    adc_unit_t unit_id;
+    int clk_src;
+    adc_ulp_mode_t ulp_mode;
+} adc_oneshot_unit_init_cfg_t;
+
+typedef struct {
+    adc_atten_t atten;
+    adc_bitwidth_t bitwidth;
+} adc_oneshot_chan_cfg_t;
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t *init_config, adc_oneshot_unit_handle_t *ret_unit);
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t handle, adc_channel_t channel, const adc_oneshot_chan_cfg_t *config);
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t handle, adc_channel_t chan, int *out_raw);
+esp_err_t adc_oneshot_del_unit(adc_oneshot_unit_handle_t handle);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef __SHIM_ESP_ATTR_H__
+#define __SHIM_ESP_ATTR_H__
+
+/*
+ * Host shim of the ESP-IDF placement attributes, the host has a single kind of memory
+ */
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define EXT_RAM_BSS_ATTR
+
+#define BIT(nr) (1UL << (nr))
+#define BIT0 0x00000001
+#define BIT1 0x00000002
+#define BIT2 0x00000004
+#define BIT3 0x00000008
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef __SHIM_ESP_ERR_H__
+#define __SHIM_ESP_ERR_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+/*
+ * Host shim of the ESP-IDF error codes, the component specific codes are in the headers of their component
+ */
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_INVALID_CRC 0x109
+#define ESP_ERR_INVALID_VERSION 0x10A
+#define ESP_ERR_INVALID_MAC 0x10B
+#define ESP_ERR_NOT_FINISHED 0x10C
+#define ESP_ERR_NOT_ALLOWED 0x10D
+
+/**
+ * Returns the name of an error code, including the codes of the components the sim implements
+ *
+ * @param code The error code
+ *
+ * @return The name, "UNKNOWN ERROR" for codes without a name
+ */
+const char *esp_err_to_name(esp_err_t code);
+
+// Like ESP-IDF, a failed check aborts, a debugger or the core dump shows where
+#define ESP_ERROR_CHECK(x) do { \
+        esp_err_t err_rc_ = (x); \
+        if (err_rc_ != ESP_OK) { \
+            fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s)\nfile: \"%s\" line %d\nfunc: %s\nexpression: %s\n", \
+                err_rc_, esp_err_to_name(err_rc_), __FILE__, __LINE__, __func__, #x); \
+            abort(); \
+        } \
+    } while (0)
+
+#define ESP_ERROR_CHECK_WITHOUT_ABORT(x) ({ \
+        esp_err_t err_rc_ = (x); \
+        if (err_rc_ != ESP_OK) { \
+            fprintf(stderr, "ESP_ERROR_CHECK_WITHOUT_ABORT failed: esp_err_t 0x%x (%s)\nfile: \"%s\" line %d\nfunc: %s\nexpression: %s\n", \
+                err_rc_, esp_err_to_name(err_rc_), __FILE__, __LINE__, __func__, #x); \
+        } \
+        err_rc_; \
+    })
+
+#endif
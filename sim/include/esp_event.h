@@ -0,0 +1,17 @@
+#ifndef __SHIM_ESP_EVENT_H__
+#define __SHIM_ESP_EVENT_H__
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+/*
+ * Host shim of the ESP-IDF event loop types, the sim has no WiFi or IP events
+ */
+
+typedef const char *esp_event_base_t;
+
+#define ESP_EVENT_ANY_ID -1
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef __SHIM_ESP_LOG_H__
+#define __SHIM_ESP_LOG_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/*
+ * Host shim of the ESP-IDF logging, the lines look like on the serial monitor: "I (1234) tag: message".
+ * The level is CONFIG_LOG_DEFAULT_LEVEL, the environment variable SIM_LOG_LEVEL (0 to 5) overrides it.
+ */
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+/**
+ * Sets the log level, only "*" is supported, the sim has no per tag levels
+ *
+ * @param tag The tag, "*" for all
+ * @param level The level
+ */
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+
+/**
+ * Returns the log level of a tag
+ *
+ * @param tag The tag
+ *
+ * @return The level
+ */
+esp_log_level_t esp_log_level_get(const char *tag);
+
+/**
+ * Returns the milliseconds since the start, like the timestamp of a log line
+ */
+uint32_t esp_log_timestamp(void);
+
+/**
+ * Writes a log line to stderr if the level is enabled
+ *
+ * @param level The level
+ * @param tag The tag
+ * @param format The printf format
+ */
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOG_LEVEL_LOCAL(level, tag, letter, format, ...) do { \
+        if (esp_log_level_get(tag) >= level) { \
+            esp_log_write(level, tag, #letter " (%lu) %s: " format "\n", (unsigned long) esp_log_timestamp(), tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR, tag, E, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN, tag, W, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO, tag, I, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG, tag, D, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, tag, V, format, ##__VA_ARGS__)
+
+#endif
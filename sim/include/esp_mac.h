@@ -0,0 +1,20 @@
+#ifndef __SHIM_ESP_MAC_H__
+#define __SHIM_ESP_MAC_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Host shim of the ESP-IDF MAC addresses, the sim has a fixed locally administered base MAC
+ */
+
+typedef enum {
+    ESP_MAC_WIFI_STA,
+    ESP_MAC_WIFI_SOFTAP,
+    ESP_MAC_BT,
+    ESP_MAC_ETH,
+} esp_mac_type_t;
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+
+#endif
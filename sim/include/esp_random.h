@@ -0,0 +1,14 @@
+#ifndef __SHIM_ESP_RANDOM_H__
+#define __SHIM_ESP_RANDOM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Host shim of the ESP-IDF random number generator, backed by the random numbers of the host
+ */
+
+uint32_t esp_random(void);
+void esp_fill_random(void *buf, size_t len);
+
+#endif
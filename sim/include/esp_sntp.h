@@ -0,0 +1,22 @@
+#ifndef __SHIM_ESP_SNTP_H__
+#define __SHIM_ESP_SNTP_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Host shim of the ESP-IDF SNTP client, the clock of the host is already synced so these do nothing
+ */
+
+typedef enum {
+    ESP_SNTP_OPMODE_POLL,
+    ESP_SNTP_OPMODE_LISTENONLY,
+} esp_sntp_operatingmode_t;
+
+void esp_sntp_setoperatingmode(esp_sntp_operatingmode_t operating_mode);
+void esp_sntp_setservername(uint8_t idx, const char *server);
+void esp_sntp_init(void);
+void esp_sntp_stop(void);
+bool esp_sntp_enabled(void);
+
+#endif
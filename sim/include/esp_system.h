@@ -0,0 +1,18 @@
+#ifndef __SHIM_ESP_SYSTEM_H__
+#define __SHIM_ESP_SYSTEM_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Host shim of the ESP-IDF system functions
+ */
+
+/**
+ * Restarts the program with the arguments it was started with, like a reboot the RAM starts out empty
+ */
+void esp_restart(void) __attribute__((noreturn));
+
+uint32_t esp_get_free_heap_size(void);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __SHIM_FREERTOS_H__
+#define __SHIM_FREERTOS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+/*
+ * Host shim of the FreeRTOS types and port macros. Tasks are threads, the tick rate is the one of the board
+ * (CONFIG_FREERTOS_HZ), so delays are rounded to ticks like on the ESP32.
+ * Critical sections are a mutex, the simulated interrupts run on threads as well.
+ */
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_EMPTY pdFALSE
+#define errQUEUE_FULL pdFALSE
+
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES 25
+#define configMINIMAL_STACK_SIZE 768
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY 0x7fffffff
+
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t) (((uint64_t) (xTimeInMs) * (uint64_t) configTICK_RATE_HZ) / (uint64_t) 1000U))
+#define pdTICKS_TO_MS(xTicks) ((TickType_t) ((uint64_t) (xTicks) * 1000 / configTICK_RATE_HZ))
+
+typedef pthread_mutex_t portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(mux)
+#define portENTER_CRITICAL_ISR(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL_ISR(mux) pthread_mutex_unlock(mux)
+#define portENTER_CRITICAL_SAFE(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL_SAFE(mux) pthread_mutex_unlock(mux)
+#define taskENTER_CRITICAL(mux) portENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL(mux) portEXIT_CRITICAL(mux)
+
+// The woken task is a thread that runs on its own
+#define portYIELD_FROM_ISR(...) do { } while (0)
+
+#endif
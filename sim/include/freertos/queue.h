@@ -0,0 +1,22 @@
+#ifndef __SHIM_FREERTOS_QUEUE_H__
+#define __SHIM_FREERTOS_QUEUE_H__
+
+#include "freertos/FreeRTOS.h"
+
+/*
+ * Host shim of the FreeRTOS queues, items are copied like in FreeRTOS
+ */
+
+typedef struct QueueDefinition *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#define xQueueSendToBack(queue, item, ticks_to_wait) xQueueSend(queue, item, ticks_to_wait)
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __SHIM_FREERTOS_SEMPHR_H__
+#define __SHIM_FREERTOS_SEMPHR_H__
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+/*
+ * Host shim of the FreeRTOS semaphores, all of them are counting semaphores with tick timeouts.
+ * A mutex is a semaphore with one token, without priority inheritance or owner.
+ */
+
+typedef struct sim_semaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __SHIM_FREERTOS_TASK_H__
+#define __SHIM_FREERTOS_TASK_H__
+
+#include "freertos/FreeRTOS.h"
+
+/*
+ * Host shim of the FreeRTOS tasks. A task is a detached thread, priorities and core affinity are ignored.
+ * Threads that weren't created as task (e.g. main) get a task handle when they first need one.
+ */
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameters, UBaseType_t priority, TaskHandle_t *created_task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameters, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id);
+
+/**
+ * Deletes the calling task, other tasks can't be deleted
+ *
+ * @param task NULL
+ */
+void vTaskDelete(TaskHandle_t task);
+
+/**
+ * Blocks until the tick count advanced by ticks, the first tick may be almost over already, like on the ESP32
+ */
+void vTaskDelay(const TickType_t ticks);
+BaseType_t xTaskDelayUntil(TickType_t *previous_wake_time, const TickType_t time_increment);
+#define vTaskDelayUntil(previous_wake_time, time_increment) ((void) xTaskDelayUntil(previous_wake_time, time_increment))
+
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+char *pcTaskGetName(TaskHandle_t task);
+void taskYIELD(void);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken);
+
+#endif
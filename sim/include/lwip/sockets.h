@@ -0,0 +1,16 @@
+#ifndef __SHIM_LWIP_SOCKETS_H__
+#define __SHIM_LWIP_SOCKETS_H__
+
+/*
+ * Host shim of the lwIP socket API, lwIP has the BSD names so these are the sockets of the host
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#endif
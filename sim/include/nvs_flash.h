@@ -0,0 +1,13 @@
+#ifndef __SHIM_NVS_FLASH_H__
+#define __SHIM_NVS_FLASH_H__
+
+#include "nvs.h"
+
+/*
+ * Host shim of the ESP-IDF NVS partition functions
+ */
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+
+#endif
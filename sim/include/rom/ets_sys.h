@@ -0,0 +1,6 @@
+#ifndef __SHIM_ROM_ETS_SYS_H__
+#define __SHIM_ROM_ETS_SYS_H__
+
+#include "esp32/rom/ets_sys.h"
+
+#endif
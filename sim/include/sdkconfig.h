@@ -0,0 +1,17 @@
+#ifndef __SHIM_SDKCONFIG_H__
+#define __SHIM_SDKCONFIG_H__
+
+/*
+ * Host shim of the generated sdkconfig.h, the options of sdkconfig.denky32 that the firmware and the shims depend on
+ */
+
+#define CONFIG_IDF_TARGET "esp32"
+#define CONFIG_IDF_TARGET_ESP32 1
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+#define CONFIG_LWIP_MAX_SOCKETS 16
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 512
+#define CONFIG_HTTPD_MAX_URI_LEN 512
+#define CONFIG_I2CDEV_TIMEOUT 1000
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __SHIM_SECRETS_H__
+#define __SHIM_SECRETS_H__
+
+/*
+ * Stand-in for include/secrets.h in the host build, the sim uses the network of the host and has no WiFi.
+ * A secrets.h in include/ is found first and takes precedence.
+ */
+
+#define WIFI_SSID "sim"
+#define WIFI_PASS ""
+#define REMOTE_WRITE_URL "http://127.0.0.1:9090/api/v1/write"
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "driver/i2c.h"
+#include "driver/spi_master.h"
+
+/*
+ * The simulator behind the shims in sim/include. The firmware runs unchanged on the host, the sensors are models
+ * on simulated buses that replay recorded traces, the HTTP server listens on localhost.
+ */
+
+// Directory of the traces if the environment variable SIM_TRACE_DIR isn't set
+#define SIM_TRACE_DIR_DEFAULT "sim/traces"
+
+//---------Traces---------//
+
+typedef struct sim_trace {
+    const char *name;
+    size_t columns;
+    size_t rows;
+    double *values;
+} sim_trace_t;
+
+/**
+ * Loads a CSV trace from the trace directory. The first line is the header, the first column is the time in seconds.
+ *
+ * @param name The file name, e.g. "am2320.csv"
+ * @param columns The number of columns including the time
+ * @param out_trace Pointer for returning the trace
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the file can't be opened, ESP_ERR_INVALID_ARG if it is malformed
+ */
+esp_err_t sim_trace_load(const char *name, size_t columns, sim_trace_t *out_trace);
+
+/**
+ * Returns a column of the trace at a time, linearly interpolated between the rows. The trace repeats after its last row.
+ *
+ * @param trace Pointer to the trace
+ * @param column The column, 1 is the first value after the time
+ * @param time_s The time in seconds
+ *
+ * @return The value
+ */
+double sim_trace_value(const sim_trace_t *trace, size_t column, double time_s);
+
+/**
+ * Frees the rows of a trace
+ *
+ * @param trace Pointer to the trace
+ */
+void sim_trace_free(sim_trace_t *trace);
+
+//---------GPIO---------//
+
+/**
+ * Drives an input pin like an external circuit, runs the interrupt handler of the pin if the edge or level matches
+ *
+ * @param gpio_num The pin
+ * @param level 0 or 1
+ */
+void sim_gpio_drive(gpio_num_t gpio_num, uint32_t level);
+
+//---------I2C---------//
+
+// The callbacks of a device on the simulated I2C bus, they run while the bus is locked
+typedef struct sim_i2c_device {
+    // Address phase, returns false to NACK the address
+    bool (*start)(void *ctx, bool read);
+    // A written byte, returns false to NACK it
+    bool (*write)(void *ctx, uint8_t byte);
+    // The next byte the device sends
+    uint8_t (*read)(void *ctx);
+    // Stop condition
+    void (*stop)(void *ctx);
+    void *ctx;
+} sim_i2c_device_t;
+
+/**
+ * Attaches a device model to an I2C port
+ *
+ * @param port The port
+ * @param addr The 7-bit address
+ * @param device Pointer to the device, must stay valid
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the address is taken, ESP_ERR_NO_MEM if the bus is full
+ */
+esp_err_t sim_i2c_attach(i2c_port_t port, uint8_t addr, const sim_i2c_device_t *device);
+
+//---------SPI---------//
+
+// The callback of a device on a simulated SPI bus, clocks out rx_bits bits MSB first
+typedef struct sim_spi_device {
+    void (*transfer)(void *ctx, uint8_t *rx, size_t rx_bits);
+    void *ctx;
+} sim_spi_device_t;
+
+/**
+ * Attaches a device model to an SPI host, the devices added with spi_bus_add_device talk to it
+ *
+ * @param host The SPI host
+ * @param device Pointer to the device, must stay valid
+ */
+void sim_spi_attach(spi_host_device_t host, const sim_spi_device_t *device);
+
+//---------ADC---------//
+
+/**
+ * Sets the millivolts of the ADC input as a function of the time, replaces the heartrate.csv trace
+ *
+ * @param input The input, NULL for the trace
+ * @param ctx Passed to input
+ */
+void sim_adc_set_input(double (*input)(void *ctx, double time_s), void *ctx);
+
+/**
+ * Lets the continuous ADC convert as fast as the frames are read instead of at the sample rate.
+ * The time of the input still advances by one sample period per conversion, so a replay runs faster than real time.
+ *
+ * @param unpaced true to convert on demand
+ */
+void sim_adc_set_unpaced(bool unpaced);
+
+//---------Devices---------//
+
+/**
+ * Attaches the AM2320 and TSL2561 models to I2C port 0 and the HX710B model to SPI2 with the traces of the trace directory
+ *
+ * @return ESP_OK on success, the error of the first trace that couldn't be loaded otherwise
+ */
+esp_err_t sim_devices_init(void);
+
+/**
+ * Attaches an AM2320 model replaying a trace with the columns time_s, temperature_c, humidity_pct
+ *
+ * @param port The I2C port
+ * @param trace Pointer to the trace, must stay valid
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t sim_am2320_attach(i2c_port_t port, const sim_trace_t *trace);
+
+/**
+ * Attaches a TSL2561 (T package) model replaying a trace with the columns time_s, lux, ir_ratio
+ *
+ * @param port The I2C port
+ * @param addr The address
+ * @param trace Pointer to the trace, must stay valid
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t sim_tsl2561_attach(i2c_port_t port, uint8_t addr, const sim_trace_t *trace);
+
+/**
+ * Attaches an HX710B model replaying a trace with the columns time_s, code. DOUT goes low when a conversion is ready.
+ *
+ * @param host The SPI host
+ * @param dout The DOUT pin
+ * @param trace Pointer to the trace, must stay valid
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t sim_hx710b_attach(spi_host_device_t host, gpio_num_t dout, const sim_trace_t *trace);
+
+#endif
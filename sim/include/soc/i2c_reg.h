@@ -0,0 +1,8 @@
+#ifndef __SHIM_SOC_I2C_REG_H__
+#define __SHIM_SOC_I2C_REG_H__
+
+/*
+ * Host shim of the I2C registers, i2cdev falls back to its own maximum timeout without them
+ */
+
+#endif
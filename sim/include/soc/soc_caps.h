@@ -0,0 +1,17 @@
+#ifndef __SHIM_SOC_SOC_CAPS_H__
+#define __SHIM_SOC_SOC_CAPS_H__
+
+/*
+ * Host shim of the ESP32 capabilities, only the ADC ones
+ */
+
+#define SOC_ADC_PERIPH_NUM 2
+#define SOC_ADC_MAX_CHANNEL_NUM 10
+#define SOC_ADC_DIGI_MAX_BITWIDTH 12
+#define SOC_ADC_DIGI_RESULT_BYTES 2
+#define SOC_ADC_DIGI_DATA_BYTES_PER_CONV 4
+#define SOC_ADC_SAMPLE_FREQ_THRES_HIGH (2 * 1000 * 1000)
+#define SOC_ADC_SAMPLE_FREQ_THRES_LOW (20 * 1000)
+#define SOC_ADC_RTC_MAX_BITWIDTH 12
+
+#endif
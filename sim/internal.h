@@ -0,0 +1,65 @@
+#ifndef __SIM_INTERNAL_H__
+#define __SIM_INTERNAL_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+/*
+ * Shared between the sources of the sim, not part of the shimmed ESP-IDF API
+ */
+
+// Microseconds of one FreeRTOS tick
+#define SIM_TICK_US (1000000 / configTICK_RATE_HZ)
+
+// Deadline that never expires
+#define SIM_FOREVER INT64_MAX
+
+/**
+ * Initializes a condition variable that waits against CLOCK_MONOTONIC, the clock of esp_timer_get_time
+ *
+ * @param cond Pointer to the condition variable
+ */
+void sim_cond_init(pthread_cond_t *cond);
+
+/**
+ * Waits on a condition variable until a deadline
+ *
+ * @param cond The condition variable
+ * @param mutex The locked mutex
+ * @param deadline_us Deadline in esp_timer_get_time microseconds, SIM_FOREVER to wait without timeout
+ *
+ * @return 0 if signaled, ETIMEDOUT if the deadline passed
+ */
+int sim_cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t deadline_us);
+
+/**
+ * Sleeps until a deadline
+ *
+ * @param deadline_us Deadline in esp_timer_get_time microseconds
+ */
+void sim_sleep_until(int64_t deadline_us);
+
+/**
+ * Returns the deadline of a FreeRTOS timeout, the tick count has to reach the current tick plus ticks.
+ * Like on the ESP32 the first tick may be almost over, so the time is between ticks - 1 and ticks periods.
+ *
+ * @param ticks The timeout in ticks, portMAX_DELAY for none
+ *
+ * @return The deadline in esp_timer_get_time microseconds, SIM_FOREVER for portMAX_DELAY
+ */
+int64_t sim_ticks_deadline(TickType_t ticks);
+
+/**
+ * Returns the arguments of the program, esp_restart runs it again with them
+ */
+char **sim_argv(void);
+
+/**
+ * Saves the arguments of the program for esp_restart
+ *
+ * @param argv The arguments of main
+ */
+void sim_set_argv(char **argv);
+
+#endif
@@ -0,0 +1,26 @@
+#include <unistd.h>
+#include "esp_log.h"
+#include "sim.h"
+#include "internal.h"
+
+/*
+ * Entry point of the host build. Like the ESP-IDF startup code it calls app_main and keeps running the tasks
+ * after it returned. The unit tests in test/test_sim_* bring their own main.
+ */
+
+#ifndef PIO_UNIT_TESTING
+
+void app_main(void);
+
+int main(int argc, char **argv) {
+    sim_set_argv(argv);
+    if (sim_devices_init() != ESP_OK) {
+        return 1;
+    }
+    app_main();
+    for (;;) {
+        pause();
+    }
+}
+
+#endif
@@ -0,0 +1,18 @@
+#include <signal.h>
+#include "wifi.h"
+#include "esp_log.h"
+
+static const char *TAG = "wifi_station";
+
+// lwIP has no signals, a send to a connection the peer closed fails with EPIPE instead of terminating the process
+__attribute__((constructor)) static void ignore_sigpipe(void) {
+    signal(SIGPIPE, SIG_IGN);
+}
+
+// The sim uses the network of the host, the station is connected right away
+void wifi_init_sta(char *ssid, char *pass, gpio_num_t *disconnect_led_pin) {
+    ESP_LOGI(TAG, "connected to ap SSID:%s, the sim uses the network of the host", ssid);
+    if (*disconnect_led_pin != GPIO_NUM_NC) {
+        gpio_set_level(*disconnect_led_pin, 0);
+    }
+}
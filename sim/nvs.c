@@ -0,0 +1,239 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nvs_flash.h"
+
+#define MAX_HANDLES 16
+#define NAMESPACE_MAX_SIZE 16
+#define NAMESPACE_COUNT_MAX 16
+
+typedef struct entry {
+    char namespace_name[NAMESPACE_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    void *value;
+    size_t length;
+    struct entry *next;
+} entry_t;
+
+typedef struct {
+    bool open;
+    nvs_open_mode_t mode;
+    char namespace_name[NAMESPACE_MAX_SIZE];
+} handle_t;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool initialized = false;
+static entry_t *entries = NULL;
+// Handle n is handles[n - 1], 0 is never a valid handle
+static handle_t handles[MAX_HANDLES];
+static char namespaces[NAMESPACE_COUNT_MAX][NAMESPACE_MAX_SIZE];
+
+esp_err_t nvs_flash_init(void) {
+    pthread_mutex_lock(&nvs_lock);
+    initialized = true;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+// Must be called with nvs_lock taken
+static void free_entry(entry_t *entry) {
+    free(entry->value);
+    free(entry);
+}
+
+esp_err_t nvs_flash_erase(void) {
+    pthread_mutex_lock(&nvs_lock);
+    while (entries != NULL) {
+        entry_t *next = entries->next;
+        free_entry(entries);
+        entries = next;
+    }
+    memset(namespaces, 0, sizeof(namespaces));
+    initialized = false;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+// Must be called with nvs_lock taken
+static bool namespace_exists(const char *namespace_name) {
+    for (int i = 0; i < NAMESPACE_COUNT_MAX; i++) {
+        if (strcmp(namespaces[i], namespace_name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Must be called with nvs_lock taken
+static void create_namespace(const char *namespace_name) {
+    for (int i = 0; i < NAMESPACE_COUNT_MAX; i++) {
+        if (namespaces[i][0] == '\0') {
+            strcpy(namespaces[i], namespace_name);
+            return;
+        }
+    }
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (strlen(namespace_name) >= NAMESPACE_MAX_SIZE) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    if (!initialized) {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    // Like ESP-IDF, a namespace is only created by a read-write open
+    if (open_mode == NVS_READONLY && !namespace_exists(namespace_name)) {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    for (int i = 0; i < MAX_HANDLES; i++) {
+        if (!handles[i].open) {
+            if (!namespace_exists(namespace_name)) {
+                create_namespace(namespace_name);
+            }
+            handles[i].open = true;
+            handles[i].mode = open_mode;
+            strcpy(handles[i].namespace_name, namespace_name);
+            *out_handle = i + 1;
+            pthread_mutex_unlock(&nvs_lock);
+            return ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    if (handle >= 1 && handle <= MAX_HANDLES) {
+        handles[handle - 1].open = false;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+// Must be called with nvs_lock taken
+static handle_t *get_handle(nvs_handle_t handle) {
+    if (handle < 1 || handle > MAX_HANDLES || !handles[handle - 1].open) {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+// Must be called with nvs_lock taken
+static entry_t **find_entry(const handle_t *h, const char *key) {
+    entry_t **link = &entries;
+    while (*link != NULL && (strcmp((*link)->namespace_name, h->namespace_name) != 0 || strcmp((*link)->key, key) != 0)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = get_handle(handle);
+    if (h == NULL) {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    entry_t *entry = *find_entry(h, key);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    // Like ESP-IDF, a NULL value only returns the length
+    if (out_value == NULL) {
+        *length = entry->length;
+    } else if (*length < entry->length) {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out_value, entry->value, entry->length);
+        *length = entry->length;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    void *copy = malloc(length > 0 ? length : 1);
+    if (copy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, value, length);
+
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = get_handle(handle);
+    if (h == NULL || h->mode == NVS_READONLY) {
+        pthread_mutex_unlock(&nvs_lock);
+        free(copy);
+        return h == NULL ? ESP_ERR_NVS_INVALID_HANDLE : ESP_ERR_NVS_READ_ONLY;
+    }
+    entry_t **link = find_entry(h, key);
+    if (*link == NULL) {
+        *link = calloc(1, sizeof(entry_t));
+        if (*link == NULL) {
+            pthread_mutex_unlock(&nvs_lock);
+            free(copy);
+            return ESP_ERR_NO_MEM;
+        }
+        strcpy((*link)->namespace_name, h->namespace_name);
+        strcpy((*link)->key, key);
+    }
+    free((*link)->value);
+    (*link)->value = copy;
+    (*link)->length = length;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = get_handle(handle);
+    if (h == NULL || h->mode == NVS_READONLY) {
+        pthread_mutex_unlock(&nvs_lock);
+        return h == NULL ? ESP_ERR_NVS_INVALID_HANDLE : ESP_ERR_NVS_READ_ONLY;
+    }
+    entry_t **link = find_entry(h, key);
+    entry_t *entry = *link;
+    if (entry == NULL) {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *link = entry->next;
+    free_entry(entry);
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = get_handle(handle);
+    if (h == NULL || h->mode == NVS_READONLY) {
+        pthread_mutex_unlock(&nvs_lock);
+        return h == NULL ? ESP_ERR_NVS_INVALID_HANDLE : ESP_ERR_NVS_READ_ONLY;
+    }
+    for (entry_t **link = &entries; *link != NULL;) {
+        entry_t *entry = *link;
+        if (strcmp(entry->namespace_name, h->namespace_name) == 0) {
+            *link = entry->next;
+            free_entry(entry);
+        } else {
+            link = &entry->next;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+// The entries are written right away
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = get_handle(handle);
+    pthread_mutex_unlock(&nvs_lock);
+    return h == NULL ? ESP_ERR_NVS_INVALID_HANDLE : ESP_OK;
+}
@@ -0,0 +1,132 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "driver/spi_master.h"
+#include "esp_timer.h"
+#include "sim.h"
+#include "internal.h"
+
+struct spi_device_t {
+    spi_host_device_t host;
+    spi_device_interface_config_t config;
+};
+
+typedef struct {
+    pthread_mutex_t lock;
+    bool initialized;
+    int devices;
+    const sim_spi_device_t *model;
+} host_t;
+
+static host_t hosts[SPI_HOST_MAX] = {
+    { .lock = PTHREAD_MUTEX_INITIALIZER },
+    { .lock = PTHREAD_MUTEX_INITIALIZER },
+    { .lock = PTHREAD_MUTEX_INITIALIZER },
+};
+
+#define CHECK_HOST(host) do { if ((host) < SPI1_HOST || (host) >= SPI_HOST_MAX) return ESP_ERR_INVALID_ARG; } while (0)
+
+void sim_spi_attach(spi_host_device_t host, const sim_spi_device_t *device) {
+    if (host < SPI1_HOST || host >= SPI_HOST_MAX) {
+        return;
+    }
+    pthread_mutex_lock(&hosts[host].lock);
+    hosts[host].model = device;
+    pthread_mutex_unlock(&hosts[host].lock);
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host_id, const spi_bus_config_t *bus_config, spi_dma_chan_t dma_chan) {
+    // SPI1 is the flash, like on the ESP32 it can't be used
+    if (host_id == SPI1_HOST) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    CHECK_HOST(host_id);
+    pthread_mutex_lock(&hosts[host_id].lock);
+    bool initialized = hosts[host_id].initialized;
+    hosts[host_id].initialized = true;
+    pthread_mutex_unlock(&hosts[host_id].lock);
+    return initialized ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host_id) {
+    CHECK_HOST(host_id);
+    host_t *host = &hosts[host_id];
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&host->lock);
+    if (!host->initialized || host->devices > 0) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        host->initialized = false;
+    }
+    pthread_mutex_unlock(&host->lock);
+    return err;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host_id, const spi_device_interface_config_t *dev_config, spi_device_handle_t *handle) {
+    CHECK_HOST(host_id);
+    if (dev_config->clock_speed_hz <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_t *host = &hosts[host_id];
+
+    pthread_mutex_lock(&host->lock);
+    if (!host->initialized) {
+        pthread_mutex_unlock(&host->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    struct spi_device_t *device = calloc(1, sizeof(struct spi_device_t));
+    if (device == NULL) {
+        pthread_mutex_unlock(&host->lock);
+        return ESP_ERR_NO_MEM;
+    }
+    device->host = host_id;
+    device->config = *dev_config;
+    host->devices++;
+    pthread_mutex_unlock(&host->lock);
+
+    *handle = device;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle) {
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_t *host = &hosts[handle->host];
+    pthread_mutex_lock(&host->lock);
+    host->devices--;
+    pthread_mutex_unlock(&host->lock);
+    free(handle);
+    return ESP_OK;
+}
+
+// Only receiving is simulated, the sensors on the buses of this firmware don't take commands
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc) {
+    if (handle == NULL || trans_desc == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t rx_bits = trans_desc->rxlength > 0 ? trans_desc->rxlength : trans_desc->length;
+    if (trans_desc->flags & SPI_TRANS_USE_RXDATA && rx_bits > 32) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t *rx = trans_desc->flags & SPI_TRANS_USE_RXDATA ? trans_desc->rx_data : trans_desc->rx_buffer;
+    host_t *host = &hosts[handle->host];
+
+    pthread_mutex_lock(&host->lock);
+    int64_t start = esp_timer_get_time();
+    if (rx != NULL) {
+        memset(rx, 0xff, (rx_bits + 7) / 8);
+        if (host->model != NULL) {
+            host->model->transfer(host->model->ctx, rx, rx_bits);
+        }
+    }
+    size_t bits = trans_desc->length > rx_bits ? trans_desc->length : rx_bits;
+    sim_sleep_until(start + (int64_t) bits * 1000000 / handle->config.clock_speed_hz);
+    pthread_mutex_unlock(&host->lock);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc) {
+    return spi_device_polling_transmit(handle, trans_desc);
+}
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "rom/ets_sys.h"
+#include "internal.h"
+
+// Free heap of the ESP32 after the boot of this firmware, the host heap has no meaningful size
+#define SIM_FREE_HEAP_SIZE (200 * 1024)
+
+static const char *TAG = "sim_system";
+
+static char **saved_argv = NULL;
+
+// Locally administered, so it can't clash with a real device in the same time series database
+static const uint8_t sim_mac[6] = {0x02, 0x53, 0x49, 0x4d, 0x00, 0x01};
+
+static bool sntp_enabled = false;
+
+char **sim_argv(void) {
+    return saved_argv;
+}
+
+void sim_set_argv(char **argv) {
+    saved_argv = argv;
+}
+
+void esp_restart(void) {
+    ESP_LOGW(TAG, "Restarting");
+    fflush(NULL);
+    if (saved_argv != NULL) {
+        execv("/proc/self/exe", saved_argv);
+        ESP_LOGE(TAG, "Restart failed");
+    }
+    exit(EXIT_FAILURE);
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return SIM_FREE_HEAP_SIZE;
+}
+
+//---------Heap---------//
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+    return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    return calloc(n, size);
+}
+
+void heap_caps_free(void *ptr) {
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return SIM_FREE_HEAP_SIZE;
+}
+
+//---------Random and MAC---------//
+
+void esp_fill_random(void *buf, size_t len) {
+    uint8_t *bytes = buf;
+    while (len > 0) {
+        ssize_t n = getrandom(bytes, len, 0);
+        if (n <= 0) {
+            continue;
+        }
+        bytes += n;
+        len -= n;
+    }
+}
+
+uint32_t esp_random(void) {
+    uint32_t value;
+    esp_fill_random(&value, sizeof(value));
+    return value;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) {
+    if (mac == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(mac, sim_mac, sizeof(sim_mac));
+    mac[5] += type;
+    return ESP_OK;
+}
+
+//---------ROM---------//
+
+void ets_delay_us(uint32_t us) {
+    // Busy-waits on the ESP32, a sleep keeps the host idle
+    sim_sleep_until(esp_timer_get_time() + us);
+}
+
+//---------SNTP---------//
+
+// The host clock is synchronized already, the firmware only checks the year
+void esp_sntp_setoperatingmode(esp_sntp_operatingmode_t operating_mode) {
+}
+
+void esp_sntp_setservername(uint8_t idx, const char *server) {
+    ESP_LOGI(TAG, "SNTP server %s, the sim uses the host clock", server);
+}
+
+void esp_sntp_init(void) {
+    sntp_enabled = true;
+}
+
+void esp_sntp_stop(void) {
+    sntp_enabled = false;
+}
+
+bool esp_sntp_enabled(void) {
+    return sntp_enabled;
+}
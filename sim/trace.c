@@ -0,0 +1,119 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "sim.h"
+
+#define LINE_MAX_LEN 256
+
+static const char *TAG = "sim_trace";
+
+esp_err_t sim_trace_load(const char *name, size_t columns, sim_trace_t *out_trace) {
+    const char *dir = getenv("SIM_TRACE_DIR");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir != NULL ? dir : SIM_TRACE_DIR_DEFAULT, name);
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        ESP_LOGE(TAG, "Opening %s failed: %s", path, strerror(errno));
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    sim_trace_t trace = { .name = name, .columns = columns };
+    size_t capacity = 0;
+    char line[LINE_MAX_LEN];
+    esp_err_t err = ESP_OK;
+
+    // The first line is the header
+    if (fgets(line, sizeof(line), file) == NULL) {
+        err = ESP_ERR_INVALID_ARG;
+    }
+    while (err == ESP_OK && fgets(line, sizeof(line), file) != NULL) {
+        if (line[0] == '\n' || line[0] == '#') {
+            continue;
+        }
+        if (trace.rows == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 256;
+            double *values = realloc(trace.values, capacity * columns * sizeof(double));
+            if (values == NULL) {
+                err = ESP_ERR_NO_MEM;
+                break;
+            }
+            trace.values = values;
+        }
+
+        char *cursor = line;
+        for (size_t column = 0; column < columns; column++) {
+            char *end;
+            double value = strtod(cursor, &end);
+            if (end == cursor) {
+                ESP_LOGE(TAG, "%s:%zu has less than %zu columns", path, trace.rows + 2, columns);
+                err = ESP_ERR_INVALID_ARG;
+                break;
+            }
+            trace.values[trace.rows * columns + column] = value;
+            cursor = end + strspn(end, ", \t");
+        }
+        // The time must increase, the interpolation searches it
+        if (err == ESP_OK && trace.rows > 0 && trace.values[trace.rows * columns] <= trace.values[(trace.rows - 1) * columns]) {
+            ESP_LOGE(TAG, "%s:%zu goes back in time", path, trace.rows + 2);
+            err = ESP_ERR_INVALID_ARG;
+        }
+        trace.rows++;
+    }
+    fclose(file);
+
+    if (err == ESP_OK && trace.rows == 0) {
+        ESP_LOGE(TAG, "%s has no rows", path);
+        err = ESP_ERR_INVALID_ARG;
+    }
+    if (err != ESP_OK) {
+        free(trace.values);
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Loaded %zu rows of %s", trace.rows, path);
+    *out_trace = trace;
+    return ESP_OK;
+}
+
+double sim_trace_value(const sim_trace_t *trace, size_t column, double time_s) {
+    const double *values = trace->values;
+    size_t columns = trace->columns;
+    double first = values[0];
+    double last = values[(trace->rows - 1) * columns];
+
+    if (trace->rows == 1 || last <= first) {
+        return values[column];
+    }
+    // The trace repeats, its last row is followed by the first one again
+    time_s = first + fmod(time_s - first, last - first);
+    if (time_s < first) {
+        time_s += last - first;
+    }
+
+    size_t low = 0;
+    size_t high = trace->rows - 1;
+    while (high - low > 1) {
+        size_t mid = (low + high) / 2;
+        if (values[mid * columns] <= time_s) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    double t0 = values[low * columns];
+    double t1 = values[high * columns];
+    double v0 = values[low * columns + column];
+    double v1 = values[high * columns + column];
+    return v0 + (v1 - v0) * (time_s - t0) / (t1 - t0);
+}
+
+void sim_trace_free(sim_trace_t *trace) {
+    free(trace->values);
+    trace->values = NULL;
+    trace->rows = 0;
+}
@@ -0,0 +1,163 @@
+#include <math.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "sim.h"
+
+/*
+ * A TSL2561 in the T package. The channels are latched at the end of every integration while the chip is powered,
+ * from the lux and the infrared ratio (channel 1 / channel 0) of the trace at that time.
+ * Writing the timing register restarts the integration.
+ */
+
+#define COMMAND_BIT 0x80
+#define ADDRESS_MASK 0x0f
+#define REG_CONTROL 0x00
+#define REG_TIMING 0x01
+#define REG_ID 0x0a
+#define REG_DATA0_LOW 0x0c
+#define POWER_ON 0x03
+#define GAIN_16X 0x10
+#define INTEGRATE_MASK 0x03
+#define PART_ID_T_PACKAGE 0x50
+
+typedef struct {
+    int64_t integration_us;
+    double scale;        // Counts relative to 402 ms at 16x gain
+    uint16_t max_counts;
+} timing_t;
+
+static const timing_t timings[] = {
+    { 13700, 1.0 / 468, 5047 },
+    { 101000, 118.0 / 16 / 468, 37177 },
+    { 402000, 468.0 / 16 / 468, 65535 },
+};
+
+// Lux = channel 0 * (b - m * ratio) at 402 ms and 16x gain, the segments of the T package data sheet
+typedef struct {
+    double max_ratio;
+    double b;
+    double m;
+} segment_t;
+
+static const segment_t segments[] = {
+    { 0.125, 0.0304, 0.0272 },
+    { 0.25, 0.0325, 0.0440 },
+    { 0.375, 0.0351, 0.0544 },
+    { 0.50, 0.0381, 0.0624 },
+    { 0.61, 0.0224, 0.0310 },
+    { 0.80, 0.0128, 0.0153 },
+    { 1.30, 0.00146, 0.00112 },
+};
+
+typedef struct {
+    const sim_trace_t *trace;
+    uint8_t registers[16];
+    uint8_t pointer;
+    bool command_written;
+    int64_t integration_start;
+    int64_t latched_integrations;
+} tsl2561_model_t;
+
+static tsl2561_model_t tsl2561;
+
+static bool powered(const tsl2561_model_t *model) {
+    return (model->registers[REG_CONTROL] & POWER_ON) == POWER_ON;
+}
+
+static uint16_t counts(double nominal, uint8_t timing_reg) {
+    const timing_t *timing = &timings[(timing_reg & INTEGRATE_MASK) < 3 ? timing_reg & INTEGRATE_MASK : 2];
+    double value = nominal * timing->scale * (timing_reg & GAIN_16X ? 16 : 1);
+    return value >= timing->max_counts ? timing->max_counts : (uint16_t) lround(value);
+}
+
+static void latch(tsl2561_model_t *model, int64_t time_us) {
+    double lux = sim_trace_value(model->trace, 1, time_us / 1e6);
+    double ratio = sim_trace_value(model->trace, 2, time_us / 1e6);
+
+    double ch0 = 0;
+    for (size_t i = 0; i < sizeof(segments) / sizeof(segments[0]); i++) {
+        if (ratio <= segments[i].max_ratio) {
+            ch0 = lux / (segments[i].b - segments[i].m * ratio);
+            break;
+        }
+    }
+    uint16_t channel0 = counts(ch0, model->registers[REG_TIMING]);
+    uint16_t channel1 = counts(ch0 * ratio, model->registers[REG_TIMING]);
+    model->registers[REG_DATA0_LOW] = channel0 & 0xff;
+    model->registers[REG_DATA0_LOW + 1] = channel0 >> 8;
+    model->registers[REG_DATA0_LOW + 2] = channel1 & 0xff;
+    model->registers[REG_DATA0_LOW + 3] = channel1 >> 8;
+}
+
+// Latches the last integration that completed until now
+static void update(tsl2561_model_t *model) {
+    if (!powered(model)) {
+        return;
+    }
+    uint8_t integrate = model->registers[REG_TIMING] & INTEGRATE_MASK;
+    int64_t integration_us = timings[integrate < 3 ? integrate : 2].integration_us;
+    int64_t integrations = (esp_timer_get_time() - model->integration_start) / integration_us;
+    if (integrations > model->latched_integrations) {
+        latch(model, model->integration_start + integrations * integration_us);
+        model->latched_integrations = integrations;
+    }
+}
+
+static void restart_integration(tsl2561_model_t *model) {
+    model->integration_start = esp_timer_get_time();
+    model->latched_integrations = 0;
+}
+
+static bool tsl2561_start(void *ctx, bool read) {
+    tsl2561_model_t *model = ctx;
+    model->command_written = false;
+    update(model);
+    return true;
+}
+
+static bool tsl2561_write(void *ctx, uint8_t byte) {
+    tsl2561_model_t *model = ctx;
+
+    if (!model->command_written) {
+        if (!(byte & COMMAND_BIT)) {
+            return false;
+        }
+        model->pointer = byte & ADDRESS_MASK;
+        model->command_written = true;
+        return true;
+    }
+
+    uint8_t reg = model->pointer++ & ADDRESS_MASK;
+    if (reg == REG_ID || reg >= REG_DATA0_LOW) {
+        // Read only
+        return true;
+    }
+    bool was_powered = powered(model);
+    model->registers[reg] = byte;
+    if ((reg == REG_CONTROL && !was_powered && powered(model)) || (reg == REG_TIMING && powered(model))) {
+        restart_integration(model);
+    }
+    return true;
+}
+
+static uint8_t tsl2561_read(void *ctx) {
+    tsl2561_model_t *model = ctx;
+    uint8_t reg = model->pointer++ & ADDRESS_MASK;
+    // The control register reads back the power bits only
+    return reg == REG_CONTROL ? model->registers[reg] & POWER_ON : model->registers[reg];
+}
+
+static const sim_i2c_device_t tsl2561_device = {
+    .start = tsl2561_start,
+    .write = tsl2561_write,
+    .read = tsl2561_read,
+    .ctx = &tsl2561,
+};
+
+esp_err_t sim_tsl2561_attach(i2c_port_t port, uint8_t addr, const sim_trace_t *trace) {
+    memset(&tsl2561, 0, sizeof(tsl2561));
+    tsl2561.trace = trace;
+    tsl2561.registers[REG_TIMING] = 0x02; // 402 ms, 1x after power-on
+    tsl2561.registers[REG_ID] = PART_ID_T_PACKAGE;
+    return sim_i2c_attach(port, addr, &tsl2561_device);
+}
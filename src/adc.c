@@ -1,17 +1,122 @@
 #include "adc.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_adc/adc_cali_scheme.h"
 
 static const char *TAG = "adc_calibration";
 
-void adc_oneshot_unit_init(adc_unit_t unit, adc_atten_t atten, adc_oneshot_unit_t *out_unit) {
+void adc_continuous_unit_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, u_int32_t sample_freq_hz, u_int32_t frame_size, adc_continuous_unit_t *out_unit) {
     out_unit->adc_unit = unit;
-    out_unit->adc_chan_config.bitwidth = ADC_BITWIDTH_DEFAULT;
-    out_unit->adc_chan_config.atten = atten;
+    out_unit->adc_channel = channel;
+    out_unit->sample_freq_hz = sample_freq_hz;
+    out_unit->frame_size = frame_size;
 
-    adc_oneshot_unit_init_cfg_t init_config1 = {
-        .unit_id = unit,
+    // The frame buffer is allocated once, reads only copy into it
+    out_unit->frame = heap_caps_malloc(frame_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (out_unit->frame == NULL) {
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+    }
+
+    adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = frame_size * 4,
+        .conv_frame_size = frame_size,
+    };
+    ESP_ERROR_CHECK(adc_continuous_new_handle(&handle_config, &out_unit->adc_handle));
+
+    adc_digi_pattern_config_t adc_pattern = {
+        .atten = atten,
+        .channel = channel & 0x7,
+        .unit = unit,
+        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+    };
+    adc_continuous_config_t dig_config = {
+        .pattern_num = 1,
+        .adc_pattern = &adc_pattern,
+        .sample_freq_hz = sample_freq_hz,
+        .conv_mode = unit == ADC_UNIT_1 ? ADC_CONV_SINGLE_UNIT_1 : ADC_CONV_SINGLE_UNIT_2,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
     };
-    ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config1, &out_unit->adc_handle));
+    ESP_ERROR_CHECK(adc_continuous_config(out_unit->adc_handle, &dig_config));
+
+    adc_cali_lut_init(unit, channel, atten, &out_unit->cali_lut);
+}
+
+esp_err_t adc_continuous_unit_read_mv(adc_continuous_unit_t *unit, u_int32_t oversampling, u_int16_t *out_mv, u_int32_t *out_count, u_int32_t timeout_ms) {
+    u_int32_t frame_len = 0;
+    u_int32_t sum = 0;
+    u_int32_t samples = 0;
+    *out_count = 0;
+
+    esp_err_t ret = adc_continuous_read(unit->adc_handle, unit->frame, unit->frame_size, &frame_len, timeout_ms);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // The samples are averaged while the frame is parsed, only the averages are calibrated
+    for (u_int32_t i = 0; i < frame_len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        adc_digi_output_data_t *result = (adc_digi_output_data_t *) &unit->frame[i];
+        if (result->type1.channel != unit->adc_channel) {
+            continue;
+        }
+        sum += result->type1.data;
+        if (++samples == oversampling) {
+            out_mv[(*out_count)++] = adc_cali_lut_to_mv(&unit->cali_lut, sum, samples);
+            sum = 0;
+            samples = 0;
+        }
+    }
+
+    return ESP_OK;
+}
+
+u_int16_t adc_cali_lut_to_mv(const adc_cali_lut_t *lut, u_int32_t raw_sum, u_int32_t count) {
+    // Average with ADC_CALI_LUT_STEP_BITS fractional bits, an oversampled average is finer than one code
+    u_int32_t average = (raw_sum << ADC_CALI_LUT_STEP_BITS) / count;
+    u_int32_t index = average >> (2 * ADC_CALI_LUT_STEP_BITS);
+    u_int32_t fraction = average & ((1 << (2 * ADC_CALI_LUT_STEP_BITS)) - 1);
+
+    if (index >= ADC_CALI_LUT_SIZE - 1) {
+        return lut->mv[ADC_CALI_LUT_SIZE - 1];
+    }
+    int32_t delta = (int32_t) lut->mv[index + 1] - lut->mv[index];
+    return lut->mv[index] + ((delta * (int32_t) fraction) >> (2 * ADC_CALI_LUT_STEP_BITS));
+}
+
+void adc_cali_lut_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, adc_cali_lut_t *out_lut) {
+    const u_int32_t max_code = (1 << SOC_ADC_DIGI_MAX_BITWIDTH) - 1;
+    adc_cali_handle_t handle = NULL;
+    bool calibrated = adc_calibration_init(unit, channel, atten, &handle);
+
+    // Upper end of the input range of every attenuation
+    static const u_int16_t nominal_max_mv[] = {
+        [ADC_ATTEN_DB_0] = 950,
+        [ADC_ATTEN_DB_2_5] = 1250,
+        [ADC_ATTEN_DB_6] = 1750,
+        [ADC_ATTEN_DB_11] = 2450,
+    };
+
+    for (u_int32_t i = 0; i < ADC_CALI_LUT_SIZE; i++) {
+        u_int32_t code = i << ADC_CALI_LUT_STEP_BITS;
+        if (code > max_code) {
+            code = max_code;
+        }
+
+        int mv = 0;
+        if (!calibrated || adc_cali_raw_to_voltage(handle, code, &mv) != ESP_OK) {
+            mv = code * nominal_max_mv[atten] / max_code;
+        }
+        out_lut->mv[i] = mv;
+    }
+
+    if (calibrated) {
+        adc_calibration_deinit(handle);
+    }
+}
+
+void adc_continuous_unit_deinit(adc_continuous_unit_t *unit) {
+    ESP_ERROR_CHECK(adc_continuous_deinit(unit->adc_handle));
+    heap_caps_free(unit->frame);
+    unit->frame = NULL;
 }
 
 bool adc_calibration_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, adc_cali_handle_t *out_handle) {
@@ -25,6 +130,7 @@ bool adc_calibration_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t at
             .unit_id = unit,
             .atten = atten,
             .bitwidth = ADC_BITWIDTH_DEFAULT,
+            .default_vref = ADC_CALI_DEFAULT_VREF_MV,
         };
         ret = adc_cali_create_scheme_line_fitting(&cali_config, &handle);
         if (ret == ESP_OK) {
@@ -0,0 +1,139 @@
+#include "beat_detector.h"
+#include <string.h>
+
+#define BASELINE_FRACTION_BITS 8
+
+// Weights of a new peak in the running levels, 1/8 like Pan-Tompkins and 1/4 for beats found by the search back
+#define LEVEL_SHIFT 3
+#define SEARCHBACK_LEVEL_SHIFT 2
+
+static void update_threshold(beat_detector_t *detector) {
+    detector->threshold = detector->noise_level + (detector->signal_level - detector->noise_level) / 4;
+    if (detector->threshold < detector->min_peak) {
+        detector->threshold = detector->min_peak;
+    }
+}
+
+void beat_detector_init(beat_detector_t *detector, uint32_t sample_rate_hz, uint16_t min_peak, uint32_t refractory_ms) {
+    memset(detector, 0, sizeof(beat_detector_t));
+    detector->sample_rate_hz = sample_rate_hz;
+    detector->min_peak = min_peak;
+    detector->refractory_samples = (uint64_t) refractory_ms * sample_rate_hz / 1000;
+
+    detector->window_size = (uint64_t) BEAT_DETECTOR_INTEGRATION_MS * sample_rate_hz / 1000;
+    if (detector->window_size == 0) {
+        detector->window_size = 1;
+    } else if (detector->window_size > BEAT_DETECTOR_MAX_INTEGRATION_SAMPLES) {
+        detector->window_size = BEAT_DETECTOR_MAX_INTEGRATION_SAMPLES;
+    }
+
+    // Smallest power of two of samples that covers a second
+    while ((1u << detector->baseline_shift) < sample_rate_hz) {
+        detector->baseline_shift++;
+    }
+
+    beat_detector_reset(detector);
+}
+
+void beat_detector_reset(beat_detector_t *detector) {
+    detector->learning_samples = (uint64_t) BEAT_DETECTOR_LEARNING_MS * detector->sample_rate_hz / 1000;
+    detector->learning_max = 0;
+    detector->learning_sum = 0;
+    detector->tracking = false;
+    detector->pulse = false;
+    detector->searchback_peak = 0;
+    detector->has_last_beat = false;
+    detector->average_interval_samples = 0;
+}
+
+static bool accept_beat(beat_detector_t *detector, uint64_t sample, int32_t peak, uint8_t level_shift, uint64_t *out_beat_sample) {
+    detector->signal_level += (peak - detector->signal_level) >> level_shift;
+    update_threshold(detector);
+
+    if (detector->has_last_beat) {
+        uint64_t interval = sample - detector->last_beat_sample;
+        // A gap would drag the average out, the search back would then wait too long
+        if (interval <= 2 * detector->sample_rate_hz) {
+            detector->average_interval_samples = detector->average_interval_samples == 0
+                ? interval
+                : detector->average_interval_samples + (((int64_t) interval - detector->average_interval_samples) >> 3);
+        }
+    }
+    detector->has_last_beat = true;
+    detector->last_beat_sample = sample;
+    detector->searchback_peak = 0;
+
+    *out_beat_sample = sample;
+    return true;
+}
+
+static bool classify_peak(beat_detector_t *detector, uint64_t sample, int32_t peak, uint64_t *out_beat_sample) {
+    bool refractory = detector->has_last_beat && sample - detector->last_beat_sample < detector->refractory_samples;
+
+    if (peak >= detector->threshold && !refractory) {
+        return accept_beat(detector, sample, peak, LEVEL_SHIFT, out_beat_sample);
+    }
+
+    detector->noise_level += (peak - detector->noise_level) >> LEVEL_SHIFT;
+    update_threshold(detector);
+    if (!refractory && peak > detector->searchback_peak) {
+        detector->searchback_peak = peak;
+        detector->searchback_sample = sample;
+    }
+    return false;
+}
+
+bool beat_detector_add_sample(beat_detector_t *detector, uint16_t value, uint64_t *out_beat_sample) {
+    uint64_t sample = detector->sample_index++;
+    bool beat = false;
+
+    if (sample == 0) {
+        // Start at the first value instead of slowly rising from 0
+        detector->baseline = (int32_t) value << BASELINE_FRACTION_BITS;
+    }
+    detector->baseline += (((int32_t) value << BASELINE_FRACTION_BITS) - detector->baseline) >> detector->baseline_shift;
+    int32_t x = (int32_t) value - (detector->baseline >> BASELINE_FRACTION_BITS);
+    if (x < 0) {
+        x = 0;
+    }
+
+    detector->window_sum += x - detector->window[detector->window_head];
+    detector->window[detector->window_head] = x;
+    detector->window_head = (detector->window_head + 1) % detector->window_size;
+    x = detector->window_sum / detector->window_size;
+
+    if (detector->learning_samples > 0) {
+        // Pan-Tompkins initializes the signal level from the maximum and the noise level from the mean
+        if (x > detector->learning_max) {
+            detector->learning_max = x;
+        }
+        detector->learning_sum += x;
+        if (--detector->learning_samples == 0) {
+            uint32_t samples = (uint64_t) BEAT_DETECTOR_LEARNING_MS * detector->sample_rate_hz / 1000;
+            detector->signal_level = detector->learning_max;
+            detector->noise_level = detector->learning_sum / samples;
+            update_threshold(detector);
+        }
+        return false;
+    }
+
+    // Local maxima, a peak is confirmed once the signal dropped to half of it
+    if (x > (detector->tracking ? detector->candidate : 0)) {
+        detector->tracking = true;
+        detector->candidate = x;
+        detector->candidate_sample = sample;
+    } else if (detector->tracking && x <= detector->candidate / 2) {
+        detector->tracking = false;
+        beat = classify_peak(detector, detector->candidate_sample, detector->candidate, out_beat_sample);
+    }
+    detector->pulse = detector->tracking && detector->candidate >= detector->threshold;
+
+    // Search back for a beat that was below the threshold
+    if (!beat && detector->has_last_beat && detector->average_interval_samples > 0
+        && sample - detector->last_beat_sample > (uint64_t) detector->average_interval_samples * 166 / 100
+        && detector->searchback_peak >= detector->threshold / 2) {
+        beat = accept_beat(detector, detector->searchback_sample, detector->searchback_peak, SEARCHBACK_LEVEL_SHIFT, out_beat_sample);
+    }
+
+    return beat;
+}
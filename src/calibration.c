@@ -0,0 +1,158 @@
+#include "calibration.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#define CALIBRATION_NVS_NAMESPACE "calibration"
+
+static const char *TAG = "calibration";
+
+static const char *nvs_keys[CALIBRATION_SENSOR_COUNT] = {
+    [CALIBRATION_TEMPERATURE] = "temp",
+    [CALIBRATION_HUMIDITY] = "hum",
+    [CALIBRATION_ILLUMINANCE] = "illuminance",
+    [CALIBRATION_PRESSURE] = "pressure",
+};
+
+// Bit widths of the readings, see calibration_sensor_t
+#define TEMPERATURE_INPUT_SHIFT 10
+#define HUMIDITY_INPUT_SHIFT 10
+#define ILLUMINANCE_INPUT_SHIFT 17
+#define PRESSURE_INPUT_SHIFT 23
+
+static const uint8_t input_shifts[CALIBRATION_SENSOR_COUNT] = {
+    [CALIBRATION_TEMPERATURE] = TEMPERATURE_INPUT_SHIFT,
+    [CALIBRATION_HUMIDITY] = HUMIDITY_INPUT_SHIFT,
+    [CALIBRATION_ILLUMINANCE] = ILLUMINANCE_INPUT_SHIFT,
+    [CALIBRATION_PRESSURE] = PRESSURE_INPUT_SHIFT,
+};
+
+static const calibration_t default_calibrations[CALIBRATION_SENSOR_COUNT] = {
+    [CALIBRATION_TEMPERATURE] = {
+        .order = 1,
+        .input_shift = TEMPERATURE_INPUT_SHIFT,
+        .coefficients = { 0, CALIBRATION_COEFFICIENT(100, 1, TEMPERATURE_INPUT_SHIFT) }
+    },
+    [CALIBRATION_HUMIDITY] = {
+        .order = 1,
+        .input_shift = HUMIDITY_INPUT_SHIFT,
+        .coefficients = { 0, CALIBRATION_COEFFICIENT(100, 1, HUMIDITY_INPUT_SHIFT) }
+    },
+    [CALIBRATION_ILLUMINANCE] = {
+        .order = 1,
+        .input_shift = ILLUMINANCE_INPUT_SHIFT,
+        .coefficients = { 0, CALIBRATION_COEFFICIENT(1000, 1, ILLUMINANCE_INPUT_SHIFT) }
+    },
+    // The HX710B only gives the bridge voltage relative to AVDD, offset and span in hPa depend on the pressure sensor
+    // it is connected to, so there is no default and the pressure needs a stored calibration
+    [CALIBRATION_PRESSURE] = { .order = 0, .input_shift = PRESSURE_INPUT_SHIFT, .coefficients = { 0 } },
+};
+
+static const bool default_valid[CALIBRATION_SENSOR_COUNT] = {
+    [CALIBRATION_TEMPERATURE] = true,
+    [CALIBRATION_HUMIDITY] = true,
+    [CALIBRATION_ILLUMINANCE] = true,
+    [CALIBRATION_PRESSURE] = false,
+};
+
+static calibration_t calibrations[CALIBRATION_SENSOR_COUNT];
+static bool valid[CALIBRATION_SENSOR_COUNT];
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t calibration_init(void) {
+    memcpy(calibrations, default_calibrations, sizeof(calibrations));
+    memcpy(valid, default_valid, sizeof(valid));
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(CALIBRATION_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        // Nothing was ever stored
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Opening the NVS namespace failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    for (int sensor = 0; sensor < CALIBRATION_SENSOR_COUNT; sensor++) {
+        calibration_t calibration;
+        size_t size = sizeof(calibration);
+        err = nvs_get_blob(handle, nvs_keys[sensor], &calibration, &size);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            continue;
+        }
+        // Calibrations stored before the input shift have 0 in its padding byte and are evaluated as before
+        if (err != ESP_OK || size != sizeof(calibration) || calibration.order > CALIBRATION_MAX_ORDER
+            || calibration.input_shift > CALIBRATION_MAX_INPUT_SHIFT) {
+            ESP_LOGW(TAG, "Ignoring the invalid calibration of %s", nvs_keys[sensor]);
+            continue;
+        }
+        calibrations[sensor] = calibration;
+        valid[sensor] = true;
+        ESP_LOGI(TAG, "Loaded the calibration of %s", nvs_keys[sensor]);
+    }
+
+    nvs_close(handle);
+    return ESP_OK;
+}
+
+esp_err_t calibration_set(calibration_sensor_t sensor, const calibration_t *calibration) {
+    if (sensor >= CALIBRATION_SENSOR_COUNT || calibration->order > CALIBRATION_MAX_ORDER
+        || calibration->input_shift > CALIBRATION_MAX_INPUT_SHIFT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(CALIBRATION_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(handle, nvs_keys[sensor], calibration, sizeof(*calibration));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Storing the calibration of %s failed: %s", nvs_keys[sensor], esp_err_to_name(err));
+        return err;
+    }
+
+    portENTER_CRITICAL_SAFE(&lock);
+    calibrations[sensor] = *calibration;
+    valid[sensor] = true;
+    portEXIT_CRITICAL_SAFE(&lock);
+    return ESP_OK;
+}
+
+uint8_t calibration_input_shift(calibration_sensor_t sensor) {
+    return input_shifts[sensor];
+}
+
+bool calibration_sensor_from_name(const char *name, calibration_sensor_t *out_sensor) {
+    for (int sensor = 0; sensor < CALIBRATION_SENSOR_COUNT; sensor++) {
+        if (strcmp(name, nvs_keys[sensor]) == 0) {
+            *out_sensor = sensor;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool calibration_is_valid(calibration_sensor_t sensor) {
+    portENTER_CRITICAL_SAFE(&lock);
+    bool result = valid[sensor];
+    portEXIT_CRITICAL_SAFE(&lock);
+    return result;
+}
+
+int32_t calibration_apply(calibration_sensor_t sensor, int32_t input) {
+    calibration_t calibration;
+
+    // Copy under the lock, so a concurrent calibration_set never mixes old and new coefficients
+    portENTER_CRITICAL_SAFE(&lock);
+    calibration = calibrations[sensor];
+    portEXIT_CRITICAL_SAFE(&lock);
+
+    return calibration_eval(&calibration, input);
+}
@@ -0,0 +1,83 @@
+#include "calibration_polynomial.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+
+static inline int64_t saturate_add(int64_t a, int64_t b) {
+    int64_t result;
+    if (__builtin_add_overflow(a, b, &result)) {
+        return b > 0 ? INT64_MAX : INT64_MIN;
+    }
+    return result;
+}
+
+// floor(value * input / 2^shift) without a 128-bit product, which the ESP32 doesn't have.
+// The products of the 32-bit halves of the value fit into 64 bits, only the high one is shifted back up.
+static int64_t saturate_mul_shift(int64_t value, int32_t input, uint8_t shift) {
+    int64_t high = (value >> 32) * input;
+    int64_t low = (int64_t) (uint32_t) value * input;
+    int high_shift = 32 - shift;
+
+    if (high > INT64_MAX >> high_shift || high < INT64_MIN >> high_shift) {
+        return high > 0 ? INT64_MAX : INT64_MIN;
+    }
+    return saturate_add(high * ((int64_t) 1 << high_shift), low >> shift);
+}
+
+int32_t calibration_eval(const calibration_t *calibration, int32_t input) {
+    // Horner's method, every step scales back by the input shift so the accumulator stays in the coefficient format
+    int64_t accumulator = calibration->coefficients[calibration->order];
+    for (int i = calibration->order - 1; i >= 0; i--) {
+        accumulator = saturate_add(saturate_mul_shift(accumulator, input, calibration->input_shift), calibration->coefficients[i]);
+    }
+
+    // Round half up, the shift of a negative value rounds towards minus infinity
+    int64_t result = saturate_add(accumulator, (int64_t) 1 << (CALIBRATION_FRACTION_BITS - 1)) >> CALIBRATION_FRACTION_BITS;
+    if (result > INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (result < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return result;
+}
+
+esp_err_t calibration_parse(const char *text, uint8_t input_shift, calibration_t *out_calibration) {
+    // Larger coefficients overflow the fixed point format
+    const double limit = ldexp(1, 63 - CALIBRATION_FRACTION_BITS);
+    calibration_t calibration = { .input_shift = input_shift };
+    int count = 0;
+
+    if (input_shift > CALIBRATION_MAX_INPUT_SHIFT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (;;) {
+        char *end;
+        double coefficient = strtod(text, &end);
+        if (end == text || count > CALIBRATION_MAX_ORDER || !isfinite(coefficient)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        // The coefficient of x^count is the one of input^count times 2^(count * input_shift)
+        double scaled = ldexp(coefficient, count * input_shift);
+        if (fabs(scaled) >= limit) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        calibration.coefficients[count++] = llround(ldexp(scaled, CALIBRATION_FRACTION_BITS));
+
+        while (isspace((unsigned char) *end)) {
+            end++;
+        }
+        if (*end == '\0') {
+            break;
+        }
+        if (*end != ',') {
+            return ESP_ERR_INVALID_ARG;
+        }
+        text = end + 1;
+    }
+
+    calibration.order = count - 1;
+    *out_calibration = calibration;
+    return ESP_OK;
+}
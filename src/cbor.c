@@ -0,0 +1,101 @@
+#include "cbor.h"
+#include <string.h>
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NEGATIVE_INT 1
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_FALSE 20
+#define CBOR_TRUE 21
+#define CBOR_NULL 22
+#define CBOR_FLOAT32 26
+
+static void write_bytes(cbor_writer_t *writer, const void *data, size_t len) {
+    if (writer->overflow || len > writer->size - writer->len) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->buffer + writer->len, data, len);
+    writer->len += len;
+}
+
+// Initial byte with the shortest argument encoding, big endian
+static void write_head(cbor_writer_t *writer, uint8_t major, uint64_t argument) {
+    uint8_t head[9];
+    size_t len;
+
+    if (argument < 24) {
+        head[0] = major << 5 | argument;
+        len = 1;
+    } else if (argument <= UINT8_MAX) {
+        head[0] = major << 5 | 24;
+        len = 2;
+    } else if (argument <= UINT16_MAX) {
+        head[0] = major << 5 | 25;
+        len = 3;
+    } else if (argument <= UINT32_MAX) {
+        head[0] = major << 5 | 26;
+        len = 5;
+    } else {
+        head[0] = major << 5 | 27;
+        len = 9;
+    }
+
+    for (size_t i = 1; i < len; i++) {
+        head[i] = argument >> (8 * (len - 1 - i));
+    }
+    write_bytes(writer, head, len);
+}
+
+void cbor_writer_init(cbor_writer_t *writer, uint8_t *buffer, size_t size) {
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->len = 0;
+    writer->overflow = false;
+}
+
+void cbor_write_uint(cbor_writer_t *writer, uint64_t value) {
+    write_head(writer, CBOR_MAJOR_UINT, value);
+}
+
+void cbor_write_int(cbor_writer_t *writer, int64_t value) {
+    if (value < 0) {
+        // -1 - n, without overflowing on INT64_MIN
+        write_head(writer, CBOR_MAJOR_NEGATIVE_INT, ~(uint64_t) value);
+    } else {
+        write_head(writer, CBOR_MAJOR_UINT, value);
+    }
+}
+
+void cbor_write_float(cbor_writer_t *writer, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint8_t data[5] = { CBOR_MAJOR_SIMPLE << 5 | CBOR_FLOAT32, bits >> 24, bits >> 16, bits >> 8, bits };
+    write_bytes(writer, data, sizeof(data));
+}
+
+void cbor_write_bool(cbor_writer_t *writer, bool value) {
+    write_head(writer, CBOR_MAJOR_SIMPLE, value ? CBOR_TRUE : CBOR_FALSE);
+}
+
+void cbor_write_null(cbor_writer_t *writer) {
+    write_head(writer, CBOR_MAJOR_SIMPLE, CBOR_NULL);
+}
+
+void cbor_write_text(cbor_writer_t *writer, const char *text) {
+    size_t len = strlen(text);
+    write_head(writer, CBOR_MAJOR_TEXT, len);
+    write_bytes(writer, text, len);
+}
+
+void cbor_write_map(cbor_writer_t *writer, size_t count) {
+    write_head(writer, CBOR_MAJOR_MAP, count);
+}
+
+void cbor_write_array(cbor_writer_t *writer, size_t count) {
+    write_head(writer, CBOR_MAJOR_ARRAY, count);
+}
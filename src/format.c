@@ -0,0 +1,62 @@
+#include "format.h"
+#include <math.h>
+#include <string.h>
+
+static const uint32_t powers_of_ten[FORMAT_MAX_DECIMALS + 1] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+// Writes the digits back to front into a scratch buffer, then copies them to the start of the buffer
+static size_t format_digits(char *buffer, uint64_t value, uint8_t min_digits) {
+    char digits[20];
+    size_t len = 0;
+
+    do {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0 || len < min_digits);
+
+    for (size_t i = 0; i < len; i++) {
+        buffer[i] = digits[len - 1 - i];
+    }
+    return len;
+}
+
+size_t format_u32(char *buffer, uint32_t value) {
+    return format_digits(buffer, value, 1);
+}
+
+size_t format_u64(char *buffer, uint64_t value) {
+    return format_digits(buffer, value, 1);
+}
+
+size_t format_i32(char *buffer, int32_t value) {
+    if (value < 0) {
+        buffer[0] = '-';
+        return 1 + format_digits(buffer + 1, -(int64_t) value, 1);
+    }
+    return format_digits(buffer, value, 1);
+}
+
+size_t format_fixed(char *buffer, float value, uint8_t decimals) {
+    if (decimals > FORMAT_MAX_DECIMALS) {
+        decimals = FORMAT_MAX_DECIMALS;
+    }
+
+    if (!isfinite(value) || fabsf(value) > UINT32_MAX) {
+        memcpy(buffer, "NaN", 3);
+        return 3;
+    }
+
+    size_t len = 0;
+    uint64_t scaled = llround(fabs((double) value) * powers_of_ten[decimals]);
+    // -0.04 with one decimal is 0.0, not -0.0
+    if (value < 0 && scaled != 0) {
+        buffer[len++] = '-';
+    }
+
+    len += format_digits(buffer + len, scaled / powers_of_ten[decimals], 1);
+    if (decimals > 0) {
+        buffer[len++] = '.';
+        len += format_digits(buffer + len, scaled % powers_of_ten[decimals], decimals);
+    }
+    return len;
+}
@@ -0,0 +1,248 @@
+#include "gorilla.h"
+#include <string.h>
+
+// Marks that no leading/trailing zero window was stored yet
+#define NO_WINDOW 0xff
+
+static void writer_init(gorilla_bit_writer_t *writer, uint8_t *buffer, size_t size) {
+    memset(buffer, 0, size);
+    writer->buffer = buffer;
+    writer->capacity_bits = size * 8;
+    writer->bit_len = 0;
+}
+
+// Writes the lowest bit_count bits of value, MSB first, into a zeroed buffer
+static void write_bits(gorilla_bit_writer_t *writer, uint64_t value, uint8_t bit_count) {
+    while (bit_count > 0) {
+        uint8_t free_bits = 8 - (writer->bit_len % 8);
+        uint8_t take = bit_count < free_bits ? bit_count : free_bits;
+        uint8_t bits = (value >> (bit_count - take)) & ((1u << take) - 1);
+
+        writer->buffer[writer->bit_len / 8] |= bits << (free_bits - take);
+        writer->bit_len += take;
+        bit_count -= take;
+    }
+}
+
+static void reader_init(gorilla_bit_reader_t *reader, const uint8_t *buffer, size_t bit_len) {
+    reader->buffer = buffer;
+    reader->bit_len = bit_len;
+    reader->position = 0;
+}
+
+static uint64_t read_bits(gorilla_bit_reader_t *reader, uint8_t bit_count) {
+    uint64_t value = 0;
+
+    while (bit_count > 0) {
+        uint8_t available = 8 - (reader->position % 8);
+        uint8_t take = bit_count < available ? bit_count : available;
+        uint8_t bits = (reader->buffer[reader->position / 8] >> (available - take)) & ((1u << take) - 1);
+
+        value = (value << take) | bits;
+        reader->position += take;
+        bit_count -= take;
+    }
+
+    return value;
+}
+
+static inline uint32_t float_to_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline float bits_to_float(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void gorilla_time_encoder_init(gorilla_time_encoder_t *encoder, uint8_t *buffer, size_t size) {
+    writer_init(&encoder->writer, buffer, size);
+    encoder->count = 0;
+    encoder->prev_timestamp = 0;
+    encoder->prev_delta = 0;
+}
+
+bool gorilla_time_encoder_append(gorilla_time_encoder_t *encoder, uint32_t timestamp) {
+    gorilla_bit_writer_t *writer = &encoder->writer;
+
+    if (encoder->count == 0) {
+        if (writer->bit_len + 32 > writer->capacity_bits) {
+            return false;
+        }
+        write_bits(writer, timestamp, 32);
+    } else {
+        int64_t delta = (int64_t) timestamp - encoder->prev_timestamp;
+        int64_t dod = delta - encoder->prev_delta;
+        uint8_t prefix_bits;
+        uint8_t prefix;
+        uint8_t value_bits;
+
+        if (dod == 0) {
+            prefix = 0x0; prefix_bits = 1; value_bits = 0;
+        } else if (dod >= -64 && dod <= 63) {
+            prefix = 0x2; prefix_bits = 2; value_bits = 7;
+        } else if (dod >= -256 && dod <= 255) {
+            prefix = 0x6; prefix_bits = 3; value_bits = 9;
+        } else if (dod >= -2048 && dod <= 2047) {
+            prefix = 0xe; prefix_bits = 4; value_bits = 12;
+        } else {
+            // Deltas of unsigned 32 bit timestamps need 33 bits as delta-of-delta
+            prefix = 0xf; prefix_bits = 4; value_bits = 40;
+        }
+
+        if (writer->bit_len + prefix_bits + value_bits > writer->capacity_bits) {
+            return false;
+        }
+        write_bits(writer, prefix, prefix_bits);
+        if (value_bits > 0) {
+            write_bits(writer, (uint64_t) dod & ((1ULL << value_bits) - 1), value_bits);
+        }
+        encoder->prev_delta = delta;
+    }
+
+    encoder->prev_timestamp = timestamp;
+    encoder->count++;
+    return true;
+}
+
+void gorilla_value_encoder_init(gorilla_value_encoder_t *encoder, uint8_t *buffer, size_t size) {
+    writer_init(&encoder->writer, buffer, size);
+    encoder->count = 0;
+    encoder->prev_value = 0;
+    encoder->prev_leading = NO_WINDOW;
+    encoder->prev_trailing = 0;
+}
+
+bool gorilla_value_encoder_append(gorilla_value_encoder_t *encoder, float value) {
+    gorilla_bit_writer_t *writer = &encoder->writer;
+    uint32_t bits = float_to_bits(value);
+
+    if (encoder->count == 0) {
+        if (writer->bit_len + 32 > writer->capacity_bits) {
+            return false;
+        }
+        write_bits(writer, bits, 32);
+    } else {
+        uint32_t xor = bits ^ encoder->prev_value;
+
+        if (xor == 0) {
+            if (writer->bit_len + 1 > writer->capacity_bits) {
+                return false;
+            }
+            write_bits(writer, 0x0, 1);
+        } else {
+            uint8_t leading = __builtin_clz(xor);
+            uint8_t trailing = __builtin_ctz(xor);
+
+            if (encoder->prev_leading != NO_WINDOW && leading >= encoder->prev_leading && trailing >= encoder->prev_trailing) {
+                // The meaningful bits fit into the previous window
+                uint8_t length = 32 - encoder->prev_leading - encoder->prev_trailing;
+                if (writer->bit_len + 2 + length > writer->capacity_bits) {
+                    return false;
+                }
+                write_bits(writer, 0x2, 2);
+                write_bits(writer, xor >> encoder->prev_trailing, length);
+            } else {
+                uint8_t length = 32 - leading - trailing;
+                if (writer->bit_len + 2 + 5 + 5 + length > writer->capacity_bits) {
+                    return false;
+                }
+                write_bits(writer, 0x3, 2);
+                write_bits(writer, leading, 5);
+                write_bits(writer, length - 1, 5);
+                write_bits(writer, xor >> trailing, length);
+                encoder->prev_leading = leading;
+                encoder->prev_trailing = trailing;
+            }
+        }
+    }
+
+    encoder->prev_value = bits;
+    encoder->count++;
+    return true;
+}
+
+void gorilla_time_decoder_init(gorilla_time_decoder_t *decoder, const uint8_t *buffer, size_t bit_len, uint32_t count) {
+    reader_init(&decoder->reader, buffer, bit_len);
+    decoder->count = count;
+    decoder->remaining = count;
+    decoder->prev_timestamp = 0;
+    decoder->prev_delta = 0;
+}
+
+bool gorilla_time_decoder_next(gorilla_time_decoder_t *decoder, uint32_t *out_timestamp) {
+    gorilla_bit_reader_t *reader = &decoder->reader;
+
+    if (decoder->remaining == 0) {
+        return false;
+    }
+
+    if (decoder->remaining == decoder->count) {
+        decoder->prev_timestamp = read_bits(reader, 32);
+    } else {
+        uint8_t value_bits;
+        if (read_bits(reader, 1) == 0) {
+            value_bits = 0;
+        } else if (read_bits(reader, 1) == 0) {
+            value_bits = 7;
+        } else if (read_bits(reader, 1) == 0) {
+            value_bits = 9;
+        } else if (read_bits(reader, 1) == 0) {
+            value_bits = 12;
+        } else {
+            value_bits = 40;
+        }
+
+        int64_t dod = 0;
+        if (value_bits > 0) {
+            uint64_t raw = read_bits(reader, value_bits);
+            // Sign extend the two's complement value
+            dod = raw & (1ULL << (value_bits - 1)) ? (int64_t) (raw | ~((1ULL << value_bits) - 1)) : (int64_t) raw;
+        }
+
+        decoder->prev_delta += dod;
+        decoder->prev_timestamp += decoder->prev_delta;
+    }
+
+    decoder->remaining--;
+    *out_timestamp = decoder->prev_timestamp;
+    return true;
+}
+
+void gorilla_value_decoder_init(gorilla_value_decoder_t *decoder, const uint8_t *buffer, size_t bit_len, uint32_t count) {
+    reader_init(&decoder->reader, buffer, bit_len);
+    decoder->count = count;
+    decoder->remaining = count;
+    decoder->prev_value = 0;
+    decoder->prev_leading = 0;
+    decoder->prev_trailing = 0;
+}
+
+bool gorilla_value_decoder_next(gorilla_value_decoder_t *decoder, float *out_value) {
+    gorilla_bit_reader_t *reader = &decoder->reader;
+
+    if (decoder->remaining == 0) {
+        return false;
+    }
+
+    if (decoder->remaining == decoder->count) {
+        decoder->prev_value = read_bits(reader, 32);
+    } else if (read_bits(reader, 1) == 1) {
+        if (read_bits(reader, 1) == 1) {
+            decoder->prev_leading = read_bits(reader, 5);
+            uint8_t length = read_bits(reader, 5) + 1;
+            decoder->prev_trailing = 32 - decoder->prev_leading - length;
+        }
+        uint8_t length = 32 - decoder->prev_leading - decoder->prev_trailing;
+        decoder->prev_value ^= read_bits(reader, length) << decoder->prev_trailing;
+    }
+
+    decoder->remaining--;
+    *out_value = bits_to_float(decoder->prev_value);
+    return true;
+}
@@ -0,0 +1,213 @@
+#include "history.h"
+#include <math.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "gorilla.h"
+
+static const char *TAG = "history";
+
+static const char *metric_names[HISTORY_METRIC_COUNT] = {
+    [HISTORY_TEMPERATURE] = "temp",
+    [HISTORY_HUMIDITY] = "hum",
+    [HISTORY_ILLUMINANCE] = "illuminance",
+    [HISTORY_HEARTRATE] = "heartrate",
+#if PRESSURE_SENSOR_ENABLED
+    [HISTORY_PRESSURE] = "pressure",
+#endif
+};
+
+// All metrics share one timestamp stream, every metric has its own value stream
+typedef struct history_block {
+    uint32_t first_timestamp;
+    uint32_t last_timestamp;
+    uint16_t rows;
+    uint16_t time_bits;
+    uint16_t value_bits[HISTORY_METRIC_COUNT];
+    uint8_t time_data[HISTORY_TIME_BYTES];
+    uint8_t value_data[HISTORY_METRIC_COUNT][HISTORY_VALUE_BYTES];
+} history_block_t;
+
+static history_block_t blocks[HISTORY_BLOCK_COUNT];
+static size_t start = 0;
+static size_t block_count = 0;
+
+// Encoders of the newest block, the only one that is appended to
+static gorilla_time_encoder_t time_encoder;
+static gorilla_value_encoder_t value_encoders[HISTORY_METRIC_COUNT];
+
+static SemaphoreHandle_t lock = NULL;
+
+static inline history_block_t *block_at(size_t position) {
+    return &blocks[(start + position) % HISTORY_BLOCK_COUNT];
+}
+
+// A row can only be appended if the worst case encoding fits into every stream, so no stream is ever partially written
+static bool block_has_room(void) {
+    if (block_at(block_count - 1)->rows >= HISTORY_BLOCK_ROWS
+        || time_encoder.writer.bit_len + GORILLA_MAX_TIME_BITS > time_encoder.writer.capacity_bits) {
+        return false;
+    }
+    for (int metric = 0; metric < HISTORY_METRIC_COUNT; metric++) {
+        if (value_encoders[metric].writer.bit_len + GORILLA_MAX_VALUE_BITS > value_encoders[metric].writer.capacity_bits) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void open_block(uint32_t timestamp) {
+    if (block_count == HISTORY_BLOCK_COUNT) {
+        start = (start + 1) % HISTORY_BLOCK_COUNT;
+        block_count--;
+    }
+
+    history_block_t *block = block_at(block_count);
+    block_count++;
+
+    block->first_timestamp = timestamp;
+    block->last_timestamp = timestamp;
+    block->rows = 0;
+    block->time_bits = 0;
+    gorilla_time_encoder_init(&time_encoder, block->time_data, HISTORY_TIME_BYTES);
+    for (int metric = 0; metric < HISTORY_METRIC_COUNT; metric++) {
+        block->value_bits[metric] = 0;
+        gorilla_value_encoder_init(&value_encoders[metric], block->value_data[metric], HISTORY_VALUE_BYTES);
+    }
+}
+
+// Position of the first block that may contain rows with a timestamp >= timestamp
+static size_t lower_bound(uint32_t timestamp) {
+    size_t low = 0;
+    size_t high = block_count;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (block_at(mid)->last_timestamp < timestamp) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+esp_err_t history_init(void) {
+    lock = xSemaphoreCreateMutex();
+    if (lock == NULL) {
+        ESP_LOGE(TAG, "Semaphore creation failed!");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Keeping %d blocks of up to %d rows (%u bytes)", HISTORY_BLOCK_COUNT, HISTORY_BLOCK_ROWS, (unsigned int) sizeof(blocks));
+    return ESP_OK;
+}
+
+void history_append(uint32_t timestamp, const float row_values[HISTORY_METRIC_COUNT]) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    if (block_count > 0) {
+        // The timestamps have to stay sorted for the binary search
+        uint32_t last_timestamp = block_at(block_count - 1)->last_timestamp;
+        if (timestamp < last_timestamp) {
+            timestamp = last_timestamp;
+        }
+    }
+
+    if (block_count == 0 || !block_has_room()) {
+        open_block(timestamp);
+    }
+
+    history_block_t *block = block_at(block_count - 1);
+    gorilla_time_encoder_append(&time_encoder, timestamp);
+    block->time_bits = time_encoder.writer.bit_len;
+    for (int metric = 0; metric < HISTORY_METRIC_COUNT; metric++) {
+        gorilla_value_encoder_append(&value_encoders[metric], row_values[metric]);
+        block->value_bits[metric] = value_encoders[metric].writer.bit_len;
+    }
+    block->last_timestamp = timestamp;
+    block->rows++;
+
+    xSemaphoreGive(lock);
+}
+
+bool history_metric_from_name(const char *name, history_metric_t *out_metric) {
+    for (int metric = 0; metric < HISTORY_METRIC_COUNT; metric++) {
+        if (strcmp(name, metric_names[metric]) == 0) {
+            *out_metric = metric;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t history_query(history_metric_t metric, uint32_t from, uint32_t to, uint32_t step, history_point_t *out_points, size_t max_points, uint32_t *next_from) {
+    size_t points = 0;
+    uint32_t bucket_start = from;
+    float sum = 0;
+    uint32_t samples = 0;
+
+    if (step == 0) {
+        step = 1;
+    }
+    *next_from = to + 1;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    for (size_t position = lower_bound(from); position < block_count; position++) {
+        history_block_t *block = block_at(position);
+        if (block->first_timestamp > to) {
+            break;
+        }
+
+        gorilla_time_decoder_t time_decoder;
+        gorilla_value_decoder_t value_decoder;
+        gorilla_time_decoder_init(&time_decoder, block->time_data, block->time_bits, block->rows);
+        gorilla_value_decoder_init(&value_decoder, block->value_data[metric], block->value_bits[metric], block->rows);
+
+        uint32_t timestamp;
+        float value;
+        while (gorilla_time_decoder_next(&time_decoder, &timestamp) && gorilla_value_decoder_next(&value_decoder, &value)) {
+            if (timestamp < from || isnan(value)) {
+                continue;
+            }
+            if (timestamp > to) {
+                break;
+            }
+
+            uint32_t bucket = from + ((timestamp - from) / step) * step;
+            if (samples > 0 && bucket != bucket_start) {
+                if (points == max_points) {
+                    *next_from = bucket_start;
+                    xSemaphoreGive(lock);
+                    return points;
+                }
+                out_points[points].timestamp = bucket_start;
+                out_points[points].value = sum / samples;
+                points++;
+                sum = 0;
+                samples = 0;
+            }
+
+            bucket_start = bucket;
+            sum += value;
+            samples++;
+        }
+    }
+
+    xSemaphoreGive(lock);
+
+    if (samples > 0) {
+        if (points == max_points) {
+            *next_from = bucket_start;
+            return points;
+        }
+        out_points[points].timestamp = bucket_start;
+        out_points[points].value = sum / samples;
+        points++;
+    }
+
+    return points;
+}
@@ -0,0 +1,103 @@
+#include "hr_estimator.h"
+#include <math.h>
+#include <string.h>
+
+#define RING_INDEX(i) ((i) % HR_ESTIMATOR_MAX_INTERVALS)
+
+static void remove_oldest_interval(hr_estimator_t *estimator) {
+    uint8_t oldest = RING_INDEX(estimator->head + HR_ESTIMATOR_MAX_INTERVALS - estimator->count);
+    uint64_t interval = estimator->intervals[oldest];
+
+    if (estimator->count > 1) {
+        int64_t diff = (int64_t) estimator->intervals[RING_INDEX(oldest + 1)] - (int64_t) interval;
+        estimator->diff_sq_sum -= diff * diff;
+    }
+    estimator->interval_sum -= interval;
+    estimator->interval_sq_sum -= interval * interval;
+    estimator->count--;
+}
+
+static void add_interval(hr_estimator_t *estimator, uint32_t interval_ms) {
+    if (estimator->count >= estimator->window) {
+        remove_oldest_interval(estimator);
+    }
+
+    if (estimator->count > 0) {
+        int64_t diff = (int64_t) interval_ms - (int64_t) estimator->intervals[RING_INDEX(estimator->head + HR_ESTIMATOR_MAX_INTERVALS - 1)];
+        estimator->diff_sq_sum += diff * diff;
+    }
+    estimator->intervals[estimator->head] = interval_ms;
+    estimator->head = RING_INDEX(estimator->head + 1);
+    estimator->count++;
+    estimator->interval_sum += interval_ms;
+    estimator->interval_sq_sum += (uint64_t) interval_ms * interval_ms;
+}
+
+void hr_estimator_init(hr_estimator_t *estimator, uint32_t sample_rate_hz, uint16_t min_peak, uint8_t window, uint32_t timeout_ms) {
+    memset(estimator, 0, sizeof(hr_estimator_t));
+    estimator->sample_rate_hz = sample_rate_hz;
+    // Anything faster than HR_ESTIMATOR_MAX_BPM is part of the same pulse
+    beat_detector_init(&estimator->detector, sample_rate_hz, min_peak, 60000 / HR_ESTIMATOR_MAX_BPM);
+    estimator->window = window > HR_ESTIMATOR_MAX_INTERVALS ? HR_ESTIMATOR_MAX_INTERVALS : window;
+    estimator->timeout_samples = (uint64_t) timeout_ms * sample_rate_hz / 1000;
+}
+
+void hr_estimator_reset(hr_estimator_t *estimator) {
+    beat_detector_reset(&estimator->detector);
+    estimator->has_last_beat = false;
+    estimator->head = 0;
+    estimator->count = 0;
+    estimator->interval_sum = 0;
+    estimator->interval_sq_sum = 0;
+    estimator->diff_sq_sum = 0;
+}
+
+bool hr_estimator_add_sample(hr_estimator_t *estimator, uint16_t value) {
+    uint64_t beat_sample;
+    bool beat = beat_detector_add_sample(&estimator->detector, value, &beat_sample);
+    uint64_t sample = estimator->detector.sample_index - 1;
+
+    if (beat) {
+        if (estimator->has_last_beat) {
+            uint32_t interval_ms = (beat_sample - estimator->last_beat_sample) * 1000 / estimator->sample_rate_hz;
+            if (interval_ms <= 60000 / HR_ESTIMATOR_MIN_BPM) {
+                add_interval(estimator, interval_ms);
+            }
+        }
+        estimator->has_last_beat = true;
+        estimator->last_beat_sample = beat_sample;
+    }
+
+    // A gap breaks the chain of intervals, the window has to be refilled
+    if (estimator->has_last_beat && sample - estimator->last_beat_sample > estimator->timeout_samples) {
+        hr_estimator_reset(estimator);
+    }
+
+    return beat;
+}
+
+void hr_estimator_get_stats(const hr_estimator_t *estimator, hr_estimator_stats_t *out_stats) {
+    uint8_t n = estimator->count;
+
+    out_stats->intervals = n;
+    out_stats->bpm = 0;
+    out_stats->rmssd_ms = NAN;
+    out_stats->sdnn_ms = NAN;
+
+    if (n == 0 || estimator->interval_sum == 0) {
+        return;
+    }
+
+    uint64_t bpm = (60000ULL * n + estimator->interval_sum / 2) / estimator->interval_sum;
+    out_stats->bpm = bpm > UINT8_MAX ? UINT8_MAX : bpm;
+
+    if (n < 2) {
+        return;
+    }
+
+    out_stats->rmssd_ms = sqrtf((float) estimator->diff_sq_sum / (n - 1));
+
+    // n * sum(x^2) - sum(x)^2 is exact in integers, only the final division is done in float
+    uint64_t scaled_variance = n * estimator->interval_sq_sum - estimator->interval_sum * estimator->interval_sum;
+    out_stats->sdnn_ms = sqrtf((float) scaled_variance / ((uint32_t) n * (n - 1)));
+}
@@ -1,116 +1,136 @@
 #include "hx710b.h"
-#include "driver/gpio.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include <rom/ets_sys.h>
-
-uint8_t shiftInSlow(uint8_t dataPin, uint8_t clockPin, bit_order_t bitOrder) {
-    uint8_t value = 0;
-    uint8_t i;
-
-    for(i = 0; i < 8; ++i) {
-        gpio_set_level(clockPin, 1);
-        ets_delay_us(1);
-        if(bitOrder == LSBFIRST)
-            value |= gpio_get_level(dataPin) << i;
-        else
-            value |= gpio_get_level(dataPin) << (7 - i);
-        gpio_set_level(clockPin, 0);
-        ets_delay_us(1);
+#include "esp_log.h"
+
+// The HX710B shifts a bit out on the rising SCK edge, it is sampled on the falling edge (SPI mode 1).
+// SCK must not stay high for more than 50 us, otherwise the sensor powers down.
+#define HX710B_SPI_CLOCK_HZ 1000000
+#define HX710B_DATA_BITS 24
+
+static const char *TAG = "hx710b";
+
+static void IRAM_ATTR hx710b_isr_handler(void *arg) {
+    hx710b_t *sensor = (hx710b_t *) arg;
+    BaseType_t higher_priority_task_woken = pdFALSE;
+
+    // DOUT is also the MISO line, the interrupt must stay off while the bits are clocked out
+    gpio_intr_disable(sensor->dout);
+    if (sensor->waiting_task != NULL) {
+        vTaskNotifyGiveFromISR(sensor->waiting_task, &higher_priority_task_woken);
     }
-    return value;
+    portYIELD_FROM_ISR(higher_priority_task_woken);
 }
 
-void hx710b_init(hx710b_t *sensor, unsigned int sck, unsigned int dout, hx710b_gain_t gain) {
+esp_err_t hx710b_init(hx710b_t *sensor, gpio_num_t sck, gpio_num_t dout, hx710b_gain_t gain, spi_host_device_t host) {
     sensor->sck = sck;
     sensor->dout = dout;
     sensor->gain = gain;
+    sensor->host = host;
+    sensor->spi = NULL;
+    sensor->waiting_task = NULL;
+
+    spi_bus_config_t bus_config = {
+        .mosi_io_num = -1,
+        .miso_io_num = dout,
+        .sclk_io_num = sck,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = 4,
+    };
+    esp_err_t err = spi_bus_initialize(host, &bus_config, SPI_DMA_DISABLED);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "SPI bus initialization failed: %s", esp_err_to_name(err));
+        return err;
+    }
 
-    gpio_reset_pin(sensor->sck);
-    gpio_set_direction(sensor->sck, GPIO_MODE_OUTPUT);
-    
-    gpio_reset_pin(sensor->dout);
-    gpio_set_direction(sensor->dout, GPIO_MODE_INPUT);
-    gpio_set_pull_mode(sensor->dout, GPIO_PULLUP_ONLY);
-}
-
-int hx710b_is_ready(hx710b_t *sensor) {
-    return gpio_get_level(sensor->dout) == 0;
-}
-
-void hx710b_wait_ready(hx710b_t *sensor, unsigned int delay_ms) {
-    while (!hx710b_is_ready(sensor)) {
-        vTaskDelay(pdMS_TO_TICKS(delay_ms));
+    spi_device_interface_config_t device_config = {
+        .mode = 1,
+        .clock_speed_hz = HX710B_SPI_CLOCK_HZ,
+        .spics_io_num = -1,
+        .flags = SPI_DEVICE_HALFDUPLEX,
+        .queue_size = 1,
+    };
+    err = spi_bus_add_device(host, &device_config, &sensor->spi);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Adding the SPI device failed: %s", esp_err_to_name(err));
+        spi_bus_free(host);
+        return err;
     }
-}
 
-long hx710b_read(hx710b_t *sensor) {
-    hx710b_wait_ready(sensor, 10);
+    gpio_set_pull_mode(dout, GPIO_PULLUP_ONLY);
+    gpio_set_intr_type(dout, GPIO_INTR_NEGEDGE);
+    gpio_intr_disable(dout);
+    err = gpio_isr_handler_add(dout, hx710b_isr_handler, sensor);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Adding the DOUT interrupt handler failed: %s", esp_err_to_name(err));
+        spi_bus_remove_device(sensor->spi);
+        spi_bus_free(host);
+        return err;
+    }
 
-    unsigned long value = 0;
-	uint8_t data[3] = { 0 };
-	uint8_t filler = 0x00;
+    return ESP_OK;
+}
 
-    // Begin of critical section.
-	// Critical sections are used as a valid protection method
-	// against simultaneous access in vanilla FreeRTOS.
-	// Disable the scheduler and call portDISABLE_INTERRUPTS. This prevents
-	// context switches and servicing of ISRs during a critical section.
-	portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
-	portENTER_CRITICAL(&mux);
+esp_err_t hx710b_free(hx710b_t *sensor) {
+    gpio_intr_disable(sensor->dout);
+    gpio_isr_handler_remove(sensor->dout);
 
-    // Pulse the clock pin 24 times to read the data.
-    for (u_int8_t i = 3; i--;) {
-        data[i] = shiftInSlow(sensor->dout, sensor->sck, MSBFIRST);
+    esp_err_t err = spi_bus_remove_device(sensor->spi);
+    if (err != ESP_OK) {
+        return err;
     }
+    sensor->spi = NULL;
+    return spi_bus_free(sensor->host);
+}
 
-    // Config gain + channel for next read
-    for (size_t i = 0; i <= sensor->gain; i++) {
-        gpio_set_level(sensor->sck, 1);
-        ets_delay_us(1);
-        gpio_set_level(sensor->sck, 0);
-        ets_delay_us(1);
-    }
+int hx710b_is_ready(hx710b_t *sensor) {
+    return gpio_get_level(sensor->dout) == 0;
+}
 
-    // End of critical section.
-	portEXIT_CRITICAL(&mux);
+static esp_err_t wait_ready(hx710b_t *sensor, u_int32_t timeout_ms) {
+    ulTaskNotifyTake(pdTRUE, 0);
+    sensor->waiting_task = xTaskGetCurrentTaskHandle();
+    gpio_intr_enable(sensor->dout);
 
-    // Replicate the most significant bit to pad out a 32-bit signed integer
-	if (data[2] & 0x80) {
-		filler = 0xFF;
-	} else {
-		filler = 0x00;
-	}
+    // The falling edge may have happened before the interrupt was enabled
+    if (hx710b_is_ready(sensor)) {
+        gpio_intr_disable(sensor->dout);
+        sensor->waiting_task = NULL;
+        return ESP_OK;
+    }
 
-	// Construct a 32-bit signed integer
-	value = ( (unsigned long)filler << 24
-			| (unsigned long)data[2] << 16
-			| (unsigned long)data[1] << 8
-			| (unsigned long)data[0] );
+    uint32_t notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    gpio_intr_disable(sensor->dout);
+    sensor->waiting_task = NULL;
 
-	return (long)(value);
+    return notified ? ESP_OK : ESP_ERR_TIMEOUT;
 }
 
-long hx710b_read_average(hx710b_t *sensor, uint8_t times) {
-    long sum = 0;
-    for (uint8_t i = 0; i < times; i++) {
-        sum += hx710b_read(sensor);
-        vTaskDelay(pdMS_TO_TICKS(1));
+esp_err_t hx710b_read(hx710b_t *sensor, int32_t *value, u_int32_t timeout_ms) {
+    esp_err_t err = wait_ready(sensor, timeout_ms);
+    if (err != ESP_OK) {
+        return err;
     }
-    return sum / times;
-}
 
-// TODO: Fix this shit
-float hx710b_read_hpa(hx710b_t *sensor) {
-    float value = (((hx710b_read_average(sensor, 10) * HX710B_RES) - 40) * 760) / 101.325;
-    return value;
-}
+    // 24 data bits and the pulses of hx710b_gain_t. The bit-banged read looped to i <= gain and sent one pulse more,
+    // 26 for HX710B_GAIN_128, which switched the following conversions to the supply voltage at 40 Hz.
+    spi_transaction_t transaction = {
+        .flags = SPI_TRANS_USE_RXDATA,
+        .length = 0,
+        .rxlength = HX710B_DATA_BITS + sensor->gain,
+    };
+    err = spi_device_polling_transmit(sensor->spi, &transaction);
+    if (err != ESP_OK) {
+        return err;
+    }
 
-void hx710b_power_down(hx710b_t *sensor){
-    gpio_set_level(sensor->sck, 0);
-    gpio_set_level(sensor->sck, 1);
-}
+    // MSB first, sign extend the 24-bit two's complement value
+    uint32_t raw = (uint32_t) transaction.rx_data[0] << 16
+        | (uint32_t) transaction.rx_data[1] << 8
+        | (uint32_t) transaction.rx_data[2];
+    if (raw & 0x800000) {
+        raw |= 0xff000000;
+    }
+    *value = (int32_t) raw;
 
-void hx710b_power_up(hx710b_t *sensor){
-    gpio_set_level(sensor->sck, 0);
-}
\ No newline at end of file
+    return ESP_OK;
+}
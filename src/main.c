@@ -5,14 +5,22 @@
 #include "am2320.h"
 #include "tsl2561.h"
 #include "hx710b.h"
+#include "pressure_filter.h"
 #include "heartrate.h"
-#include "esp_adc/adc_oneshot.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "sdkconfig.h"
 #include "adc.h"
 #include "wifi.h"
 #include "webserver.h"
+#include "scheduler.h"
+#include "history.h"
+#include "remote_write.h"
+#include "stream.h"
+#include "metrics.h"
+#include "calibration.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
 #include "config.h"
 #include "secrets.h"
 
@@ -40,6 +48,341 @@ void gpio_task(void* arg) {
     }
 }
 
+// Sample timestamps are taken when the sensor was read, so /metrics doesn't pretend that old values are fresh.
+// A sensor that stops updating turns its values into NaN after a few of its periods.
+static metric_t illuminance_metric = {
+    .name = "illuminance_lux",
+    .help = "Light intensity in lux",
+    .type = METRICS_GAUGE,
+    .stale_after_ms = METRICS_STALE_PERIODS * ILLUMINANCE_PERIOD_MS
+};
+static metric_t temperature_metric = {
+    .name = "temperature_celsius",
+    .help = "Temperature in celsius",
+    .type = METRICS_GAUGE,
+    .stale_after_ms = METRICS_STALE_PERIODS * TEMPERATURE_PERIOD_MS
+};
+static metric_t humidity_metric = {
+    .name = "humidity_relative",
+    .help = "Relative humidity in percent",
+    .type = METRICS_GAUGE,
+    .stale_after_ms = METRICS_STALE_PERIODS * TEMPERATURE_PERIOD_MS
+};
+static metric_t heartrate_metric = {
+    .name = "heartrate_bpm",
+    .help = "Heart rate in beats per minute",
+    .type = METRICS_GAUGE,
+    .stale_after_ms = METRICS_STALE_PERIODS * HEARTRATE_PUBLISH_INTERVAL_MS
+};
+static metric_t heartrate_rmssd_metric = {
+    .name = "heartrate_rmssd_milliseconds",
+    .help = "Root mean square of successive heart beat interval differences",
+    .type = METRICS_GAUGE,
+    .stale_after_ms = METRICS_STALE_PERIODS * HEARTRATE_PUBLISH_INTERVAL_MS
+};
+static metric_t heartrate_sdnn_metric = {
+    .name = "heartrate_sdnn_milliseconds",
+    .help = "Standard deviation of heart beat intervals",
+    .type = METRICS_GAUGE,
+    .stale_after_ms = METRICS_STALE_PERIODS * HEARTRATE_PUBLISH_INTERVAL_MS
+};
+
+#if PRESSURE_SENSOR_ENABLED
+static metric_t pressure_metric = {
+    .name = "pressure_hpa",
+    .help = "Filtered air pressure in hectopascal",
+    .type = METRICS_GAUGE,
+    .stale_after_ms = METRICS_STALE_PERIODS * PRESSURE_PERIOD_MS
+};
+#endif
+
+static metric_t illuminance_gain_metric = {
+    .name = "illuminance_sensor_gain",
+    .help = "Gain chosen by the TSL2561 auto ranging",
+    .type = METRICS_GAUGE,
+    .stale_after_ms = METRICS_STALE_PERIODS * ILLUMINANCE_PERIOD_MS
+};
+static metric_t illuminance_integration_metric = {
+    .name = "illuminance_sensor_integration_seconds",
+    .help = "Integration time chosen by the TSL2561 auto ranging",
+    .type = METRICS_GAUGE,
+    .stale_after_ms = METRICS_STALE_PERIODS * ILLUMINANCE_PERIOD_MS
+};
+static metric_t illuminance_saturated_metric = {
+    .name = "illuminance_sensor_saturated",
+    .help = "1 if the TSL2561 saturated in its least sensitive range and the illuminance is a lower bound",
+    .type = METRICS_GAUGE,
+    .stale_after_ms = METRICS_STALE_PERIODS * ILLUMINANCE_PERIOD_MS
+};
+
+static metric_t *sensor_metrics[] = {
+    &illuminance_metric,
+    &illuminance_gain_metric,
+    &illuminance_integration_metric,
+    &illuminance_saturated_metric,
+    &temperature_metric,
+    &humidity_metric,
+    &heartrate_metric,
+    &heartrate_rmssd_metric,
+    &heartrate_sdnn_metric,
+#if PRESSURE_SENSOR_ENABLED
+    &pressure_metric,
+#endif
+};
+
+static const float tsl2561_integration_seconds[] = {
+    [TSL2561_INTEGRATION_13MS] = 0.0137,
+    [TSL2561_INTEGRATION_101MS] = 0.101,
+    [TSL2561_INTEGRATION_402MS] = 0.402,
+};
+
+static esp_err_t sample_illuminance(sensor_task_t *task) {
+    tsl2561_t *tsl2561 = (tsl2561_t *) task->sensor;
+    u_int32_t raw_illuminance = 0;
+    esp_err_t res = tsl2561_read_lux(tsl2561, &raw_illuminance);
+    if (res == ESP_ERR_NOT_FINISHED) {
+        // No conversion completed since the start yet
+        return ESP_OK;
+    }
+    if (res != ESP_OK) {
+        return res;
+    }
+    int32_t illuminance = calibration_apply(CALIBRATION_ILLUMINANCE, raw_illuminance);
+    if (illuminance < 0) {
+        illuminance = 0;
+    }
+
+    if (webserver_sensor_data_begin_update(task->data)) {
+        task->data->values.illuminance = (illuminance + 500) / 1000;
+        metrics_set(&illuminance_metric, illuminance / 1000.0f);
+        metrics_set(&illuminance_gain_metric, tsl2561->gain == TSL2561_GAIN_16X ? 16 : 1);
+        metrics_set(&illuminance_integration_metric, tsl2561_integration_seconds[tsl2561->integration_time]);
+        metrics_set(&illuminance_saturated_metric, tsl2561->saturated);
+        webserver_sensor_data_mark_sampled(task->data, WEBSERVER_SENSOR_TSL2561);
+        webserver_sensor_data_end_update(task->data);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t sample_temperature_humidity(sensor_task_t *task) {
+    int16_t raw_temperature = 0;
+    u_int16_t raw_humidity = 0;
+    esp_err_t res = am2320_get_rht_raw_cached((am2320_reader_t *) task->sensor, &raw_temperature, &raw_humidity);
+    if (res != ESP_OK) {
+        return res;
+    }
+    float temperature = calibration_apply(CALIBRATION_TEMPERATURE, raw_temperature) / 1000.0f;
+    float humidity = calibration_apply(CALIBRATION_HUMIDITY, raw_humidity) / 1000.0f;
+
+    if (webserver_sensor_data_begin_update(task->data)) {
+        task->data->values.temperature = temperature;
+        task->data->values.humidity = humidity;
+        metrics_set(&temperature_metric, temperature);
+        metrics_set(&humidity_metric, humidity);
+        webserver_sensor_data_mark_sampled(task->data, WEBSERVER_SENSOR_AM2320);
+        webserver_sensor_data_end_update(task->data);
+    }
+    return ESP_OK;
+}
+
+typedef struct heart_rate_sensor {
+    adc_continuous_unit_t adc;
+    hr_estimator_t estimator;
+    u_int8_t published_intervals;
+    int64_t published_ms;
+} heart_rate_sensor_t;
+
+static esp_err_t sample_heartrate(sensor_task_t *task) {
+    heart_rate_sensor_t *sensor = (heart_rate_sensor_t *) task->sensor;
+    u_int32_t beats = 0;
+
+    esp_err_t res = heart_rate_process_frame(&sensor->adc, &sensor->estimator, HEARTBEAT_TIMEOUT_MS, HEARTBEAT_LED_GPIO, &beats);
+    if (res != ESP_OK) {
+        return res;
+    }
+    if (beats > 0) {
+        stream_publish_heartbeats(beats);
+    }
+
+    // Only publish when the interval window changed, not for every frame, and often enough to not go stale
+    int64_t uptime_ms = esp_timer_get_time() / 1000;
+    bool refresh = uptime_ms - sensor->published_ms >= HEARTRATE_PUBLISH_INTERVAL_MS;
+    if (beats == 0 && sensor->estimator.count == sensor->published_intervals && !refresh) {
+        return ESP_OK;
+    }
+    sensor->published_ms = uptime_ms;
+
+    hr_estimator_stats_t stats;
+    hr_estimator_get_stats(&sensor->estimator, &stats);
+    sensor->published_intervals = stats.intervals;
+
+    if (webserver_sensor_data_begin_update(task->data)) {
+        task->data->values.heartrate = stats.bpm;
+        task->data->values.heartrate_rmssd = stats.rmssd_ms;
+        task->data->values.heartrate_sdnn = stats.sdnn_ms;
+        metrics_set(&heartrate_metric, stats.bpm);
+        metrics_set(&heartrate_rmssd_metric, stats.rmssd_ms);
+        metrics_set(&heartrate_sdnn_metric, stats.sdnn_ms);
+        webserver_sensor_data_mark_sampled(task->data, WEBSERVER_SENSOR_HEARTRATE);
+        webserver_sensor_data_end_update(task->data);
+    }
+    return ESP_OK;
+}
+
+#if PRESSURE_SENSOR_ENABLED
+typedef struct pressure_sensor {
+    hx710b_t hx710b;
+    pressure_filter_t filter;
+} pressure_sensor_t;
+
+// Runs back to back, every conversion of the sensor goes through the filter
+static esp_err_t acquire_pressure(sensor_task_t *task) {
+    pressure_sensor_t *sensor = (pressure_sensor_t *) task->sensor;
+    int32_t conversion;
+    esp_err_t err = hx710b_read(&sensor->hx710b, &conversion, HX710B_CONVERSION_TIMEOUT_MS);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    pressure_filter_add(&sensor->filter, conversion);
+    return ESP_OK;
+}
+
+static esp_err_t sample_pressure(sensor_task_t *task) {
+    pressure_sensor_t *sensor = (pressure_sensor_t *) task->sensor;
+    int32_t filtered;
+    if (!pressure_filter_get(&sensor->filter, &filtered)) {
+        // No conversion yet
+        return ESP_OK;
+    }
+    if (!calibration_is_valid(CALIBRATION_PRESSURE)) {
+        // The conversions are only relative to AVDD, nothing is published before a calibration was stored
+        static bool warned = false;
+        if (!warned) {
+            ESP_LOGW(TAG, "The pressure isn't calibrated, POST the coefficients to /calibration?sensor=pressure");
+            warned = true;
+        }
+        return ESP_OK;
+    }
+    float pressure = calibration_apply(CALIBRATION_PRESSURE, filtered) / 1000.0f;
+
+    if (webserver_sensor_data_begin_update(task->data)) {
+        task->data->values.pressure = pressure;
+        metrics_set(&pressure_metric, pressure);
+        webserver_sensor_data_mark_sampled(task->data, WEBSERVER_SENSOR_HX710B);
+        webserver_sensor_data_end_update(task->data);
+    }
+    return ESP_OK;
+}
+#endif
+
+static esp_err_t record_history(sensor_task_t *task) {
+    webserver_sensor_values_t values;
+    webserver_sensor_data_read(task->data, &values);
+
+    float row[HISTORY_METRIC_COUNT] = {
+        [HISTORY_TEMPERATURE] = values.temperature,
+        [HISTORY_HUMIDITY] = values.humidity,
+        [HISTORY_ILLUMINANCE] = values.illuminance,
+        [HISTORY_HEARTRATE] = values.heartrate,
+#if PRESSURE_SENSOR_ENABLED
+        [HISTORY_PRESSURE] = values.pressure,
+#endif
+    };
+    history_append(esp_timer_get_time() / 1000000, row);
+    return ESP_OK;
+}
+
+#if REMOTE_WRITE_ENABLED
+static esp_err_t record_remote_write(sensor_task_t *task) {
+    webserver_sensor_values_t values;
+    webserver_sensor_data_read(task->data, &values);
+
+    remote_write_append(&values);
+    return ESP_OK;
+}
+#endif
+
+// Everything the sensor tasks use has to outlive app_main
+static i2c_dev_t am2320_i2c_dev = {0};
+static am2320_reader_t am2320_reader = {0};
+static tsl2561_t tsl2561_dev = {0};
+static heart_rate_sensor_t heart_rate_sensor = {0};
+#if PRESSURE_SENSOR_ENABLED
+static pressure_sensor_t pressure_sensor = {0};
+#endif
+static webserver_sensor_data_t webserver_sensor_data = {0};
+
+static sensor_task_t sensor_tasks[] = {
+    {
+        .name = "tsl2561_task",
+        .period_ms = ILLUMINANCE_PERIOD_MS,
+        .deadline_ms = ILLUMINANCE_DEADLINE_MS,
+        .sample = sample_illuminance,
+        .sensor = &tsl2561_dev,
+        .data = &webserver_sensor_data,
+        .status = WEBSERVER_SENSOR_TSL2561
+    },
+    {
+        .name = "am2320_task",
+        .period_ms = TEMPERATURE_PERIOD_MS,
+        .deadline_ms = TEMPERATURE_DEADLINE_MS,
+        .sample = sample_temperature_humidity,
+        .sensor = &am2320_reader,
+        .data = &webserver_sensor_data,
+        .status = WEBSERVER_SENSOR_AM2320
+    },
+    {
+        .name = "heartrate_task",
+        .period_ms = HEARTRATE_PERIOD_MS,
+        .deadline_ms = HEARTRATE_DEADLINE_MS,
+        .sample = sample_heartrate,
+        .sensor = &heart_rate_sensor,
+        .data = &webserver_sensor_data,
+        .status = WEBSERVER_SENSOR_HEARTRATE
+    },
+    {
+        .name = "history_task",
+        .period_ms = HISTORY_PERIOD_MS,
+        .deadline_ms = HISTORY_DEADLINE_MS,
+        .sample = record_history,
+        .sensor = NULL,
+        .data = &webserver_sensor_data,
+        .status = WEBSERVER_SENSOR_NONE
+    },
+#if REMOTE_WRITE_ENABLED
+    {
+        .name = "push_sample_task",
+        .period_ms = REMOTE_WRITE_SAMPLE_PERIOD_MS,
+        .deadline_ms = REMOTE_WRITE_SAMPLE_DEADLINE_MS,
+        .sample = record_remote_write,
+        .sensor = NULL,
+        .data = &webserver_sensor_data,
+        .status = WEBSERVER_SENSOR_NONE
+    },
+#endif
+#if PRESSURE_SENSOR_ENABLED
+    {
+        .name = "hx710b_task",
+        .period_ms = PRESSURE_ACQUIRE_PERIOD_MS,
+        .deadline_ms = PRESSURE_ACQUIRE_DEADLINE_MS,
+        .sample = acquire_pressure,
+        .sensor = &pressure_sensor,
+        .data = &webserver_sensor_data,
+        .status = WEBSERVER_SENSOR_HX710B
+    },
+    {
+        .name = "pressure_task",
+        .period_ms = PRESSURE_PERIOD_MS,
+        .deadline_ms = PRESSURE_DEADLINE_MS,
+        .sample = sample_pressure,
+        .sensor = &pressure_sensor,
+        .data = &webserver_sensor_data,
+        .status = WEBSERVER_SENSOR_NONE
+    },
+#endif
+};
+
 void app_main() {
     //-------------LED GPIO Init---------------//
     gpio_reset_pin(WIFI_DISCONNECT_LED_GPIO);
@@ -61,6 +404,12 @@ void app_main() {
     gpio_num_t disconnect_led_pin = WIFI_DISCONNECT_LED_GPIO;
     wifi_init_sta(WIFI_SSID, WIFI_PASS, &disconnect_led_pin);
     
+    //-------------SNTP Init---------------//
+    // The history, the metric timestamps and remote write need the wall clock time
+    esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, SNTP_SERVER);
+    esp_sntp_init();
+
     //-------------Reset GPIO Init---------------//
     gpio_set_direction(RESET_BUTTON_GPIO, GPIO_MODE_INPUT);
     gpio_set_pull_mode(RESET_BUTTON_GPIO, GPIO_PULLDOWN_ONLY);
@@ -76,88 +425,77 @@ void app_main() {
     ESP_ERROR_CHECK(gpio_install_isr_service(0));
     ESP_ERROR_CHECK(gpio_isr_handler_add(RESET_BUTTON_GPIO, gpio_isr_handler, (void*) RESET_BUTTON_GPIO));
 
+    //-------------Calibration Init---------------//
+    ESP_ERROR_CHECK(calibration_init());
+
     //-------------I2C Init---------------//
     ESP_ERROR_CHECK(i2cdev_init());
 
     //-------------AM2320 Init---------------//
-    i2c_dev_t am2320_i2c_dev = {0};
     ESP_ERROR_CHECK(am2320_init_desc(&am2320_i2c_dev, I2C_NUM_0, I2C_SDA_PIN, I2C_SCL_PIN));
+    ESP_ERROR_CHECK(am2320_reader_init(&am2320_reader, &am2320_i2c_dev));
 
     //-------------TSL2561 Init---------------//
-    tsl2561_t tsl2561_dev = {0};
     ESP_ERROR_CHECK(tsl2561_init_desc(&tsl2561_dev, TSL2561_I2C_ADDR_FLOAT, I2C_NUM_0, I2C_SDA_PIN, I2C_SCL_PIN));
     ESP_ERROR_CHECK(tsl2561_init(&tsl2561_dev));
+    ESP_ERROR_CHECK(tsl2561_set_auto_range(&tsl2561_dev, true, ILLUMINANCE_MIN_COUNTS));
+    ESP_ERROR_CHECK(tsl2561_start_measurement(&tsl2561_dev));
 
     //-------------HX710B Init---------------//
-    // hx710b_t hx710b_dev = {0};
-    // hx710b_init(&hx710b_dev, PRESSURE_SENSOR_SCK_PIN, PRESSURE_SENSOR_OUT_PIN, HX710B_GAIN_128);
-
-    // while (1)
-    // {
-    //     float out = hx710b_read_hpa(&hx710b_dev);
-    //     ESP_LOGI(TAG, "Pressure: %f", out);
-    //     vTaskDelay(pdMS_TO_TICKS(1000));
-    // }
+#if PRESSURE_SENSOR_ENABLED
+    ESP_ERROR_CHECK(hx710b_init(&pressure_sensor.hx710b, PRESSURE_SENSOR_SCK_PIN, PRESSURE_SENSOR_OUT_PIN, HX710B_GAIN_128, PRESSURE_SENSOR_SPI_HOST));
+    pressure_filter_init(&pressure_sensor.filter, PRESSURE_MEDIAN_WINDOW, PRESSURE_EMA_SHIFT);
+#endif
 
     //-------------ADC Init---------------//
-    adc_oneshot_unit_t adc_oneshot = {0};
-    adc_oneshot_unit_init(ADC_UNIT_1, ADC_ATTEN, &adc_oneshot);
+    adc_continuous_unit_init(ADC_UNIT_1, HEARTRATE_SENSOR_ADC_CHANNEL, ADC_ATTEN, HEARTRATE_ADC_SAMPLE_FREQ_HZ, HEARTRATE_ADC_FRAME_SIZE, &heart_rate_sensor.adc);
+    ESP_ERROR_CHECK(adc_continuous_start(heart_rate_sensor.adc.adc_handle));
+
+    //-------------Heart Rate Estimator Init---------------//
+    hr_estimator_init(
+        &heart_rate_sensor.estimator,
+        HEARTRATE_ADC_SAMPLE_FREQ_HZ / HEARTRATE_SAMPLES_PER_POINT,
+        HEARTBEAT_MIN_PEAK_MV,
+        HEARTBEAT_INTERVAL_WINDOW,
+        HEARTBEAT_TIMEOUT_MS
+    );
 
-    //-------------ADC Config---------------//
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_oneshot.adc_handle, HEARTRATE_SENSOR_ADC_CHANNEL, &adc_oneshot.adc_chan_config));
+    //-------------History Init---------------//
+    ESP_ERROR_CHECK(history_init());
+
+    //-------------Remote Write Init---------------//
+#if REMOTE_WRITE_ENABLED
+    ESP_ERROR_CHECK(remote_write_init(REMOTE_WRITE_URL, REMOTE_WRITE_JOB));
+    ESP_ERROR_CHECK(remote_write_start(REMOTE_WRITE_PUSH_PERIOD_MS, REMOTE_WRITE_TASK_STACK_SIZE, REMOTE_WRITE_TASK_PRIORITY));
+#endif
+
+    //-------------Metrics Init---------------//
+    for (int i = 0; i < sizeof(sensor_metrics)/sizeof(metric_t *); i++) {
+        ESP_ERROR_CHECK(metrics_register(sensor_metrics[i]));
+    }
 
     //-------------Webserver Init---------------//
-    webserver_sensor_data_t webserver_sensor_data = {0};
     webserver_sensor_data.semaphore = xSemaphoreCreateMutex();
     if(webserver_sensor_data.semaphore == NULL ) {
         ESP_LOGE(TAG, "Semaphore creation failed!");
         return;
     }
-    httpd_handle_t server = start_webserver(80, &webserver_sensor_data);
+    webserver_config_t webserver_config = {
+        .port = WEBSERVER_PORT,
+        .max_open_sockets = WEBSERVER_MAX_OPEN_SOCKETS,
+        .backlog = WEBSERVER_BACKLOG,
+        .lru_purge = WEBSERVER_LRU_PURGE,
+        .keep_alive_idle_s = WEBSERVER_KEEP_ALIVE_IDLE_S,
+        .stack_size = WEBSERVER_STACK_SIZE,
+        .priority = WEBSERVER_TASK_PRIORITY,
+        .core_id = WEBSERVER_CORE_ID
+    };
+    ESP_ERROR_CHECK(stream_start(&webserver_sensor_data, STREAM_TASK_STACK_SIZE, STREAM_TASK_PRIORITY));
+    start_webserver(&webserver_config, &webserver_sensor_data);
 
-    // Update sensor data every 5 seconds
-    for (;;) {
-        // Illuminance
-        u_int32_t illuminance = 0;
-        tsl2561_read_lux(&tsl2561_dev, &illuminance);
-
-        // Temperature and Humidity
-        float temperature = 0;
-        float humidity = 0;
-        esp_err_t res = am2320_get_rht(&am2320_i2c_dev, &temperature, &humidity);
-        if (res != ESP_OK) {
-            ESP_LOGE(TAG, "Error reading AM2320 data: %d (%s)", res, esp_err_to_name(res));
-        }
-
-        // Heart Rate
-        u_int8_t heartrate = get_heart_rate(
-            &adc_oneshot.adc_handle, 
-            HEARTRATE_SENSOR_ADC_CHANNEL, 
-            HEARTBEAT_THRESHOLD, 
-            REQUIRED_HEARTBEATS, 
-            HEARTBEAT_TIMEOUT_MS, 
-            HEARTBEAT_LED_GPIO
-        );
-
-        // Update webserver data
-        if (xSemaphoreTake(webserver_sensor_data.semaphore, portMAX_DELAY) == pdTRUE) {
-            webserver_sensor_data.temperature = temperature;
-            webserver_sensor_data.humidity = humidity;
-            webserver_sensor_data.illuminance = illuminance;
-            webserver_sensor_data.heartrate = heartrate;
-            if (xSemaphoreGive(webserver_sensor_data.semaphore) != pdTRUE) {
-                ESP_LOGE(TAG, "Could not give semaphore!");
-            }
-        } else {
-            ESP_LOGE(TAG, "Could not take semaphore!");
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(5000));
+    //-------------Sensor Tasks---------------//
+    // Every sensor runs in its own task, so a slow sensor (e.g. a missing chest strap) doesn't stall the others
+    for (int i = 0; i < sizeof(sensor_tasks)/sizeof(sensor_task_t); i++) {
+        ESP_ERROR_CHECK(sensor_task_start(&sensor_tasks[i], SENSOR_TASK_STACK_SIZE, SENSOR_TASK_PRIORITY));
     }
-
-    // Tear Down Webserver
-    stop_webserver(server);
-
-    // Tear Down ADC
-    ESP_ERROR_CHECK(adc_oneshot_del_unit(adc_oneshot.adc_handle));
 }
\ No newline at end of file
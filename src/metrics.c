@@ -0,0 +1,138 @@
+#include "metrics.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+// Anything before this (2023-01-01) means that SNTP hasn't synced the clock yet
+#define MIN_VALID_UNIX_TIME 1672531200
+
+static const char *TAG = "metrics";
+
+static const char *type_names[] = {
+    [METRICS_GAUGE] = "gauge",
+    [METRICS_COUNTER] = "counter",
+    [METRICS_HISTOGRAM] = "histogram",
+};
+
+static const char *content_types[METRICS_FORMAT_COUNT] = {
+    [METRICS_FORMAT_PROMETHEUS] = "text/plain; version=0.0.4; charset=utf-8",
+    [METRICS_FORMAT_OPENMETRICS] = "application/openmetrics-text; version=1.0.0; charset=utf-8",
+};
+
+static metric_t *metrics[METRICS_MAX_COUNT];
+static size_t metric_count = 0;
+
+esp_err_t metrics_register(metric_t *metric) {
+    if (metric_count == METRICS_MAX_COUNT) {
+        ESP_LOGE(TAG, "Can't register %s, the registry is full!", metric->name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    metric->value = NAN;
+    metric->timestamp_ms = 0;
+    metric->uptime_ms = 0;
+    metrics[metric_count++] = metric;
+    return ESP_OK;
+}
+
+int64_t metrics_timestamp_ms(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    return now.tv_sec >= MIN_VALID_UNIX_TIME ? (int64_t) now.tv_sec * 1000 + now.tv_usec / 1000 : 0;
+}
+
+void metrics_set(metric_t *metric, float value) {
+    metric->value = value;
+    metric->timestamp_ms = metrics_timestamp_ms();
+    metric->uptime_ms = esp_timer_get_time() / 1000;
+}
+
+static bool is_stale(const metric_t *metric, int64_t uptime_ms) {
+    return metric->stale_after_ms != 0 && uptime_ms - metric->uptime_ms > metric->stale_after_ms;
+}
+
+const char *metrics_content_type(metrics_format_t format) {
+    return content_types[format];
+}
+
+// OpenMetrics requires the _total suffix on counter samples but not in the metric family name
+static const char *sample_suffix(metrics_format_t format, metrics_type_t type, const char *suffix) {
+    if (suffix != NULL) {
+        return suffix;
+    }
+    return format == METRICS_FORMAT_OPENMETRICS && type == METRICS_COUNTER ? "_total" : "";
+}
+
+static int checked_length(int written, size_t size) {
+    return written < 0 || written >= size ? -1 : written;
+}
+
+int metrics_render_family(metrics_format_t format, const char *name, const char *help, metrics_type_t type, char *buffer, size_t size) {
+    return checked_length(snprintf(buffer, size, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type_names[type]), size);
+}
+
+int metrics_render_sample(metrics_format_t format, const char *name, const char *suffix, metrics_type_t type, const char *labels, const char *value, char *buffer, size_t size) {
+    int written = snprintf(
+        buffer,
+        size,
+        "%s%s%s%s%s %s\n",
+        name, sample_suffix(format, type, suffix), labels ? "{" : "", labels ? labels : "", labels ? "}" : "", value
+    );
+    return checked_length(written, size);
+}
+
+int metrics_render_eof(metrics_format_t format, char *buffer, size_t size) {
+    if (format != METRICS_FORMAT_OPENMETRICS) {
+        return 0;
+    }
+    return checked_length(snprintf(buffer, size, "# EOF\n"), size);
+}
+
+int metrics_render(metrics_format_t format, char *buffer, size_t size) {
+    size_t len = 0;
+    int64_t uptime_ms = esp_timer_get_time() / 1000;
+
+    for (size_t i = 0; i < metric_count; i++) {
+        metric_t *metric = metrics[i];
+        char value[16];
+        char timestamp[24] = "";
+        bool stale = is_stale(metric, uptime_ms);
+
+        if (isnan(metric->value) || stale) {
+            snprintf(value, sizeof(value), "NaN");
+        } else {
+            snprintf(value, sizeof(value), "%.7g", metric->value);
+        }
+
+        // Prometheus text uses milliseconds, OpenMetrics seconds, samples without timestamp get the scrape time
+        bool stamped = metric->timestamp_ms != 0 && !stale;
+        if (stamped && format == METRICS_FORMAT_OPENMETRICS) {
+            snprintf(timestamp, sizeof(timestamp), " %" PRId64 ".%03d", metric->timestamp_ms / 1000, (int) (metric->timestamp_ms % 1000));
+        } else if (stamped) {
+            snprintf(timestamp, sizeof(timestamp), " %" PRId64, metric->timestamp_ms);
+        }
+
+        int written = metrics_render_family(format, metric->name, metric->help, metric->type, buffer + len, size - len);
+        if (written < 0) {
+            return -1;
+        }
+        len += written;
+
+        written = snprintf(
+            buffer + len,
+            size - len,
+            "%s%s%s%s%s %s%s\n",
+            metric->name, sample_suffix(format, metric->type, NULL), metric->labels ? "{" : "", metric->labels ? metric->labels : "", metric->labels ? "}" : "", value, timestamp
+        );
+        if (written < 0 || written >= size - len) {
+            return -1;
+        }
+        len += written;
+    }
+
+    return len;
+}
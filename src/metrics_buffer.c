@@ -0,0 +1,46 @@
+#include "metrics_buffer.h"
+
+void metrics_buffer_init(metrics_double_buffer_t *double_buffer) {
+    for (int i = 0; i < 2; i++) {
+        double_buffer->buffers[i].len = 0;
+        atomic_init(&double_buffer->buffers[i].readers, 0);
+    }
+    atomic_init(&double_buffer->current, &double_buffer->buffers[0]);
+}
+
+esp_err_t metrics_buffer_render(metrics_double_buffer_t *double_buffer, metrics_format_t format) {
+    metrics_buffer_t *current = atomic_load(&double_buffer->current);
+    metrics_buffer_t *next = current == &double_buffer->buffers[0] ? &double_buffer->buffers[1] : &double_buffer->buffers[0];
+
+    // A slow client is still sending the previous response, keep the current one until the next update
+    if (atomic_load(&next->readers) != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int len = metrics_render(format, next->data, METRICS_BUFFER_SIZE);
+    if (len < 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    next->len = len;
+
+    atomic_store(&double_buffer->current, next);
+    return ESP_OK;
+}
+
+metrics_buffer_t *metrics_buffer_acquire(metrics_double_buffer_t *double_buffer) {
+    metrics_buffer_t *buffer;
+
+    // Retry if the buffer was swapped before the pin became visible to the writer
+    for (;;) {
+        buffer = atomic_load(&double_buffer->current);
+        atomic_fetch_add(&buffer->readers, 1);
+        if (buffer == atomic_load(&double_buffer->current)) {
+            return buffer;
+        }
+        atomic_fetch_sub(&buffer->readers, 1);
+    }
+}
+
+void metrics_buffer_release(metrics_buffer_t *buffer) {
+    atomic_fetch_sub(&buffer->readers, 1);
+}
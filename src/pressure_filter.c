@@ -0,0 +1,62 @@
+#include "pressure_filter.h"
+
+void pressure_filter_init(pressure_filter_t *filter, uint8_t median_window, uint8_t ema_shift) {
+    if (median_window == 0) {
+        median_window = 1;
+    } else if (median_window > PRESSURE_FILTER_RING_SIZE) {
+        median_window = PRESSURE_FILTER_RING_SIZE;
+    }
+
+    filter->median_window = median_window;
+    filter->ema_shift = ema_shift;
+    filter->head = 0;
+    filter->count = 0;
+    filter->ema = 0;
+    atomic_init(&filter->filtered, 0);
+    atomic_init(&filter->has_value, false);
+}
+
+// Median of the newest conversions, the window is small so an insertion sort is the cheapest
+static int32_t median(const pressure_filter_t *filter) {
+    uint8_t window = filter->count < filter->median_window ? filter->count : filter->median_window;
+    int32_t sorted[PRESSURE_FILTER_RING_SIZE];
+
+    for (uint8_t i = 0; i < window; i++) {
+        int32_t value = filter->conversions[(filter->head + PRESSURE_FILTER_RING_SIZE - 1 - i) % PRESSURE_FILTER_RING_SIZE];
+        int8_t j = i - 1;
+        while (j >= 0 && sorted[j] > value) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = value;
+    }
+
+    return sorted[window / 2];
+}
+
+void pressure_filter_add(pressure_filter_t *filter, int32_t conversion) {
+    filter->conversions[filter->head] = conversion;
+    filter->head = (filter->head + 1) % PRESSURE_FILTER_RING_SIZE;
+    if (filter->count < PRESSURE_FILTER_RING_SIZE) {
+        filter->count++;
+    }
+
+    int64_t value = (int64_t) median(filter) << PRESSURE_FILTER_EMA_FRACTION_BITS;
+    if (!atomic_load(&filter->has_value)) {
+        // Start at the first value instead of slowly rising from 0
+        filter->ema = value;
+    } else {
+        filter->ema += (value - filter->ema) >> filter->ema_shift;
+    }
+
+    atomic_store(&filter->filtered, (int32_t) (filter->ema >> PRESSURE_FILTER_EMA_FRACTION_BITS));
+    atomic_store(&filter->has_value, true);
+}
+
+bool pressure_filter_get(pressure_filter_t *filter, int32_t *out_filtered) {
+    if (!atomic_load(&filter->has_value)) {
+        return false;
+    }
+    *out_filtered = atomic_load(&filter->filtered);
+    return true;
+}
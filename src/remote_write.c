@@ -0,0 +1,424 @@
+#include "remote_write.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_http_client.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "snappy.h"
+#include "config.h"
+
+// Anything before this (2023-01-01) means that SNTP hasn't synced the clock yet
+#define MIN_VALID_UNIX_TIME 1672531200
+#define HTTP_TIMEOUT_MS 10000
+#define BACKOFF_MIN_MS 1000
+#define BACKOFF_MAX_MS 60000
+#define INSTANCE_SIZE 20
+
+#define SERIES_COUNT (sizeof(series_names) / sizeof(series_names[0]))
+
+// Protobuf wire types
+#define WIRE_VARINT 0
+#define WIRE_FIXED64 1
+#define WIRE_LEN 2
+
+static const char *TAG = "remote_write";
+
+// Same names as in the /metrics response
+static const char *series_names[] = {
+    "illuminance_lux",
+    "temperature_celsius",
+    "humidity_relative",
+    "heartrate_bpm",
+    "heartrate_rmssd_milliseconds",
+    "heartrate_sdnn_milliseconds",
+#if PRESSURE_SENSOR_ENABLED
+    "pressure_hpa",
+#endif
+};
+
+// The sensor of every series, a series has no sample in rows taken before its sensor published a value
+static const webserver_sensor_t series_sensors[] = {
+    WEBSERVER_SENSOR_TSL2561,
+    WEBSERVER_SENSOR_AM2320,
+    WEBSERVER_SENSOR_AM2320,
+    WEBSERVER_SENSOR_HEARTRATE,
+    WEBSERVER_SENSOR_HEARTRATE,
+    WEBSERVER_SENSOR_HEARTRATE,
+#if PRESSURE_SENSOR_ENABLED
+    WEBSERVER_SENSOR_HX710B,
+#endif
+};
+
+_Static_assert(sizeof(series_sensors) / sizeof(series_sensors[0]) == SERIES_COUNT, "Every series needs a sensor");
+
+typedef struct remote_write_row {
+    int64_t uptime_ms;
+    float values[SERIES_COUNT];
+} remote_write_row_t;
+
+// Rows are numbered since boot, row n is stored at rows[n % REMOTE_WRITE_BATCH_ROWS]
+static remote_write_row_t rows[REMOTE_WRITE_BATCH_ROWS];
+static u_int32_t first_row = 0;
+static u_int32_t next_row = 0;
+static SemaphoreHandle_t lock = NULL;
+
+// Copy of the rows that are being pushed and the encoded request, only used by the push task.
+// The request buffers are allocated once in remote_write_init for a full batch.
+static remote_write_row_t push_rows[REMOTE_WRITE_BATCH_ROWS];
+static u_int8_t *request = NULL;
+static u_int8_t *compressed = NULL;
+static size_t request_capacity = 0;
+
+static const char *remote_write_url = NULL;
+static const char *remote_write_job = NULL;
+static char instance[INSTANCE_SIZE];
+static TickType_t push_period = 0;
+static TaskHandle_t push_task = NULL;
+
+//---------Protobuf encoding---------//
+
+static size_t varint_size(u_int64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static u_int8_t *write_varint(u_int8_t *out, u_int64_t value) {
+    while (value >= 0x80) {
+        *out++ = value | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+static inline u_int8_t *write_tag(u_int8_t *out, u_int8_t field, u_int8_t wire_type) {
+    return write_varint(out, (field << 3) | wire_type);
+}
+
+static u_int8_t *write_string(u_int8_t *out, u_int8_t field, const char *value) {
+    size_t len = strlen(value);
+    out = write_tag(out, field, WIRE_LEN);
+    out = write_varint(out, len);
+    memcpy(out, value, len);
+    return out + len;
+}
+
+static u_int8_t *write_double(u_int8_t *out, u_int8_t field, double value) {
+    u_int64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    out = write_tag(out, field, WIRE_FIXED64);
+    for (int i = 0; i < 8; i++) {
+        *out++ = bits >> (8 * i);
+    }
+    return out;
+}
+
+static inline size_t field_size(size_t len) {
+    return 1 + varint_size(len) + len;
+}
+
+// message Label { string name = 1; string value = 2; }
+static size_t label_size(const char *name, const char *value) {
+    return field_size(strlen(name)) + field_size(strlen(value));
+}
+
+static u_int8_t *write_label(u_int8_t *out, const char *name, const char *value) {
+    out = write_tag(out, 1, WIRE_LEN);
+    out = write_varint(out, label_size(name, value));
+    out = write_string(out, 1, name);
+    return write_string(out, 2, value);
+}
+
+// message Sample { double value = 1; int64 timestamp = 2; }
+static size_t sample_size(int64_t timestamp_ms) {
+    return 9 + 1 + varint_size(timestamp_ms);
+}
+
+static u_int8_t *write_sample(u_int8_t *out, float value, int64_t timestamp_ms) {
+    out = write_tag(out, 2, WIRE_LEN);
+    out = write_varint(out, sample_size(timestamp_ms));
+    out = write_double(out, 1, value);
+    out = write_tag(out, 2, WIRE_VARINT);
+    return write_varint(out, timestamp_ms);
+}
+
+static size_t labels_size(size_t series) {
+    return field_size(label_size("__name__", series_names[series]))
+        + field_size(label_size("instance", instance))
+        + field_size(label_size("job", remote_write_job));
+}
+
+// message TimeSeries { repeated Label labels = 1; repeated Sample samples = 2; }, labels sorted by name
+static size_t series_size(size_t series, size_t row_count, int64_t boot_time_ms, size_t *out_samples) {
+    size_t size = labels_size(series);
+
+    *out_samples = 0;
+    for (size_t row = 0; row < row_count; row++) {
+        if (isnan(push_rows[row].values[series])) {
+            continue;
+        }
+        size += field_size(sample_size(boot_time_ms + push_rows[row].uptime_ms));
+        (*out_samples)++;
+    }
+    return size;
+}
+
+// message WriteRequest { repeated TimeSeries timeseries = 1; }, only the size is computed without an output buffer
+static size_t encode_write_request(size_t row_count, int64_t boot_time_ms, u_int8_t *out) {
+    size_t len = 0;
+
+    for (size_t series = 0; series < SERIES_COUNT; series++) {
+        size_t samples;
+        size_t size = series_size(series, row_count, boot_time_ms, &samples);
+        if (samples == 0) {
+            continue;
+        }
+        len += field_size(size);
+        if (out == NULL) {
+            continue;
+        }
+
+        out = write_tag(out, 1, WIRE_LEN);
+        out = write_varint(out, size);
+        out = write_label(out, "__name__", series_names[series]);
+        out = write_label(out, "instance", instance);
+        out = write_label(out, "job", remote_write_job);
+        for (size_t row = 0; row < row_count; row++) {
+            if (!isnan(push_rows[row].values[series])) {
+                out = write_sample(out, push_rows[row].values[series], boot_time_ms + push_rows[row].uptime_ms);
+            }
+        }
+    }
+
+    return len;
+}
+
+// Size of a request with a sample of every series in every row of a full batch, with the largest timestamps
+static size_t max_write_request_size(void) {
+    size_t len = 0;
+    for (size_t series = 0; series < SERIES_COUNT; series++) {
+        len += field_size(labels_size(series) + REMOTE_WRITE_BATCH_ROWS * field_size(sample_size(INT64_MAX)));
+    }
+    return len;
+}
+
+//---------Push task---------//
+
+// Unix time of the boot in milliseconds, -1 while the clock isn't synced
+static int64_t get_boot_time_ms(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    if (now.tv_sec < MIN_VALID_UNIX_TIME) {
+        return -1;
+    }
+    return (int64_t) now.tv_sec * 1000 + now.tv_usec / 1000 - esp_timer_get_time() / 1000;
+}
+
+/**
+ * Posts a compressed WriteRequest
+ *
+ * @return The HTTP status code, or -1 if the request could not be sent
+ */
+static int post_write_request(const u_int8_t *body, size_t len) {
+    esp_http_client_config_t config = {
+        .url = remote_write_url,
+        .method = HTTP_METHOD_POST,
+        .timeout_ms = HTTP_TIMEOUT_MS,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return -1;
+    }
+
+    esp_http_client_set_header(client, "Content-Type", "application/x-protobuf");
+    esp_http_client_set_header(client, "Content-Encoding", "snappy");
+    esp_http_client_set_header(client, "X-Prometheus-Remote-Write-Version", "0.1.0");
+    esp_http_client_set_post_field(client, (const char *) body, len);
+
+    int status = -1;
+    esp_err_t res = esp_http_client_perform(client);
+    if (res == ESP_OK) {
+        status = esp_http_client_get_status_code(client);
+    } else {
+        ESP_LOGW(TAG, "Request failed: %d (%s)", res, esp_err_to_name(res));
+    }
+
+    esp_http_client_cleanup(client);
+    return status;
+}
+
+/**
+ * Pushes all rows of the batch
+ *
+ * @return ESP_OK if the rows were accepted or rejected for good, ESP_FAIL if the push should be retried
+ */
+static esp_err_t push_batch(int64_t boot_time_ms) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    u_int32_t first = first_row;
+    u_int32_t end = next_row;
+    for (u_int32_t row = first; row != end; row++) {
+        push_rows[row - first] = rows[row % REMOTE_WRITE_BATCH_ROWS];
+    }
+    xSemaphoreGive(lock);
+
+    size_t row_count = end - first;
+    size_t len = encode_write_request(row_count, boot_time_ms, NULL);
+    if (len > request_capacity) {
+        // Can't happen, the capacity is the worst case of a full batch
+        ESP_LOGE(TAG, "Write request of %u bytes doesn't fit into %u bytes!", len, request_capacity);
+        return ESP_FAIL;
+    }
+
+    encode_write_request(row_count, boot_time_ms, request);
+    size_t compressed_len = snappy_compress(request, len, compressed);
+
+    int status = post_write_request(compressed, compressed_len);
+
+    // 4xx except 429 means that the receiver will never accept the batch, retrying would block all newer rows
+    bool done = (status >= 200 && status < 300) || (status >= 400 && status < 500 && status != 429);
+    if (!done) {
+        ESP_LOGW(TAG, "Push of %u rows failed with status %d", row_count, status);
+        return ESP_FAIL;
+    }
+    if (status >= 300) {
+        ESP_LOGE(TAG, "Receiver rejected %u rows with status %d, dropping them", row_count, status);
+    } else {
+        ESP_LOGI(TAG, "Pushed %u rows (%u bytes compressed from %u)", row_count, compressed_len, len);
+    }
+
+    // Rows that were dropped for newer ones while pushing are already gone
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if ((int32_t) (end - first_row) > 0) {
+        first_row = end;
+    }
+    xSemaphoreGive(lock);
+    return ESP_OK;
+}
+
+static void push_task_run(void *arg) {
+    u_int32_t backoff_ms = BACKOFF_MIN_MS;
+
+    for (;;) {
+        // remote_write_append wakes the task early when the batch is almost full
+        ulTaskNotifyTake(pdTRUE, push_period);
+
+        xSemaphoreTake(lock, portMAX_DELAY);
+        bool empty = first_row == next_row;
+        xSemaphoreGive(lock);
+        if (empty) {
+            continue;
+        }
+
+        int64_t boot_time_ms = get_boot_time_ms();
+        if (boot_time_ms < 0) {
+            ESP_LOGW(TAG, "Clock not synced yet, keeping the batch");
+            continue;
+        }
+
+        while (push_batch(boot_time_ms) != ESP_OK) {
+            // The jitter keeps devices that lost the receiver at the same time from retrying in lockstep
+            u_int32_t delay_ms = backoff_ms + esp_random() % (backoff_ms / 2 + 1);
+            ESP_LOGW(TAG, "Retrying in %ld ms", delay_ms);
+            vTaskDelay(pdMS_TO_TICKS(delay_ms));
+
+            backoff_ms = backoff_ms * 2 > BACKOFF_MAX_MS ? BACKOFF_MAX_MS : backoff_ms * 2;
+        }
+        backoff_ms = BACKOFF_MIN_MS;
+    }
+}
+
+//---------Public API---------//
+
+esp_err_t remote_write_init(const char *url, const char *job) {
+    lock = xSemaphoreCreateMutex();
+    if (lock == NULL) {
+        ESP_LOGE(TAG, "Semaphore creation failed!");
+        return ESP_FAIL;
+    }
+
+    remote_write_url = url;
+    remote_write_job = job;
+
+    u_int8_t mac[6];
+    esp_err_t res = esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    if (res != ESP_OK) {
+        return res;
+    }
+    snprintf(instance, INSTANCE_SIZE, "esp32-%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    // The label sizes are known now, a push never allocates
+    request_capacity = max_write_request_size();
+    request = malloc(request_capacity);
+    compressed = malloc(snappy_max_compressed_length(request_capacity));
+    if (request == NULL || compressed == NULL) {
+        ESP_LOGE(TAG, "Could not allocate %u bytes for the write request!", request_capacity);
+        free(request);
+        free(compressed);
+        request = NULL;
+        compressed = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Pushing to %s as %s", url, instance);
+    return ESP_OK;
+}
+
+void remote_write_append(const webserver_sensor_values_t *values) {
+    remote_write_row_t row = {
+        .uptime_ms = esp_timer_get_time() / 1000,
+        .values = {
+            values->illuminance,
+            values->temperature,
+            values->humidity,
+            values->heartrate,
+            values->heartrate_rmssd,
+            values->heartrate_sdnn,
+#if PRESSURE_SENSOR_ENABLED
+            values->pressure,
+#endif
+        },
+    };
+    // A sensor that never published has no value, a 0 would look like a real reading
+    for (size_t series = 0; series < SERIES_COUNT; series++) {
+        if (!values->status[series_sensors[series]].sampled) {
+            row.values[series] = NAN;
+        }
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (next_row - first_row == REMOTE_WRITE_BATCH_ROWS) {
+        first_row++;
+    }
+    rows[next_row % REMOTE_WRITE_BATCH_ROWS] = row;
+    next_row++;
+    u_int32_t pending = next_row - first_row;
+    xSemaphoreGive(lock);
+
+    if (pending >= REMOTE_WRITE_BATCH_ROWS * 3 / 4 && push_task != NULL) {
+        xTaskNotifyGive(push_task);
+    }
+}
+
+esp_err_t remote_write_start(u_int32_t push_period_ms, u_int32_t stack_size, UBaseType_t priority) {
+    push_period = pdMS_TO_TICKS(push_period_ms);
+
+    if (xTaskCreate(push_task_run, "push_task", stack_size, NULL, priority, &push_task) != pdPASS) {
+        ESP_LOGE(TAG, "Could not create push_task task!");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,88 @@
+#include "scheduler.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "scheduler";
+
+static sensor_task_t *tasks[SCHEDULER_MAX_TASKS];
+static atomic_size_t task_count = 0;
+
+// Only errors and the first success after errors are published, so a healthy sensor doesn't re-render the metrics every sample
+static void publish_status(sensor_task_t *task, esp_err_t res) {
+    if (task->status == WEBSERVER_SENSOR_NONE || (res == ESP_OK && task->errors == 0)) {
+        return;
+    }
+
+    task->errors = res == ESP_OK ? 0 : task->errors + 1;
+    if (webserver_sensor_data_begin_update(task->data)) {
+        webserver_sensor_status_t *status = &task->data->values.status[task->status];
+        status->errors = task->errors;
+        if (res != ESP_OK) {
+            status->last_error = res;
+        }
+        webserver_sensor_data_end_update(task->data);
+    }
+}
+
+static void sensor_task_run(void *arg) {
+    sensor_task_t *task = (sensor_task_t *) arg;
+    TickType_t last_wake_time = xTaskGetTickCount();
+
+    for (;;) {
+        int64_t start_time = esp_timer_get_time();
+
+        esp_err_t res = task->sample(task);
+        if (res != ESP_OK) {
+            ESP_LOGE(TAG, "Error sampling %s: %d (%s)", task->name, res, esp_err_to_name(res));
+        }
+        publish_status(task, res);
+
+        int64_t duration_ms = (esp_timer_get_time() - start_time) / 1000;
+        if (duration_ms > task->deadline_ms) {
+            atomic_fetch_add(&task->missed_deadlines, 1);
+            ESP_LOGW(TAG, "%s missed its deadline: %lld ms > %ld ms", task->name, duration_ms, task->deadline_ms);
+        }
+
+        if (task->period_ms == 0) {
+            // A failing free-running sample can return right away, e.g. without the sensor, don't spin on it
+            if (res != ESP_OK) {
+                TickType_t backoff = pdMS_TO_TICKS(task->deadline_ms);
+                vTaskDelay(backoff > 0 ? backoff : 1);
+            }
+            continue;
+        }
+
+        // Don't try to catch up on periods that were lost to a slow sample
+        if (xTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(task->period_ms)) == pdFALSE) {
+            last_wake_time = xTaskGetTickCount();
+        }
+    }
+}
+
+esp_err_t sensor_task_start(sensor_task_t *task, u_int32_t stack_size, UBaseType_t priority) {
+    ESP_LOGI(TAG, "Starting %s task (period: %ld ms, deadline: %ld ms)", task->name, task->period_ms, task->deadline_ms);
+
+    size_t index = atomic_load(&task_count);
+    if (index == SCHEDULER_MAX_TASKS) {
+        ESP_LOGE(TAG, "Could not start %s task, %d tasks are running!", task->name, SCHEDULER_MAX_TASKS);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreate(sensor_task_run, task->name, stack_size, task, priority, &task->handle) != pdPASS) {
+        ESP_LOGE(TAG, "Could not create %s task!", task->name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Published after the entry is written, readers on other tasks only see complete entries
+    tasks[index] = task;
+    atomic_store(&task_count, index + 1);
+    return ESP_OK;
+}
+
+size_t sensor_task_count(void) {
+    return atomic_load(&task_count);
+}
+
+const sensor_task_t *sensor_task_get(size_t index) {
+    return tasks[index];
+}
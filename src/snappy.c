@@ -0,0 +1,121 @@
+#include "snappy.h"
+#include <string.h>
+
+// Matches are only searched within blocks of this size, so offsets always fit into a copy with a 2 byte offset
+#define BLOCK_SIZE 65536
+#define HASH_BITS 10
+#define MIN_MATCH 4
+#define MAX_COPY_LEN 64
+
+#define TAG_LITERAL 0x0
+#define TAG_COPY_2 0x2
+
+static inline uint32_t load_u32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hash(uint32_t bytes) {
+    return (bytes * 0x1e35a7bd) >> (32 - HASH_BITS);
+}
+
+static uint8_t *write_varint(uint8_t *out, uint32_t value) {
+    while (value >= 0x80) {
+        *out++ = value | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+static uint8_t *write_literal(uint8_t *out, const uint8_t *literal, size_t len) {
+    size_t n = len - 1;
+
+    if (n < 60) {
+        *out++ = (n << 2) | TAG_LITERAL;
+    } else {
+        // The length follows the tag in 1-4 little endian bytes
+        uint8_t *tag = out++;
+        uint8_t bytes = 0;
+        while (n > 0) {
+            *out++ = n & 0xff;
+            n >>= 8;
+            bytes++;
+        }
+        *tag = ((59 + bytes) << 2) | TAG_LITERAL;
+    }
+
+    memcpy(out, literal, len);
+    return out + len;
+}
+
+static uint8_t *write_copy(uint8_t *out, size_t offset, size_t len) {
+    while (len > 0) {
+        // Avoid a remainder below MIN_MATCH, it would still be valid but a literal is shorter
+        size_t n = len;
+        if (n > MAX_COPY_LEN) {
+            n = len - MAX_COPY_LEN < MIN_MATCH ? MAX_COPY_LEN - MIN_MATCH : MAX_COPY_LEN;
+        }
+
+        *out++ = ((n - 1) << 2) | TAG_COPY_2;
+        *out++ = offset & 0xff;
+        *out++ = offset >> 8;
+        len -= n;
+    }
+    return out;
+}
+
+static uint8_t *compress_block(const uint8_t *block, size_t len, uint8_t *out) {
+    uint16_t table[1 << HASH_BITS];
+    const uint8_t *end = block + len;
+    const uint8_t *literal = block;
+    const uint8_t *ip = block;
+
+    memset(table, 0, sizeof(table));
+
+    while (len >= MIN_MATCH && ip <= end - MIN_MATCH) {
+        uint32_t bytes = load_u32(ip);
+        uint32_t h = hash(bytes);
+        const uint8_t *candidate = block + table[h];
+        table[h] = ip - block;
+
+        if (candidate >= ip || load_u32(candidate) != bytes) {
+            ip++;
+            continue;
+        }
+
+        size_t match_len = MIN_MATCH;
+        while (ip + match_len < end && candidate[match_len] == ip[match_len]) {
+            match_len++;
+        }
+
+        if (ip > literal) {
+            out = write_literal(out, literal, ip - literal);
+        }
+        out = write_copy(out, ip - candidate, match_len);
+
+        ip += match_len;
+        literal = ip;
+    }
+
+    if (end > literal) {
+        out = write_literal(out, literal, end - literal);
+    }
+    return out;
+}
+
+size_t snappy_max_compressed_length(size_t input_len) {
+    return 32 + input_len + input_len / 6;
+}
+
+size_t snappy_compress(const uint8_t *input, size_t input_len, uint8_t *output) {
+    uint8_t *out = write_varint(output, input_len);
+
+    for (size_t offset = 0; offset < input_len; offset += BLOCK_SIZE) {
+        size_t len = input_len - offset < BLOCK_SIZE ? input_len - offset : BLOCK_SIZE;
+        out = compress_block(input + offset, len, out);
+    }
+
+    return out - output;
+}
@@ -0,0 +1,302 @@
+#include "stream.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "format.h"
+
+// Bit of the heart beat event, the bits below are the sample events of the sensors
+#define HEARTBEAT_EVENT WEBSERVER_SENSOR_COUNT
+#define SAMPLE_EVENTS ((1u << WEBSERVER_SENSOR_COUNT) - 1 - (1u << WEBSERVER_SENSOR_NONE))
+
+// Poll interval while a client has unsent data, the socket can't wake the task when it gets writable
+#define RETRY_MS 20
+// "ffff\r\n" in front of and "\r\n" after every event, the response uses chunked transfer encoding
+#define CHUNK_FRAMING_SIZE 8
+#define RECONNECT_MS 3000
+
+#define HEARTBEAT_PREFIX "event: heartbeat\ndata: {\"beats\":"
+#define HEARTBEAT_SEPARATOR ",\"heartrate\":"
+#define HEARTBEAT_SUFFIX "}\n\n"
+#define SAMPLE_PREFIX "event: sample\ndata: "
+
+_Static_assert(sizeof(HEARTBEAT_PREFIX HEARTBEAT_SEPARATOR HEARTBEAT_SUFFIX) - 1 + 2 * FORMAT_MAX_LENGTH <= STREAM_EVENT_SIZE,
+    "The heart beat event doesn't fit into STREAM_EVENT_SIZE");
+
+static const char *TAG = "stream";
+
+typedef struct stream_client {
+    httpd_req_t *req; // Copy from httpd_req_async_handler_begin, NULL if the slot is free or the session was closed
+    int fd;
+    u_int32_t pending; // Events that weren't sent since they were published
+    char buffer[STREAM_EVENT_SIZE + CHUNK_FRAMING_SIZE];
+    size_t len;
+    size_t sent;
+    int64_t last_progress_us;
+} stream_client_t;
+
+// Clients are added by stream_subscribe and removed by stream_close_session on the server task, and sent to by the
+// stream task. The lock is held from checking a slot until its send returned, so a socket that the server closed and
+// reused for a new connection never gets an event.
+static stream_client_t clients[STREAM_MAX_CLIENTS];
+static SemaphoreHandle_t clients_lock = NULL;
+static atomic_uint client_count = 0;
+
+static atomic_uint published = 0;
+static atomic_uint beat_count = 0;
+
+static webserver_sensor_data_t *sensor_data = NULL;
+static TaskHandle_t stream_task = NULL;
+
+// Called with the lock held
+static void release_client(stream_client_t *client) {
+    httpd_req_async_handler_complete(client->req);
+    client->req = NULL;
+    atomic_fetch_sub(&client_count, 1);
+}
+
+// Called with the lock held, by the stream task
+static void drop_client(stream_client_t *client) {
+    httpd_handle_t server = client->req->handle;
+
+    // The connection was handed over in the middle of a response, it can't be used for another request.
+    // The slot is free before the server closes the session, stream_close_session won't find it anymore.
+    release_client(client);
+    httpd_sess_trigger_close(server, client->fd);
+    ESP_LOGI(TAG, "Client %d dropped", client->fd);
+}
+
+// Called with the lock held, by the server task
+static stream_client_t *add_client(httpd_req_t *req) {
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        stream_client_t *client = &clients[i];
+        if (client->req != NULL) {
+            continue;
+        }
+
+        client->req = req;
+        client->fd = httpd_req_to_sockfd(req);
+        // A new client gets the current values right away
+        client->pending = SAMPLE_EVENTS;
+        client->len = 0;
+        client->sent = 0;
+        client->last_progress_us = esp_timer_get_time();
+        atomic_fetch_add(&client_count, 1);
+        ESP_LOGI(TAG, "Client %d subscribed", client->fd);
+        return client;
+    }
+    return NULL;
+}
+
+// Sends as much of the buffered event as the socket takes without blocking, returns false if the client has to be dropped
+static bool flush_client(stream_client_t *client, int64_t now_us) {
+    if (client->sent == client->len) {
+        return true;
+    }
+
+    ssize_t written = send(client->fd, client->buffer + client->sent, client->len - client->sent, MSG_DONTWAIT);
+    if (written > 0) {
+        client->sent += written;
+        client->last_progress_us = now_us;
+        return true;
+    }
+    if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return now_us - client->last_progress_us < STREAM_CLIENT_TIMEOUT_MS * 1000LL;
+    }
+    return false;
+}
+
+// Wraps the event in the buffer of the client into a chunk
+static void frame_event(stream_client_t *client, const char *event, size_t len) {
+    int header = snprintf(client->buffer, CHUNK_FRAMING_SIZE, "%x\r\n", (unsigned int) len);
+    memcpy(client->buffer + header, event, len);
+    memcpy(client->buffer + header + len, "\r\n", 2);
+    client->len = header + len + 2;
+    client->sent = 0;
+}
+
+static size_t append_literal(char *buffer, size_t len, const char *literal, size_t literal_len) {
+    memcpy(buffer + len, literal, literal_len);
+    return len + literal_len;
+}
+
+// The heart beat event has a fixed size limit, see the assertion above, the sample data is bounded by the encoder
+static size_t render_event(int event, const webserver_sensor_values_t *values, char *buffer) {
+    size_t len = 0;
+    size_t data_len;
+
+    if (event == HEARTBEAT_EVENT) {
+        len = append_literal(buffer, len, HEARTBEAT_PREFIX, sizeof(HEARTBEAT_PREFIX) - 1);
+        len += format_u32(buffer + len, atomic_load(&beat_count));
+        len = append_literal(buffer, len, HEARTBEAT_SEPARATOR, sizeof(HEARTBEAT_SEPARATOR) - 1);
+        len += format_u32(buffer + len, values->heartrate);
+        return append_literal(buffer, len, HEARTBEAT_SUFFIX, sizeof(HEARTBEAT_SUFFIX) - 1);
+    }
+
+    if (!values->status[event].sampled) {
+        return 0;
+    }
+    len = append_literal(buffer, len, SAMPLE_PREFIX, sizeof(SAMPLE_PREFIX) - 1);
+    // Room for the two line feeds that end the event
+    data_len = webserver_encode_sensor_json(event, values, buffer + len, STREAM_EVENT_SIZE - len - 2);
+    if (data_len == 0) {
+        ESP_LOGE(TAG, "Event doesn't fit into the buffer!");
+        return 0;
+    }
+    len += data_len;
+    memcpy(buffer + len, "\n\n", 2);
+    return len + 2;
+}
+
+// Fills the free buffer of the client with its next pending event
+static void next_event(stream_client_t *client, const webserver_sensor_values_t *values) {
+    char event[STREAM_EVENT_SIZE];
+
+    while (client->pending != 0) {
+        int next = __builtin_ctz(client->pending);
+        client->pending &= ~(1u << next);
+
+        size_t len = render_event(next, values, event);
+        if (len > 0) {
+            frame_event(client, event, len);
+            return;
+        }
+    }
+}
+
+static void stream_task_run(void *arg) {
+    TickType_t wait = pdMS_TO_TICKS(STREAM_KEEPALIVE_MS);
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        // Every client takes the events it didn't send yet from here, events that are already pending coalesce
+        u_int32_t events = atomic_exchange(&published, 0);
+        int64_t now_us = esp_timer_get_time();
+        webserver_sensor_values_t values;
+        bool read = false;
+        bool unsent = false;
+
+        xSemaphoreTake(clients_lock, portMAX_DELAY);
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            stream_client_t *client = &clients[i];
+            if (client->req == NULL) {
+                continue;
+            }
+            client->pending |= events;
+
+            // Send events until the socket doesn't take more
+            bool connected = flush_client(client, now_us);
+            while (connected && client->sent == client->len && client->pending != 0) {
+                if (!read) {
+                    webserver_sensor_data_read(sensor_data, &values);
+                    read = true;
+                }
+                next_event(client, &values);
+                connected = flush_client(client, now_us);
+            }
+            // A comment on idle connections, a client that went away is only noticed when a send fails
+            if (connected && client->sent == client->len && now_us - client->last_progress_us >= STREAM_KEEPALIVE_MS * 1000LL) {
+                frame_event(client, ":\n\n", 3);
+                connected = flush_client(client, now_us);
+            }
+            if (!connected) {
+                drop_client(client);
+                continue;
+            }
+            if (client->sent < client->len) {
+                unsent = true;
+            }
+        }
+        xSemaphoreGive(clients_lock);
+
+        wait = pdMS_TO_TICKS(unsent ? RETRY_MS : STREAM_KEEPALIVE_MS);
+    }
+}
+
+esp_err_t stream_start(webserver_sensor_data_t *webserver_sensor_data, u_int32_t stack_size, UBaseType_t priority) {
+    sensor_data = webserver_sensor_data;
+
+    clients_lock = xSemaphoreCreateMutex();
+    if (clients_lock == NULL) {
+        ESP_LOGE(TAG, "Semaphore creation failed!");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreate(stream_task_run, "stream_task", stack_size, NULL, priority, &stream_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the stream task!");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t stream_subscribe(httpd_req_t *req) {
+    // Only the server task adds clients, a slot that is free now is still free after the headers were sent
+    if (stream_task == NULL || atomic_load(&client_count) >= STREAM_MAX_CLIENTS) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Too many streams", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    char retry[32];
+    int len = snprintf(retry, sizeof(retry), "retry: %d\n\n", RECONNECT_MS);
+
+    httpd_req_t *async_req = NULL;
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (httpd_resp_send_chunk(req, retry, len) != ESP_OK || httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    // Added on the server task, so the session can't have been closed in between
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    stream_client_t *client = add_client(async_req);
+    xSemaphoreGive(clients_lock);
+    if (client == NULL) {
+        httpd_req_async_handler_complete(async_req);
+        return ESP_FAIL;
+    }
+
+    xTaskNotifyGive(stream_task);
+    return ESP_OK;
+}
+
+void stream_close_session(httpd_handle_t server, int sockfd) {
+    if (clients_lock != NULL) {
+        xSemaphoreTake(clients_lock, portMAX_DELAY);
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            stream_client_t *client = &clients[i];
+            if (client->req != NULL && client->fd == sockfd) {
+                // Closed by the server, e.g. purged as least recently used, the session is still valid until this returns
+                release_client(client);
+                ESP_LOGI(TAG, "Client %d closed by the server", sockfd);
+            }
+        }
+        xSemaphoreGive(clients_lock);
+    }
+
+    close(sockfd);
+}
+
+void stream_publish_samples(u_int32_t sensors) {
+    if (stream_task == NULL || atomic_load(&client_count) == 0) {
+        return;
+    }
+    atomic_fetch_or(&published, sensors & SAMPLE_EVENTS);
+    xTaskNotifyGive(stream_task);
+}
+
+void stream_publish_heartbeats(u_int32_t beats) {
+    atomic_fetch_add(&beat_count, beats);
+    if (stream_task == NULL || atomic_load(&client_count) == 0) {
+        return;
+    }
+    atomic_fetch_or(&published, 1u << HEARTBEAT_EVENT);
+    xTaskNotifyGive(stream_task);
+}
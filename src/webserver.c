@@ -1,174 +1,880 @@
 #include "webserver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "history.h"
+#include "metrics.h"
+#include "metrics_buffer.h"
+#include "format.h"
+#include "cbor.h"
+#include "stream.h"
+#include "seqlock.h"
+#include "calibration.h"
+#include "scheduler.h"
+#include "config.h"
+
+#define SEQUENCE_SPIN_LIMIT 8
+#define HISTORY_QUERY_SIZE 128
+#define HISTORY_PAGE_POINTS 32
+#define HISTORY_POINT_SIZE 64 // ",[<u32>,<float>]", a float with 2 decimals has up to 42 characters
+#define CALIBRATION_QUERY_SIZE 64
+#define CALIBRATION_BODY_SIZE 128
+#define ACCEPT_HEADER_SIZE 256
+#define SENSOR_RESPONSE_SIZE 32
+#define SENSORS_BUFFER_SIZE 1024
+#define METRICS_CHUNK_SIZE 512
+#define METRICS_MAX_AGE_MS 1000
+#define METRICS_LINE_SIZE 160
+#define METRICS_LABELS_SIZE 64
+#define LATENCY_BUCKET_COUNT 10
+#define KEEP_ALIVE_INTERVAL_S 5
+#define KEEP_ALIVE_COUNT 3
+#define ETAG_SIZE 32
+#define CACHE_CONTROL_SIZE 32
+#define IF_NONE_MATCH_SIZE 128
 
 const static char *TAG = "webserver";
 
-static esp_err_t get_illuminance_handler(httpd_req_t *req) {
-    webserver_sensor_data_t *webserver_sensor_data = (webserver_sensor_data_t *) req->user_ctx;
+typedef enum sensor_value_type {
+    SENSOR_VALUE_FLOAT = 0,
+    SENSOR_VALUE_U32,
+    SENSOR_VALUE_U8
+} sensor_value_type_t;
+
+// A single value in webserver_sensor_values_t, served as plain text at uri and as part of /sensors
+typedef struct sensor_endpoint {
+    const char *uri; // NULL for values that are only part of /sensors
+    const char *name;
+    const char *unit;
+    const char *suffix; // Appended to the plain text value
+    webserver_sensor_t sensor;
+    sensor_value_type_t type;
+    size_t offset;
+    u_int8_t decimals;
+} sensor_endpoint_t;
+
+static const sensor_endpoint_t sensor_endpoints[] = {
+    { "/illuminance", "illuminance", "lx", " Lux", WEBSERVER_SENSOR_TSL2561, SENSOR_VALUE_U32, offsetof(webserver_sensor_values_t, illuminance), 0 },
+    { "/temp", "temperature", "°C", "°C", WEBSERVER_SENSOR_AM2320, SENSOR_VALUE_FLOAT, offsetof(webserver_sensor_values_t, temperature), 1 },
+    { "/hum", "humidity", "%", "%", WEBSERVER_SENSOR_AM2320, SENSOR_VALUE_FLOAT, offsetof(webserver_sensor_values_t, humidity), 1 },
+    { "/heartrate", "heartrate", "bpm", " BPM", WEBSERVER_SENSOR_HEARTRATE, SENSOR_VALUE_U8, offsetof(webserver_sensor_values_t, heartrate), 0 },
+    { NULL, "heartrate_rmssd", "ms", NULL, WEBSERVER_SENSOR_HEARTRATE, SENSOR_VALUE_FLOAT, offsetof(webserver_sensor_values_t, heartrate_rmssd), 1 },
+    { NULL, "heartrate_sdnn", "ms", NULL, WEBSERVER_SENSOR_HEARTRATE, SENSOR_VALUE_FLOAT, offsetof(webserver_sensor_values_t, heartrate_sdnn), 1 },
+#if PRESSURE_SENSOR_ENABLED
+    { "/pressure", "pressure", "hPa", " hPa", WEBSERVER_SENSOR_HX710B, SENSOR_VALUE_FLOAT, offsetof(webserver_sensor_values_t, pressure), 1 },
+#endif
+};
+
+static const char *sensor_names[WEBSERVER_SENSOR_COUNT] = {
+    [WEBSERVER_SENSOR_AM2320] = "am2320",
+    [WEBSERVER_SENSOR_TSL2561] = "tsl2561",
+    [WEBSERVER_SENSOR_HEARTRATE] = "kyto2800d",
+    [WEBSERVER_SENSOR_HX710B] = "hx710b",
+};
+
+#define SENSOR_ENDPOINT_COUNT (sizeof(sensor_endpoints) / sizeof(sensor_endpoint_t))
+#define MAX_ENDPOINT_COUNT (SENSOR_ENDPOINT_COUNT + 5)
+
+typedef struct latency_bucket {
+    int64_t upper_bound_us;
+    const char *le; // The bound in seconds, as label value
+} latency_bucket_t;
+
+static const latency_bucket_t latency_buckets[LATENCY_BUCKET_COUNT] = {
+    { 1000, "0.001" },
+    { 2500, "0.0025" },
+    { 5000, "0.005" },
+    { 10000, "0.01" },
+    { 25000, "0.025" },
+    { 50000, "0.05" },
+    { 100000, "0.1" },
+    { 250000, "0.25" },
+    { 500000, "0.5" },
+    { 1000000, "1" },
+};
+
+// Request counters of one URI, the registered handler is wrapped by instrumented_handler.
+// All handlers run on the server task, so the counters are updated and rendered without synchronization.
+typedef struct endpoint_stats {
+    const char *uri;
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+    u_int32_t requests;
+    u_int32_t errors;
+    u_int64_t duration_sum_us;
+    u_int32_t buckets[LATENCY_BUCKET_COUNT + 1]; // Not cumulative, the last one counts the requests slower than every bound
+} endpoint_stats_t;
+
+// Header values of a response, httpd only keeps pointers to them until the response is sent
+typedef struct cache_headers {
+    char etag[ETAG_SIZE];
+    char cache_control[CACHE_CONTROL_SIZE];
+} cache_headers_t;
+
+// The rest of a /metrics response is streamed in chunks of this buffer
+typedef struct chunk_buffer {
+    httpd_req_t *req;
+    char data[METRICS_CHUNK_SIZE];
+    size_t len;
+    esp_err_t res;
+} chunk_buffer_t;
+
+static webserver_sensor_data_t *sensor_data = NULL;
+
+static endpoint_stats_t endpoint_stats[MAX_ENDPOINT_COUNT];
+static size_t endpoint_count = 0;
+
+// Part of every ETag, the generations start at 0 again after a reboot
+static u_int32_t boot_id = 0;
+
+// The /metrics response is rendered once per update and format into the buffer that is not published,
+// so handlers can send it without taking the semaphore or allocating
+static metrics_double_buffer_t metrics_responses[METRICS_FORMAT_COUNT];
+// Uptime of the last render in milliseconds, wraps after 49 days
+static atomic_uint metrics_rendered_ms;
+
+// Must be called with the semaphore taken, the semaphore serializes the writers
+static void render_metrics(metrics_format_t format) {
+    esp_err_t res = metrics_buffer_render(&metrics_responses[format], format);
+    if (res == ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(TAG, "Metrics buffer still in use, skipping render");
+    } else if (res != ESP_OK) {
+        ESP_LOGE(TAG, "Metrics don't fit into the buffer!");
+    }
+}
+
+static void render_all_metrics(void) {
+    for (int format = 0; format < METRICS_FORMAT_COUNT; format++) {
+        render_metrics(format);
+    }
+    atomic_store(&metrics_rendered_ms, esp_timer_get_time() / 1000);
+}
 
-    if (xSemaphoreTake(webserver_sensor_data->semaphore, pdMS_TO_TICKS(100)) != pdTRUE) {
+// The staleness of the values is only checked while rendering, the scrape renders itself when no sensor updated for a while
+static void refresh_metrics(void) {
+    u_int32_t age_ms = (u_int32_t) (esp_timer_get_time() / 1000) - atomic_load(&metrics_rendered_ms);
+    if (age_ms < METRICS_MAX_AGE_MS) {
+        return;
+    }
+    // A sensor update that holds the semaphore renders anyway
+    if (xSemaphoreTake(sensor_data->semaphore, 0) != pdTRUE) {
+        return;
+    }
+    render_all_metrics();
+    xSemaphoreGive(sensor_data->semaphore);
+}
+
+bool webserver_sensor_data_begin_update(webserver_sensor_data_t *webserver_sensor_data) {
+    if (xSemaphoreTake(webserver_sensor_data->semaphore, portMAX_DELAY) != pdTRUE) {
         ESP_LOGE(TAG, "Could not take semaphore!");
-        return ESP_FAIL;
+        return false;
     }
 
-    char *resp;
-    asprintf(&resp, "%ld Lux", webserver_sensor_data->illuminance);
+    seqlock_write_begin(&webserver_sensor_data->sequence);
+    webserver_sensor_data->values.generation++;
+    return true;
+}
+
+void webserver_sensor_data_end_update(webserver_sensor_data_t *webserver_sensor_data) {
+    seqlock_write_end(&webserver_sensor_data->sequence);
+
+    render_all_metrics();
+    u_int32_t sampled = webserver_sensor_data->sampled;
+    webserver_sensor_data->sampled = 0;
 
     if (xSemaphoreGive(webserver_sensor_data->semaphore) != pdTRUE) {
         ESP_LOGE(TAG, "Could not give semaphore!");
-        return ESP_FAIL;
     }
 
-    httpd_resp_set_type(req, "text/plain");
-    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    if (sampled != 0) {
+        stream_publish_samples(sampled);
+    }
 }
 
-static esp_err_t get_temp_handler(httpd_req_t *req) {
-    webserver_sensor_data_t *webserver_sensor_data = (webserver_sensor_data_t *) req->user_ctx;
+void webserver_sensor_data_mark_sampled(webserver_sensor_data_t *webserver_sensor_data, webserver_sensor_t sensor) {
+    webserver_sensor_status_t *status = &webserver_sensor_data->values.status[sensor];
+    int64_t uptime_ms = esp_timer_get_time() / 1000;
 
-    if (xSemaphoreTake(webserver_sensor_data->semaphore, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGE(TAG, "Could not take semaphore!");
-        return ESP_FAIL;
+    status->interval_ms = status->sampled ? uptime_ms - status->uptime_ms : 0;
+    status->sampled = true;
+    status->timestamp_ms = metrics_timestamp_ms();
+    status->uptime_ms = uptime_ms;
+    status->generation++;
+    webserver_sensor_data->sampled |= 1u << sensor;
+}
+
+void webserver_sensor_data_read(webserver_sensor_data_t *webserver_sensor_data, webserver_sensor_values_t *out_values) {
+    unsigned int attempts = 0;
+    unsigned int sequence;
+
+    do {
+        // The writer may be preempted in the middle of an update, give it the CPU instead of spinning
+        if (attempts++ > SEQUENCE_SPIN_LIMIT) {
+            vTaskDelay(1);
+        }
+
+        sequence = seqlock_read_begin(&webserver_sensor_data->sequence);
+        if (sequence & 1) {
+            continue;
+        }
+
+        *out_values = webserver_sensor_data->values;
+    } while (seqlock_read_retry(&webserver_sensor_data->sequence, sequence));
+}
+
+static size_t format_sensor_value(const sensor_endpoint_t *endpoint, const webserver_sensor_values_t *values, char *buffer) {
+    const u_int8_t *value = (const u_int8_t *) values + endpoint->offset;
+
+    switch (endpoint->type) {
+        case SENSOR_VALUE_U32:
+            return format_u32(buffer, *(const u_int32_t *) value);
+        case SENSOR_VALUE_U8:
+            return format_u32(buffer, *value);
+        case SENSOR_VALUE_FLOAT:
+        default:
+            return format_fixed(buffer, *(const float *) value, endpoint->decimals);
     }
+}
 
-    char *resp;
-    asprintf(&resp, "%.1f°C", webserver_sensor_data->temperature);
+// Seconds until the sensor is expected to publish again, a cache may serve its values until then
+static u_int32_t seconds_until_next_sample(const webserver_sensor_status_t *status, int64_t now_ms) {
+    if (!status->sampled || status->interval_ms == 0) {
+        return 0;
+    }
+    int64_t left_ms = status->uptime_ms + status->interval_ms - now_ms;
+    return left_ms > 0 ? left_ms / 1000 : 0;
+}
 
-    if (xSemaphoreGive(webserver_sensor_data->semaphore) != pdTRUE) {
-        ESP_LOGE(TAG, "Could not give semaphore!");
-        return ESP_FAIL;
+// The ETag is the generation of the values, variant tells apart the encodings of the same values
+static void set_cache_headers(httpd_req_t *req, cache_headers_t *headers, u_int32_t generation, const char *variant, u_int32_t max_age_s) {
+    snprintf(headers->etag, sizeof(headers->etag), "\"%08lx-%lx%s\"", boot_id, generation, variant);
+    snprintf(headers->cache_control, sizeof(headers->cache_control), "max-age=%lu", max_age_s);
+    httpd_resp_set_hdr(req, "ETag", headers->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", headers->cache_control);
+}
+
+// If-None-Match may hold a list of ETags, weak ones (W/"...") match as well
+static bool client_has_current(httpd_req_t *req, const char *etag) {
+    char if_none_match[IF_NONE_MATCH_SIZE];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) != ESP_OK) {
+        return false;
+    }
+    return strcmp(if_none_match, "*") == 0 || strstr(if_none_match, etag) != NULL;
+}
+
+static esp_err_t send_not_modified(httpd_req_t *req) {
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static esp_err_t get_sensor_handler(httpd_req_t *req) {
+    const sensor_endpoint_t *endpoint = (const sensor_endpoint_t *) req->user_ctx;
+
+    webserver_sensor_values_t values;
+    webserver_sensor_data_read(sensor_data, &values);
+
+    const webserver_sensor_status_t *status = &values.status[endpoint->sensor];
+    cache_headers_t cache;
+    set_cache_headers(req, &cache, status->generation, "", seconds_until_next_sample(status, esp_timer_get_time() / 1000));
+    if (client_has_current(req, cache.etag)) {
+        return send_not_modified(req);
+    }
+
+    char resp[SENSOR_RESPONSE_SIZE];
+    size_t suffix_len = strlen(endpoint->suffix);
+    size_t len = format_sensor_value(endpoint, &values, resp);
+    if (len + suffix_len > sizeof(resp)) {
+        suffix_len = sizeof(resp) - len;
     }
+    memcpy(resp + len, endpoint->suffix, suffix_len);
+    len += suffix_len;
 
     httpd_resp_set_type(req, "text/plain");
-    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    return httpd_resp_send(req, resp, len);
 }
 
-static esp_err_t get_hum_handler(httpd_req_t *req) {
-    webserver_sensor_data_t *webserver_sensor_data = (webserver_sensor_data_t *) req->user_ctx;
+static bool accepts(httpd_req_t *req, const char *content_type) {
+    char accept[ACCEPT_HEADER_SIZE];
+    esp_err_t res = httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+    // A truncated header still starts with the preferred types
+    if (res != ESP_OK && res != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    return strstr(accept, content_type) != NULL;
+}
 
-    if (xSemaphoreTake(webserver_sensor_data->semaphore, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGE(TAG, "Could not take semaphore!");
-        return ESP_FAIL;
+// Prometheus asks for OpenMetrics first when it supports it, everything else gets the classic text format
+static metrics_format_t negotiate_metrics_format(httpd_req_t *req) {
+    return accepts(req, "application/openmetrics-text") ? METRICS_FORMAT_OPENMETRICS : METRICS_FORMAT_PROMETHEUS;
+}
+
+static void chunk_flush(chunk_buffer_t *chunk) {
+    if (chunk->res == ESP_OK && chunk->len > 0) {
+        chunk->res = httpd_resp_send_chunk(chunk->req, chunk->data, chunk->len);
+    }
+    chunk->len = 0;
+}
+
+// len is the return value of a render function, -1 if the rendered text didn't fit
+static void chunk_append(chunk_buffer_t *chunk, const char *data, int len) {
+    if (len < 0) {
+        ESP_LOGE(TAG, "Metrics line doesn't fit into the buffer!");
+        return;
+    }
+    if (chunk->len + len > sizeof(chunk->data)) {
+        chunk_flush(chunk);
+    }
+    if (chunk->res == ESP_OK) {
+        memcpy(chunk->data + chunk->len, data, len);
+        chunk->len += len;
     }
+}
 
-    char *resp;
-    asprintf(&resp, "%.1f%%", webserver_sensor_data->humidity);
+static void render_uri_counter(chunk_buffer_t *chunk, metrics_format_t format, const char *name, const char *help, size_t counter_offset) {
+    char line[METRICS_LINE_SIZE];
+    char labels[METRICS_LABELS_SIZE];
+    char value[FORMAT_MAX_LENGTH + 1];
 
-    if (xSemaphoreGive(webserver_sensor_data->semaphore) != pdTRUE) {
-        ESP_LOGE(TAG, "Could not give semaphore!");
+    chunk_append(chunk, line, metrics_render_family(format, name, help, METRICS_COUNTER, line, sizeof(line)));
+    for (size_t i = 0; i < endpoint_count; i++) {
+        snprintf(labels, sizeof(labels), "uri=\"%s\"", endpoint_stats[i].uri);
+        value[format_u32(value, *(const u_int32_t *) ((const u_int8_t *) &endpoint_stats[i] + counter_offset))] = '\0';
+        chunk_append(chunk, line, metrics_render_sample(format, name, NULL, METRICS_COUNTER, labels, value, line, sizeof(line)));
+    }
+}
+
+static void render_request_metrics(chunk_buffer_t *chunk, metrics_format_t format) {
+    static const char *duration_name = "http_request_duration_seconds";
+    char line[METRICS_LINE_SIZE];
+    char labels[METRICS_LABELS_SIZE];
+    char value[FORMAT_MAX_LENGTH + 1];
+
+    render_uri_counter(chunk, format, "http_requests", "Handled requests per URI", offsetof(endpoint_stats_t, requests));
+    render_uri_counter(chunk, format, "http_request_errors", "Requests per URI that failed or were answered with an error", offsetof(endpoint_stats_t, errors));
+
+    chunk_append(chunk, line, metrics_render_family(format, duration_name, "Time per URI from the start of the handler until the response was sent", METRICS_HISTOGRAM, line, sizeof(line)));
+    for (size_t i = 0; i < endpoint_count; i++) {
+        const endpoint_stats_t *stats = &endpoint_stats[i];
+        u_int32_t cumulative = 0;
+
+        for (size_t bucket = 0; bucket <= LATENCY_BUCKET_COUNT; bucket++) {
+            cumulative += stats->buckets[bucket];
+            snprintf(labels, sizeof(labels), "uri=\"%s\",le=\"%s\"", stats->uri, bucket < LATENCY_BUCKET_COUNT ? latency_buckets[bucket].le : "+Inf");
+            value[format_u32(value, cumulative)] = '\0';
+            chunk_append(chunk, line, metrics_render_sample(format, duration_name, "_bucket", METRICS_HISTOGRAM, labels, value, line, sizeof(line)));
+        }
+
+        snprintf(labels, sizeof(labels), "uri=\"%s\"", stats->uri);
+        snprintf(value, sizeof(value), "%llu.%06llu", stats->duration_sum_us / 1000000, stats->duration_sum_us % 1000000);
+        chunk_append(chunk, line, metrics_render_sample(format, duration_name, "_sum", METRICS_HISTOGRAM, labels, value, line, sizeof(line)));
+        value[format_u32(value, stats->requests)] = '\0';
+        chunk_append(chunk, line, metrics_render_sample(format, duration_name, "_count", METRICS_HISTOGRAM, labels, value, line, sizeof(line)));
+    }
+}
+
+static void render_task_metrics(chunk_buffer_t *chunk, metrics_format_t format) {
+    static const char *name = "sensor_task_missed_deadlines";
+    char line[METRICS_LINE_SIZE];
+    char labels[METRICS_LABELS_SIZE];
+    char value[FORMAT_MAX_LENGTH + 1];
+
+    chunk_append(chunk, line, metrics_render_family(format, name, "Samples per sensor task that took longer than the deadline", METRICS_COUNTER, line, sizeof(line)));
+    for (size_t i = 0; i < sensor_task_count(); i++) {
+        const sensor_task_t *task = sensor_task_get(i);
+        snprintf(labels, sizeof(labels), "task=\"%s\"", task->name);
+        value[format_u32(value, atomic_load(&task->missed_deadlines))] = '\0';
+        chunk_append(chunk, line, metrics_render_sample(format, name, NULL, METRICS_COUNTER, labels, value, line, sizeof(line)));
+    }
+}
+
+static esp_err_t get_metrics_handler(httpd_req_t *req) {
+    metrics_format_t format = negotiate_metrics_format(req);
+    refresh_metrics();
+
+    // Pinned so the writer can't render into it while it is sent
+    metrics_buffer_t *buffer = metrics_buffer_acquire(&metrics_responses[format]);
+
+    httpd_resp_set_type(req, metrics_content_type(format));
+    esp_err_t ret = httpd_resp_send_chunk(req, buffer->data, buffer->len);
+
+    metrics_buffer_release(buffer);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // The request and deadline counters change without a sensor update, they are rendered for each scrape
+    chunk_buffer_t chunk = { .req = req, .len = 0, .res = ESP_OK };
+    char eof[8];
+    render_request_metrics(&chunk, format);
+    render_task_metrics(&chunk, format);
+    chunk_append(&chunk, eof, metrics_render_eof(format, eof, sizeof(eof)));
+    chunk_flush(&chunk);
+    if (chunk.res != ESP_OK) {
+        return chunk.res;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static const char *sensor_status_name(const webserver_sensor_status_t *status) {
+    if (status->errors > 0) {
+        return "error";
+    }
+    return status->sampled ? "ok" : "pending";
+}
+
+typedef struct json_buffer {
+    char *data;
+    size_t size;
+    size_t len;
+    bool overflow;
+} json_buffer_t;
+
+static void json_append(json_buffer_t *json, const char *text, size_t len) {
+    if (json->overflow || len > json->size - json->len) {
+        json->overflow = true;
+        return;
+    }
+    memcpy(json->data + json->len, text, len);
+    json->len += len;
+}
+
+static void json_append_str(json_buffer_t *json, const char *text) {
+    json_append(json, text, strlen(text));
+}
+
+// Keys and units are constants without characters that need escaping
+static void json_append_key(json_buffer_t *json, const char *key) {
+    json_append_str(json, "\"");
+    json_append_str(json, key);
+    json_append_str(json, "\":");
+}
+
+static void json_append_string(json_buffer_t *json, const char *text) {
+    json_append_str(json, "\"");
+    json_append_str(json, text);
+    json_append_str(json, "\"");
+}
+
+static void json_append_sensor_value(json_buffer_t *json, const sensor_endpoint_t *endpoint, const webserver_sensor_values_t *values) {
+    char number[FORMAT_MAX_LENGTH];
+    size_t len = format_sensor_value(endpoint, values, number);
+
+    // JSON has no NaN, a value that was never sampled is null as well
+    if (!values->status[endpoint->sensor].sampled || (len == 3 && memcmp(number, "NaN", 3) == 0)) {
+        json_append_str(json, "null");
+    } else {
+        json_append(json, number, len);
+    }
+}
+
+static size_t encode_sensors_json(const webserver_sensor_values_t *values, char *buffer, size_t size) {
+    json_buffer_t json = { .data = buffer, .size = size };
+    char number[FORMAT_MAX_LENGTH];
+
+    json_append_str(&json, "{\"sensors\":{");
+    for (int sensor = WEBSERVER_SENSOR_NONE + 1; sensor < WEBSERVER_SENSOR_COUNT; sensor++) {
+        const webserver_sensor_status_t *status = &values->status[sensor];
+        if (sensor > WEBSERVER_SENSOR_NONE + 1) {
+            json_append_str(&json, ",");
+        }
+        json_append_key(&json, sensor_names[sensor]);
+        json_append_str(&json, "{\"status\":");
+        json_append_string(&json, sensor_status_name(status));
+        json_append_str(&json, ",\"timestamp_ms\":");
+        if (status->timestamp_ms != 0) {
+            json_append(&json, number, format_u64(number, status->timestamp_ms));
+        } else {
+            json_append_str(&json, "null");
+        }
+        json_append_str(&json, ",\"errors\":");
+        json_append(&json, number, format_u32(number, status->errors));
+        json_append_str(&json, "}");
+    }
+
+    json_append_str(&json, "},\"values\":{");
+    for (size_t i = 0; i < SENSOR_ENDPOINT_COUNT; i++) {
+        const sensor_endpoint_t *endpoint = &sensor_endpoints[i];
+        if (i > 0) {
+            json_append_str(&json, ",");
+        }
+        json_append_key(&json, endpoint->name);
+        json_append_str(&json, "{\"value\":");
+        json_append_sensor_value(&json, endpoint, values);
+        json_append_str(&json, ",\"unit\":");
+        json_append_string(&json, endpoint->unit);
+        json_append_str(&json, ",\"sensor\":");
+        json_append_string(&json, sensor_names[endpoint->sensor]);
+        json_append_str(&json, "}");
+    }
+    json_append_str(&json, "}}");
+
+    return json.overflow ? 0 : json.len;
+}
+
+size_t webserver_encode_sensor_json(webserver_sensor_t sensor, const webserver_sensor_values_t *values, char *buffer, size_t size) {
+    json_buffer_t json = { .data = buffer, .size = size };
+    char number[FORMAT_MAX_LENGTH];
+    bool first = true;
+
+    json_append_str(&json, "{\"sensor\":");
+    json_append_string(&json, sensor_names[sensor]);
+    json_append_str(&json, ",\"timestamp_ms\":");
+    if (values->status[sensor].timestamp_ms != 0) {
+        json_append(&json, number, format_u64(number, values->status[sensor].timestamp_ms));
+    } else {
+        json_append_str(&json, "null");
+    }
+
+    json_append_str(&json, ",\"values\":{");
+    for (size_t i = 0; i < SENSOR_ENDPOINT_COUNT; i++) {
+        const sensor_endpoint_t *endpoint = &sensor_endpoints[i];
+        if (endpoint->sensor != sensor) {
+            continue;
+        }
+        if (!first) {
+            json_append_str(&json, ",");
+        }
+        first = false;
+        json_append_key(&json, endpoint->name);
+        json_append_sensor_value(&json, endpoint, values);
+    }
+    json_append_str(&json, "}}");
+
+    return json.overflow ? 0 : json.len;
+}
+
+static void cbor_write_sensor_value(cbor_writer_t *writer, const sensor_endpoint_t *endpoint, const webserver_sensor_values_t *values) {
+    const u_int8_t *value = (const u_int8_t *) values + endpoint->offset;
+
+    if (!values->status[endpoint->sensor].sampled) {
+        cbor_write_null(writer);
+        return;
+    }
+    switch (endpoint->type) {
+        case SENSOR_VALUE_U32:
+            cbor_write_uint(writer, *(const u_int32_t *) value);
+            break;
+        case SENSOR_VALUE_U8:
+            cbor_write_uint(writer, *value);
+            break;
+        case SENSOR_VALUE_FLOAT:
+        default:
+            cbor_write_float(writer, *(const float *) value);
+            break;
+    }
+}
+
+// Same structure as the JSON, floats keep their full precision
+static size_t encode_sensors_cbor(const webserver_sensor_values_t *values, u_int8_t *buffer, size_t size) {
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buffer, size);
+
+    cbor_write_map(&writer, 2);
+    cbor_write_text(&writer, "sensors");
+    cbor_write_map(&writer, WEBSERVER_SENSOR_COUNT - 1);
+    for (int sensor = WEBSERVER_SENSOR_NONE + 1; sensor < WEBSERVER_SENSOR_COUNT; sensor++) {
+        const webserver_sensor_status_t *status = &values->status[sensor];
+        cbor_write_text(&writer, sensor_names[sensor]);
+        cbor_write_map(&writer, 3);
+        cbor_write_text(&writer, "status");
+        cbor_write_text(&writer, sensor_status_name(status));
+        cbor_write_text(&writer, "timestamp_ms");
+        if (status->timestamp_ms != 0) {
+            cbor_write_uint(&writer, status->timestamp_ms);
+        } else {
+            cbor_write_null(&writer);
+        }
+        cbor_write_text(&writer, "errors");
+        cbor_write_uint(&writer, status->errors);
+    }
+
+    cbor_write_text(&writer, "values");
+    cbor_write_map(&writer, SENSOR_ENDPOINT_COUNT);
+    for (size_t i = 0; i < SENSOR_ENDPOINT_COUNT; i++) {
+        const sensor_endpoint_t *endpoint = &sensor_endpoints[i];
+        cbor_write_text(&writer, endpoint->name);
+        cbor_write_map(&writer, 3);
+        cbor_write_text(&writer, "value");
+        cbor_write_sensor_value(&writer, endpoint, values);
+        cbor_write_text(&writer, "unit");
+        cbor_write_text(&writer, endpoint->unit);
+        cbor_write_text(&writer, "sensor");
+        cbor_write_text(&writer, sensor_names[endpoint->sensor]);
+    }
+
+    return writer.overflow ? 0 : writer.len;
+}
+
+// All values from one snapshot, so a collector gets a consistent reading in one round trip
+static esp_err_t get_sensors_handler(httpd_req_t *req) {
+    webserver_sensor_values_t values;
+    webserver_sensor_data_read(sensor_data, &values);
+
+    // The snapshot is current until the first sensor publishes again
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    u_int32_t max_age_s = UINT32_MAX;
+    for (int sensor = WEBSERVER_SENSOR_NONE + 1; sensor < WEBSERVER_SENSOR_COUNT; sensor++) {
+        if (values.status[sensor].sampled) {
+            u_int32_t left_s = seconds_until_next_sample(&values.status[sensor], now_ms);
+            max_age_s = left_s < max_age_s ? left_s : max_age_s;
+        }
+    }
+    if (max_age_s == UINT32_MAX) {
+        max_age_s = 0;
+    }
+
+    bool cbor = accepts(req, "application/cbor");
+    cache_headers_t cache;
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    set_cache_headers(req, &cache, values.generation, cbor ? "-cbor" : "", max_age_s);
+    if (client_has_current(req, cache.etag)) {
+        return send_not_modified(req);
+    }
+
+    u_int8_t buffer[SENSORS_BUFFER_SIZE];
+    size_t len;
+    if (cbor) {
+        len = encode_sensors_cbor(&values, buffer, sizeof(buffer));
+        httpd_resp_set_type(req, "application/cbor");
+    } else {
+        len = encode_sensors_json(&values, (char *) buffer, sizeof(buffer));
+        httpd_resp_set_type(req, "application/json");
+    }
+
+    if (len == 0) {
+        ESP_LOGE(TAG, "Sensors don't fit into the buffer!");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
         return ESP_FAIL;
     }
+    return httpd_resp_send(req, (const char *) buffer, len);
+}
 
-    httpd_resp_set_type(req, "text/plain");
-    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+static u_int32_t get_query_u32(const char *query, const char *key, u_int32_t default_value) {
+    char value[16];
+    if (httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK) {
+        return default_value;
+    }
+    return strtoul(value, NULL, 10);
 }
 
-static esp_err_t get_heartrate_handler(httpd_req_t *req) {
-    webserver_sensor_data_t *webserver_sensor_data = (webserver_sensor_data_t *) req->user_ctx;
+static esp_err_t get_history_handler(httpd_req_t *req) {
+    char query[HISTORY_QUERY_SIZE] = {0};
+    char metric_name[16];
+    history_metric_t metric;
 
-    if (xSemaphoreTake(webserver_sensor_data->semaphore, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGE(TAG, "Could not take semaphore!");
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK
+        || httpd_query_key_value(query, "metric", metric_name, sizeof(metric_name)) != ESP_OK
+        || !history_metric_from_name(metric_name, &metric)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or unknown metric");
         return ESP_FAIL;
     }
 
-    char *resp;
-    asprintf(&resp, "%d BPM", webserver_sensor_data->heartrate);
+    // The history is stored in seconds since boot, the API uses unix time
+    u_int32_t uptime = esp_timer_get_time() / 1000000;
+    u_int32_t boot_time = time(NULL) - uptime;
 
-    if (xSemaphoreGive(webserver_sensor_data->semaphore) != pdTRUE) {
-        ESP_LOGE(TAG, "Could not give semaphore!");
+    u_int32_t from = get_query_u32(query, "from", boot_time);
+    u_int32_t to = get_query_u32(query, "to", boot_time + uptime);
+    u_int32_t step = get_query_u32(query, "step", 1);
+    if (step == 0 || to < from) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid range");
         return ESP_FAIL;
     }
+    from = from > boot_time ? from - boot_time : 0;
+    to = to > boot_time ? to - boot_time : 0;
+    if (to > uptime) {
+        to = uptime;
+    }
 
-    httpd_resp_set_type(req, "text/plain");
-    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+
+    char chunk[HISTORY_PAGE_POINTS * 32 + 64];
+    int len = snprintf(chunk, sizeof(chunk), "{\"metric\":\"%s\",\"step\":%ld,\"values\":[", metric_name, step);
+    bool first = true;
+
+    history_point_t points[HISTORY_PAGE_POINTS];
+    while (from <= to) {
+        size_t count = history_query(metric, from, to, step, points, HISTORY_PAGE_POINTS, &from);
+        for (size_t i = 0; i < count; i++) {
+            char point[HISTORY_POINT_SIZE];
+            int point_len = snprintf(point, sizeof(point), "%s[%ld,%.2f]", first ? "" : ",", points[i].timestamp + boot_time, points[i].value);
+            if (point_len < 0 || point_len >= sizeof(point)) {
+                ESP_LOGE(TAG, "History point doesn't fit into the buffer!");
+                return ESP_FAIL;
+            }
+            // Send what the chunk holds before a point would overflow it
+            if (len + point_len > sizeof(chunk)) {
+                if (httpd_resp_send_chunk(req, chunk, len) != ESP_OK) {
+                    return ESP_FAIL;
+                }
+                len = 0;
+            }
+            memcpy(chunk + len, point, point_len);
+            len += point_len;
+            first = false;
+        }
+        if (len > 0 && httpd_resp_send_chunk(req, chunk, len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        len = 0;
+    }
+
+    len = snprintf(chunk, sizeof(chunk), "]}");
+    httpd_resp_send_chunk(req, chunk, len);
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
-static esp_err_t get_metrics_handler(httpd_req_t *req) {
-    webserver_sensor_data_t *webserver_sensor_data = (webserver_sensor_data_t *) req->user_ctx;
+// Stores the calibration of the sensor in the query, the body are the coefficients c0,c1,... of calibration_parse
+static esp_err_t post_calibration_handler(httpd_req_t *req) {
+    char query[CALIBRATION_QUERY_SIZE] = {0};
+    char sensor_name[16];
+    calibration_sensor_t sensor;
 
-    if (xSemaphoreTake(webserver_sensor_data->semaphore, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGE(TAG, "Could not take semaphore!");
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK
+        || httpd_query_key_value(query, "sensor", sensor_name, sizeof(sensor_name)) != ESP_OK
+        || !calibration_sensor_from_name(sensor_name, &sensor)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or unknown sensor");
         return ESP_FAIL;
     }
 
-    char *resp;
-    asprintf(
-        &resp,
-        "# HELP illuminance_lux Light intensity in lux\n"
-        "# TYPE illuminance_lux gauge\n"
-        "illuminance_lux %ld\n\n"
-        "# HELP temperature_celsius Temperature in celsius\n"
-        "# TYPE temperature_celsius gauge\n"
-        "temperature_celsius %.1f\n\n"
-        "# HELP humidity_relative Relative humidity in percent\n"
-        "# TYPE humidity_relative gauge\n"
-        "humidity_relative %.1f\n\n"
-        "# HELP heartrate_bpm Heart rate in beats per minute\n"
-        "# TYPE heartrate_bpm gauge\n"
-        "heartrate_bpm %d"
-        , webserver_sensor_data->illuminance, webserver_sensor_data->temperature, webserver_sensor_data->humidity, webserver_sensor_data->heartrate
-    );
+    char body[CALIBRATION_BODY_SIZE];
+    if (req->content_len == 0 || req->content_len >= sizeof(body)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or too long coefficients");
+        return ESP_FAIL;
+    }
+    size_t received = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, body + received, req->content_len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        received += ret;
+    }
+    body[received] = '\0';
 
-    if (xSemaphoreGive(webserver_sensor_data->semaphore) != pdTRUE) {
-        ESP_LOGE(TAG, "Could not give semaphore!");
+    calibration_t calibration;
+    if (calibration_parse(body, calibration_input_shift(sensor), &calibration) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected 1 to 4 comma separated coefficients");
+        return ESP_FAIL;
+    }
+    if (calibration_set(sensor, &calibration) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Storing the calibration failed");
         return ESP_FAIL;
     }
 
-    httpd_resp_set_type(req, "text/plain");
-    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    ESP_LOGI(TAG, "Calibration of %s set to order %d", sensor_name, calibration.order);
+    httpd_resp_set_status(req, "204 No Content");
+    return httpd_resp_send(req, NULL, 0);
 }
 
-httpd_handle_t start_webserver(u_int16_t port, webserver_sensor_data_t *webserver_sensor_data) {
+// Measures the wrapped handler, a handler that returns an error either couldn't send its response or sent an error status
+static esp_err_t instrumented_handler(httpd_req_t *req) {
+    endpoint_stats_t *stats = (endpoint_stats_t *) req->user_ctx;
+    req->user_ctx = stats->user_ctx;
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t res = stats->handler(req);
+    int64_t duration_us = esp_timer_get_time() - start;
+
+    size_t bucket = 0;
+    while (bucket < LATENCY_BUCKET_COUNT && duration_us > latency_buckets[bucket].upper_bound_us) {
+        bucket++;
+    }
+    stats->buckets[bucket]++;
+    stats->duration_sum_us += duration_us;
+    stats->requests++;
+    if (res != ESP_OK) {
+        stats->errors++;
+    }
+
+    return res;
+}
+
+static httpd_uri_t instrumented_uri(endpoint_stats_t *stats, const char *uri, httpd_method_t method, esp_err_t (*handler)(httpd_req_t *req), void *user_ctx) {
+    *stats = (endpoint_stats_t) {
+        .uri = uri,
+        .handler = handler,
+        .user_ctx = user_ctx
+    };
+
+    return (httpd_uri_t) {
+        .uri = uri,
+        .method = method,
+        .handler = instrumented_handler,
+        .user_ctx = stats
+    };
+}
+
+httpd_handle_t start_webserver(const webserver_config_t *webserver_config, webserver_sensor_data_t *webserver_sensor_data) {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.server_port = port;
+    config.server_port = webserver_config->port;
+    config.max_open_sockets = webserver_config->max_open_sockets;
+    config.backlog_conn = webserver_config->backlog;
+    config.lru_purge_enable = webserver_config->lru_purge;
+    // Stream sessions can be purged as well, the stream task has to forget them before the socket is reused
+    config.close_fn = stream_close_session;
+    config.stack_size = webserver_config->stack_size;
+    config.task_priority = webserver_config->priority;
+    config.core_id = webserver_config->core_id;
+    if (webserver_config->keep_alive_idle_s > 0) {
+        config.keep_alive_enable = true;
+        config.keep_alive_idle = webserver_config->keep_alive_idle_s;
+        config.keep_alive_interval = KEEP_ALIVE_INTERVAL_S;
+        config.keep_alive_count = KEEP_ALIVE_COUNT;
+    }
 
     httpd_handle_t server = NULL;
 
-    httpd_uri_t uris[] = {
-        {
-            .uri = "/illuminance",
-            .method = HTTP_GET,
-            .handler = get_illuminance_handler,
-            .user_ctx = webserver_sensor_data
-        },
-        {
-            .uri = "/temp",
-            .method = HTTP_GET,
-            .handler = get_temp_handler,
-            .user_ctx = webserver_sensor_data
-        },
-        {
-            .uri = "/hum",
-            .method = HTTP_GET,
-             .handler = get_hum_handler,
-             .user_ctx = webserver_sensor_data
-        },
-        {
-            .uri = "/heartrate",
-            .method = HTTP_GET,
-            .handler = get_heartrate_handler,
-            .user_ctx = webserver_sensor_data
-        },
-        {
-            .uri = "/metrics",
-            .method = HTTP_GET,
-            .handler = get_metrics_handler,
-            .user_ctx = webserver_sensor_data
+    // Publish the initial values, the sensor tasks render every following update
+    for (int format = 0; format < METRICS_FORMAT_COUNT; format++) {
+        metrics_buffer_init(&metrics_responses[format]);
+    }
+    render_all_metrics();
+
+    sensor_data = webserver_sensor_data;
+    boot_id = esp_random();
+
+    // Every sensor endpoint is served by the same handler, its descriptor is the user context
+    httpd_uri_t uris[MAX_ENDPOINT_COUNT];
+    size_t uri_count = 0;
+    for (size_t i = 0; i < SENSOR_ENDPOINT_COUNT; i++) {
+        if (sensor_endpoints[i].uri != NULL) {
+            uris[uri_count] = instrumented_uri(&endpoint_stats[uri_count], sensor_endpoints[i].uri, HTTP_GET, get_sensor_handler, (void *) &sensor_endpoints[i]);
+            uri_count++;
         }
-    };
+    }
+    uris[uri_count] = instrumented_uri(&endpoint_stats[uri_count], "/sensors", HTTP_GET, get_sensors_handler, NULL);
+    uri_count++;
+    uris[uri_count] = instrumented_uri(&endpoint_stats[uri_count], "/metrics", HTTP_GET, get_metrics_handler, webserver_sensor_data);
+    uri_count++;
+    uris[uri_count] = instrumented_uri(&endpoint_stats[uri_count], "/history", HTTP_GET, get_history_handler, NULL);
+    uri_count++;
+    uris[uri_count] = instrumented_uri(&endpoint_stats[uri_count], "/stream", HTTP_GET, stream_subscribe, NULL);
+    uri_count++;
+    uris[uri_count] = instrumented_uri(&endpoint_stats[uri_count], "/calibration", HTTP_POST, post_calibration_handler, NULL);
+    uri_count++;
+    endpoint_count = uri_count;
+    config.max_uri_handlers = uri_count;
 
     ESP_LOGI(TAG, "Starting webserver on port: '%d'", config.server_port);
-    if (httpd_start(&server, &config) == ESP_OK) {
-        ESP_LOGI(TAG, "Registering URI handlers");
-        for (int i = 0; i < sizeof(uris)/sizeof(httpd_uri_t); i++) {
-            httpd_register_uri_handler(server, &uris[i]);
-        }
+    if (httpd_start(&server, &config) != ESP_OK) {
+        ESP_LOGE(TAG, "Could not start the webserver!");
+        return NULL;
+    }
+
+    ESP_LOGI(TAG, "Registering URI handlers");
+    for (int i = 0; i < uri_count; i++) {
+        httpd_register_uri_handler(server, &uris[i]);
     }
 
     return server;
@@ -0,0 +1,248 @@
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "hr_estimator.h"
+
+/*
+ * Replays synthetic PPG traces through the heart rate estimator with the settings of the device and measures the beat
+ * detection, the BPM accuracy and the time to the first BPM.
+ *
+ * The traces are in millivolts at the rate of heart_rate_process_frame (20 kHz / 16 samples per point). Every pulse is
+ * a systolic peak followed by a smaller diastolic wave, on top of a wandering baseline, 50 Hz mains hum and white noise.
+ */
+
+#define SAMPLE_RATE_HZ 1250
+#define MIN_PEAK_MV 300
+#define WINDOW 8
+#define TIMEOUT_MS 2000
+
+#define TRACE_S 60
+#define BASELINE_MV 1500
+// Time from the onset of a pulse to its systolic peak
+#define SYSTOLIC_DELAY_S 0.12
+// A detected beat within this distance of a systolic peak is a hit
+#define MATCH_TOLERANCE_S 0.1
+#define MAX_BEATS (TRACE_S * 4)
+
+typedef struct {
+    const char *name;
+    double bpm;
+    double variability;  // Relative interval change from beat to beat, alternating
+    double amplitude_mv; // Of the systolic peak
+    double noise_mv;     // Standard deviation of the white noise
+    double wander_mv;    // Amplitude of the 0.25 Hz baseline wander
+    double hum_mv;       // Amplitude of the 50 Hz mains hum
+    double weak_from_s;  // From this time on the pulses have weak_factor of the amplitude, 0 for never
+    double weak_factor;
+    double dropout_s;    // The sensor loses contact for 3 s at this time, 0 for never
+    double artifact_s;   // Period of 60 ms motion artifacts of the pulse amplitude, 0 for none
+    // Pass criteria
+    unsigned long min_sensitivity_permille;
+    unsigned long min_precision_permille;
+    double max_bpm_error;
+} scenario_t;
+
+typedef struct {
+    double peaks_s[MAX_BEATS];
+    int peak_count;
+    double last_bpm; // Of the last WINDOW intervals of the trace
+    unsigned long sensitivity_permille;
+    unsigned long precision_permille;
+    double first_bpm_s;
+    int final_bpm;
+    double max_bpm_error; // After the first BPM, of the estimate against the trailing true rate
+} replay_result_t;
+
+static uint32_t random_state;
+
+void setUp(void) {
+    random_state = 12345;
+}
+
+void tearDown(void) {
+}
+
+static double random_uniform(void) {
+    random_state = random_state * 1664525 + 1013904223;
+    return (random_state >> 8) / (double) (1 << 24);
+}
+
+static double random_gaussian(void) {
+    double u = random_uniform() + 1e-9;
+    double v = random_uniform();
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static double pulse_shape(double t) {
+    double systolic = exp(-pow((t - SYSTOLIC_DELAY_S) / 0.05, 2));
+    double diastolic = 0.35 * exp(-pow((t - 0.35) / 0.06, 2));
+    return systolic + diastolic;
+}
+
+// True rate over the last WINDOW intervals before the time t
+static double trailing_bpm(const replay_result_t *result, double t) {
+    int last = -1;
+    for (int i = 0; i < result->peak_count && result->peaks_s[i] <= t; i++) {
+        last = i;
+    }
+    if (last < 1) {
+        return 0;
+    }
+    int first = last - WINDOW < 0 ? 0 : last - WINDOW;
+    return 60.0 * (last - first) / (result->peaks_s[last] - result->peaks_s[first]);
+}
+
+static void replay(const scenario_t *scenario, replay_result_t *result) {
+    hr_estimator_t estimator;
+    hr_estimator_init(&estimator, SAMPLE_RATE_HZ, MIN_PEAK_MV, WINDOW, TIMEOUT_MS);
+
+    double onsets[MAX_BEATS];
+    int onset_count = 0;
+    double interval = 60.0 / scenario->bpm;
+    for (double t = 0.3; t < TRACE_S && onset_count < MAX_BEATS; onset_count++) {
+        onsets[onset_count] = t;
+        t += interval * (onset_count % 2 ? 1 + scenario->variability : 1 - scenario->variability);
+    }
+
+    result->peak_count = 0;
+    for (int i = 0; i < onset_count; i++) {
+        double peak = onsets[i] + SYSTOLIC_DELAY_S;
+        bool lost = scenario->dropout_s > 0 && peak >= scenario->dropout_s && peak < scenario->dropout_s + 3;
+        if (!lost && peak < TRACE_S) {
+            result->peaks_s[result->peak_count++] = peak;
+        }
+    }
+
+    double detected[MAX_BEATS * 2];
+    int detected_count = 0;
+    int next_onset = 0;
+    result->first_bpm_s = -1;
+    result->max_bpm_error = 0;
+
+    for (uint64_t n = 0; n < (uint64_t) TRACE_S * SAMPLE_RATE_HZ; n++) {
+        double t = (double) n / SAMPLE_RATE_HZ;
+        double value = BASELINE_MV
+            + scenario->wander_mv * sin(2 * M_PI * 0.25 * t)
+            + scenario->hum_mv * sin(2 * M_PI * 50 * t)
+            + scenario->noise_mv * random_gaussian();
+
+        while (next_onset + 1 < onset_count && onsets[next_onset + 1] <= t) {
+            next_onset++;
+        }
+        // The two pulses that can overlap at the time t
+        for (int i = next_onset - 1; i <= next_onset; i++) {
+            if (i < 0 || onsets[i] > t) {
+                continue;
+            }
+            double amplitude = scenario->amplitude_mv;
+            if (scenario->weak_from_s > 0 && onsets[i] >= scenario->weak_from_s) {
+                amplitude *= scenario->weak_factor;
+            }
+            value += amplitude * pulse_shape(t - onsets[i]);
+        }
+        if (scenario->dropout_s > 0 && t >= scenario->dropout_s && t < scenario->dropout_s + 3) {
+            // Without contact the receiver only sees the ambient light
+            value = 200 + scenario->noise_mv * random_gaussian();
+        }
+        if (scenario->artifact_s > 0) {
+            double phase = fmod(t, scenario->artifact_s) - scenario->artifact_s / 2;
+            if (phase >= 0 && phase < 0.06) {
+                value += scenario->amplitude_mv * sin(M_PI * phase / 0.06);
+            }
+        }
+        value = value < 0 ? 0 : value > 3300 ? 3300 : value;
+
+        if (hr_estimator_add_sample(&estimator, (uint16_t) lround(value)) && detected_count < MAX_BEATS * 2) {
+            detected[detected_count++] = (double) estimator.last_beat_sample / SAMPLE_RATE_HZ;
+        }
+
+        // Check the estimate once per 100 ms
+        if (n % (SAMPLE_RATE_HZ / 10) == 0) {
+            hr_estimator_stats_t stats;
+            hr_estimator_get_stats(&estimator, &stats);
+            if (stats.bpm != 0 && result->first_bpm_s < 0) {
+                result->first_bpm_s = t;
+            }
+            // Only full windows are compared, a partial one after a dropout still averages the intervals it has
+            double expected = trailing_bpm(result, t);
+            if (stats.intervals >= WINDOW && expected > 0 && fabs(stats.bpm - expected) > result->max_bpm_error) {
+                result->max_bpm_error = fabs(stats.bpm - expected);
+            }
+        }
+    }
+
+    hr_estimator_stats_t stats;
+    hr_estimator_get_stats(&estimator, &stats);
+    result->final_bpm = stats.bpm;
+    result->last_bpm = trailing_bpm(result, TRACE_S);
+
+    // Beats are only expected once the detector learned the levels
+    int expected_count = 0;
+    int hits = 0;
+    bool matched[MAX_BEATS] = {false};
+    int expected_hits = 0;
+    for (int d = 0; d < detected_count; d++) {
+        for (int i = 0; i < result->peak_count; i++) {
+            if (!matched[i] && fabs(detected[d] - result->peaks_s[i]) <= MATCH_TOLERANCE_S) {
+                matched[i] = true;
+                hits++;
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < result->peak_count; i++) {
+        if (result->peaks_s[i] >= BEAT_DETECTOR_LEARNING_MS / 1000.0 + 0.3) {
+            expected_count++;
+            expected_hits += matched[i];
+        }
+    }
+    result->sensitivity_permille = expected_count ? 1000UL * expected_hits / expected_count : 0;
+    result->precision_permille = detected_count ? 1000UL * hits / detected_count : 0;
+}
+
+// Artifacts as large as a pulse can't be told apart from one, they are detected as beats and the following beat falls
+// into the refractory period, so the motion trace only guards against regressions
+static const scenario_t scenarios[] = {
+    // name             bpm  var   amp  noise wander hum  weak_from factor dropout artifact  sens  prec  error
+    {"rest 60",          60, 0.00, 800,  10,    0,   0,   0,       0,     0,      0,      980,  980,  2},
+    {"rest 60 noisy",    60, 0.03, 800,  40,  150,  30,   0,       0,     0,      0,      980,  980,  2},
+    {"bradycardia 40",   40, 0.02, 800,  20,  100,  20,   0,       0,     0,      0,      980,  980,  2},
+    {"walking 110",     110, 0.02, 700,  30,  150,  20,   0,       0,     0,      0,      980,  980,  2},
+    {"exercise 180",    180, 0.01, 600,  30,  100,  20,   0,       0,     0,      0,      980,  980,  2},
+    {"hrv 75",           75, 0.08, 800,  20,  100,  20,   0,       0,     0,      0,      980,  980,  2},
+    {"weakening 70",     70, 0.02, 900,  20,  100,  20,  30,    0.45,     0,      0,      980,  980,  2},
+    {"dropout 80",       80, 0.02, 800,  20,  100,  20,   0,       0,    25,      0,      980,  980,  2},
+    {"motion 90",        90, 0.02, 800,  30,  150,  20,   0,       0,     0,    7.3,      900,  880, 15},
+};
+
+static void test_replay(void) {
+    static replay_result_t result;
+    char message[200];
+
+    TEST_MESSAGE("scenario          sens  prec  first BPM  final/true  max error");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        const scenario_t *scenario = &scenarios[i];
+        setUp();
+        replay(scenario, &result);
+
+        snprintf(message, sizeof(message), "%-16s %4.1f%% %4.1f%%  %6.2f s   %3d/%5.1f  %5.1f",
+            scenario->name, result.sensitivity_permille / 10.0, result.precision_permille / 10.0,
+            result.first_bpm_s, result.final_bpm, result.last_bpm, result.max_bpm_error);
+        TEST_MESSAGE(message);
+
+        TEST_ASSERT_GREATER_OR_EQUAL_MESSAGE(scenario->min_sensitivity_permille, result.sensitivity_permille, scenario->name);
+        TEST_ASSERT_GREATER_OR_EQUAL_MESSAGE(scenario->min_precision_permille, result.precision_permille, scenario->name);
+        // Learning, then two beats for the first interval
+        TEST_ASSERT_TRUE_MESSAGE(result.first_bpm_s > 0, scenario->name);
+        TEST_ASSERT_TRUE_MESSAGE(result.first_bpm_s <= BEAT_DETECTOR_LEARNING_MS / 1000.0 + 0.3 + 2.5 * 60 / scenario->bpm, scenario->name);
+        TEST_ASSERT_FLOAT_WITHIN_MESSAGE(scenario->max_bpm_error, result.last_bpm, result.final_bpm, scenario->name);
+        TEST_ASSERT_TRUE_MESSAGE(result.max_bpm_error <= scenario->max_bpm_error, scenario->name);
+    }
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_replay);
+    return UNITY_END();
+}
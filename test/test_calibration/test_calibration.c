@@ -0,0 +1,190 @@
+#include <unity.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "calibration_polynomial.h"
+
+/*
+ * The fixed point calibration polynomials against the same polynomials in double precision, over the ranges of the
+ * readings of every sensor: the results must not be more than 1 milli-unit apart unless they saturate.
+ */
+
+#define RANDOM_CALIBRATIONS 200
+#define RANDOM_INPUTS 1000
+#define MAX_TERM 1e8 // Largest term of a random polynomial in milli-units, so the sum doesn't saturate
+
+typedef struct {
+    uint8_t input_shift;
+    int32_t min_input;
+    int32_t max_input;
+} sensor_range_t;
+
+// The readings of calibration.h
+static const sensor_range_t sensor_ranges[] = {
+    { 10, -400, 800 },          // Temperature
+    { 10, 0, 1000 },            // Humidity
+    { 17, 0, 120000 },          // Illuminance
+    { 23, -0x800000, 0x7fffff }, // Pressure
+};
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static double eval_double(const double *coefficients, int order, int32_t input) {
+    double result = coefficients[order];
+    for (int i = order - 1; i >= 0; i--) {
+        result = result * input + coefficients[i];
+    }
+    return result;
+}
+
+static calibration_t parse(const double *coefficients, int order, uint8_t input_shift) {
+    char text[160];
+    int len = 0;
+    for (int i = 0; i <= order; i++) {
+        len += snprintf(text + len, sizeof(text) - len, "%s%.17g", i > 0 ? "," : "", coefficients[i]);
+    }
+    calibration_t calibration = {0};
+    TEST_ASSERT_EQUAL(ESP_OK, calibration_parse(text, input_shift, &calibration));
+    TEST_ASSERT_EQUAL(order, calibration.order);
+    return calibration;
+}
+
+static void assert_equivalent(const calibration_t *calibration, const double *coefficients, int32_t input) {
+    double expected = floor(eval_double(coefficients, calibration->order, input) + 0.5);
+    TEST_ASSERT_FLOAT_WITHIN(1, expected, calibration_eval(calibration, input));
+}
+
+void test_linear(void) {
+    calibration_t calibration;
+    TEST_ASSERT_EQUAL(ESP_OK, calibration_parse("0,100", 10, &calibration));
+
+    // 0.1 degrees to millidegrees, as the default of the temperature
+    TEST_ASSERT_EQUAL_INT32(21500, calibration_eval(&calibration, 215));
+    TEST_ASSERT_EQUAL_INT32(-12300, calibration_eval(&calibration, -123));
+    TEST_ASSERT_EQUAL_INT32(0, calibration_eval(&calibration, 0));
+
+    const calibration_t defaults = { .order = 1, .input_shift = 10, .coefficients = { 0, CALIBRATION_COEFFICIENT(100, 1, 10) } };
+    TEST_ASSERT_EQUAL_INT64(calibration.coefficients[1], defaults.coefficients[1]);
+}
+
+void test_horner(void) {
+    const double coefficients[] = { 1000, -2.5, 0.125, -0.001 };
+    calibration_t calibration = parse(coefficients, 3, 10);
+
+    TEST_ASSERT_EQUAL_INT32(1000, calibration_eval(&calibration, 0));
+    // 1000 - 250 + 1250 - 1000
+    TEST_ASSERT_EQUAL_INT32(1000, calibration_eval(&calibration, 100));
+    for (int32_t input = -1000; input <= 1000; input++) {
+        assert_equivalent(&calibration, coefficients, input);
+    }
+}
+
+void test_negative_inputs_round_half_up(void) {
+    calibration_t calibration;
+    TEST_ASSERT_EQUAL(ESP_OK, calibration_parse("0,0.5", 0, &calibration));
+
+    TEST_ASSERT_EQUAL_INT32(1, calibration_eval(&calibration, 1));
+    TEST_ASSERT_EQUAL_INT32(0, calibration_eval(&calibration, -1));
+    TEST_ASSERT_EQUAL_INT32(-1, calibration_eval(&calibration, -3));
+    TEST_ASSERT_EQUAL_INT32(-2, calibration_eval(&calibration, -5));
+
+    // Odd powers keep the sign of the input
+    TEST_ASSERT_EQUAL(ESP_OK, calibration_parse("0,0,0,1", 8, &calibration));
+    TEST_ASSERT_EQUAL_INT32(-1000000, calibration_eval(&calibration, -100));
+    TEST_ASSERT_EQUAL_INT32(1000000, calibration_eval(&calibration, 100));
+}
+
+void test_saturation(void) {
+    calibration_t calibration;
+
+    TEST_ASSERT_EQUAL(ESP_OK, calibration_parse("0,1000", 0, &calibration));
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, calibration_eval(&calibration, INT32_MAX));
+    TEST_ASSERT_EQUAL_INT32(INT32_MIN, calibration_eval(&calibration, INT32_MIN));
+
+    // The intermediate products overflow 64 bits
+    TEST_ASSERT_EQUAL(ESP_OK, calibration_parse("0,0,0,100000", 0, &calibration));
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, calibration_eval(&calibration, INT32_MAX));
+    TEST_ASSERT_EQUAL_INT32(INT32_MIN, calibration_eval(&calibration, INT32_MIN));
+    TEST_ASSERT_EQUAL(ESP_OK, calibration_parse("0,0,100000", 0, &calibration));
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, calibration_eval(&calibration, INT32_MIN));
+
+    // The largest coefficients cancel without overflowing: (2^63 * (1 - 2^-31) - 2^63) / 2^24
+    calibration_t extreme = { .order = 1, .input_shift = 31, .coefficients = { INT64_MIN, INT64_MAX } };
+    TEST_ASSERT_EQUAL_INT32(INT32_MIN, calibration_eval(&extreme, INT32_MIN));
+    TEST_ASSERT_EQUAL_INT32(-256, calibration_eval(&extreme, INT32_MAX));
+}
+
+void test_parse_rejects(void) {
+    calibration_t calibration = { .order = 2 };
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, calibration_parse("", 0, &calibration));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, calibration_parse("1,2,3,4,5", 0, &calibration));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, calibration_parse("1;2", 0, &calibration));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, calibration_parse("1,", 0, &calibration));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, calibration_parse("nan", 0, &calibration));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, calibration_parse("1e12", 0, &calibration));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, calibration_parse("1", CALIBRATION_MAX_INPUT_SHIFT + 1, &calibration));
+    // In range for the reading, but not once scaled to the input shift
+    TEST_ASSERT_EQUAL(ESP_OK, calibration_parse("0,0,1000", 0, &calibration));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, calibration_parse("0,0,1000", 23, &calibration));
+    TEST_ASSERT_EQUAL(2, calibration.order);
+}
+
+void test_hx710b_second_order(void) {
+    // A bridge with a slightly quadratic span: 1013.25 hPa at 0, +-160 hPa of which 128 hPa quadratic at full scale
+    const double coefficients[] = { 1013250, 0.004, 2e-9 };
+    calibration_t calibration = parse(coefficients, 2, 23);
+
+    for (int64_t input = -0x800000; input <= 0x7fffff; input += 997) {
+        assert_equivalent(&calibration, coefficients, input);
+    }
+    assert_equivalent(&calibration, coefficients, -0x800000);
+    assert_equivalent(&calibration, coefficients, 0x7fffff);
+
+    // Without the input shift the 2nd order coefficient is 0.03 of a fractional bit and lost
+    calibration_t unscaled = parse(coefficients, 2, 0);
+    TEST_ASSERT_EQUAL_INT64(0, unscaled.coefficients[2]);
+    double expected = eval_double(coefficients, 2, 0x7fffff);
+    TEST_ASSERT_GREATER_THAN(100000, fabs(expected - calibration_eval(&unscaled, 0x7fffff)));
+}
+
+void test_random_polynomials(void) {
+    srand(1);
+    for (size_t sensor = 0; sensor < sizeof(sensor_ranges) / sizeof(sensor_ranges[0]); sensor++) {
+        const sensor_range_t *range = &sensor_ranges[sensor];
+        double max_input = fmax(-(double) range->min_input, range->max_input);
+
+        for (int i = 0; i < RANDOM_CALIBRATIONS; i++) {
+            int order = rand() % (CALIBRATION_MAX_ORDER + 1);
+            double coefficients[CALIBRATION_MAX_ORDER + 1];
+            for (int k = 0; k <= order; k++) {
+                coefficients[k] = (2.0 * rand() / RAND_MAX - 1) * MAX_TERM / pow(max_input, k);
+            }
+            calibration_t calibration = parse(coefficients, order, range->input_shift);
+
+            for (int j = 0; j < RANDOM_INPUTS; j++) {
+                int32_t input = range->min_input + (int32_t) ((double) rand() / RAND_MAX * ((double) range->max_input - range->min_input));
+                assert_equivalent(&calibration, coefficients, input);
+            }
+            assert_equivalent(&calibration, coefficients, range->min_input);
+            assert_equivalent(&calibration, coefficients, range->max_input);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_linear);
+    RUN_TEST(test_horner);
+    RUN_TEST(test_negative_inputs_round_half_up);
+    RUN_TEST(test_saturation);
+    RUN_TEST(test_parse_rejects);
+    RUN_TEST(test_hx710b_second_order);
+    RUN_TEST(test_random_polynomials);
+    return UNITY_END();
+}
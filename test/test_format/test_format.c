@@ -0,0 +1,195 @@
+#include <unity.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "format.h"
+
+/*
+ * The number formatting of the sensor endpoints against printf: the same output apart from the documented differences,
+ * and a micro-benchmark of the response bodies the table-driven handler renders
+ */
+
+#define BENCHMARK_VALUES 1000000
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void assert_formatted(const char *expected, char *buffer, size_t len) {
+    TEST_ASSERT_EQUAL_size_t(strlen(expected), len);
+    TEST_ASSERT_EQUAL_STRING_LEN(expected, buffer, len);
+}
+
+static void test_integers(void) {
+    char buffer[FORMAT_MAX_LENGTH];
+
+    assert_formatted("0", buffer, format_u32(buffer, 0));
+    assert_formatted("9", buffer, format_u32(buffer, 9));
+    assert_formatted("10", buffer, format_u32(buffer, 10));
+    assert_formatted("4294967295", buffer, format_u32(buffer, UINT32_MAX));
+    assert_formatted("18446744073709551615", buffer, format_u64(buffer, UINT64_MAX));
+    assert_formatted("-2147483648", buffer, format_i32(buffer, INT32_MIN));
+    assert_formatted("2147483647", buffer, format_i32(buffer, INT32_MAX));
+    assert_formatted("-1", buffer, format_i32(buffer, -1));
+}
+
+static void test_integers_match_printf(void) {
+    char buffer[FORMAT_MAX_LENGTH];
+    char expected[FORMAT_MAX_LENGTH + 1];
+    uint32_t value = 1;
+
+    for (int i = 0; i < 100000; i++) {
+        value = value * 1664525 + 1013904223;
+        snprintf(expected, sizeof(expected), "%" PRIu32, value >> (i % 32));
+        assert_formatted(expected, buffer, format_u32(buffer, value >> (i % 32)));
+        snprintf(expected, sizeof(expected), "%" PRId32, (int32_t) value);
+        assert_formatted(expected, buffer, format_i32(buffer, (int32_t) value));
+    }
+}
+
+static void test_fixed_special_values(void) {
+    char buffer[FORMAT_MAX_LENGTH];
+
+    assert_formatted("NaN", buffer, format_fixed(buffer, NAN, 1));
+    assert_formatted("NaN", buffer, format_fixed(buffer, INFINITY, 1));
+    assert_formatted("NaN", buffer, format_fixed(buffer, -INFINITY, 1));
+    assert_formatted("NaN", buffer, format_fixed(buffer, 1e10f, 1));
+    // No negative zero
+    assert_formatted("0.0", buffer, format_fixed(buffer, -0.04f, 1));
+    assert_formatted("0", buffer, format_fixed(buffer, -0.0f, 0));
+    // Ties are rounded away from zero
+    assert_formatted("3", buffer, format_fixed(buffer, 2.5f, 0));
+    assert_formatted("-3", buffer, format_fixed(buffer, -2.5f, 0));
+    assert_formatted("0.3", buffer, format_fixed(buffer, 0.25f, 1));
+    // The decimals are capped
+    assert_formatted("1.500000", buffer, format_fixed(buffer, 1.5f, 9));
+    assert_formatted("-4294967040.000000", buffer, format_fixed(buffer, -4294967040.0f, 6));
+}
+
+static void test_fixed_matches_printf(void) {
+    char buffer[FORMAT_MAX_LENGTH];
+    char expected[64];
+    unsigned long ties = 0;
+
+    for (int decimals = 0; decimals <= 3; decimals++) {
+        for (int i = -200000; i <= 200000; i++) {
+            float value = i * 0.0137f;
+            size_t len = format_fixed(buffer, value, decimals);
+            snprintf(expected, sizeof(expected), "%.*f", decimals, (double) value);
+
+            // printf keeps the sign of values that round to zero
+            const char *compare = expected;
+            if (expected[0] == '-' && strspn(expected + 1, "0.") == strlen(expected + 1)) {
+                compare++;
+            }
+            if (len == strlen(compare) && strncmp(compare, buffer, len) == 0) {
+                continue;
+            }
+
+            // printf rounds ties to even, format_fixed away from zero
+            double scaled = fabs((double) value) * pow(10, decimals);
+            TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.5, scaled - floor(scaled));
+            ties++;
+        }
+    }
+    char message[64];
+    snprintf(message, sizeof(message), "%lu ties rounded away from zero", ties);
+    TEST_MESSAGE(message);
+}
+
+// The body of /temp the way the handler renders it and the way it was rendered before
+static size_t render_fixed(char *buffer, float value) {
+    size_t len = format_fixed(buffer, value, 1);
+    memcpy(buffer + len, "°C", sizeof("°C") - 1);
+    return len + sizeof("°C") - 1;
+}
+
+static size_t render_printf(char *buffer, float value) {
+    return snprintf(buffer, FORMAT_MAX_LENGTH + 8, "%.1f°C", value);
+}
+
+static size_t render_u32(char *buffer, uint32_t value) {
+    size_t len = format_u32(buffer, value);
+    memcpy(buffer + len, " Lux", 4);
+    return len + 4;
+}
+
+static size_t render_u32_printf(char *buffer, uint32_t value) {
+    return snprintf(buffer, FORMAT_MAX_LENGTH + 8, "%" PRIu32 " Lux", value);
+}
+
+static void test_benchmark(void) {
+    static float values[1024];
+    char buffer[FORMAT_MAX_LENGTH + 8];
+    struct timespec start;
+    struct timespec end;
+    volatile size_t sink = 0;
+    char message[128];
+
+    for (int i = 0; i < 1024; i++) {
+        values[i] = 18.0f + (i % 97) * 0.1f;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCHMARK_VALUES; i++) {
+        sink = render_printf(buffer, values[i & 1023]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double printf_ns = elapsed_ns(&start, &end) / BENCHMARK_VALUES;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCHMARK_VALUES; i++) {
+        sink = render_fixed(buffer, values[i & 1023]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double fixed_ns = elapsed_ns(&start, &end) / BENCHMARK_VALUES;
+
+    snprintf(message, sizeof(message), "/temp body: snprintf %.1f ns, format_fixed %.1f ns, %.1fx", printf_ns, fixed_ns, printf_ns / fixed_ns);
+    TEST_MESSAGE(message);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCHMARK_VALUES; i++) {
+        sink = render_u32_printf(buffer, i * 7);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf_ns = elapsed_ns(&start, &end) / BENCHMARK_VALUES;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCHMARK_VALUES; i++) {
+        sink = render_u32(buffer, i * 7);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fixed_ns = elapsed_ns(&start, &end) / BENCHMARK_VALUES;
+    (void) sink;
+
+    snprintf(message, sizeof(message), "/illuminance body: snprintf %.1f ns, format_u32 %.1f ns, %.1fx", printf_ns, fixed_ns, printf_ns / fixed_ns);
+    TEST_MESSAGE(message);
+
+    // Both render the same bodies for the benchmarked values
+    char expected[FORMAT_MAX_LENGTH + 8];
+    for (int i = 0; i < 1024; i++) {
+        size_t len = render_fixed(buffer, values[i]);
+        TEST_ASSERT_EQUAL_size_t(render_printf(expected, values[i]), len);
+        TEST_ASSERT_EQUAL_STRING_LEN(expected, buffer, len);
+    }
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_integers);
+    RUN_TEST(test_integers_match_printf);
+    RUN_TEST(test_fixed_special_values);
+    RUN_TEST(test_fixed_matches_printf);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,231 @@
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "gorilla.h"
+
+/*
+ * Round trips of the Gorilla codec, and a benchmark of bytes per sample and throughput on a day of the series that
+ * the history keeps, sampled every 5 seconds like history_append
+ */
+
+#define DAY_ROWS (24 * 3600 / 5)
+#define SERIES_COUNT 4
+#define BUFFER_SIZE (DAY_ROWS * 8)
+#define BENCHMARK_ROUNDS 20
+
+typedef struct {
+    const char *name;
+    float values[DAY_ROWS];
+} series_t;
+
+static uint32_t timestamps[DAY_ROWS];
+static series_t series[SERIES_COUNT] = {
+    {.name = "temperature"},
+    {.name = "humidity"},
+    {.name = "illuminance"},
+    {.name = "heartrate"},
+};
+static uint8_t time_buffer[BUFFER_SIZE];
+static uint8_t value_buffer[BUFFER_SIZE];
+static uint32_t random_state;
+
+static double random_uniform(void) {
+    random_state = random_state * 1664525 + 1013904223;
+    return (random_state >> 8) / (double) (1 << 24);
+}
+
+static void generate_traces(void) {
+    uint32_t timestamp = 1700000000;
+    double heartrate = 70;
+
+    for (int i = 0; i < DAY_ROWS; i++) {
+        double day = 2 * M_PI * i / DAY_ROWS;
+
+        // The sampling task runs every 5 s, a late wakeup shifts a row by a second now and then
+        timestamps[i] = timestamp + (random_uniform() < 0.05 ? 1 : 0);
+        timestamp += 5;
+
+        // The AM2320 resolves 0.1 °C and 0.1 %RH
+        series[0].values[i] = roundf((21 + 2 * sin(day) + 0.1 * (random_uniform() - 0.5)) * 10) / 10;
+        series[1].values[i] = roundf((45 - 5 * sin(day) + 0.3 * (random_uniform() - 0.5)) * 10) / 10;
+        // Dark at night, whole lux during the day with clouds passing
+        double light = sin(day - M_PI / 2);
+        series[2].values[i] = light <= 0 ? 0 : roundf(light * 600 * (0.8 + 0.2 * random_uniform()));
+        // A finger on the sensor for a few hours, no reading otherwise
+        if (i % (DAY_ROWS / 6) < DAY_ROWS / 12) {
+            heartrate += random_uniform() - 0.5;
+            series[3].values[i] = roundf(heartrate);
+        } else {
+            series[3].values[i] = 0;
+        }
+    }
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+void setUp(void) {
+    random_state = 42;
+}
+
+void tearDown(void) {
+}
+
+static void test_timestamps_round_trip(void) {
+    const uint32_t input[] = {0, 0, 5, 10, 15, 21, 26, 26, 1000, 1005, 100000, 0xfffffff0, 0xffffffff};
+    gorilla_time_encoder_t encoder;
+    gorilla_time_decoder_t decoder;
+    uint32_t timestamp;
+
+    gorilla_time_encoder_init(&encoder, time_buffer, sizeof(time_buffer));
+    for (size_t i = 0; i < sizeof(input) / sizeof(input[0]); i++) {
+        TEST_ASSERT_TRUE(gorilla_time_encoder_append(&encoder, input[i]));
+    }
+
+    gorilla_time_decoder_init(&decoder, time_buffer, encoder.writer.bit_len, encoder.count);
+    for (size_t i = 0; i < sizeof(input) / sizeof(input[0]); i++) {
+        TEST_ASSERT_TRUE(gorilla_time_decoder_next(&decoder, &timestamp));
+        TEST_ASSERT_EQUAL_UINT32(input[i], timestamp);
+    }
+    TEST_ASSERT_FALSE(gorilla_time_decoder_next(&decoder, &timestamp));
+}
+
+static void test_values_round_trip_bit_exact(void) {
+    const float input[] = {21.5f, 21.5f, 21.6f, -0.0f, 0.0f, NAN, INFINITY, -INFINITY, 1e-45f, 3.4e38f, -273.15f, 21.5f};
+    gorilla_value_encoder_t encoder;
+    gorilla_value_decoder_t decoder;
+    float value;
+
+    gorilla_value_encoder_init(&encoder, value_buffer, sizeof(value_buffer));
+    for (size_t i = 0; i < sizeof(input) / sizeof(input[0]); i++) {
+        TEST_ASSERT_TRUE(gorilla_value_encoder_append(&encoder, input[i]));
+    }
+
+    gorilla_value_decoder_init(&decoder, value_buffer, encoder.writer.bit_len, encoder.count);
+    for (size_t i = 0; i < sizeof(input) / sizeof(input[0]); i++) {
+        TEST_ASSERT_TRUE(gorilla_value_decoder_next(&decoder, &value));
+        TEST_ASSERT_EQUAL_MEMORY(&input[i], &value, sizeof(float));
+    }
+    TEST_ASSERT_FALSE(gorilla_value_decoder_next(&decoder, &value));
+}
+
+static void test_full_buffer_keeps_stream_valid(void) {
+    uint8_t buffer[16];
+    gorilla_value_encoder_t encoder;
+    gorilla_value_decoder_t decoder;
+    float value;
+    uint32_t appended = 0;
+
+    gorilla_value_encoder_init(&encoder, buffer, sizeof(buffer));
+    // Values that share no bits need the most space
+    for (uint32_t i = 0; i < 100; i++) {
+        if (!gorilla_value_encoder_append(&encoder, i % 2 ? 1e30f * (i + 1) : -1e-30f / (i + 1))) {
+            break;
+        }
+        appended++;
+    }
+    TEST_ASSERT_LESS_THAN(100, appended);
+    TEST_ASSERT_EQUAL_UINT32(appended, encoder.count);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(buffer) * 8, encoder.writer.bit_len);
+
+    gorilla_value_decoder_init(&decoder, buffer, encoder.writer.bit_len, encoder.count);
+    for (uint32_t i = 0; i < appended; i++) {
+        float expected = i % 2 ? 1e30f * (i + 1) : -1e-30f / (i + 1);
+        TEST_ASSERT_TRUE(gorilla_value_decoder_next(&decoder, &value));
+        TEST_ASSERT_EQUAL_MEMORY(&expected, &value, sizeof(float));
+    }
+}
+
+static void test_benchmark_day(void) {
+    gorilla_time_encoder_t time_encoder;
+    gorilla_value_encoder_t value_encoder;
+    struct timespec start;
+    struct timespec end;
+    char message[160];
+
+    generate_traces();
+
+    // A row of the history shares the timestamp between the series
+    gorilla_time_encoder_init(&time_encoder, time_buffer, sizeof(time_buffer));
+    for (int i = 0; i < DAY_ROWS; i++) {
+        TEST_ASSERT_TRUE(gorilla_time_encoder_append(&time_encoder, timestamps[i]));
+    }
+    double total_bytes = time_encoder.writer.bit_len / 8.0;
+    snprintf(message, sizeof(message), "%-12s %5.2f bytes/sample", "timestamps", time_encoder.writer.bit_len / 8.0 / DAY_ROWS);
+    TEST_MESSAGE(message);
+
+    for (int s = 0; s < SERIES_COUNT; s++) {
+        gorilla_value_encoder_t encoder;
+        gorilla_value_decoder_t decoder;
+        float value;
+
+        gorilla_value_encoder_init(&encoder, value_buffer, sizeof(value_buffer));
+        for (int i = 0; i < DAY_ROWS; i++) {
+            TEST_ASSERT_TRUE(gorilla_value_encoder_append(&encoder, series[s].values[i]));
+        }
+        gorilla_value_decoder_init(&decoder, value_buffer, encoder.writer.bit_len, encoder.count);
+        for (int i = 0; i < DAY_ROWS; i++) {
+            TEST_ASSERT_TRUE(gorilla_value_decoder_next(&decoder, &value));
+            TEST_ASSERT_EQUAL_MEMORY(&series[s].values[i], &value, sizeof(float));
+        }
+
+        double bytes_per_sample = encoder.writer.bit_len / 8.0 / DAY_ROWS;
+        total_bytes += encoder.writer.bit_len / 8.0;
+        snprintf(message, sizeof(message), "%-12s %5.2f bytes/sample", series[s].name, bytes_per_sample);
+        TEST_MESSAGE(message);
+        // Against 4 bytes of a plain float
+        TEST_ASSERT_LESS_THAN(3.0, bytes_per_sample);
+    }
+
+    // A plain row is a 4 byte timestamp and a 4 byte float per series
+    snprintf(message, sizeof(message), "day of %d rows: %.1f KB, plain %.1f KB, %.2f bytes/row",
+        DAY_ROWS, total_bytes / 1024, DAY_ROWS * (4.0 + 4 * SERIES_COUNT) / 1024, total_bytes / DAY_ROWS);
+    TEST_MESSAGE(message);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+        gorilla_time_encoder_init(&time_encoder, time_buffer, sizeof(time_buffer));
+        gorilla_value_encoder_init(&value_encoder, value_buffer, sizeof(value_buffer));
+        for (int i = 0; i < DAY_ROWS; i++) {
+            gorilla_time_encoder_append(&time_encoder, timestamps[i]);
+            gorilla_value_encoder_append(&value_encoder, series[0].values[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double encode_ns = elapsed_ns(&start, &end) / ((double) BENCHMARK_ROUNDS * DAY_ROWS);
+
+    volatile float sink = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+        gorilla_time_decoder_t time_decoder;
+        gorilla_value_decoder_t value_decoder;
+        uint32_t timestamp;
+        float value;
+
+        gorilla_time_decoder_init(&time_decoder, time_buffer, time_encoder.writer.bit_len, time_encoder.count);
+        gorilla_value_decoder_init(&value_decoder, value_buffer, value_encoder.writer.bit_len, value_encoder.count);
+        while (gorilla_time_decoder_next(&time_decoder, &timestamp) && gorilla_value_decoder_next(&value_decoder, &value)) {
+            sink = value + timestamp;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double decode_ns = elapsed_ns(&start, &end) / ((double) BENCHMARK_ROUNDS * DAY_ROWS);
+    (void) sink;
+
+    snprintf(message, sizeof(message), "temperature with timestamps: encode %.1f ns (%.1f M/s), decode %.1f ns (%.1f M/s)",
+        encode_ns, 1e3 / encode_ns, decode_ns, 1e3 / decode_ns);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_timestamps_round_trip);
+    RUN_TEST(test_values_round_trip_bit_exact);
+    RUN_TEST(test_full_buffer_keeps_stream_valid);
+    RUN_TEST(test_benchmark_day);
+    return UNITY_END();
+}
@@ -0,0 +1,435 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+/*
+ * i2cdev against a mock bus with a TSL2561 on it: the pre-built transaction against the read calls it replaced,
+ * counted in bus transactions, port setups and allocations per channel read, and a benchmark of the driver overhead.
+ * The mock bus takes no time, so the benchmark only measures the software around the transfers.
+ */
+
+// Kconfig options of the component, the driver is compiled into this test only since it needs the mock bus below
+#define CONFIG_IDF_TARGET_ESP32 1
+#define CONFIG_I2CDEV_TIMEOUT 1000
+#include "i2cdev.c"
+
+#define TSL2561_ADDRESS 0x39
+#define TSL2561_COMMAND 0x80
+#define TSL2561_READ_WORD 0x20
+#define TSL2561_CHANNEL_0_LOW 0x0c
+#define TSL2561_CHANNEL_1_LOW 0x0e
+
+#define BENCHMARK_READS 200000
+
+typedef enum {
+    OP_START,
+    OP_WRITE_BYTE,
+    OP_WRITE,
+    OP_READ,
+    OP_STOP,
+} op_type_t;
+
+// The size of a command of the ESP-IDF driver
+typedef struct op {
+    struct op *next;
+    union {
+        const uint8_t *out;
+        uint8_t *in;
+    };
+    uint16_t len;
+    uint8_t byte;
+    uint8_t type;
+} op_t;
+
+typedef struct {
+    op_t *first;
+    op_t *last;
+    uint8_t *free;  // Next free command in the buffer of a static link
+    uint8_t *end;
+    bool is_static;
+} cmd_link_t;
+
+_Static_assert(sizeof(op_t) <= I2C_INTERNAL_STRUCT_SIZE, "Command larger than in ESP-IDF");
+_Static_assert(sizeof(cmd_link_t) <= 2 * I2C_INTERNAL_STRUCT_SIZE, "Link larger than in ESP-IDF");
+
+typedef struct {
+    unsigned long allocations; // Of command links and commands
+    unsigned long transactions;
+    unsigned long get_timeouts;
+    unsigned long installs;
+} bus_counters_t;
+
+static bus_counters_t counters;
+static int port_timeouts[I2C_NUM_MAX];
+static uint8_t registers[16];
+static uint8_t register_pointer;
+
+static i2c_dev_t tsl2561 = {
+    .port = I2C_NUM_0,
+    .addr = TSL2561_ADDRESS,
+    .cfg = {
+        .sda_io_num = 21,
+        .scl_io_num = 22,
+        .master.clk_speed = 400000,
+    },
+};
+// Same bus, a device that isn't connected
+static i2c_dev_t other = {
+    .port = I2C_NUM_0,
+    .addr = 0x5c,
+    .cfg = {
+        .sda_io_num = 21,
+        .scl_io_num = 22,
+        .master.clk_speed = 100000,
+    },
+};
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len, int intr_alloc_flags) {
+    counters.installs++;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t port) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *config) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_set_timeout(i2c_port_t port, int timeout) {
+    port_timeouts[port] = timeout;
+    return ESP_OK;
+}
+
+esp_err_t i2c_get_timeout(i2c_port_t port, int *timeout) {
+    counters.get_timeouts++;
+    *timeout = port_timeouts[port];
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void) {
+    cmd_link_t *link = calloc(1, sizeof(cmd_link_t));
+    counters.allocations++;
+    return link;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size) {
+    if (size < 2 * I2C_INTERNAL_STRUCT_SIZE) {
+        return NULL;
+    }
+    cmd_link_t *link = (cmd_link_t *) buffer;
+    memset(link, 0, sizeof(cmd_link_t));
+    link->is_static = true;
+    link->free = buffer + 2 * I2C_INTERNAL_STRUCT_SIZE;
+    link->end = buffer + size;
+    return link;
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd) {
+    cmd_link_t *link = cmd;
+    for (op_t *op = link->first; op != NULL;) {
+        op_t *next = op->next;
+        free(op);
+        op = next;
+    }
+    free(link);
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd) {
+}
+
+static esp_err_t add_op(i2c_cmd_handle_t cmd, op_type_t type, uint8_t byte, const uint8_t *data, size_t len) {
+    cmd_link_t *link = cmd;
+    op_t *op;
+
+    if (link->is_static) {
+        if (link->free + I2C_INTERNAL_STRUCT_SIZE > link->end) {
+            return ESP_ERR_NO_MEM;
+        }
+        op = (op_t *) link->free;
+        link->free += I2C_INTERNAL_STRUCT_SIZE;
+    } else {
+        op = malloc(sizeof(op_t));
+        counters.allocations++;
+    }
+    op->next = NULL;
+    op->type = type;
+    op->byte = byte;
+    op->out = data;
+    op->len = len;
+
+    if (link->last != NULL) {
+        link->last->next = op;
+    } else {
+        link->first = op;
+    }
+    link->last = op;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd) {
+    return add_op(cmd, OP_START, 0, NULL, 0);
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en) {
+    return add_op(cmd, OP_WRITE_BYTE, data, NULL, 1);
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *data, size_t data_len, bool ack_en) {
+    return add_op(cmd, OP_WRITE, 0, data, data_len);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t *data, size_t data_len, i2c_ack_type_t ack) {
+    return add_op(cmd, OP_READ, 0, data, data_len);
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd) {
+    return add_op(cmd, OP_STOP, 0, NULL, 0);
+}
+
+// A TSL2561: the first byte written after the address is the command with the register pointer
+static void device_write(uint8_t byte, bool *command_written) {
+    if (!*command_written) {
+        register_pointer = byte & 0x0f;
+        *command_written = true;
+    } else {
+        registers[register_pointer++ & 0x0f] = byte;
+    }
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait) {
+    cmd_link_t *link = cmd;
+    bool addressed = false;
+    bool expect_address = false;
+    bool command_written = false;
+
+    counters.transactions++;
+    for (const op_t *op = link->first; op != NULL; op = op->next) {
+        switch (op->type) {
+            case OP_START:
+                expect_address = true;
+                break;
+            case OP_WRITE_BYTE:
+                if (expect_address) {
+                    // Nobody acknowledges the address
+                    if (op->byte >> 1 != TSL2561_ADDRESS) {
+                        return ESP_FAIL;
+                    }
+                    addressed = true;
+                    expect_address = false;
+                    command_written = false;
+                } else {
+                    device_write(op->byte, &command_written);
+                }
+                break;
+            case OP_WRITE:
+                for (size_t i = 0; i < op->len; i++) {
+                    device_write(op->out[i], &command_written);
+                }
+                break;
+            case OP_READ:
+                if (!addressed) {
+                    return ESP_FAIL;
+                }
+                for (size_t i = 0; i < op->len; i++) {
+                    op->in[i] = registers[register_pointer++ & 0x0f];
+                }
+                break;
+            case OP_STOP:
+                addressed = false;
+                break;
+        }
+    }
+    return ESP_OK;
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static size_t heap_in_use(void) {
+#if defined(__GLIBC__)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// How the TSL2561 driver read both channels before the transaction
+static esp_err_t read_channels_separately(uint16_t *channel0, uint16_t *channel1) {
+    uint8_t buffer[2];
+
+    esp_err_t res = i2c_dev_read_reg(&tsl2561, TSL2561_COMMAND | TSL2561_READ_WORD | TSL2561_CHANNEL_0_LOW, buffer, 2);
+    if (res != ESP_OK) {
+        return res;
+    }
+    *channel0 = (uint16_t) buffer[1] << 8 | buffer[0];
+    res = i2c_dev_read_reg(&tsl2561, TSL2561_COMMAND | TSL2561_READ_WORD | TSL2561_CHANNEL_1_LOW, buffer, 2);
+    *channel1 = (uint16_t) buffer[1] << 8 | buffer[0];
+    return res;
+}
+
+// The transaction of the TSL2561 driver, built once in tsl2561_init_desc
+static i2c_dev_transaction_t channel_read;
+static uint8_t channel_read_buffer[I2C_DEV_TRANSACTION_SIZE(2)];
+static uint8_t channel_regs[2];
+static uint8_t channel_data[4];
+
+static void build_channel_read(void) {
+    channel_regs[0] = TSL2561_COMMAND | TSL2561_READ_WORD | TSL2561_CHANNEL_0_LOW;
+    channel_regs[1] = TSL2561_COMMAND | TSL2561_READ_WORD | TSL2561_CHANNEL_1_LOW;
+
+    TEST_ASSERT_EQUAL_INT(ESP_OK, i2c_dev_transaction_init(&channel_read, &tsl2561, channel_read_buffer, sizeof(channel_read_buffer)));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, i2c_dev_transaction_add_read(&channel_read, &channel_regs[0], 1, &channel_data[0], 2));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, i2c_dev_transaction_add_read(&channel_read, &channel_regs[1], 1, &channel_data[2], 2));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, i2c_dev_transaction_end(&channel_read));
+}
+
+static esp_err_t read_channels_transaction(uint16_t *channel0, uint16_t *channel1) {
+    esp_err_t res = i2c_dev_transaction_execute(&channel_read);
+    *channel0 = (uint16_t) channel_data[1] << 8 | channel_data[0];
+    *channel1 = (uint16_t) channel_data[3] << 8 | channel_data[2];
+    return res;
+}
+
+void setUp(void) {
+    TEST_ASSERT_EQUAL_INT(ESP_OK, i2cdev_init());
+    memset(&counters, 0, sizeof(counters));
+    memset(port_timeouts, 0, sizeof(port_timeouts));
+    memset(registers, 0, sizeof(registers));
+    registers[TSL2561_CHANNEL_0_LOW] = 0x34;
+    registers[TSL2561_CHANNEL_0_LOW + 1] = 0x12;
+    registers[TSL2561_CHANNEL_1_LOW] = 0x78;
+    registers[TSL2561_CHANNEL_1_LOW + 1] = 0x05;
+    build_channel_read();
+}
+
+void tearDown(void) {
+    i2c_dev_transaction_free(&channel_read);
+    i2cdev_done();
+}
+
+static void test_transaction_reads_both_channels(void) {
+    uint16_t channel0 = 0;
+    uint16_t channel1 = 0;
+
+    TEST_ASSERT_EQUAL_INT(ESP_OK, read_channels_transaction(&channel0, &channel1));
+    TEST_ASSERT_EQUAL_HEX16(0x1234, channel0);
+    TEST_ASSERT_EQUAL_HEX16(0x0578, channel1);
+
+    // Executed again with new data, the transaction reads into the same buffers
+    registers[TSL2561_CHANNEL_0_LOW] = 0xcd;
+    registers[TSL2561_CHANNEL_1_LOW + 1] = 0xab;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, read_channels_transaction(&channel0, &channel1));
+    TEST_ASSERT_EQUAL_HEX16(0x12cd, channel0);
+    TEST_ASSERT_EQUAL_HEX16(0xab78, channel1);
+
+    uint16_t separate0 = 0;
+    uint16_t separate1 = 0;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, read_channels_separately(&separate0, &separate1));
+    TEST_ASSERT_EQUAL_HEX16(channel0, separate0);
+    TEST_ASSERT_EQUAL_HEX16(channel1, separate1);
+}
+
+static void test_transaction_doesnt_allocate(void) {
+    uint16_t channel0;
+    uint16_t channel1;
+
+    // The first transfer sets up the port
+    TEST_ASSERT_EQUAL_INT(ESP_OK, read_channels_transaction(&channel0, &channel1));
+    memset(&counters, 0, sizeof(counters));
+
+    size_t heap_before = heap_in_use();
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_EQUAL_INT(ESP_OK, read_channels_transaction(&channel0, &channel1));
+    }
+    TEST_ASSERT_EQUAL_size_t(heap_before, heap_in_use());
+    TEST_ASSERT_EQUAL_UINT32(0, counters.allocations);
+    TEST_ASSERT_EQUAL_UINT32(1000, counters.transactions);
+    TEST_ASSERT_EQUAL_UINT32(0, counters.get_timeouts);
+}
+
+static void test_transaction_buffer_too_small(void) {
+    i2c_dev_transaction_t transaction;
+    uint8_t small[I2C_DEV_TRANSACTION_SIZE(1)];
+    uint8_t data[2];
+    uint8_t reg = 0;
+
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NO_MEM, i2c_dev_transaction_init(&transaction, &tsl2561, small, I2C_INTERNAL_STRUCT_SIZE));
+
+    TEST_ASSERT_EQUAL_INT(ESP_OK, i2c_dev_transaction_init(&transaction, &tsl2561, small, sizeof(small)));
+    esp_err_t res = ESP_OK;
+    for (int i = 0; i < 10 && res == ESP_OK; i++) {
+        res = i2c_dev_transaction_add_read(&transaction, &reg, 1, data, sizeof(data));
+    }
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NO_MEM, res);
+    i2c_dev_transaction_free(&transaction);
+}
+
+static void test_port_setup_fast_path(void) {
+    uint16_t channel0;
+    uint16_t channel1;
+    uint8_t data;
+
+    TEST_ASSERT_EQUAL_INT(ESP_OK, read_channels_separately(&channel0, &channel1));
+    TEST_ASSERT_EQUAL_UINT32(1, counters.installs);
+    TEST_ASSERT_EQUAL_UINT32(1, counters.get_timeouts);
+
+    // The port is still set up for the same device
+    TEST_ASSERT_EQUAL_INT(ESP_OK, read_channels_separately(&channel0, &channel1));
+    TEST_ASSERT_EQUAL_UINT32(1, counters.get_timeouts);
+
+    // Another device with another clock reconfigures the port, the next transfer to the TSL2561 again
+    TEST_ASSERT_EQUAL_INT(ESP_FAIL, i2c_dev_read_reg(&other, 0, &data, 1));
+    TEST_ASSERT_EQUAL_UINT32(2, counters.installs);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, read_channels_transaction(&channel0, &channel1));
+    TEST_ASSERT_EQUAL_UINT32(3, counters.installs);
+    TEST_ASSERT_EQUAL_UINT32(3, counters.get_timeouts);
+}
+
+static void benchmark(const char *name, esp_err_t (*read_channels)(uint16_t *, uint16_t *)) {
+    struct timespec start;
+    struct timespec end;
+    uint16_t channel0;
+    uint16_t channel1;
+    char message[160];
+
+    read_channels(&channel0, &channel1);
+    memset(&counters, 0, sizeof(counters));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCHMARK_READS; i++) {
+        read_channels(&channel0, &channel1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = elapsed_ns(&start, &end) / BENCHMARK_READS;
+    snprintf(message, sizeof(message), "%-12s %6.0f ns, %.2f M reads/s, %.1f allocations, %.1f bus transactions per read",
+        name, ns, 1e3 / ns, (double) counters.allocations / BENCHMARK_READS, (double) counters.transactions / BENCHMARK_READS);
+    TEST_MESSAGE(message);
+}
+
+static void test_benchmark_channel_read(void) {
+    benchmark("separate", read_channels_separately);
+    TEST_ASSERT_EQUAL_UINT32(2 * BENCHMARK_READS, counters.transactions);
+
+    benchmark("transaction", read_channels_transaction);
+    TEST_ASSERT_EQUAL_UINT32(0, counters.allocations);
+    TEST_ASSERT_EQUAL_UINT32(BENCHMARK_READS, counters.transactions);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_transaction_reads_both_channels);
+    RUN_TEST(test_transaction_doesnt_allocate);
+    RUN_TEST(test_transaction_buffer_too_small);
+    RUN_TEST(test_port_setup_fast_path);
+    RUN_TEST(test_benchmark_channel_read);
+    return UNITY_END();
+}
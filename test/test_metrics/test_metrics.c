@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+#include <unity.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "metrics.h"
+#include "metrics_buffer.h"
+
+/*
+ * Rendering of the metrics registry, and a benchmark of the /metrics scrape path before and after the double buffers:
+ * formatting the response with asprintf for every scrape against rendering it once per update and sending the
+ * published buffer of metrics_buffer, the same way webserver.c does it.
+ */
+
+#define SCRAPES 100000
+// 5 s scrape interval, two Prometheus replicas
+#define SCRAPES_PER_DAY (2 * 24 * 3600 / 5)
+
+// Same families as app_main
+static metric_t sensor_metrics[] = {
+    {.name = "illuminance_lux", .help = "Light intensity in lux", .type = METRICS_GAUGE},
+    {.name = "illuminance_sensor_gain", .help = "Gain chosen by the TSL2561 auto ranging", .type = METRICS_GAUGE},
+    {.name = "illuminance_sensor_integration_seconds", .help = "Integration time chosen by the TSL2561 auto ranging", .type = METRICS_GAUGE},
+    {.name = "illuminance_sensor_saturated", .help = "1 if the TSL2561 saturated in its least sensitive range and the illuminance is a lower bound", .type = METRICS_GAUGE},
+    {.name = "temperature_celsius", .help = "Temperature in celsius", .type = METRICS_GAUGE},
+    {.name = "humidity_relative", .help = "Relative humidity in percent", .type = METRICS_GAUGE},
+    {.name = "heartrate_bpm", .help = "Heart rate in beats per minute", .type = METRICS_GAUGE},
+    {.name = "heartrate_rmssd_milliseconds", .help = "Root mean square of successive heart beat interval differences", .type = METRICS_GAUGE},
+    {.name = "heartrate_sdnn_milliseconds", .help = "Standard deviation of heart beat intervals", .type = METRICS_GAUGE},
+    {.name = "pressure_hpa", .help = "Filtered air pressure in hectopascal", .type = METRICS_GAUGE},
+};
+
+static metrics_double_buffer_t response;
+// Stands in for the socket
+static char sent[METRICS_BUFFER_SIZE];
+static volatile size_t sent_len;
+
+void setUp(void) {
+    static bool registered = false;
+
+    // The registry can't be cleared, all tests share it
+    if (!registered) {
+        for (size_t i = 0; i < sizeof(sensor_metrics) / sizeof(sensor_metrics[0]); i++) {
+            TEST_ASSERT_EQUAL_INT(ESP_OK, metrics_register(&sensor_metrics[i]));
+        }
+        registered = true;
+    }
+    metrics_set(&sensor_metrics[0], 312);
+    metrics_set(&sensor_metrics[1], 16);
+    metrics_set(&sensor_metrics[2], 0.402f);
+    metrics_set(&sensor_metrics[3], 0);
+    metrics_set(&sensor_metrics[4], 21.5f);
+    metrics_set(&sensor_metrics[5], 43.2f);
+    metrics_set(&sensor_metrics[6], 64);
+    metrics_set(&sensor_metrics[7], 41.25f);
+    metrics_set(&sensor_metrics[8], 52.5f);
+    metrics_set(&sensor_metrics[9], 1013.25f);
+}
+
+void tearDown(void) {
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static size_t heap_in_use(void) {
+#if defined(__GLIBC__)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+static void send_response(const char *data, size_t len) {
+    memcpy(sent, data, len);
+    sent_len = len;
+}
+
+// The handler before the double buffers, without the leak
+static size_t scrape_asprintf(void) {
+    char *resp;
+    int len = asprintf(
+        &resp,
+        "# HELP illuminance_lux Light intensity in lux\n"
+        "# TYPE illuminance_lux gauge\n"
+        "illuminance_lux %ld\n\n"
+        "# HELP temperature_celsius Temperature in celsius\n"
+        "# TYPE temperature_celsius gauge\n"
+        "temperature_celsius %.1f\n\n"
+        "# HELP humidity_relative Relative humidity in percent\n"
+        "# TYPE humidity_relative gauge\n"
+        "humidity_relative %.1f\n\n"
+        "# HELP heartrate_bpm Heart rate in beats per minute\n"
+        "# TYPE heartrate_bpm gauge\n"
+        "heartrate_bpm %d"
+        , (long) sensor_metrics[0].value, sensor_metrics[4].value, sensor_metrics[5].value, (int) sensor_metrics[6].value
+    );
+    send_response(resp, len);
+#if defined(__GLIBC__)
+    size_t allocated = malloc_usable_size(resp);
+#else
+    size_t allocated = len + 1;
+#endif
+    free(resp);
+    return allocated;
+}
+
+// render_metrics, called once per update
+static void render_update(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_buffer_render(&response, METRICS_FORMAT_PROMETHEUS));
+}
+
+// get_metrics_handler
+static void scrape_buffer(void) {
+    metrics_buffer_t *buffer = metrics_buffer_acquire(&response);
+    send_response(buffer->data, buffer->len);
+    metrics_buffer_release(buffer);
+}
+
+static void test_render_prometheus(void) {
+    char buffer[METRICS_BUFFER_SIZE];
+    sensor_metrics[0].timestamp_ms = 1700000000123;
+
+    int len = metrics_render(METRICS_FORMAT_PROMETHEUS, buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL_size_t(strlen(buffer), len);
+    TEST_ASSERT_NOT_NULL(strstr(buffer,
+        "# HELP illuminance_lux Light intensity in lux\n"
+        "# TYPE illuminance_lux gauge\n"
+        "illuminance_lux 312 1700000000123\n"));
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "temperature_celsius 21.5"));
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "illuminance_sensor_saturated 0"));
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "pressure_hpa 1013.25"));
+}
+
+static void test_render_openmetrics(void) {
+    char buffer[METRICS_BUFFER_SIZE];
+    sensor_metrics[0].timestamp_ms = 1700000000123;
+
+    int len = metrics_render(METRICS_FORMAT_OPENMETRICS, buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    // Seconds with milliseconds as fraction
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "illuminance_lux 312 1700000000.123\n"));
+    TEST_ASSERT_EQUAL_INT(6, metrics_render_eof(METRICS_FORMAT_OPENMETRICS, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING("# EOF\n", buffer);
+    TEST_ASSERT_EQUAL_INT(0, metrics_render_eof(METRICS_FORMAT_PROMETHEUS, buffer, sizeof(buffer)));
+}
+
+static void test_render_unsampled_is_nan(void) {
+    char buffer[METRICS_BUFFER_SIZE];
+    sensor_metrics[8].value = NAN;
+    sensor_metrics[8].timestamp_ms = 0;
+
+    TEST_ASSERT_GREATER_THAN(0, metrics_render(METRICS_FORMAT_PROMETHEUS, buffer, sizeof(buffer)));
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "heartrate_sdnn_milliseconds NaN\n"));
+}
+
+static void test_render_stale_is_nan(void) {
+    char buffer[METRICS_BUFFER_SIZE];
+    char expected[64];
+    metric_t *temperature = &sensor_metrics[4];
+    temperature->stale_after_ms = 15000;
+
+    snprintf(expected, sizeof(expected), "temperature_celsius 21.5 %lld\n", (long long) temperature->timestamp_ms);
+    TEST_ASSERT_GREATER_THAN(0, metrics_render(METRICS_FORMAT_PROMETHEUS, buffer, sizeof(buffer)));
+    TEST_ASSERT_NOT_NULL(strstr(buffer, expected));
+
+    // The sensor stopped updating, the value goes without the timestamp that would keep it alive
+    temperature->uptime_ms -= 15001;
+    // Metrics without a timeout are never stale
+    sensor_metrics[5].uptime_ms -= 3600000;
+    TEST_ASSERT_GREATER_THAN(0, metrics_render(METRICS_FORMAT_PROMETHEUS, buffer, sizeof(buffer)));
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "temperature_celsius NaN\n"));
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "humidity_relative 43.2 "));
+    TEST_ASSERT_GREATER_THAN(0, metrics_render(METRICS_FORMAT_OPENMETRICS, buffer, sizeof(buffer)));
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "temperature_celsius NaN\n"));
+
+    metrics_set(temperature, 22);
+    TEST_ASSERT_GREATER_THAN(0, metrics_render(METRICS_FORMAT_PROMETHEUS, buffer, sizeof(buffer)));
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "temperature_celsius 22 "));
+    temperature->stale_after_ms = 0;
+}
+
+static void test_render_too_small(void) {
+    char buffer[METRICS_BUFFER_SIZE];
+    int len = metrics_render(METRICS_FORMAT_PROMETHEUS, buffer, sizeof(buffer));
+
+    for (size_t size = 0; size <= (size_t) len; size += 17) {
+        TEST_ASSERT_EQUAL_INT(-1, metrics_render(METRICS_FORMAT_PROMETHEUS, buffer, size));
+    }
+    TEST_ASSERT_EQUAL_INT(len, metrics_render(METRICS_FORMAT_PROMETHEUS, buffer, len + 1));
+}
+
+static void test_double_buffer_keeps_pinned_buffer(void) {
+    metrics_buffer_init(&response);
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_buffer_render(&response, METRICS_FORMAT_PROMETHEUS));
+    metrics_buffer_t *first = metrics_buffer_acquire(&response);
+    TEST_ASSERT_EQUAL_PTR(&response.buffers[1], first);
+
+    // The writer renders into the other buffer while the first one is sent
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_buffer_render(&response, METRICS_FORMAT_PROMETHEUS));
+    metrics_buffer_t *second = metrics_buffer_acquire(&response);
+    TEST_ASSERT_EQUAL_PTR(&response.buffers[0], second);
+
+    // Both are pinned now, the next render has nowhere to go and the published buffer stays
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, metrics_buffer_render(&response, METRICS_FORMAT_PROMETHEUS));
+    TEST_ASSERT_EQUAL_PTR(second, atomic_load(&response.current));
+    TEST_ASSERT_NOT_NULL(strstr(first->data, "pressure_hpa 1013.25"));
+
+    metrics_buffer_release(first);
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_buffer_render(&response, METRICS_FORMAT_PROMETHEUS));
+    TEST_ASSERT_EQUAL_PTR(first, atomic_load(&response.current));
+    metrics_buffer_release(second);
+    TEST_ASSERT_EQUAL_UINT(0, atomic_load(&response.buffers[0].readers) + atomic_load(&response.buffers[1].readers));
+}
+
+static void test_benchmark_scrape(void) {
+    struct timespec start;
+    struct timespec end;
+    char message[160];
+
+    size_t allocated = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < SCRAPES; i++) {
+        allocated = scrape_asprintf();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    snprintf(message, sizeof(message), "asprintf per scrape: %.0f ns, %zu bytes allocated (leaked before: %.1f MB/day)",
+        elapsed_ns(&start, &end) / SCRAPES, allocated, allocated * (double) SCRAPES_PER_DAY / 1e6);
+    TEST_MESSAGE(message);
+
+    metrics_buffer_init(&response);
+    render_update();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < SCRAPES; i++) {
+        render_update();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double render_ns = elapsed_ns(&start, &end) / SCRAPES;
+
+    size_t heap_before = heap_in_use();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < SCRAPES; i++) {
+        scrape_buffer();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    size_t heap_after = heap_in_use();
+
+    snprintf(message, sizeof(message), "double buffer: %.0f ns per scrape, %.0f ns per update to render, heap %zu -> %zu bytes",
+        elapsed_ns(&start, &end) / SCRAPES, render_ns, heap_before, heap_after);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_size_t(heap_before, heap_after);
+    TEST_ASSERT_EQUAL_size_t(atomic_load(&response.current)->len, sent_len);
+    TEST_ASSERT_EQUAL_UINT(0, atomic_load(&response.buffers[0].readers) + atomic_load(&response.buffers[1].readers));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_render_prometheus);
+    RUN_TEST(test_render_openmetrics);
+    RUN_TEST(test_render_unsampled_is_nan);
+    RUN_TEST(test_render_stale_is_nan);
+    RUN_TEST(test_render_too_small);
+    RUN_TEST(test_double_buffer_keeps_pinned_buffer);
+    RUN_TEST(test_benchmark_scrape);
+    return UNITY_END();
+}
@@ -0,0 +1,141 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "modbus_crc.h"
+
+/*
+ * Known vectors of the table driven CRC16 and a benchmark against the bit loop it replaced
+ */
+
+#define BENCHMARK_BYTES (8 * 1024 * 1024)
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+// The bit loop the AM2320 driver used before
+static uint16_t crc16_bitwise(const uint8_t *data, size_t len) {
+    uint16_t crc = MODBUS_CRC16_INIT;
+
+    while (len--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            if (crc & 0x01) {
+                crc >>= 1;
+                crc ^= 0xa001;
+            } else {
+                crc >>= 1;
+            }
+        }
+    }
+    return crc;
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void test_check_vector(void) {
+    const uint8_t data[] = "123456789";
+    TEST_ASSERT_EQUAL_HEX16(0x4b37, modbus_crc16(data, sizeof(data) - 1));
+}
+
+static void test_empty(void) {
+    TEST_ASSERT_EQUAL_HEX16(MODBUS_CRC16_INIT, modbus_crc16(NULL, 0));
+}
+
+static void test_am2320_frame(void) {
+    // Response to "read 4 registers from 0x00" in the AM2320 datasheet: 50.0 %RH, 25.0 °C, CRC 0xa531 sent low byte first
+    const uint8_t frame[] = {0x03, 0x04, 0x01, 0xf4, 0x00, 0xfa, 0x31, 0xa5};
+    uint16_t crc = modbus_crc16(frame, sizeof(frame) - 2);
+
+    TEST_ASSERT_EQUAL_HEX16(((uint16_t) frame[7] << 8) | frame[6], crc);
+    // The CRC over a frame including its own CRC is 0
+    TEST_ASSERT_EQUAL_HEX16(0x0000, modbus_crc16(frame, sizeof(frame)));
+}
+
+static void test_chained_updates(void) {
+    uint8_t data[64];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (i * 37 + 11);
+    }
+    uint16_t expected = modbus_crc16(data, sizeof(data));
+
+    for (size_t split = 0; split <= sizeof(data); split++) {
+        uint16_t crc = modbus_crc16_update(MODBUS_CRC16_INIT, data, split);
+        crc = modbus_crc16_update(crc, data + split, sizeof(data) - split);
+        TEST_ASSERT_EQUAL_HEX16(expected, crc);
+    }
+
+    // Byte by byte
+    uint16_t crc = MODBUS_CRC16_INIT;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        crc = modbus_crc16_update(crc, &data[i], 1);
+    }
+    TEST_ASSERT_EQUAL_HEX16(expected, crc);
+}
+
+static void test_matches_bitwise(void) {
+    uint8_t data[256];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (255 - i);
+    }
+    for (size_t len = 0; len <= sizeof(data); len++) {
+        TEST_ASSERT_EQUAL_HEX16(crc16_bitwise(data, len), modbus_crc16(data, len));
+    }
+}
+
+static void benchmark(size_t frame_len) {
+    static uint8_t data[256];
+    struct timespec start;
+    struct timespec end;
+    size_t frames = BENCHMARK_BYTES / frame_len;
+    // Keeps the compiler from dropping the loops
+    volatile uint16_t sink = 0;
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (i * 13);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < frames; i++) {
+        data[0] = (uint8_t) i;
+        sink = crc16_bitwise(data, frame_len);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double bitwise = elapsed_ns(&start, &end) / frames;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < frames; i++) {
+        data[0] = (uint8_t) i;
+        sink = modbus_crc16(data, frame_len);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double table = elapsed_ns(&start, &end) / frames;
+    (void) sink;
+
+    char message[128];
+    snprintf(message, sizeof(message), "%3zu byte frames: bit loop %.1f ns, table %.1f ns, %.1fx", frame_len, bitwise, table, bitwise / table);
+    TEST_MESSAGE(message);
+}
+
+static void test_benchmark(void) {
+    // 6 bytes is the AM2320 humidity and temperature response
+    benchmark(6);
+    benchmark(64);
+    benchmark(256);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_check_vector);
+    RUN_TEST(test_empty);
+    RUN_TEST(test_am2320_frame);
+    RUN_TEST(test_chained_updates);
+    RUN_TEST(test_matches_bitwise);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,189 @@
+#include <unity.h>
+#include <stdint.h>
+#include <string.h>
+#include "cbor.h"
+#include "pressure_filter.h"
+#include "snappy.h"
+
+/*
+ * Host checks of the portable modules that the other tests don't cover
+ */
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+// Decoder of the snappy block format, to check the compressor by round trips
+static size_t snappy_decompress(const uint8_t *input, size_t input_len, uint8_t *output, size_t output_size) {
+    size_t in = 0;
+    size_t out = 0;
+    size_t expected = 0;
+
+    for (int shift = 0; in < input_len; shift += 7) {
+        expected |= (size_t) (input[in] & 0x7f) << shift;
+        if ((input[in++] & 0x80) == 0) {
+            break;
+        }
+    }
+
+    while (in < input_len) {
+        uint8_t tag = input[in++];
+        size_t len;
+        size_t offset;
+
+        switch (tag & 3) {
+            case 0:
+                len = tag >> 2;
+                if (len >= 60) {
+                    size_t bytes = len - 59;
+                    len = 0;
+                    for (size_t i = 0; i < bytes; i++) {
+                        len |= (size_t) input[in++] << (8 * i);
+                    }
+                }
+                len++;
+                if (out + len > output_size) {
+                    return 0;
+                }
+                memcpy(output + out, input + in, len);
+                in += len;
+                out += len;
+                continue;
+            case 1:
+                len = 4 + ((tag >> 2) & 7);
+                offset = ((size_t) (tag >> 5) << 8) | input[in++];
+                break;
+            case 2:
+                len = 1 + (tag >> 2);
+                offset = input[in] | (size_t) input[in + 1] << 8;
+                in += 2;
+                break;
+            default:
+                len = 1 + (tag >> 2);
+                offset = input[in] | (size_t) input[in + 1] << 8 | (size_t) input[in + 2] << 16 | (size_t) input[in + 3] << 24;
+                in += 4;
+                break;
+        }
+        if (offset == 0 || offset > out || out + len > output_size) {
+            return 0;
+        }
+        // Copies may overlap their own output
+        for (size_t i = 0; i < len; i++, out++) {
+            output[out] = output[out - offset];
+        }
+    }
+
+    return out == expected ? out : 0;
+}
+
+static void test_cbor_known_encodings(void) {
+    uint8_t buffer[64];
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buffer, sizeof(buffer));
+
+    // {"a": [0, -1, 500, 1.5, true, null]}
+    cbor_write_map(&writer, 1);
+    cbor_write_text(&writer, "a");
+    cbor_write_array(&writer, 6);
+    cbor_write_uint(&writer, 0);
+    cbor_write_int(&writer, -1);
+    cbor_write_uint(&writer, 500);
+    cbor_write_float(&writer, 1.5f);
+    cbor_write_bool(&writer, true);
+    cbor_write_null(&writer);
+
+    const uint8_t expected[] = {
+        0xa1, 0x61, 'a', 0x86, 0x00, 0x20, 0x19, 0x01, 0xf4,
+        0xfa, 0x3f, 0xc0, 0x00, 0x00, 0xf5, 0xf6,
+    };
+    TEST_ASSERT_FALSE(writer.overflow);
+    TEST_ASSERT_EQUAL_size_t(sizeof(expected), writer.len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+static void test_cbor_overflow(void) {
+    uint8_t buffer[4];
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buffer, sizeof(buffer));
+
+    cbor_write_text(&writer, "too long");
+    TEST_ASSERT_TRUE(writer.overflow);
+}
+
+static void test_pressure_filter_rejects_spikes(void) {
+    pressure_filter_t filter;
+    int32_t filtered = 0;
+    pressure_filter_init(&filter, 5, 0);
+
+    TEST_ASSERT_FALSE(pressure_filter_get(&filter, &filtered));
+    for (int i = 0; i < 10; i++) {
+        // Two spikes in a row are below the median of 5
+        pressure_filter_add(&filter, i % 5 < 2 ? 1000000 : 1000);
+        if (i >= 4) {
+            TEST_ASSERT_TRUE(pressure_filter_get(&filter, &filtered));
+            TEST_ASSERT_EQUAL_INT32(1000, filtered);
+        }
+    }
+}
+
+static void test_pressure_filter_ema_converges(void) {
+    pressure_filter_t filter;
+    int32_t filtered = 0;
+    pressure_filter_init(&filter, 1, 3);
+
+    pressure_filter_add(&filter, 0);
+    for (int i = 0; i < 200; i++) {
+        pressure_filter_add(&filter, 8000);
+    }
+    TEST_ASSERT_TRUE(pressure_filter_get(&filter, &filtered));
+    TEST_ASSERT_INT_WITHIN(1, 8000, filtered);
+}
+
+static void test_snappy_round_trip(void) {
+    static uint8_t input[4096];
+    static uint8_t compressed[4096 + 4096 / 6 + 32];
+    static uint8_t output[4096];
+
+    // Repetitive like a batch of samples, with some noise that needs literals
+    uint32_t seed = 1;
+    for (size_t i = 0; i < sizeof(input); i++) {
+        seed = seed * 1103515245 + 12345;
+        input[i] = i % 64 < 48 ? (uint8_t) (i % 16) : (uint8_t) (seed >> 16);
+    }
+
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(compressed), snappy_max_compressed_length(sizeof(input)));
+    size_t len = snappy_compress(input, sizeof(input), compressed);
+    TEST_ASSERT_LESS_THAN(sizeof(input), len);
+    TEST_ASSERT_EQUAL_size_t(sizeof(input), snappy_decompress(compressed, len, output, sizeof(output)));
+    TEST_ASSERT_EQUAL_MEMORY(input, output, sizeof(input));
+}
+
+static void test_snappy_incompressible(void) {
+    static uint8_t input[1000];
+    static uint8_t compressed[1000 + 1000 / 6 + 32];
+    static uint8_t output[1000];
+
+    uint32_t seed = 7;
+    for (size_t i = 0; i < sizeof(input); i++) {
+        seed = seed * 1103515245 + 12345;
+        input[i] = seed >> 16;
+    }
+
+    size_t len = snappy_compress(input, sizeof(input), compressed);
+    TEST_ASSERT_LESS_OR_EQUAL(snappy_max_compressed_length(sizeof(input)), len);
+    TEST_ASSERT_EQUAL_size_t(sizeof(input), snappy_decompress(compressed, len, output, sizeof(output)));
+    TEST_ASSERT_EQUAL_MEMORY(input, output, sizeof(input));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_cbor_known_encodings);
+    RUN_TEST(test_cbor_overflow);
+    RUN_TEST(test_pressure_filter_rejects_spikes);
+    RUN_TEST(test_pressure_filter_ema_converges);
+    RUN_TEST(test_snappy_round_trip);
+    RUN_TEST(test_snappy_incompressible);
+    return UNITY_END();
+}
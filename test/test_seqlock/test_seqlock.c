@@ -0,0 +1,146 @@
+#include <unity.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "seqlock.h"
+
+/*
+ * Stress test of the sequence counter that guards the sensor data of the webserver: a writer thread keeps rewriting a
+ * snapshot while reader threads copy it the same way webserver_sensor_data_read does. Every field of a snapshot holds
+ * the same value, so a copy that mixes two writes is noticed.
+ */
+
+#define READER_COUNT 3
+#define WRITES 200000
+#define SPIN_LIMIT 8
+// About the size of webserver_sensor_values_t
+#define FIELD_COUNT 48
+
+typedef struct {
+    uint32_t fields[FIELD_COUNT];
+} snapshot_t;
+
+typedef struct {
+    unsigned long reads;
+    unsigned long retries;
+    unsigned long torn;
+} reader_result_t;
+
+static atomic_uint sequence;
+static snapshot_t shared;
+static atomic_bool done;
+
+void setUp(void) {
+    atomic_init(&sequence, 0);
+    atomic_init(&done, false);
+    for (int i = 0; i < FIELD_COUNT; i++) {
+        shared.fields[i] = 0;
+    }
+}
+
+void tearDown(void) {
+}
+
+static void *writer_run(void *arg) {
+    for (uint32_t value = 1; value <= WRITES; value++) {
+        seqlock_write_begin(&sequence);
+        for (int i = 0; i < FIELD_COUNT; i++) {
+            // Volatile so the compiler can't turn the loop into one block write
+            ((volatile uint32_t *) shared.fields)[i] = value;
+        }
+        seqlock_write_end(&sequence);
+    }
+    atomic_store(&done, true);
+    return NULL;
+}
+
+static void *reader_run(void *arg) {
+    reader_result_t *result = arg;
+    snapshot_t copy;
+    uint32_t last = 0;
+
+    while (!atomic_load(&done)) {
+        unsigned int attempts = 0;
+        unsigned int start;
+
+        // Same loop as webserver_sensor_data_read, with sched_yield in place of vTaskDelay
+        do {
+            if (attempts++ > SPIN_LIMIT) {
+                sched_yield();
+            }
+            start = seqlock_read_begin(&sequence);
+            if (start & 1) {
+                continue;
+            }
+            for (int i = 0; i < FIELD_COUNT; i++) {
+                copy.fields[i] = ((volatile uint32_t *) shared.fields)[i];
+            }
+        } while (seqlock_read_retry(&sequence, start));
+
+        result->reads++;
+        result->retries += attempts - 1;
+        for (int i = 1; i < FIELD_COUNT; i++) {
+            if (copy.fields[i] != copy.fields[0]) {
+                result->torn++;
+                break;
+            }
+        }
+        // Snapshots never go back in time
+        if (copy.fields[0] < last) {
+            result->torn++;
+        }
+        last = copy.fields[0];
+    }
+    return NULL;
+}
+
+static void test_read_retry_detects_writes(void) {
+    unsigned int start = seqlock_read_begin(&sequence);
+    TEST_ASSERT_FALSE(seqlock_read_retry(&sequence, start));
+
+    // A write that started during the read
+    seqlock_write_begin(&sequence);
+    TEST_ASSERT_TRUE(seqlock_read_retry(&sequence, start));
+
+    // A read that started during a write
+    unsigned int during = seqlock_read_begin(&sequence);
+    TEST_ASSERT_TRUE(during & 1);
+    seqlock_write_end(&sequence);
+    TEST_ASSERT_TRUE(seqlock_read_retry(&sequence, during));
+
+    // A whole write during the read
+    TEST_ASSERT_TRUE(seqlock_read_retry(&sequence, start));
+}
+
+static void test_concurrent_reads_are_consistent(void) {
+    pthread_t writer;
+    pthread_t readers[READER_COUNT];
+    reader_result_t results[READER_COUNT] = {0};
+
+    for (int i = 0; i < READER_COUNT; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&readers[i], NULL, reader_run, &results[i]));
+    }
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&writer, NULL, writer_run, NULL));
+
+    pthread_join(writer, NULL);
+    for (int i = 0; i < READER_COUNT; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    char message[128];
+    for (int i = 0; i < READER_COUNT; i++) {
+        snprintf(message, sizeof(message), "Reader %d: %lu reads, %lu retries", i, results[i].reads, results[i].retries);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_GREATER_THAN(0, results[i].reads);
+        TEST_ASSERT_EQUAL_UINT32(0, results[i].torn);
+    }
+    TEST_ASSERT_EQUAL_UINT(WRITES * 2, atomic_load(&sequence));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_read_retry_detects_writes);
+    RUN_TEST(test_concurrent_reads_are_consistent);
+    return UNITY_END();
+}
@@ -0,0 +1,200 @@
+#include <unity.h>
+#include <math.h>
+#include "i2cdev.h"
+#include "am2320.h"
+#include "tsl2561.h"
+#include "hx710b.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "rom/ets_sys.h"
+#include "sim.h"
+#include "config.h"
+
+/*
+ * The drivers of the firmware against the simulated buses: every device model replays a constant trace that the
+ * tests change, and the readings of the drivers must match it. The models enforce the timing of the datasheets,
+ * so these are also the reference for the sim itself.
+ */
+
+#define LUX_TOLERANCE 0.1 // The lux formula of the driver and the piecewise channel ratio of the model
+#define HX710B_READ_TIMEOUT_MS 200
+#define AM2320_READS 100
+#define TSL2561_READ_MAX_US 5000 // A few I2C transactions, far below ILLUMINANCE_DEADLINE_MS
+
+// Two rows with the same values, the models read the value arrays live
+static double am2320_values[] = { 0, 0, 0, 1000, 0, 0 };
+static double tsl2561_values[] = { 0, 0, 0, 1000, 0, 0 };
+static double hx710b_values[] = { 0, 0, 1000, 0 };
+
+static sim_trace_t am2320_trace = { .name = "am2320", .columns = 3, .rows = 2, .values = am2320_values };
+static sim_trace_t tsl2561_trace = { .name = "tsl2561", .columns = 3, .rows = 2, .values = tsl2561_values };
+static sim_trace_t hx710b_trace = { .name = "hx710b", .columns = 2, .rows = 2, .values = hx710b_values };
+
+static i2c_dev_t am2320_dev;
+static tsl2561_t tsl2561_dev;
+static hx710b_t hx710b_dev;
+
+static void set_trace(double *values, size_t columns, size_t column, double value) {
+    values[column] = value;
+    values[columns + column] = value;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_am2320_reads_the_trace(void) {
+    set_trace(am2320_values, 3, 1, 23.4);
+    set_trace(am2320_values, 3, 2, 51.2);
+
+    float temperature, humidity;
+    TEST_ASSERT_EQUAL(ESP_OK, am2320_get_rht(&am2320_dev, &temperature, &humidity));
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 23.4, temperature);
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 51.2, humidity);
+}
+
+void test_am2320_negative_temperature(void) {
+    set_trace(am2320_values, 3, 1, -12.7);
+    set_trace(am2320_values, 3, 2, 80);
+
+    float temperature, humidity;
+    TEST_ASSERT_EQUAL(ESP_OK, am2320_get_rht(&am2320_dev, &temperature, &humidity));
+    TEST_ASSERT_FLOAT_WITHIN(0.05, -12.7, temperature);
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 80, humidity);
+}
+
+void test_am2320_back_to_back_reads(void) {
+    set_trace(am2320_values, 3, 1, 19.5);
+    set_trace(am2320_values, 3, 2, 40);
+
+    // The wake-up and measurement delays must hold wherever in a tick a read starts
+    for (int i = 0; i < AM2320_READS; i++) {
+        ets_delay_us(esp_random() % (portTICK_PERIOD_MS * 1000));
+        float temperature, humidity;
+        TEST_ASSERT_EQUAL(ESP_OK, am2320_get_rht(&am2320_dev, &temperature, &humidity));
+        TEST_ASSERT_FLOAT_WITHIN(0.05, 19.5, temperature);
+    }
+}
+
+void test_am2320_identification(void) {
+    uint8_t version;
+    uint32_t id;
+    TEST_ASSERT_EQUAL(ESP_OK, am2320_get_version(&am2320_dev, &version));
+    TEST_ASSERT_EQUAL_UINT8(1, version);
+    TEST_ASSERT_EQUAL(ESP_OK, am2320_get_device_id(&am2320_dev, &id));
+    TEST_ASSERT_EQUAL_HEX32(0x53494d01, id);
+}
+
+void test_missing_device_is_nacked(void) {
+    i2c_dev_t missing = { .port = I2C_NUM_0, .addr = 0x10, .cfg = am2320_dev.cfg };
+    TEST_ASSERT_EQUAL(ESP_OK, i2c_dev_create_mutex(&missing));
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, i2c_dev_probe(&missing, I2C_DEV_WRITE));
+    i2c_dev_delete_mutex(&missing);
+}
+
+static void assert_lux(double expected) {
+    set_trace(tsl2561_values, 3, 1, expected);
+    set_trace(tsl2561_values, 3, 2, 0.3);
+
+    // Auto ranging discards the conversions until it settled, at most a few integrations
+    uint32_t lux = 0;
+    esp_err_t res = ESP_ERR_NOT_FINISHED;
+    for (int i = 0; i < 20 && res != ESP_OK; i++) {
+        vTaskDelay(pdMS_TO_TICKS(450));
+        tsl2561_gain_t gain = tsl2561_dev.gain;
+        tsl2561_integration_time_t integration_time = tsl2561_dev.integration_time;
+        res = tsl2561_fetch_lux(&tsl2561_dev, &lux);
+        bool ranged = gain != tsl2561_dev.gain || integration_time != tsl2561_dev.integration_time;
+        if (res == ESP_OK && (ranged || fabs(lux - expected) > expected * LUX_TOLERANCE + 1)) {
+            // A conversion of the previous light level, or one that made the auto ranging switch
+            res = ESP_ERR_NOT_FINISHED;
+        }
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, res);
+    TEST_ASSERT_FALSE(tsl2561_dev.saturated);
+}
+
+void test_tsl2561_dark(void) {
+    assert_lux(2);
+    TEST_ASSERT_EQUAL(TSL2561_INTEGRATION_402MS, tsl2561_dev.integration_time);
+}
+
+void test_tsl2561_bright(void) {
+    assert_lux(20000);
+    TEST_ASSERT_EQUAL(TSL2561_GAIN_1X, tsl2561_dev.gain);
+}
+
+static uint32_t read_lux_timed(void) {
+    uint32_t lux = 0;
+    int64_t start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, tsl2561_read_lux(&tsl2561_dev, &lux));
+    TEST_ASSERT_LESS_THAN(TSL2561_READ_MAX_US, esp_timer_get_time() - start);
+    return lux;
+}
+
+void test_tsl2561_read_lux_does_not_wait(void) {
+    // In the least sensitive range from test_tsl2561_bright, darkness picks the most sensitive range in one step
+    set_trace(tsl2561_values, 3, 1, 2);
+    vTaskDelay(pdMS_TO_TICKS(30));
+    read_lux_timed();
+    TEST_ASSERT_EQUAL(TSL2561_INTEGRATION_402MS, tsl2561_dev.integration_time);
+    TEST_ASSERT_EQUAL(TSL2561_GAIN_16X, tsl2561_dev.gain);
+
+    // The new range integrates, the read returns the last conversion instead of waiting for it
+    uint32_t previous = tsl2561_dev.lux;
+    TEST_ASSERT_EQUAL_UINT32(previous, read_lux_timed());
+    vTaskDelay(pdMS_TO_TICKS(450));
+    TEST_ASSERT_UINT_WITHIN(1, 2, read_lux_timed());
+
+    // Saturating drops to the least sensitive range, again without waiting
+    set_trace(tsl2561_values, 3, 1, 20000);
+    vTaskDelay(pdMS_TO_TICKS(450));
+    TEST_ASSERT_UINT_WITHIN(1, 2, read_lux_timed());
+    TEST_ASSERT_EQUAL(TSL2561_INTEGRATION_13MS, tsl2561_dev.integration_time);
+    TEST_ASSERT_EQUAL(TSL2561_GAIN_1X, tsl2561_dev.gain);
+    vTaskDelay(pdMS_TO_TICKS(30));
+    uint32_t lux = read_lux_timed();
+    TEST_ASSERT_UINT_WITHIN(20000 * LUX_TOLERANCE, 20000, lux);
+    TEST_ASSERT_FALSE(tsl2561_dev.saturated);
+}
+
+void test_hx710b_reads_the_trace(void) {
+    const int32_t codes[] = { 1234567, -2345678, 0x7fffff, -0x800000 };
+    for (size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++) {
+        set_trace(hx710b_values, 2, 1, codes[i]);
+        int32_t value;
+        // The conversion in progress may still have the previous code
+        TEST_ASSERT_EQUAL(ESP_OK, hx710b_read(&hx710b_dev, &value, HX710B_READ_TIMEOUT_MS));
+        TEST_ASSERT_EQUAL(ESP_OK, hx710b_read(&hx710b_dev, &value, HX710B_READ_TIMEOUT_MS));
+        TEST_ASSERT_EQUAL_INT32(codes[i], value);
+    }
+}
+
+int main(int argc, char **argv) {
+    ESP_ERROR_CHECK(gpio_install_isr_service(0));
+    ESP_ERROR_CHECK(i2cdev_init());
+    ESP_ERROR_CHECK(sim_am2320_attach(I2C_NUM_0, &am2320_trace));
+    ESP_ERROR_CHECK(sim_tsl2561_attach(I2C_NUM_0, TSL2561_I2C_ADDR_FLOAT, &tsl2561_trace));
+    ESP_ERROR_CHECK(sim_hx710b_attach(PRESSURE_SENSOR_SPI_HOST, PRESSURE_SENSOR_OUT_PIN, &hx710b_trace));
+
+    ESP_ERROR_CHECK(am2320_init_desc(&am2320_dev, I2C_NUM_0, I2C_SDA_PIN, I2C_SCL_PIN));
+    ESP_ERROR_CHECK(tsl2561_init_desc(&tsl2561_dev, TSL2561_I2C_ADDR_FLOAT, I2C_NUM_0, I2C_SDA_PIN, I2C_SCL_PIN));
+    ESP_ERROR_CHECK(tsl2561_init(&tsl2561_dev));
+    ESP_ERROR_CHECK(tsl2561_set_auto_range(&tsl2561_dev, true, ILLUMINANCE_MIN_COUNTS));
+    ESP_ERROR_CHECK(tsl2561_start_measurement(&tsl2561_dev));
+    ESP_ERROR_CHECK(hx710b_init(&hx710b_dev, PRESSURE_SENSOR_SCK_PIN, PRESSURE_SENSOR_OUT_PIN, HX710B_GAIN_128, PRESSURE_SENSOR_SPI_HOST));
+
+    UNITY_BEGIN();
+    RUN_TEST(test_am2320_reads_the_trace);
+    RUN_TEST(test_am2320_negative_temperature);
+    RUN_TEST(test_am2320_back_to_back_reads);
+    RUN_TEST(test_am2320_identification);
+    RUN_TEST(test_missing_device_is_nacked);
+    RUN_TEST(test_tsl2561_dark);
+    RUN_TEST(test_tsl2561_bright);
+    RUN_TEST(test_tsl2561_read_lux_does_not_wait);
+    RUN_TEST(test_hx710b_reads_the_trace);
+    return UNITY_END();
+}
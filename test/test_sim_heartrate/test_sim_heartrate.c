@@ -0,0 +1,161 @@
+#include <unity.h>
+#include <math.h>
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "adc.h"
+#include "heartrate.h"
+#include "sim.h"
+#include "config.h"
+
+/*
+ * Replays the recorded PPG of sim/traces/heartrate.csv and synthetic pulses through the simulated continuous ADC,
+ * adc.c and heartrate.c with the settings of the device. The ADC runs unpaced, so a minute of signal takes a few
+ * hundred milliseconds. Every frame advances the signal by frame_size / 2 / HEARTRATE_ADC_SAMPLE_FREQ_HZ seconds.
+ */
+
+#define POINT_RATE_HZ (HEARTRATE_ADC_SAMPLE_FREQ_HZ / HEARTRATE_SAMPLES_PER_POINT)
+#define FRAME_S ((double) HEARTRATE_ADC_FRAME_SIZE / SOC_ADC_DIGI_RESULT_BYTES / HEARTRATE_ADC_SAMPLE_FREQ_HZ)
+#define BASELINE_MV 1500
+#define AMPLITUDE_MV 600
+#define SYSTOLIC_DELAY_S 0.12
+
+typedef struct {
+    double start_s; // Time of the ADC start, the signal starts at 0 there
+    const sim_trace_t *trace;
+    double bpm;
+} signal_t;
+
+typedef struct {
+    adc_continuous_unit_t adc;
+    hr_estimator_t estimator;
+    signal_t signal;
+    u_int32_t frames;
+    u_int32_t beats;
+} replay_t;
+
+static sim_trace_t recording;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static double pulse_shape(double t) {
+    double systolic = exp(-pow((t - SYSTOLIC_DELAY_S) / 0.05, 2));
+    double diastolic = 0.35 * exp(-pow((t - 0.35) / 0.06, 2));
+    return systolic + diastolic;
+}
+
+static double signal_mv(void *ctx, double time_s) {
+    const signal_t *signal = ctx;
+    double t = time_s - signal->start_s;
+    if (signal->trace != NULL) {
+        return sim_trace_value(signal->trace, 1, t);
+    }
+    double interval = 60 / signal->bpm;
+    double onset = floor(t / interval) * interval;
+    return BASELINE_MV + AMPLITUDE_MV * (pulse_shape(t - onset) + pulse_shape(t - onset + interval));
+}
+
+static void replay_start(replay_t *replay, const sim_trace_t *trace, double bpm) {
+    replay->signal = (signal_t) { .trace = trace, .bpm = bpm };
+    replay->frames = 0;
+    replay->beats = 0;
+    sim_adc_set_input(signal_mv, &replay->signal);
+
+    adc_continuous_unit_init(ADC_UNIT_1, HEARTRATE_SENSOR_ADC_CHANNEL, ADC_ATTEN, HEARTRATE_ADC_SAMPLE_FREQ_HZ, HEARTRATE_ADC_FRAME_SIZE, &replay->adc);
+    hr_estimator_init(&replay->estimator, POINT_RATE_HZ, HEARTBEAT_MIN_PEAK_MV, HEARTBEAT_INTERVAL_WINDOW, HEARTBEAT_TIMEOUT_MS);
+    replay->signal.start_s = esp_timer_get_time() / 1e6;
+    TEST_ASSERT_EQUAL(ESP_OK, adc_continuous_start(replay->adc.adc_handle));
+}
+
+// Processes the frames until the signal reached the time, returns the rate at that time
+static u_int8_t replay_until(replay_t *replay, double time_s) {
+    while (replay->frames * FRAME_S < time_s) {
+        u_int32_t beats;
+        TEST_ASSERT_EQUAL(ESP_OK, heart_rate_process_frame(&replay->adc, &replay->estimator, HEARTBEAT_TIMEOUT_MS, HEARTBEAT_LED_GPIO, &beats));
+        replay->beats += beats;
+        replay->frames++;
+    }
+    hr_estimator_stats_t stats;
+    hr_estimator_get_stats(&replay->estimator, &stats);
+    return stats.bpm;
+}
+
+static void replay_stop(replay_t *replay) {
+    TEST_ASSERT_EQUAL(ESP_OK, adc_continuous_stop(replay->adc.adc_handle));
+    adc_continuous_unit_deinit(&replay->adc);
+}
+
+void test_recording_gives_its_rate(void) {
+    static replay_t replay;
+    replay_start(&replay, &recording, 0);
+
+    // 72 bpm until the strap comes off at 20 s
+    TEST_ASSERT_INT_WITHIN(1, 72, replay_until(&replay, 19.5));
+    // The first beats teach the detector the amplitude
+    TEST_ASSERT_INT_WITHIN(3, 72 * 19.5 / 60, replay.beats);
+
+    replay_stop(&replay);
+}
+
+void test_strap_off_clears_the_rate(void) {
+    static replay_t replay;
+    replay_start(&replay, &recording, 0);
+
+    TEST_ASSERT_INT_WITHIN(1, 72, replay_until(&replay, 20));
+    // No pulse for HEARTBEAT_TIMEOUT_MS
+    TEST_ASSERT_EQUAL(0, replay_until(&replay, 20 + HEARTBEAT_TIMEOUT_MS / 1000.0 + 0.5));
+    // Back on at 23 s, the rate returns with the window
+    TEST_ASSERT_INT_WITHIN(1, 72, replay_until(&replay, 23 + HEARTBEAT_INTERVAL_WINDOW * 60 / 72.0 + 2));
+
+    replay_stop(&replay);
+}
+
+void test_synthetic_rates(void) {
+    const double rates[] = { 45, 60, 100, 150 };
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        static replay_t replay;
+        replay_start(&replay, NULL, rates[i]);
+        TEST_ASSERT_INT_WITHIN(1, rates[i], replay_until(&replay, 20));
+        replay_stop(&replay);
+    }
+}
+
+void test_led_follows_the_pulses(void) {
+    static replay_t replay;
+    gpio_reset_pin(HEARTBEAT_LED_GPIO);
+    gpio_set_direction(HEARTBEAT_LED_GPIO, GPIO_MODE_INPUT_OUTPUT);
+    gpio_set_level(HEARTBEAT_LED_GPIO, 0);
+    replay_start(&replay, NULL, 60);
+
+    // The LED is on while the detector is inside a pulse
+    bool seen_on = false;
+    bool seen_off = false;
+    while (replay.frames * FRAME_S < 10) {
+        replay_until(&replay, (replay.frames + 1) * FRAME_S);
+        bool on = gpio_get_level(HEARTBEAT_LED_GPIO);
+        TEST_ASSERT_EQUAL(replay.estimator.detector.pulse, on);
+        seen_on |= on;
+        seen_off |= !on;
+    }
+    TEST_ASSERT_TRUE(seen_on);
+    TEST_ASSERT_TRUE(seen_off);
+
+    replay_stop(&replay);
+}
+
+int main(int argc, char **argv) {
+    ESP_ERROR_CHECK(sim_trace_load("heartrate.csv", 2, &recording));
+    sim_adc_set_unpaced(true);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_recording_gives_its_rate);
+    RUN_TEST(test_strap_off_clears_the_rate);
+    RUN_TEST(test_synthetic_rates);
+    RUN_TEST(test_led_follows_the_pulses);
+    int failures = UNITY_END();
+    sim_trace_free(&recording);
+    return failures;
+}
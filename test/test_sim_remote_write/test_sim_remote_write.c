@@ -0,0 +1,399 @@
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <sys/time.h>
+#include "esp_http_server.h"
+#include "remote_write.h"
+#include "config.h"
+
+/*
+ * The remote write push against a stand-in receiver on the host: the receiver undoes the snappy compression and
+ * decodes the WriteRequest with its own protobuf reader, so the encoder is checked against the field numbers and
+ * wire types of the spec (https://prometheus.io/docs/concepts/remote_write_spec/) and not against itself.
+ */
+
+#define RECEIVER_PORT 19090
+#define RECEIVER_URL "http://127.0.0.1:19090/api/v1/write"
+#define PUSH_PERIOD_MS 100
+#define PUSH_TIMEOUT_MS 3000
+#define BODY_SIZE 16384
+#define MAX_SERIES 8
+#define MAX_LABELS 4
+#define MAX_SAMPLES 8
+#define STRING_SIZE 64
+#define TIMESTAMP_TOLERANCE_MS 50
+
+// Protobuf wire types
+#define WIRE_VARINT 0
+#define WIRE_FIXED64 1
+#define WIRE_LEN 2
+
+typedef struct {
+    const u_int8_t *data;
+    const u_int8_t *end;
+} reader_t;
+
+typedef struct {
+    char names[MAX_LABELS][STRING_SIZE];
+    char values[MAX_LABELS][STRING_SIZE];
+    size_t label_count;
+    double samples[MAX_SAMPLES];
+    int64_t timestamps_ms[MAX_SAMPLES];
+    size_t sample_count;
+} series_t;
+
+// The last request of the receiver, a push is only taken after its semaphore was given
+static u_int8_t body[BODY_SIZE];
+static size_t body_len;
+static char content_encoding[STRING_SIZE];
+static char content_type[STRING_SIZE];
+static const char *response_status = "204 No Content";
+static SemaphoreHandle_t received;
+
+static u_int8_t request[BODY_SIZE];
+static series_t series[MAX_SERIES];
+static size_t series_count;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static int64_t unix_time_ms(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t) now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+static esp_err_t post_write_handler(httpd_req_t *req) {
+    body_len = 0;
+    while (body_len < req->content_len && body_len < sizeof(body)) {
+        int n = httpd_req_recv(req, (char *) body + body_len, sizeof(body) - body_len);
+        if (n <= 0) {
+            return ESP_FAIL;
+        }
+        body_len += n;
+    }
+    httpd_req_get_hdr_value_str(req, "Content-Encoding", content_encoding, sizeof(content_encoding));
+    httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type));
+
+    httpd_resp_set_status(req, response_status);
+    esp_err_t res = httpd_resp_send(req, NULL, 0);
+    xSemaphoreGive(received);
+    return res;
+}
+
+//---------Decoding---------//
+
+static u_int64_t read_varint(reader_t *reader) {
+    u_int64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        TEST_ASSERT_TRUE(reader->data < reader->end);
+        u_int8_t byte = *reader->data++;
+        value |= (u_int64_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    TEST_FAIL_MESSAGE("Varint longer than 10 bytes");
+    return 0;
+}
+
+static u_int32_t read_le(const u_int8_t *data, int bytes) {
+    u_int32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (u_int32_t) data[i] << (8 * i);
+    }
+    return value;
+}
+
+// The raw block format, the reference for the compressor in snappy.c
+static size_t snappy_uncompress(const u_int8_t *input, size_t input_len, u_int8_t *output, size_t output_size) {
+    reader_t reader = { input, input + input_len };
+    size_t expected = read_varint(&reader);
+    TEST_ASSERT_TRUE(expected <= output_size);
+
+    size_t len = 0;
+    while (reader.data < reader.end) {
+        u_int8_t tag = *reader.data++;
+        size_t copy_len;
+        size_t offset;
+        switch (tag & 3) {
+            case 0: {
+                copy_len = (tag >> 2) + 1;
+                if (copy_len > 60) {
+                    int bytes = copy_len - 60;
+                    copy_len = read_le(reader.data, bytes) + 1;
+                    reader.data += bytes;
+                }
+                TEST_ASSERT_TRUE(reader.data + copy_len <= reader.end && len + copy_len <= expected);
+                memcpy(output + len, reader.data, copy_len);
+                reader.data += copy_len;
+                len += copy_len;
+                continue;
+            }
+            case 1:
+                copy_len = 4 + ((tag >> 2) & 7);
+                offset = ((size_t) (tag >> 5) << 8) | *reader.data++;
+                break;
+            case 2:
+                copy_len = (tag >> 2) + 1;
+                offset = read_le(reader.data, 2);
+                reader.data += 2;
+                break;
+            default:
+                copy_len = (tag >> 2) + 1;
+                offset = read_le(reader.data, 4);
+                reader.data += 4;
+                break;
+        }
+        TEST_ASSERT_TRUE(offset > 0 && offset <= len && len + copy_len <= expected);
+        // Copies may overlap their output
+        for (size_t i = 0; i < copy_len; i++, len++) {
+            output[len] = output[len - offset];
+        }
+    }
+    TEST_ASSERT_EQUAL(expected, len);
+    return len;
+}
+
+static u_int32_t read_tag(reader_t *reader, u_int32_t *wire_type) {
+    u_int64_t tag = read_varint(reader);
+    *wire_type = tag & 7;
+    return tag >> 3;
+}
+
+static reader_t read_message(reader_t *reader) {
+    u_int64_t len = read_varint(reader);
+    TEST_ASSERT_TRUE(len <= (u_int64_t) (reader->end - reader->data));
+    reader_t message = { reader->data, reader->data + len };
+    reader->data += len;
+    return message;
+}
+
+static void read_string(reader_t *reader, char *out) {
+    reader_t string = read_message(reader);
+    size_t len = string.end - string.data;
+    TEST_ASSERT_TRUE(len < STRING_SIZE);
+    memcpy(out, string.data, len);
+    out[len] = '\0';
+}
+
+// message Label { string name = 1; string value = 2; }
+static void decode_label(reader_t reader, series_t *out) {
+    TEST_ASSERT_TRUE(out->label_count < MAX_LABELS);
+    while (reader.data < reader.end) {
+        u_int32_t wire_type;
+        u_int32_t field = read_tag(&reader, &wire_type);
+        TEST_ASSERT_EQUAL(WIRE_LEN, wire_type);
+        if (field == 1) {
+            read_string(&reader, out->names[out->label_count]);
+        } else if (field == 2) {
+            read_string(&reader, out->values[out->label_count]);
+        } else {
+            TEST_FAIL_MESSAGE("Unknown Label field");
+        }
+    }
+    out->label_count++;
+}
+
+// message Sample { double value = 1; int64 timestamp = 2; }
+static void decode_sample(reader_t reader, series_t *out) {
+    TEST_ASSERT_TRUE(out->sample_count < MAX_SAMPLES);
+    while (reader.data < reader.end) {
+        u_int32_t wire_type;
+        u_int32_t field = read_tag(&reader, &wire_type);
+        if (field == 1) {
+            TEST_ASSERT_EQUAL(WIRE_FIXED64, wire_type);
+            TEST_ASSERT_TRUE(reader.end - reader.data >= 8);
+            u_int64_t bits = read_le(reader.data, 4) | (u_int64_t) read_le(reader.data + 4, 4) << 32;
+            memcpy(&out->samples[out->sample_count], &bits, sizeof(bits));
+            reader.data += 8;
+        } else if (field == 2) {
+            TEST_ASSERT_EQUAL(WIRE_VARINT, wire_type);
+            out->timestamps_ms[out->sample_count] = read_varint(&reader);
+        } else {
+            TEST_FAIL_MESSAGE("Unknown Sample field");
+        }
+    }
+    out->sample_count++;
+}
+
+// message TimeSeries { repeated Label labels = 1; repeated Sample samples = 2; }
+static void decode_series(reader_t reader, series_t *out) {
+    while (reader.data < reader.end) {
+        u_int32_t wire_type;
+        u_int32_t field = read_tag(&reader, &wire_type);
+        TEST_ASSERT_EQUAL(WIRE_LEN, wire_type);
+        if (field == 1) {
+            decode_label(read_message(&reader), out);
+        } else if (field == 2) {
+            decode_sample(read_message(&reader), out);
+        } else {
+            TEST_FAIL_MESSAGE("Unknown TimeSeries field");
+        }
+    }
+}
+
+// message WriteRequest { repeated TimeSeries timeseries = 1; }
+static void decode_write_request(void) {
+    TEST_ASSERT_EQUAL_STRING("snappy", content_encoding);
+    TEST_ASSERT_EQUAL_STRING("application/x-protobuf", content_type);
+    size_t len = snappy_uncompress(body, body_len, request, sizeof(request));
+
+    reader_t reader = { request, request + len };
+    memset(series, 0, sizeof(series));
+    series_count = 0;
+    while (reader.data < reader.end) {
+        u_int32_t wire_type;
+        u_int32_t field = read_tag(&reader, &wire_type);
+        TEST_ASSERT_EQUAL(1, field);
+        TEST_ASSERT_EQUAL(WIRE_LEN, wire_type);
+        TEST_ASSERT_TRUE(series_count < MAX_SERIES);
+        decode_series(read_message(&reader), &series[series_count++]);
+    }
+}
+
+static const series_t *find_series(const char *name) {
+    for (size_t i = 0; i < series_count; i++) {
+        if (strcmp(series[i].names[0], "__name__") == 0 && strcmp(series[i].values[0], name) == 0) {
+            return &series[i];
+        }
+    }
+    return NULL;
+}
+
+static void wait_for_push(void) {
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(received, pdMS_TO_TICKS(PUSH_TIMEOUT_MS)));
+}
+
+static webserver_sensor_values_t sampled_values(float offset) {
+    webserver_sensor_values_t values = {
+        .illuminance = 312 + offset,
+        .temperature = 21.5f + offset,
+        .humidity = 43.25f + offset,
+        .heartrate = 64,
+        .heartrate_rmssd = 41.5f,
+        .heartrate_sdnn = 52.5f,
+        .pressure = 1013.25f + offset,
+    };
+    values.status[WEBSERVER_SENSOR_TSL2561].sampled = true;
+    values.status[WEBSERVER_SENSOR_AM2320].sampled = true;
+    values.status[WEBSERVER_SENSOR_HX710B].sampled = true;
+    return values;
+}
+
+//---------Tests---------//
+
+void test_write_request_decodes(void) {
+    // The heart rate strap only delivers from the second row on
+    webserver_sensor_values_t first = sampled_values(0);
+    webserver_sensor_values_t second = sampled_values(1);
+    second.status[WEBSERVER_SENSOR_HEARTRATE].sampled = true;
+
+    int64_t first_ms = unix_time_ms();
+    remote_write_append(&first);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    int64_t second_ms = unix_time_ms();
+    remote_write_append(&second);
+
+    TEST_ASSERT_EQUAL(ESP_OK, remote_write_start(PUSH_PERIOD_MS, REMOTE_WRITE_TASK_STACK_SIZE, REMOTE_WRITE_TASK_PRIORITY));
+    wait_for_push();
+    decode_write_request();
+
+    TEST_ASSERT_EQUAL(6 + PRESSURE_SENSOR_ENABLED, series_count);
+    for (size_t i = 0; i < series_count; i++) {
+        // __name__, instance and job, sorted by name as the spec requires
+        TEST_ASSERT_EQUAL(3, series[i].label_count);
+        for (size_t label = 1; label < series[i].label_count; label++) {
+            TEST_ASSERT_LESS_THAN(0, strcmp(series[i].names[label - 1], series[i].names[label]));
+        }
+        TEST_ASSERT_EQUAL_STRING("instance", series[i].names[1]);
+        TEST_ASSERT_EQUAL(0, strncmp(series[i].values[1], "esp32-", 6));
+        TEST_ASSERT_EQUAL_STRING("job", series[i].names[2]);
+        TEST_ASSERT_EQUAL_STRING(REMOTE_WRITE_JOB, series[i].values[2]);
+    }
+
+    const series_t *temperature = find_series("temperature_celsius");
+    TEST_ASSERT_NOT_NULL(temperature);
+    TEST_ASSERT_EQUAL(2, temperature->sample_count);
+    TEST_ASSERT_EQUAL_FLOAT(21.5, temperature->samples[0]);
+    TEST_ASSERT_EQUAL_FLOAT(22.5, temperature->samples[1]);
+    // Milliseconds since the epoch, not seconds
+    TEST_ASSERT_INT64_WITHIN(TIMESTAMP_TOLERANCE_MS, first_ms, temperature->timestamps_ms[0]);
+    TEST_ASSERT_INT64_WITHIN(TIMESTAMP_TOLERANCE_MS, second_ms, temperature->timestamps_ms[1]);
+    TEST_ASSERT_TRUE(temperature->timestamps_ms[0] < temperature->timestamps_ms[1]);
+
+    // The row before the first heart rate has no sample instead of a NaN
+    const series_t *heartrate = find_series("heartrate_bpm");
+    TEST_ASSERT_NOT_NULL(heartrate);
+    TEST_ASSERT_EQUAL(1, heartrate->sample_count);
+    TEST_ASSERT_EQUAL_FLOAT(64, heartrate->samples[0]);
+    TEST_ASSERT_EQUAL_INT64(temperature->timestamps_ms[1], heartrate->timestamps_ms[0]);
+
+    const series_t *pressure = find_series("pressure_hpa");
+#if PRESSURE_SENSOR_ENABLED
+    TEST_ASSERT_NOT_NULL(pressure);
+    TEST_ASSERT_EQUAL(2, pressure->sample_count);
+    TEST_ASSERT_EQUAL_FLOAT(1013.25, pressure->samples[0]);
+#else
+    TEST_ASSERT_NULL(pressure);
+#endif
+}
+
+void test_unsampled_series_are_left_out(void) {
+    webserver_sensor_values_t values = sampled_values(0);
+    values.status[WEBSERVER_SENSOR_TSL2561].sampled = false;
+    remote_write_append(&values);
+
+    wait_for_push();
+    decode_write_request();
+
+    TEST_ASSERT_NULL(find_series("illuminance_lux"));
+    TEST_ASSERT_NULL(find_series("heartrate_bpm"));
+    TEST_ASSERT_NOT_NULL(find_series("humidity_relative"));
+    for (size_t i = 0; i < series_count; i++) {
+        TEST_ASSERT_EQUAL(1, series[i].sample_count);
+        TEST_ASSERT_FALSE(isnan(series[i].samples[0]));
+    }
+}
+
+void test_failed_push_is_retried(void) {
+    webserver_sensor_values_t values = sampled_values(0);
+    response_status = "503 Service Unavailable";
+    int64_t append_ms = unix_time_ms();
+    remote_write_append(&values);
+
+    wait_for_push();
+    response_status = "204 No Content";
+    // The backoff starts at a second
+    wait_for_push();
+    decode_write_request();
+
+    const series_t *humidity = find_series("humidity_relative");
+    TEST_ASSERT_NOT_NULL(humidity);
+    TEST_ASSERT_EQUAL(1, humidity->sample_count);
+    TEST_ASSERT_INT64_WITHIN(TIMESTAMP_TOLERANCE_MS, append_ms, humidity->timestamps_ms[0]);
+}
+
+int main(int argc, char **argv) {
+    received = xSemaphoreCreateCounting(8, 0);
+
+    httpd_handle_t receiver = NULL;
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = RECEIVER_PORT;
+    ESP_ERROR_CHECK(httpd_start(&receiver, &config));
+    httpd_uri_t write_uri = { .uri = "/api/v1/write", .method = HTTP_POST, .handler = post_write_handler };
+    ESP_ERROR_CHECK(httpd_register_uri_handler(receiver, &write_uri));
+
+    ESP_ERROR_CHECK(remote_write_init(RECEIVER_URL, REMOTE_WRITE_JOB));
+
+    UNITY_BEGIN();
+    RUN_TEST(test_write_request_decodes);
+    RUN_TEST(test_unsampled_series_are_left_out);
+    RUN_TEST(test_failed_push_is_retried);
+    int failures = UNITY_END();
+    httpd_stop(receiver);
+    return failures;
+}
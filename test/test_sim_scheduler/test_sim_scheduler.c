@@ -0,0 +1,187 @@
+#include <unity.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "rom/ets_sys.h"
+#include "scheduler.h"
+
+/*
+ * The sensor task scheduler on the simulated FreeRTOS with the 100 Hz tick of the device: the pacing of periodic and
+ * free-running tasks, the missed deadlines, the back-off after failures and the status published for the webserver.
+ * Every test starts its own task with a probe as sensor and stops it from inside the sample function.
+ */
+
+#define MAX_SAMPLES 64
+#define TICK_MS portTICK_PERIOD_MS
+
+typedef struct {
+    u_int32_t duration_ms;
+    esp_err_t result;
+    int fail_count; // Samples that fail before result is returned, -1 for all
+    atomic_bool stop;
+    atomic_int samples;
+    int64_t start_us[MAX_SAMPLES];
+} probe_t;
+
+static webserver_sensor_data_t sensor_data;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static esp_err_t sample_probe(sensor_task_t *task) {
+    probe_t *probe = task->sensor;
+    if (atomic_load(&probe->stop)) {
+        vTaskDelete(NULL);
+    }
+    int n = atomic_load(&probe->samples);
+    if (n < MAX_SAMPLES) {
+        probe->start_us[n] = esp_timer_get_time();
+    }
+    ets_delay_us(probe->duration_ms * 1000);
+    atomic_store(&probe->samples, n + 1);
+    return probe->fail_count < 0 || n < probe->fail_count ? probe->result : ESP_OK;
+}
+
+static void start_probe(sensor_task_t *task, probe_t *probe) {
+    task->sample = sample_probe;
+    task->sensor = probe;
+    task->data = &sensor_data;
+    TEST_ASSERT_EQUAL(ESP_OK, sensor_task_start(task, 4096, 5));
+}
+
+static void run_probe(sensor_task_t *task, probe_t *probe, u_int32_t run_ms) {
+    start_probe(task, probe);
+    vTaskDelay(pdMS_TO_TICKS(run_ms));
+    atomic_store(&probe->stop, true);
+}
+
+static int64_t min_interval_ms(const probe_t *probe) {
+    int64_t min = INT64_MAX;
+    int n = atomic_load(&probe->samples);
+    for (int i = 1; i < n && i < MAX_SAMPLES; i++) {
+        int64_t interval = (probe->start_us[i] - probe->start_us[i - 1]) / 1000;
+        min = interval < min ? interval : min;
+    }
+    return min;
+}
+
+static int64_t max_interval_ms(const probe_t *probe) {
+    int64_t max = 0;
+    int n = atomic_load(&probe->samples);
+    for (int i = 1; i < n && i < MAX_SAMPLES; i++) {
+        int64_t interval = (probe->start_us[i] - probe->start_us[i - 1]) / 1000;
+        max = interval > max ? interval : max;
+    }
+    return max;
+}
+
+void test_periodic_task_keeps_its_period(void) {
+    static probe_t probe = { .duration_ms = 20, .result = ESP_OK };
+    static sensor_task_t task = { .name = "periodic", .period_ms = 100, .deadline_ms = 50 };
+    run_probe(&task, &probe, 1050);
+
+    // The period is measured from the start of the previous sample, not its end
+    TEST_ASSERT_INT_WITHIN(1, 11, atomic_load(&probe.samples));
+    TEST_ASSERT_INT_WITHIN(TICK_MS, 100, min_interval_ms(&probe));
+    TEST_ASSERT_INT_WITHIN(TICK_MS, 100, max_interval_ms(&probe));
+    TEST_ASSERT_EQUAL_UINT32(0, atomic_load(&task.missed_deadlines));
+}
+
+void test_slow_samples_miss_their_deadline(void) {
+    static probe_t probe = { .duration_ms = 50, .result = ESP_OK };
+    static sensor_task_t task = { .name = "slow", .period_ms = 100, .deadline_ms = 30 };
+    run_probe(&task, &probe, 520);
+
+    int samples = atomic_load(&probe.samples);
+    TEST_ASSERT_GREATER_OR_EQUAL(5, samples);
+    // The sample that runs while the task is stopped may not have been counted yet
+    TEST_ASSERT_INT_WITHIN(1, samples, atomic_load(&task.missed_deadlines));
+}
+
+void test_overrun_does_not_catch_up(void) {
+    static probe_t probe = { .duration_ms = 250, .result = ESP_OK };
+    static sensor_task_t task = { .name = "overrun", .period_ms = 100, .deadline_ms = 100 };
+    run_probe(&task, &probe, 1100);
+
+    // Every sample starts right after the previous one, the periods lost to it aren't made up with a burst
+    TEST_ASSERT_INT_WITHIN(1, 5, atomic_load(&probe.samples));
+    TEST_ASSERT_GREATER_OR_EQUAL(250, min_interval_ms(&probe));
+    TEST_ASSERT_LESS_OR_EQUAL(250 + TICK_MS, max_interval_ms(&probe));
+}
+
+void test_free_running_failures_back_off(void) {
+    static probe_t probe = { .duration_ms = 0, .result = ESP_ERR_TIMEOUT, .fail_count = -1 };
+    static sensor_task_t task = { .name = "failing", .period_ms = 0, .deadline_ms = 100 };
+    run_probe(&task, &probe, 1000);
+
+    // One try per deadline instead of spinning on the sensor
+    TEST_ASSERT_INT_WITHIN(1, 10, atomic_load(&probe.samples));
+    TEST_ASSERT_GREATER_OR_EQUAL(100 - TICK_MS, min_interval_ms(&probe));
+}
+
+void test_free_running_successes_run_back_to_back(void) {
+    static probe_t probe = { .duration_ms = 5, .result = ESP_OK };
+    static sensor_task_t task = { .name = "free", .period_ms = 0, .deadline_ms = 100 };
+    run_probe(&task, &probe, 200);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(30, atomic_load(&probe.samples));
+    TEST_ASSERT_LESS_THAN(TICK_MS, max_interval_ms(&probe));
+}
+
+void test_failures_are_published(void) {
+    static probe_t probe = { .duration_ms = 0, .result = ESP_ERR_INVALID_CRC, .fail_count = 3 };
+    static sensor_task_t task = { .name = "status", .period_ms = 50, .deadline_ms = 50, .status = WEBSERVER_SENSOR_AM2320 };
+    const webserver_sensor_status_t *status = &sensor_data.values.status[WEBSERVER_SENSOR_AM2320];
+
+    start_probe(&task, &probe);
+    vTaskDelay(pdMS_TO_TICKS(120));
+    TEST_ASSERT_EQUAL_UINT32(3, status->errors);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, status->last_error);
+
+    // The first success resets the count, the last error stays for the diagnosis
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ASSERT_EQUAL_UINT32(0, status->errors);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, status->last_error);
+    atomic_store(&probe.stop, true);
+}
+
+void test_started_tasks_are_listed(void) {
+    const char *names[] = { "periodic", "slow", "overrun", "failing", "free", "status" };
+    TEST_ASSERT_EQUAL(sizeof(names) / sizeof(names[0]), sensor_task_count());
+    for (size_t i = 0; i < sensor_task_count(); i++) {
+        TEST_ASSERT_EQUAL_STRING(names[i], sensor_task_get(i)->name);
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(5, atomic_load(&sensor_task_get(1)->missed_deadlines));
+}
+
+void test_task_limit(void) {
+    static probe_t probes[SCHEDULER_MAX_TASKS];
+    static sensor_task_t tasks[SCHEDULER_MAX_TASKS];
+    size_t started = sensor_task_count();
+    for (size_t i = started; i < SCHEDULER_MAX_TASKS; i++) {
+        tasks[i] = (sensor_task_t) { .name = "filler", .period_ms = 1000, .deadline_ms = 100, .sample = sample_probe, .sensor = &probes[i] };
+        atomic_store(&probes[i].stop, true);
+        TEST_ASSERT_EQUAL(ESP_OK, sensor_task_start(&tasks[i], 4096, 5));
+    }
+    sensor_task_t extra = { .name = "extra", .period_ms = 1000, .deadline_ms = 100, .sample = sample_probe, .sensor = &probes[0] };
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, sensor_task_start(&extra, 4096, 5));
+    TEST_ASSERT_EQUAL(SCHEDULER_MAX_TASKS, sensor_task_count());
+}
+
+int main(int argc, char **argv) {
+    sensor_data.semaphore = xSemaphoreCreateMutex();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_periodic_task_keeps_its_period);
+    RUN_TEST(test_slow_samples_miss_their_deadline);
+    RUN_TEST(test_overrun_does_not_catch_up);
+    RUN_TEST(test_free_running_failures_back_off);
+    RUN_TEST(test_free_running_successes_run_back_to_back);
+    RUN_TEST(test_failures_are_published);
+    RUN_TEST(test_started_tasks_are_listed);
+    RUN_TEST(test_task_limit);
+    return UNITY_END();
+}
@@ -0,0 +1,212 @@
+#include <unity.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "esp_timer.h"
+#include "stream.h"
+#include "webserver.h"
+#include "config.h"
+
+/*
+ * The /stream endpoint of the webserver against local clients: every slot is subscribed, the sensor data is updated
+ * the way the sensor tasks do it and the time from the end of the update to the event at every client is measured.
+ * The clients are plain sockets that read the chunked response as it comes, the SSE framing is checked on the text.
+ */
+
+#define SERVER_PORT 19191
+#define EXTRA_CLIENTS 4 // Rejected with 503, one socket each
+#define ROUNDS 50
+#define RECEIVE_TIMEOUT_MS 1000
+#define LATENCY_MAX_MS 20    // Two ticks, the stream task is woken by the update and doesn't wait for one
+#define PUBLISH_MAX_US 2000  // The update of the sampler, it only sets flags for the stream task
+#define CLIENT_BUFFER_SIZE 65536
+
+typedef struct {
+    int fd;
+    char text[CLIENT_BUFFER_SIZE];
+    size_t len;
+    size_t read; // The text before it was checked already
+} client_t;
+
+static webserver_sensor_data_t sensor_data;
+static client_t clients[STREAM_MAX_CLIENTS];
+static u_int32_t beats;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static int connect_client(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(SERVER_PORT) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        return -1;
+    }
+    const char *request = "GET /stream HTTP/1.1\r\nHost: localhost\r\nAccept: text/event-stream\r\n\r\n";
+    if (send(fd, request, strlen(request), 0) != (ssize_t) strlen(request)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Reads what the client got until the text after client->read contains the needle, returns the time it was found
+static int64_t receive_until(client_t *client, const char *needle) {
+    int64_t deadline = esp_timer_get_time() + RECEIVE_TIMEOUT_MS * 1000LL;
+    for (;;) {
+        client->text[client->len] = '\0';
+        char *found = strstr(client->text + client->read, needle);
+        if (found != NULL) {
+            client->read = found + strlen(needle) - client->text;
+            return esp_timer_get_time();
+        }
+
+        int64_t left_ms = (deadline - esp_timer_get_time()) / 1000;
+        struct pollfd pfd = { .fd = client->fd, .events = POLLIN };
+        if (left_ms <= 0 || poll(&pfd, 1, left_ms) <= 0 || client->len + 1 >= sizeof(client->text)) {
+            return -1;
+        }
+        ssize_t n = recv(client->fd, client->text + client->len, sizeof(client->text) - client->len - 1, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        client->len += n;
+    }
+}
+
+// Updates the temperature like the AM2320 task, returns the time the update ended
+static int64_t publish_sample(float temperature) {
+    TEST_ASSERT_TRUE(webserver_sensor_data_begin_update(&sensor_data));
+    sensor_data.values.temperature = temperature;
+    webserver_sensor_data_mark_sampled(&sensor_data, WEBSERVER_SENSOR_AM2320);
+    int64_t start = esp_timer_get_time();
+    webserver_sensor_data_end_update(&sensor_data);
+    int64_t end = esp_timer_get_time();
+    TEST_ASSERT_LESS_THAN(PUBLISH_MAX_US, end - start);
+    return end;
+}
+
+static void report(const char *event, int64_t total_us, int64_t max_us, int count) {
+    printf("%s events: %d, mean latency %.3f ms, max latency %.3f ms\n", event, count, total_us / 1000.0 / count, max_us / 1000.0);
+}
+
+void test_clients_subscribe(void) {
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        clients[i].fd = connect_client();
+        TEST_ASSERT_GREATER_OR_EQUAL(0, clients[i].fd);
+        TEST_ASSERT_GREATER_OR_EQUAL(0, receive_until(&clients[i], "Content-Type: text/event-stream"));
+        TEST_ASSERT_GREATER_OR_EQUAL(0, receive_until(&clients[i], "Transfer-Encoding: chunked"));
+        TEST_ASSERT_GREATER_OR_EQUAL(0, receive_until(&clients[i], "retry: "));
+    }
+}
+
+void test_extra_clients_are_refused(void) {
+    for (int i = 0; i < EXTRA_CLIENTS; i++) {
+        client_t extra = { .fd = connect_client() };
+        TEST_ASSERT_GREATER_OR_EQUAL(0, extra.fd);
+        TEST_ASSERT_GREATER_OR_EQUAL(0, receive_until(&extra, "HTTP/1.1 503"));
+        close(extra.fd);
+    }
+}
+
+void test_sample_latency(void) {
+    int64_t total_us = 0;
+    int64_t max_us = 0;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        char expected[64];
+        snprintf(expected, sizeof(expected), "\"temperature\":%d.5", round);
+
+        int64_t published = publish_sample(round + 0.5f);
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            // The subscription itself sends the current values, the event of this update is the last one
+            TEST_ASSERT_GREATER_OR_EQUAL(0, receive_until(&clients[i], "event: sample\ndata: {\"sensor\":\"am2320\""));
+            int64_t received = receive_until(&clients[i], expected);
+            TEST_ASSERT_GREATER_OR_EQUAL(0, received);
+            TEST_ASSERT_GREATER_OR_EQUAL(0, receive_until(&clients[i], "\n\n\r\n"));
+            total_us += received - published;
+            max_us = received - published > max_us ? received - published : max_us;
+        }
+    }
+
+    report("Sample", total_us, max_us, ROUNDS * STREAM_MAX_CLIENTS);
+    TEST_ASSERT_LESS_THAN(LATENCY_MAX_MS * 1000, max_us);
+}
+
+void test_heartbeat_latency(void) {
+    int64_t total_us = 0;
+    int64_t max_us = 0;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        char expected[64];
+        beats += round % 3 + 1;
+        snprintf(expected, sizeof(expected), "event: heartbeat\ndata: {\"beats\":%u,", beats);
+
+        int64_t start = esp_timer_get_time();
+        stream_publish_heartbeats(round % 3 + 1);
+        int64_t published = esp_timer_get_time();
+        TEST_ASSERT_LESS_THAN(PUBLISH_MAX_US, published - start);
+
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            int64_t received = receive_until(&clients[i], expected);
+            TEST_ASSERT_GREATER_OR_EQUAL(0, received);
+            total_us += received - published;
+            max_us = received - published > max_us ? received - published : max_us;
+        }
+    }
+
+    report("Heartbeat", total_us, max_us, ROUNDS * STREAM_MAX_CLIENTS);
+    TEST_ASSERT_LESS_THAN(LATENCY_MAX_MS * 1000, max_us);
+}
+
+void test_closed_client_frees_its_slot(void) {
+    close(clients[0].fd);
+    // The first send after the close still succeeds, the reset it gets back makes the next one fail
+    beats++;
+    stream_publish_heartbeats(1);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    stream_publish_heartbeats(0);
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    clients[0] = (client_t) { .fd = connect_client() };
+    TEST_ASSERT_GREATER_OR_EQUAL(0, clients[0].fd);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, receive_until(&clients[0], "retry: "));
+
+    // The new client gets the next update like the ones that stayed
+    publish_sample(99.5f);
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        TEST_ASSERT_GREATER_OR_EQUAL(0, receive_until(&clients[i], "\"temperature\":99.5"));
+    }
+}
+
+int main(int argc, char **argv) {
+    sensor_data.semaphore = xSemaphoreCreateMutex();
+    webserver_config_t config = {
+        .port = SERVER_PORT,
+        .max_open_sockets = STREAM_MAX_CLIENTS + EXTRA_CLIENTS,
+        .backlog = WEBSERVER_BACKLOG,
+        .lru_purge = false,
+        .stack_size = WEBSERVER_STACK_SIZE,
+        .priority = WEBSERVER_TASK_PRIORITY,
+        .core_id = WEBSERVER_CORE_ID
+    };
+    ESP_ERROR_CHECK(stream_start(&sensor_data, STREAM_TASK_STACK_SIZE, STREAM_TASK_PRIORITY));
+    httpd_handle_t server = start_webserver(&config, &sensor_data);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_clients_subscribe);
+    RUN_TEST(test_extra_clients_are_refused);
+    RUN_TEST(test_sample_latency);
+    RUN_TEST(test_heartbeat_latency);
+    RUN_TEST(test_closed_client_frees_its_slot);
+    int failures = UNITY_END();
+    stop_webserver(server);
+    return failures;
+}